@@ -322,6 +322,21 @@ project "unit_tests"
 	useLua()
 	defaultConfigurations()
 
+project "pack_builder"
+	kind "ConsoleApp"
+
+	debugdir "../../LumixEngine_data"
+
+	files { "../src/pack_builder/**.h", "../src/pack_builder/**.cpp" }
+	includedirs { "../src" }
+	links { "engine", "editor" }
+	if _OPTIONS["static-plugins"] then	
+		links { "winmm", "psapi" }
+	end
+
+	useLua()
+	defaultConfigurations()
+
 project "app"
 	kind "WindowedApp"
 
@@ -8,6 +8,8 @@
 #include "engine/core/vec.h"
 #include "renderer/model.h"
 #include "renderer/pose.h"
+#include <cmath>
+#include <xmmintrin.h>
 
 
 namespace Lumix
@@ -28,79 +30,314 @@ void AnimationManager::destroyResource(Resource& resource)
 
 Animation::Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
+	, m_bone_remaps(allocator)
 {
-	m_rotations = nullptr;
-	m_positions = nullptr;
-	m_bones = nullptr;
-	m_frame_count = 0;
+	m_data = nullptr;
 	m_fps = 30;
+	clearTracks();
 }
 
 
 Animation::~Animation()
+{
+	clearBoneRemaps();
+	clearTracks();
+}
+
+
+void Animation::clearTracks()
+{
+	if (m_data) getAllocator().deallocate(m_data);
+	m_data = nullptr;
+	m_bones = nullptr;
+	m_position_tracks = nullptr;
+	m_rotation_tracks = nullptr;
+	m_position_ranges = nullptr;
+	m_position_frames = nullptr;
+	m_position_keys = nullptr;
+	m_rotation_frames = nullptr;
+	m_rotation_keys = nullptr;
+	m_frame_count = m_bone_count = 0;
+}
+
+
+// everything is in one block, so sampling touches as few cache lines as possible
+void Animation::allocateTracks(uint32 position_key_count, uint32 rotation_key_count)
+{
+	size_t size = sizeof(uint32) * m_bone_count + sizeof(Track) * m_bone_count * 2 +
+				  sizeof(Vec3) * m_bone_count * 2 +
+				  sizeof(uint16) * 4 * (position_key_count + rotation_key_count);
+	m_data = static_cast<uint8*>(getAllocator().allocate(size));
+	uint8* ptr = m_data;
+	m_bones = reinterpret_cast<uint32*>(ptr);
+	ptr += sizeof(uint32) * m_bone_count;
+	m_position_tracks = reinterpret_cast<Track*>(ptr);
+	ptr += sizeof(Track) * m_bone_count;
+	m_rotation_tracks = reinterpret_cast<Track*>(ptr);
+	ptr += sizeof(Track) * m_bone_count;
+	m_position_ranges = reinterpret_cast<Vec3*>(ptr);
+	ptr += sizeof(Vec3) * m_bone_count * 2;
+	m_position_keys = reinterpret_cast<uint16*>(ptr);
+	ptr += sizeof(uint16) * 3 * position_key_count;
+	m_rotation_keys = reinterpret_cast<uint16*>(ptr);
+	ptr += sizeof(uint16) * 3 * rotation_key_count;
+	m_position_frames = reinterpret_cast<uint16*>(ptr);
+	ptr += sizeof(uint16) * position_key_count;
+	m_rotation_frames = reinterpret_cast<uint16*>(ptr);
+}
+
+
+static const int SAMPLED_BONES_BLOCK = 32;
+
+
+float Animation::unpackPosition(uint16 value, float min, float extent)
+{
+	return min + extent * (value * (1.0f / 0xffff));
+}
+
+
+Quat Animation::unpackRotation(const uint16* in)
+{
+	int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+	float c[4];
+	float sum = 0;
+	for (int i = 0, j = 0; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		c[i] = ((in[j] & 0x7fff) * (2.0f / 0x7fff) - 1) * (1 / Math::SQRT2);
+		sum += c[i] * c[i];
+		++j;
+	}
+	c[largest] = sqrt(Math::maximum(1 - sum, 0.0f));
+	return Quat(c[0], c[1], c[2], c[3]);
+}
+
+
+// findKey and the interpolation expect increasing frames, starting with the first frame
+static bool areKeyFramesValid(const uint16* frames, uint32 count)
+{
+	if (frames[0] != 0) return false;
+	for (uint32 i = 1; i < count; ++i)
+	{
+		if (frames[i] <= frames[i - 1]) return false;
+	}
+	return true;
+}
+
+
+// index of the last key not after the frame
+static int findKey(const uint16* frames, int count, float frame)
+{
+	int first = 0;
+	int last = count - 1;
+	while (first < last)
+	{
+		int mid = (first + last + 1) >> 1;
+		if (frames[mid] <= frame) first = mid;
+		else last = mid - 1;
+	}
+	return first;
+}
+
+
+// positions and rotations of 4 bones are interpolated at once, rotations in structure of arrays layout
+static void sampleBones(const Vec3* pos1,
+	const Quat* rot1,
+	const Vec3* pos2,
+	const Quat* rot2,
+	const float* pos_t,
+	const float* rot_t,
+	const int* bone_remap,
+	int count,
+	Vec3* out_pos,
+	Quat* out_rot)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 sign_mask = _mm_set1_ps(-0.0f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// 4 positions are 12 consecutive floats, lerp factor of each float is taken from its bone
+		float pos[12];
+		float t12[12] = {pos_t[i], pos_t[i], pos_t[i],
+			pos_t[i + 1], pos_t[i + 1], pos_t[i + 1],
+			pos_t[i + 2], pos_t[i + 2], pos_t[i + 2],
+			pos_t[i + 3], pos_t[i + 3], pos_t[i + 3]};
+		for (int j = 0; j < 3; ++j)
+		{
+			__m128 a = _mm_loadu_ps(&pos1[i].x + j * 4);
+			__m128 b = _mm_loadu_ps(&pos2[i].x + j * 4);
+			__m128 pos_t4 = _mm_loadu_ps(t12 + j * 4);
+			_mm_storeu_ps(pos + j * 4, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), pos_t4)));
+		}
+
+		__m128 t4 = _mm_loadu_ps(rot_t + i);
+		__m128 inv_t4 = _mm_sub_ps(one, t4);
+
+		__m128 ax = _mm_loadu_ps(&rot1[i].x);
+		__m128 ay = _mm_loadu_ps(&rot1[i + 1].x);
+		__m128 az = _mm_loadu_ps(&rot1[i + 2].x);
+		__m128 aw = _mm_loadu_ps(&rot1[i + 3].x);
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+		__m128 bx = _mm_loadu_ps(&rot2[i].x);
+		__m128 by = _mm_loadu_ps(&rot2[i + 1].x);
+		__m128 bz = _mm_loadu_ps(&rot2[i + 2].x);
+		__m128 bw = _mm_loadu_ps(&rot2[i + 3].x);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+			_mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+		// same as nlerp, negative t takes the shorter path
+		__m128 bt = _mm_xor_ps(t4, _mm_and_ps(_mm_cmplt_ps(dot, zero), sign_mask));
+		__m128 x = _mm_add_ps(_mm_mul_ps(ax, inv_t4), _mm_mul_ps(bx, bt));
+		__m128 y = _mm_add_ps(_mm_mul_ps(ay, inv_t4), _mm_mul_ps(by, bt));
+		__m128 z = _mm_add_ps(_mm_mul_ps(az, inv_t4), _mm_mul_ps(bz, bt));
+		__m128 w = _mm_add_ps(_mm_mul_ps(aw, inv_t4), _mm_mul_ps(bw, bt));
+		__m128 len_sq = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+		__m128 inv_len = _mm_div_ps(one, _mm_sqrt_ps(len_sq));
+		x = _mm_mul_ps(x, inv_len);
+		y = _mm_mul_ps(y, inv_len);
+		z = _mm_mul_ps(z, inv_len);
+		w = _mm_mul_ps(w, inv_len);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		Quat rot[4];
+		_mm_storeu_ps(&rot[0].x, x);
+		_mm_storeu_ps(&rot[1].x, y);
+		_mm_storeu_ps(&rot[2].x, z);
+		_mm_storeu_ps(&rot[3].x, w);
+
+		for (int j = 0; j < 4; ++j)
+		{
+			int model_bone_index = bone_remap[i + j];
+			if (model_bone_index < 0) continue;
+			out_pos[model_bone_index].set(pos[j * 3], pos[j * 3 + 1], pos[j * 3 + 2]);
+			out_rot[model_bone_index] = rot[j];
+		}
+	}
+
+	for (; i < count; ++i)
+	{
+		int model_bone_index = bone_remap[i];
+		if (model_bone_index < 0) continue;
+		lerp(pos1[i], pos2[i], &out_pos[model_bone_index], pos_t[i]);
+		nlerp(rot1[i], rot2[i], &out_rot[model_bone_index], rot_t[i]);
+	}
+}
+
+
+// not thread safe, the remap is built the first time a skeleton uses the animation,
+// keyed by the bone names so reloaded models and reused model addresses can not get a stale remap
+const int* Animation::getBoneRemap(Model& model)
+{
+	ASSERT(model.isReady());
+	uint32 model_bones_hash = model.getBonesHash();
+	for (BoneRemap& remap : m_bone_remaps)
+	{
+		if (remap.model_bones_hash == model_bones_hash) return remap.indices;
+	}
+
+	BoneRemap& remap = m_bone_remaps.emplace();
+	remap.model_bones_hash = model_bones_hash;
+	remap.indices = static_cast<int*>(getAllocator().allocate(sizeof(int) * m_bone_count));
+	for (int i = 0; i < m_bone_count; ++i)
+	{
+		Model::BoneMap::iterator iter = model.getBoneIndex(m_bones[i]);
+		remap.indices[i] = iter.isValid() ? iter.value() : -1;
+	}
+	return remap.indices;
+}
+
+
+void Animation::clearBoneRemaps()
 {
 	IAllocator& allocator = getAllocator();
-	allocator.deallocate(m_positions);
-	allocator.deallocate(m_rotations);
-	allocator.deallocate(m_bones);
+	for (BoneRemap& remap : m_bone_remaps)
+	{
+		allocator.deallocate(remap.indices);
+	}
+	m_bone_remaps.clear();
 }
 
 
-void Animation::getPose(float time, Pose& pose, Model& model) const
+void Animation::samplePosition(int bone, float frame, Vec3* pos1, Vec3* pos2, float* t) const
+{
+	const Track& track = m_position_tracks[bone];
+	const uint16* frames = &m_position_frames[track.first_key];
+	const Vec3& min = m_position_ranges[bone * 2];
+	const Vec3& extent = m_position_ranges[bone * 2 + 1];
+	int key = findKey(frames, track.key_count, frame);
+	int next_key = key + 1 < (int)track.key_count ? key + 1 : key;
+	const uint16* key_value = &m_position_keys[(track.first_key + key) * 3];
+	const uint16* next_key_value = &m_position_keys[(track.first_key + next_key) * 3];
+	pos1->set(unpackPosition(key_value[0], min.x, extent.x),
+		unpackPosition(key_value[1], min.y, extent.y),
+		unpackPosition(key_value[2], min.z, extent.z));
+	pos2->set(unpackPosition(next_key_value[0], min.x, extent.x),
+		unpackPosition(next_key_value[1], min.y, extent.y),
+		unpackPosition(next_key_value[2], min.z, extent.z));
+	*t = next_key == key ? 0 : (frame - frames[key]) / (frames[next_key] - frames[key]);
+}
+
+
+void Animation::sampleRotation(int bone, float frame, Quat* rot1, Quat* rot2, float* t) const
+{
+	const Track& track = m_rotation_tracks[bone];
+	const uint16* frames = &m_rotation_frames[track.first_key];
+	int key = findKey(frames, track.key_count, frame);
+	int next_key = key + 1 < (int)track.key_count ? key + 1 : key;
+	*rot1 = unpackRotation(&m_rotation_keys[(track.first_key + key) * 3]);
+	*rot2 = unpackRotation(&m_rotation_keys[(track.first_key + next_key) * 3]);
+	*t = next_key == key ? 0 : (frame - frames[key]) / (frames[next_key] - frames[key]);
+}
+
+
+void Animation::getPose(float time, Pose& pose, Model& model, const int* bone_remap) const
 {
 	PROFILE_FUNCTION();
 	if(model.isReady())
 	{
-		int frame = (int)(time * m_fps);
-		frame = frame >= m_frame_count ? m_frame_count - 1 : frame;
+		getRelativePose(time, pose, model, bone_remap);
+		pose.computeAbsolute(model);
+	}
+}
+
+
+void Animation::getRelativePose(float time, Pose& pose, Model& model, const int* bone_remap) const
+{
+	if(model.isReady())
+	{
+		float frame = Math::clamp(time * m_fps, 0.0f, float(m_frame_count - 1));
 		Vec3* pos = pose.getPositions();
 		Quat* rot = pose.getRotations();
-		int off = frame * m_bone_count;
-		int off2 = off + m_bone_count;
-		float t = (time - frame / (float)m_fps) / (1.0f / m_fps);
 
-		if(frame < m_frame_count - 1)
-		{
-			for(int i = 0; i < m_bone_count; ++i)
-			{
-				Model::BoneMap::iterator iter = model.getBoneIndex(m_bones[i]);
-				if (iter.isValid())
-				{
-					int model_bone_index = iter.value();
-					lerp(m_positions[off + i], m_positions[off2 + i], &pos[model_bone_index], t);
-					nlerp(m_rotations[off + i], m_rotations[off2 + i], &rot[model_bone_index], t);
-				}
-			}
-		}
-		else
+		// keys are decoded into small blocks, which are then interpolated with SIMD
+		Vec3 pos1[SAMPLED_BONES_BLOCK];
+		Vec3 pos2[SAMPLED_BONES_BLOCK];
+		Quat rot1[SAMPLED_BONES_BLOCK];
+		Quat rot2[SAMPLED_BONES_BLOCK];
+		float pos_t[SAMPLED_BONES_BLOCK];
+		float rot_t[SAMPLED_BONES_BLOCK];
+		for (int block = 0; block < m_bone_count; block += SAMPLED_BONES_BLOCK)
 		{
-			for(int i = 0; i < m_bone_count; ++i)
+			int count = Math::minimum(SAMPLED_BONES_BLOCK, m_bone_count - block);
+			for (int i = 0; i < count; ++i)
 			{
-				Model::BoneMap::iterator iter = model.getBoneIndex(m_bones[i]);
-				if (iter.isValid())
-				{
-					int model_bone_index = iter.value();
-					pos[model_bone_index] = m_positions[off + i];
-					rot[model_bone_index] = m_rotations[off + i];
-				}
+				samplePosition(block + i, frame, &pos1[i], &pos2[i], &pos_t[i]);
+				sampleRotation(block + i, frame, &rot1[i], &rot2[i], &rot_t[i]);
 			}
+			sampleBones(pos1, rot1, pos2, rot2, pos_t, rot_t, bone_remap + block, count, pos, rot);
 		}
 		pose.setIsRelative();
-		pose.computeAbsolute(model);
 	}
 }
 
 
-bool Animation::load(FS::IFile& file)
+bool Animation::decode(FS::IFile& file)
 {
-	IAllocator& allocator = getAllocator();
-	allocator.deallocate(m_positions);
-	allocator.deallocate(m_rotations);
-	allocator.deallocate(m_bones);
-	m_positions = nullptr;
-	m_rotations = nullptr;
-	m_bones = 0;
-	m_frame_count = m_bone_count = 0;
+	PROFILE_FUNCTION();
+	clearTracks();
 	Header header;
 	file.read(&header, sizeof(header));
 	if (header.magic != HEADER_MAGIC)
@@ -108,7 +345,7 @@ bool Animation::load(FS::IFile& file)
 		g_log_error.log("Animation") << getPath() << " is not an animation file";
 		return false;
 	}
-	if (header.version > 1)
+	if (header.version >= (uint32)Version::LATEST)
 	{
 		g_log_error.log("Animation") << "Unsupported animation version " << header.version << " ("
 									 << getPath() << ")";
@@ -117,14 +354,116 @@ bool Animation::load(FS::IFile& file)
 	m_fps = header.fps;
 	file.read(&m_frame_count, sizeof(m_frame_count));
 	file.read(&m_bone_count, sizeof(m_bone_count));
+	if (m_frame_count <= 0 || m_frame_count > 0xffff || m_bone_count < 0)
+	{
+		g_log_error.log("Animation") << "Invalid animation " << getPath();
+		m_frame_count = m_bone_count = 0;
+		return false;
+	}
+
+	bool success = header.version <= (uint32)Version::FIRST ? decodeRaw(file) : decodeCompressed(file);
+	if (!success)
+	{
+		g_log_error.log("Animation") << "Corrupted animation " << getPath();
+		clearTracks();
+	}
+	return success;
+}
 
-	m_positions = static_cast<Vec3*>(allocator.allocate(sizeof(Vec3) * m_frame_count * m_bone_count));
-	m_rotations = static_cast<Quat*>(allocator.allocate(sizeof(Quat) * m_frame_count * m_bone_count));
-	m_bones = static_cast<uint32*>(allocator.allocate(sizeof(uint32) * m_bone_count));
-	file.read(&m_positions[0], sizeof(Vec3)* m_bone_count * m_frame_count);
-	file.read(&m_rotations[0], sizeof(Quat)* m_bone_count * m_frame_count);
+
+// old files have all frames of all bones, every frame becomes a key
+bool Animation::decodeRaw(FS::IFile& file)
+{
+	IAllocator& allocator = getAllocator();
+	int count = m_frame_count * m_bone_count;
+	Vec3* positions = static_cast<Vec3*>(allocator.allocate(sizeof(Vec3) * count));
+	Quat* rotations = static_cast<Quat*>(allocator.allocate(sizeof(Quat) * count));
+	file.read(positions, sizeof(Vec3) * count);
+	file.read(rotations, sizeof(Quat) * count);
+
+	allocateTracks(count, count);
+	file.read(m_bones, sizeof(m_bones[0]) * m_bone_count);
+	for (int bone = 0; bone < m_bone_count; ++bone)
+	{
+		Track& position_track = m_position_tracks[bone];
+		Track& rotation_track = m_rotation_tracks[bone];
+		position_track.first_key = rotation_track.first_key = bone * m_frame_count;
+		position_track.key_count = rotation_track.key_count = m_frame_count;
+
+		Vec3 min = positions[bone];
+		Vec3 max = min;
+		for (int frame = 1; frame < m_frame_count; ++frame)
+		{
+			const Vec3& pos = positions[frame * m_bone_count + bone];
+			min.set(Math::minimum(min.x, pos.x), Math::minimum(min.y, pos.y), Math::minimum(min.z, pos.z));
+			max.set(Math::maximum(max.x, pos.x), Math::maximum(max.y, pos.y), Math::maximum(max.z, pos.z));
+		}
+		Vec3 extent = max - min;
+		m_position_ranges[bone * 2] = min;
+		m_position_ranges[bone * 2 + 1] = extent;
+
+		for (int frame = 0; frame < m_frame_count; ++frame)
+		{
+			int key = bone * m_frame_count + frame;
+			const Vec3& pos = positions[frame * m_bone_count + bone];
+			m_position_frames[key] = m_rotation_frames[key] = (uint16)frame;
+			m_position_keys[key * 3] = packPosition(pos.x, min.x, extent.x);
+			m_position_keys[key * 3 + 1] = packPosition(pos.y, min.y, extent.y);
+			m_position_keys[key * 3 + 2] = packPosition(pos.z, min.z, extent.z);
+			packRotation(rotations[frame * m_bone_count + bone], &m_rotation_keys[key * 3]);
+		}
+	}
+
+	allocator.deallocate(positions);
+	allocator.deallocate(rotations);
+	return true;
+}
+
+
+bool Animation::decodeCompressed(FS::IFile& file)
+{
+	uint32 position_key_count;
+	uint32 rotation_key_count;
+	file.read(&position_key_count, sizeof(position_key_count));
+	file.read(&rotation_key_count, sizeof(rotation_key_count));
+	allocateTracks(position_key_count, rotation_key_count);
 	file.read(m_bones, sizeof(m_bones[0]) * m_bone_count);
-		
+
+	uint32 position_key = 0;
+	uint32 rotation_key = 0;
+	for (int bone = 0; bone < m_bone_count; ++bone)
+	{
+		Track& position_track = m_position_tracks[bone];
+		file.read(&position_track.key_count, sizeof(position_track.key_count));
+		if (position_track.key_count == 0 || position_key + position_track.key_count > position_key_count)
+		{
+			return false;
+		}
+		position_track.first_key = position_key;
+		position_key += position_track.key_count;
+		file.read(&m_position_ranges[bone * 2], sizeof(Vec3) * 2);
+		file.read(&m_position_frames[position_track.first_key], sizeof(uint16) * position_track.key_count);
+		file.read(&m_position_keys[position_track.first_key * 3], sizeof(uint16) * 3 * position_track.key_count);
+		if (!areKeyFramesValid(&m_position_frames[position_track.first_key], position_track.key_count)) return false;
+
+		Track& rotation_track = m_rotation_tracks[bone];
+		file.read(&rotation_track.key_count, sizeof(rotation_track.key_count));
+		if (rotation_track.key_count == 0 || rotation_key + rotation_track.key_count > rotation_key_count)
+		{
+			return false;
+		}
+		rotation_track.first_key = rotation_key;
+		rotation_key += rotation_track.key_count;
+		file.read(&m_rotation_frames[rotation_track.first_key], sizeof(uint16) * rotation_track.key_count);
+		file.read(&m_rotation_keys[rotation_track.first_key * 3], sizeof(uint16) * 3 * rotation_track.key_count);
+		if (!areKeyFramesValid(&m_rotation_frames[rotation_track.first_key], rotation_track.key_count)) return false;
+	}
+	return true;
+}
+
+
+bool Animation::load(FS::IFile& file)
+{
 	m_size = file.size();
 	return true;
 }
@@ -138,14 +477,8 @@ IAllocator& Animation::getAllocator()
 
 void Animation::unload(void)
 {
-	IAllocator& allocator = getAllocator();
-	allocator.deallocate(m_positions);
-	allocator.deallocate(m_rotations);
-	allocator.deallocate(m_bones);
-	m_rotations = nullptr;
-	m_positions = nullptr;
-	m_bones = nullptr;
-	m_frame_count = 0;
+	clearBoneRemaps();
+	clearTracks();
 }
 
 
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "engine/core/array.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/quat.h"
 #include "engine/core/resource.h"
 #include "engine/core/resource_manager_base.h"
 
@@ -14,8 +17,6 @@ namespace FS
 
 class Model;
 class Pose;
-struct Quat;
-struct Vec3;
 
 
 class LUMIX_ANIMATION_API AnimationManager : public ResourceManagerBase
@@ -42,6 +43,14 @@ class LUMIX_ANIMATION_API Animation : public Resource
 	public:
 		static const uint32 HEADER_MAGIC = 0x5f4c4146; // '_LAF'
 
+		enum class Version : uint32
+		{
+			FIRST = 1,
+			COMPRESSED,
+
+			LATEST // keep this last
+		};
+
 	public:
 		struct Header
 		{
@@ -50,28 +59,141 @@ class LUMIX_ANIMATION_API Animation : public Resource
 			uint32 fps;
 		};
 
+		/*
+		Version::COMPRESSED layout after the header:
+			int32 frame_count, int32 bone_count,
+			uint32 position_key_count, uint32 rotation_key_count (sums over all bones),
+			uint32 bone_hashes[bone_count],
+			for every bone:
+				uint32 key_count, Vec3 min, Vec3 extent, uint16 frames[key_count], uint16 positions[key_count * 3]
+				uint32 key_count, uint16 frames[key_count], uint16 rotations[key_count * 3]
+		Values between keys are linearly interpolated.
+		*/
+		static uint16 packPosition(float value, float min, float extent)
+		{
+			if (extent <= 0) return 0;
+			float normalized = Math::clamp((value - min) / extent, 0.0f, 1.0f);
+			return uint16(normalized * 0xffff + 0.5f);
+		}
+
+		// smallest three - the largest component is dropped and restored from the unit length,
+		// the rest is stored in 15 bits each, the index of the dropped one is in the top bits
+		static void packRotation(const Quat& rot, uint16* out)
+		{
+			const float* c = &rot.x;
+			int largest = 0;
+			for (int i = 1; i < 4; ++i)
+			{
+				if (c[i] * c[i] > c[largest] * c[largest]) largest = i;
+			}
+			float sign = c[largest] < 0 ? -1.0f : 1.0f;
+			for (int i = 0, j = 0; i < 4; ++i)
+			{
+				if (i == largest) continue;
+				float normalized = Math::clamp((c[i] * sign * Math::SQRT2 + 1) * 0.5f, 0.0f, 1.0f);
+				out[j] = uint16(normalized * 0x7fff + 0.5f);
+				if (j < 2) out[j] |= ((largest >> j) & 1) << 15;
+				++j;
+			}
+		}
+
+		static float unpackPosition(uint16 value, float min, float extent);
+		static Quat unpackRotation(const uint16* in);
+
+		// a key is added only where the values can not be interpolated from the previous key within max_error,
+		// constant tracks end up with a single key
+		template <typename T>
+		static void reduceKeys(const T* values,
+			int count,
+			float max_error,
+			float (*get_error)(const T&, const T&, float, const T&),
+			Array<int>& keys)
+		{
+			keys.clear();
+			keys.push(0);
+
+			bool is_constant = true;
+			for (int i = 1; i < count && is_constant; ++i)
+			{
+				is_constant = get_error(values[0], values[0], 0, values[i]) <= max_error;
+			}
+			if (is_constant) return;
+
+			int from = 0;
+			for (int to = from + 2; to < count; ++to)
+			{
+				for (int i = from + 1; i < to; ++i)
+				{
+					float t = (i - from) / float(to - from);
+					if (get_error(values[from], values[to], t, values[i]) > max_error)
+					{
+						from = to - 1;
+						keys.push(from);
+						break;
+					}
+				}
+			}
+			keys.push(count - 1);
+		}
+
 	public:
 		Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator);
 		~Animation();
 
-		void getPose(float time, Pose& pose, Model& model) const;
+		void getPose(float time, Pose& pose, Model& model, const int* bone_remap) const;
+		// leaves the pose in bone space, bones without a track keep their values
+		void getRelativePose(float time, Pose& pose, Model& model, const int* bone_remap) const;
+		const int* getBoneRemap(Model& model);
+		int getBoneCount() const { return m_bone_count; }
 		int getFrameCount() const { return m_frame_count; }
 		float getLength() const { return m_frame_count / (float)m_fps; }
 		int getFPS() const { return m_fps; }
 
+	private:
+		struct Track
+		{
+			uint32 first_key;
+			uint32 key_count;
+		};
+
+		// model's bone index for every animated bone, -1 if the model does not have the bone,
+		// shared by all models with the same skeleton
+		struct BoneRemap
+		{
+			uint32 model_bones_hash;
+			int* indices;
+		};
+
 	private:
 		IAllocator& getAllocator();
+		void clearBoneRemaps();
+		void clearTracks();
+		bool decodeRaw(FS::IFile& file);
+		bool decodeCompressed(FS::IFile& file);
+		void allocateTracks(uint32 position_key_count, uint32 rotation_key_count);
+		void samplePosition(int bone, float frame, Vec3* pos1, Vec3* pos2, float* t) const;
+		void sampleRotation(int bone, float frame, Quat* rot1, Quat* rot2, float* t) const;
 
 		void unload() override;
+		bool decode(FS::IFile& file) override;
 		bool load(FS::IFile& file) override;
 
 	private:
 		int	m_frame_count;
 		int	m_bone_count;
-		Vec3* m_positions;
-		Quat* m_rotations;
 		uint32* m_bones;
 		int m_fps;
+		// all tracks are in one block of m_data
+		uint8* m_data;
+		Track* m_position_tracks;
+		Track* m_rotation_tracks;
+		// min and extent of every bone's positions
+		Vec3* m_position_ranges;
+		uint16* m_position_frames;
+		uint16* m_position_keys;
+		uint16* m_rotation_frames;
+		uint16* m_rotation_keys;
+		Array<BoneRemap> m_bone_remaps;
 };
 
 
@@ -1,15 +1,23 @@
 #include "animation_system.h"
 #include "animation/animation.h"
+#include "animation/controller.h"
 #include "engine/core/base_proxy_allocator.h"
 #include "engine/core/blob.h"
 #include "engine/core/crc32.h"
+#include "engine/core/geometry.h"
 #include "engine/core/json_serializer.h"
+#include "engine/core/lua_wrapper.h"
+#include "engine/core/mt/sync.h"
+#include "engine/core/mtjd/parallel_for.h"
 #include "engine/core/profiler.h"
+#include "engine/core/quat.h"
 #include "engine/core/resource_manager.h"
+#include "engine/core/vec.h"
 #include "editor/asset_browser.h"
 #include "editor/imgui/imgui.h"
 #include "editor/property_grid.h"
 #include "editor/studio_app.h"
+#include "editor/utils.h"
 #include "editor/world_editor.h"
 #include "engine/engine.h"
 #include "engine/property_descriptor.h"
@@ -18,6 +26,7 @@
 #include "renderer/pose.h"
 #include "renderer/render_scene.h"
 #include "engine/universe/universe.h"
+#include <cmath>
 
 
 namespace Lumix
@@ -25,6 +34,12 @@ namespace Lumix
 
 	static const uint32 RENDERABLE_HASH = crc32("renderable");
 	static const uint32 ANIMABLE_HASH = crc32("animable");
+	static const uint32 ANIM_CONTROLLER_HASH = crc32("anim_controller");
+	static const int ANIMABLES_PER_JOB = 16;
+	static const int CONTROLLERS_PER_JOB = 4;
+	static const float DEFAULT_HALF_RATE_SCREEN_SIZE = 0.2f;
+	static const float DEFAULT_QUARTER_RATE_SCREEN_SIZE = 0.05f;
+	static void registerLuaAPI(lua_State* L);
 
 	namespace FS
 	{
@@ -40,11 +55,99 @@ namespace Lumix
 	enum class AnimationSceneVersion : int
 	{
 		FIRST,
+		TIME_SCALE,
+		CONTROLLERS,
+		LOD,
 
 		LATEST
 	};
 
 
+	// update tiers, chosen by the size on the screen of the main camera
+	enum AnimationLOD : uint8
+	{
+		LOD_FULL,
+		LOD_HALF_RATE,
+		LOD_QUARTER_RATE,
+		// time still advances, but poses are not sampled
+		LOD_OFFSCREEN,
+
+		LOD_COUNT
+	};
+
+
+	static const uint32 LOD_UPDATE_INTERVALS[LOD_COUNT] = {1, 2, 4, 0};
+	static const char* const LOD_NAMES[LOD_COUNT] = {"Full rate", "Half rate", "Quarter rate", "Offscreen"};
+
+
+	static void copyPose(const Pose& src, Pose& dst)
+	{
+		ASSERT(src.getCount() == dst.getCount());
+		copyMemory(dst.getPositions(), src.getPositions(), sizeof(Vec3) * src.getCount());
+		copyMemory(dst.getRotations(), src.getRotations(), sizeof(Quat) * src.getCount());
+		dst.setIsRelative();
+	}
+
+
+	// temporary poses of controller evaluation, they are kept for reuse so there are no allocations per frame
+	struct PosePool
+	{
+		explicit PosePool(IAllocator& allocator)
+			: m_allocator(allocator)
+			, m_poses(allocator)
+			, m_mutex(false)
+		{
+		}
+
+
+		~PosePool()
+		{
+			for (Pose* pose : m_poses)
+			{
+				LUMIX_DELETE(m_allocator, pose);
+			}
+		}
+
+
+		Pose* acquire(int bone_count)
+		{
+			Pose* pose = nullptr;
+			{
+				MT::SpinLock lock(m_mutex);
+				int index = m_poses.size() - 1;
+				for (int i = index; i >= 0; --i)
+				{
+					if (m_poses[i]->getCount() == bone_count)
+					{
+						index = i;
+						break;
+					}
+				}
+				if (index >= 0)
+				{
+					pose = m_poses[index];
+					m_poses.eraseFast(index);
+				}
+			}
+			if (!pose) pose = LUMIX_NEW(m_allocator, Pose)(m_allocator);
+			pose->resize(bone_count);
+			return pose;
+		}
+
+
+		void release(Pose* pose)
+		{
+			MT::SpinLock lock(m_mutex);
+			m_poses.push(pose);
+		}
+
+
+		IAllocator& m_allocator;
+		Array<Pose*> m_poses;
+		MT::SpinMutex m_mutex;
+	};
+
+
 	struct AnimationSceneImpl : public IScene
 	{
 		struct Animable
@@ -60,7 +163,36 @@ namespace Lumix
 			float time_scale;
 			float start_time;
 			class Animation* animation;
+			const int* bone_remap;
 			Entity entity;
+			AnimationLOD lod;
+		};
+
+
+		struct ControllerInstance
+		{
+			enum Flags : int
+			{
+				FREE = 1
+			};
+
+			explicit ControllerInstance(IAllocator& allocator)
+				: inputs(allocator)
+				, layers(allocator)
+				, bone_remaps(allocator)
+			{
+			}
+
+			uint32 flags;
+			ComponentIndex renderable;
+			Controller* resource;
+			Entity entity;
+			AnimationLOD lod;
+			// inputs and layers are initialized once the resource is ready
+			Array<float> inputs;
+			Array<Controller::LayerState> layers;
+			// bone remap of every clip node, prepared before the jobs run
+			Array<const int*> bone_remaps;
 		};
 
 
@@ -69,8 +201,16 @@ namespace Lumix
 			, m_engine(engine)
 			, m_anim_system(anim_system)
 			, m_animables(allocator)
+			, m_controllers(allocator)
+			, m_pose_pool(allocator)
+			, m_allocator(allocator)
 		{
 			m_is_game_running = false;
+			m_frame = 0;
+			m_is_lod_enabled = true;
+			m_half_rate_screen_size = DEFAULT_HALF_RATE_SCREEN_SIZE;
+			m_quarter_rate_screen_size = DEFAULT_QUARTER_RATE_SCREEN_SIZE;
+			setMemory(m_lod_stats, 0, sizeof(m_lod_stats));
 			m_render_scene = nullptr;
 			uint32 hash = crc32("renderer");
 			for (auto* scene : ctx.getScenes())
@@ -96,6 +236,11 @@ namespace Lumix
 				if (animable.flags & Animable::FREE) continue;
 				unloadAnimation(animable.animation);
 			}
+			for (auto& controller : m_controllers)
+			{
+				if (controller.flags & ControllerInstance::FREE) continue;
+				unloadController(controller.resource);
+			}
 
 			m_render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
 			if (m_render_scene)
@@ -127,6 +272,15 @@ namespace Lumix
 		ComponentIndex getComponent(Entity entity, uint32 type) override
 		{
 			ASSERT(ownComponentType(type));
+			if (type == ANIM_CONTROLLER_HASH)
+			{
+				for (int i = 0; i < m_controllers.size(); ++i)
+				{
+					auto& controller = m_controllers[i];
+					if ((controller.flags & ControllerInstance::FREE) == 0 && controller.entity == entity) return i;
+				}
+				return INVALID_COMPONENT;
+			}
 			for (int i = 0; i < m_animables.size(); ++i)
 			{
 				if ((m_animables[i].flags & Animable::FREE) == 0 && m_animables[i].entity == entity) return i;
@@ -137,7 +291,7 @@ namespace Lumix
 
 		bool ownComponentType(uint32 type) const override
 		{
-			return type == ANIMABLE_HASH;
+			return type == ANIMABLE_HASH || type == ANIM_CONTROLLER_HASH;
 		}
 
 
@@ -148,6 +302,10 @@ namespace Lumix
 			{
 				return createAnimable(entity);
 			}
+			if (type == ANIM_CONTROLLER_HASH)
+			{
+				return createController(entity);
+			}
 			return INVALID_COMPONENT;
 		}
 
@@ -162,6 +320,15 @@ namespace Lumix
 		}
 
 
+		void unloadController(Controller* controller)
+		{
+			if (!controller) return;
+
+			auto& rm = controller->getResourceManager();
+			rm.get(ResourceManager::ANIMATION_CONTROLLER)->unload(*controller);
+		}
+
+
 		void destroyComponent(ComponentIndex component, uint32 type) override
 		{
 			if (type == ANIMABLE_HASH)
@@ -170,6 +337,17 @@ namespace Lumix
 				m_animables[component].flags |= Animable::FREE;
 				m_universe.destroyComponent(m_animables[component].entity, type, this, component);
 			}
+			else if (type == ANIM_CONTROLLER_HASH)
+			{
+				auto& controller = m_controllers[component];
+				unloadController(controller.resource);
+				controller.resource = nullptr;
+				controller.inputs.clear();
+				controller.layers.clear();
+				controller.bone_remaps.clear();
+				controller.flags |= ControllerInstance::FREE;
+				m_universe.destroyComponent(controller.entity, type, this, component);
+			}
 		}
 
 
@@ -185,6 +363,18 @@ namespace Lumix
 				serializer.writeString(
 					m_animables[i].animation ? m_animables[i].animation->getPath().c_str() : "");
 			}
+
+			serializer.write((int32)m_controllers.size());
+			for (auto& controller : m_controllers)
+			{
+				serializer.write(controller.entity);
+				serializer.write(controller.flags);
+				serializer.writeString(controller.resource ? controller.resource->getPath().c_str() : "");
+			}
+
+			serializer.write(m_is_lod_enabled);
+			serializer.write(m_half_rate_screen_size);
+			serializer.write(m_quarter_rate_screen_size);
 		}
 
 
@@ -223,8 +413,40 @@ namespace Lumix
 				char path[MAX_PATH_LENGTH];
 				serializer.readString(path, sizeof(path));
 				m_animables[i].animation = path[0] == '\0' ? nullptr : loadAnimation(Path(path));
+				m_animables[i].bone_remap = nullptr;
+				m_animables[i].lod = LOD_FULL;
 				m_universe.addComponent(m_animables[i].entity, ANIMABLE_HASH, this, i);
 			}
+
+			for (auto& controller : m_controllers)
+			{
+				unloadController(controller.resource);
+			}
+			m_controllers.clear();
+			if (version < (int)AnimationSceneVersion::CONTROLLERS) return;
+
+			serializer.read(count);
+			m_controllers.reserve(count);
+			for (int i = 0; i < count; ++i)
+			{
+				auto& controller = m_controllers.emplace(m_allocator);
+				serializer.read(controller.entity);
+				serializer.read(controller.flags);
+				char path[MAX_PATH_LENGTH];
+				serializer.readString(path, sizeof(path));
+				controller.renderable = m_render_scene->getRenderableComponent(controller.entity);
+				controller.resource = nullptr;
+				controller.lod = LOD_FULL;
+				if (controller.flags & ControllerInstance::FREE) continue;
+
+				controller.resource = path[0] == '\0' ? nullptr : loadController(Path(path));
+				m_universe.addComponent(controller.entity, ANIM_CONTROLLER_HASH, this, i);
+			}
+
+			if (version < (int)AnimationSceneVersion::LOD) return;
+			serializer.read(m_is_lod_enabled);
+			serializer.read(m_half_rate_screen_size);
+			serializer.read(m_quarter_rate_screen_size);
 		}
 
 
@@ -280,34 +502,485 @@ namespace Lumix
 				if (!pose) return;
 				if (!model->isReady()) return;
 
+				if (!animable.bone_remap) return;
+
 				model->getPose(*pose);
 				pose->computeRelative(*model);
 				animable.animation->getPose(
 					animable.time,
 					*pose,
-					*model);
+					*model,
+					animable.bone_remap);
+				// skinning palette is built here, so it is computed in parallel and only once a frame
+				pose->computeSkinningMatrices(*model);
 
-				float t = animable.time + time_delta * animable.time_scale;
-				float l = animable.animation->getLength();
-				while (t > l)
-				{
-					t -= l;
-				}
-				animable.time = t;
+				advanceAnimable(animable, time_delta);
+			}
+		}
+
+
+		void advanceAnimable(Animable& animable, float time_delta)
+		{
+			if ((animable.flags & Animable::FREE) || !animable.animation || !animable.animation->isReady()) return;
+
+			float t = animable.time + time_delta * animable.time_scale;
+			float l = animable.animation->getLength();
+			while (t > l)
+			{
+				t -= l;
 			}
+			animable.time = t;
 		}
 
 
+		// the LOD pass reads entity transforms and the camera
+		uint32 getUpdateReads() const override { return SceneAccess::POSES | SceneAccess::TRANSFORMS; }
+		uint32 getUpdateWrites() const override { return SceneAccess::POSES; }
+
+
 		void update(float time_delta, bool paused) override
 		{
 			PROFILE_FUNCTION();
-			if (m_animables.empty()) return;
+			if (m_animables.empty() && m_controllers.empty()) return;
 			if (!m_is_game_running) return;
 
-			for (int i = 0, c = m_animables.size(); i < c; ++i)
+			++m_frame;
+			prepareBoneRemaps();
+			computeLODs();
+			// every animable writes only to its own pose
+			MTJD::parallelFor(m_engine.getMTJDManager(),
+				0,
+				m_animables.size(),
+				ANIMABLES_PER_JOB,
+				[this, time_delta](int from, int to)
+				{
+					PROFILE_BLOCK("Animation Job");
+					for (int i = from; i < to; ++i)
+					{
+						if (isLODUpdateFrame(m_animables[i].lod, i))
+						{
+							updateAnimable(i, time_delta);
+						}
+						else
+						{
+							advanceAnimable(m_animables[i], time_delta);
+						}
+					}
+				});
+			// the same for controllers, temporary poses come from the shared pool
+			MTJD::parallelFor(m_engine.getMTJDManager(),
+				0,
+				m_controllers.size(),
+				CONTROLLERS_PER_JOB,
+				[this, time_delta](int from, int to)
+				{
+					PROFILE_BLOCK("Animation Controller Job");
+					for (int i = from; i < to; ++i)
+					{
+						if (isLODUpdateFrame(m_controllers[i].lod, i))
+						{
+							updateController(m_controllers[i], time_delta);
+						}
+						else
+						{
+							advanceController(m_controllers[i], time_delta);
+						}
+					}
+				});
+		}
+
+
+		// skipped frames are spread between objects, so the cost of a tier is the same every frame
+		bool isLODUpdateFrame(AnimationLOD lod, int index) const
+		{
+			uint32 interval = LOD_UPDATE_INTERVALS[lod];
+			return interval > 0 && (m_frame + index) % interval == 0;
+		}
+
+
+		struct LODView
+		{
+			Frustum frustum;
+			Vec3 position;
+			bool is_ortho;
+			// screen size of a unit sphere at a unit distance, or of a unit sphere for ortho cameras
+			float size_scale;
+		};
+
+
+		bool getLODView(LODView* view)
+		{
+			ComponentIndex camera = m_render_scene->getCameraInSlot("main");
+			if (camera == INVALID_COMPONENT) return false;
+
+			view->frustum = m_render_scene->getCameraFrustum(camera);
+			view->position = m_universe.getPosition(m_render_scene->getCameraEntity(camera));
+			view->is_ortho = m_render_scene->isCameraOrtho(camera);
+			if (view->is_ortho)
 			{
-				updateAnimable(i, time_delta);
+				view->size_scale = 1 / m_render_scene->getCameraOrthoSize(camera);
 			}
+			else
+			{
+				float half_fov = Math::degreesToRadians(m_render_scene->getCameraFOV(camera)) * 0.5f;
+				view->size_scale = 1 / tanf(half_fov);
+			}
+			return true;
+		}
+
+
+		AnimationLOD computeLOD(const LODView& view, Entity entity, ComponentIndex renderable)
+		{
+			if (renderable == INVALID_COMPONENT) return LOD_FULL;
+			Model* model = m_render_scene->getRenderableModel(renderable);
+			if (!model || !model->isReady()) return LOD_FULL;
+
+			Vec3 position = m_universe.getPosition(entity);
+			float radius = m_universe.getScale(entity) * model->getBoundingRadius();
+			if (!view.frustum.isSphereInside(position, radius)) return LOD_OFFSCREEN;
+
+			float screen_size = radius * view.size_scale;
+			if (!view.is_ortho)
+			{
+				float distance = (position - view.position).length();
+				if (distance <= radius) return LOD_FULL;
+				screen_size /= distance;
+			}
+			if (screen_size < m_quarter_rate_screen_size) return LOD_QUARTER_RATE;
+			if (screen_size < m_half_rate_screen_size) return LOD_HALF_RATE;
+			return LOD_FULL;
+		}
+
+
+		void computeLODs()
+		{
+			PROFILE_FUNCTION();
+			setMemory(m_lod_stats, 0, sizeof(m_lod_stats));
+			LODView view;
+			bool has_view = m_is_lod_enabled && getLODView(&view);
+			for (Animable& animable : m_animables)
+			{
+				if (animable.flags & Animable::FREE) continue;
+				animable.lod = has_view ? computeLOD(view, animable.entity, animable.renderable) : LOD_FULL;
+				++m_lod_stats[animable.lod];
+			}
+			for (ControllerInstance& controller : m_controllers)
+			{
+				if (controller.flags & ControllerInstance::FREE) continue;
+				controller.lod = has_view ? computeLOD(view, controller.entity, controller.renderable) : LOD_FULL;
+				++m_lod_stats[controller.lod];
+			}
+		}
+
+
+		bool isLODEnabled() const { return m_is_lod_enabled; }
+		void enableLOD(bool enable) { m_is_lod_enabled = enable; }
+		float getHalfRateScreenSize() const { return m_half_rate_screen_size; }
+		void setHalfRateScreenSize(float size) { m_half_rate_screen_size = size; }
+		float getQuarterRateScreenSize() const { return m_quarter_rate_screen_size; }
+		void setQuarterRateScreenSize(float size) { m_quarter_rate_screen_size = size; }
+		// number of animables and controllers in every tier in the last update
+		const int* getLODStats() const { return m_lod_stats; }
+
+
+		// remaps are cached in animations, jobs only read them
+		void prepareBoneRemaps()
+		{
+			PROFILE_FUNCTION();
+			for (Animable& animable : m_animables)
+			{
+				prepareBoneRemap(animable);
+			}
+			for (ControllerInstance& controller : m_controllers)
+			{
+				prepareController(controller);
+			}
+		}
+
+
+		void prepareBoneRemap(Animable& animable)
+		{
+			animable.bone_remap = nullptr;
+			if ((animable.flags & Animable::FREE) || !animable.animation) return;
+			if (!animable.animation->isReady() || animable.renderable == INVALID_COMPONENT) return;
+
+			auto* model = m_render_scene->getRenderableModel(animable.renderable);
+			if (!model || !model->isReady()) return;
+
+			animable.bone_remap = animable.animation->getBoneRemap(*model);
+		}
+
+
+		void prepareController(ControllerInstance& instance)
+		{
+			instance.bone_remaps.clear();
+			if ((instance.flags & ControllerInstance::FREE) || !instance.resource) return;
+			Controller* controller = instance.resource;
+			if (!controller->isReady())
+			{
+				// the resource can be reloaded with different layers or inputs
+				instance.layers.clear();
+				instance.inputs.clear();
+				return;
+			}
+			if (instance.renderable == INVALID_COMPONENT) return;
+
+			auto* model = m_render_scene->getRenderableModel(instance.renderable);
+			if (!model || !model->isReady()) return;
+
+			if (instance.layers.empty()) resetController(instance);
+			for (auto& node : controller->getNodes())
+			{
+				bool is_ready = node.animation && node.animation->isReady();
+				instance.bone_remaps.push(is_ready ? node.animation->getBoneRemap(*model) : nullptr);
+			}
+		}
+
+
+		void resetController(ControllerInstance& instance)
+		{
+			Controller* controller = instance.resource;
+			instance.inputs.resize(controller->getInputsCount());
+			for (float& input : instance.inputs)
+			{
+				input = 0;
+			}
+			instance.layers.resize(controller->getLayers().size());
+			for (int i = 0; i < instance.layers.size(); ++i)
+			{
+				instance.layers[i].reset(controller->getLayers()[i].first_state);
+			}
+		}
+
+
+		float getNodeLength(const ControllerInstance& instance, int node_index) const
+		{
+			const Controller::Node& node = instance.resource->getNodes()[node_index];
+			if (node.type == Controller::Node::CLIP) return node.animation->getLength();
+
+			int a, b;
+			float weight;
+			instance.resource->getBlendChildren(node, instance.inputs.begin(), &a, &b, &weight);
+			float length = getNodeLength(instance, a);
+			return length + (getNodeLength(instance, b) - length) * weight;
+		}
+
+
+		void evaluateNode(const ControllerInstance& instance,
+			int node_index,
+			float phase,
+			const Pose& bind_pose,
+			Model& model,
+			Pose& pose)
+		{
+			const Controller::Node& node = instance.resource->getNodes()[node_index];
+			if (node.type == Controller::Node::CLIP)
+			{
+				const int* bone_remap = instance.bone_remaps[node_index];
+				if (!bone_remap) return;
+				node.animation->getRelativePose(phase * node.animation->getLength(), pose, model, bone_remap);
+				return;
+			}
+
+			int a, b;
+			float weight;
+			instance.resource->getBlendChildren(node, instance.inputs.begin(), &a, &b, &weight);
+			evaluateNode(instance, a, phase, bind_pose, model, pose);
+			if (a == b || weight <= 0) return;
+
+			Pose* tmp = m_pose_pool.acquire(pose.getCount());
+			copyPose(bind_pose, *tmp);
+			evaluateNode(instance, b, phase, bind_pose, model, *tmp);
+			pose.blend(*tmp, weight);
+			m_pose_pool.release(tmp);
+		}
+
+
+		void evaluateLayer(const ControllerInstance& instance,
+			int layer_index,
+			const Pose& bind_pose,
+			Model& model,
+			Pose& pose)
+		{
+			auto& layer = instance.layers[layer_index];
+			auto& states = instance.resource->getStates();
+			evaluateNode(instance, states[layer.state].node, layer.phase, bind_pose, model, pose);
+			if (layer.prev_state < 0) return;
+
+			Pose* prev = m_pose_pool.acquire(pose.getCount());
+			copyPose(bind_pose, *prev);
+			evaluateNode(instance, states[layer.prev_state].node, layer.prev_phase, bind_pose, model, *prev);
+			pose.blend(*prev, 1 - layer.getTransitionWeight());
+			m_pose_pool.release(prev);
+		}
+
+
+		// additive layers store the difference from the bind pose
+		static void addPose(Pose& pose, const Pose& additive, const Pose& bind_pose, float weight)
+		{
+			Vec3* pos = pose.getPositions();
+			Quat* rot = pose.getRotations();
+			const Vec3* add_pos = additive.getPositions();
+			const Quat* add_rot = additive.getRotations();
+			const Vec3* bind_pos = bind_pose.getPositions();
+			const Quat* bind_rot = bind_pose.getRotations();
+			Quat identity(0, 0, 0, 1);
+			for (int i = 0, c = pose.getCount(); i < c; ++i)
+			{
+				pos[i] += (add_pos[i] - bind_pos[i]) * weight;
+				Quat delta;
+				nlerp(identity, add_rot[i] * -bind_rot[i], &delta, weight);
+				rot[i] = delta * rot[i];
+			}
+			pose.setIsRelative();
+		}
+
+
+		// returns true if a non looping state reached its end or a looping one wrapped around
+		static bool advancePhase(float* phase, float time_delta, float length, const Controller::State& state)
+		{
+			if (length > 0) *phase += time_delta * state.speed / length;
+			if (*phase < 1) return false;
+
+			*phase = state.loop ? *phase - (int)*phase : 1;
+			return true;
+		}
+
+
+		void advanceLayer(ControllerInstance& instance, int layer_index, float time_delta)
+		{
+			auto& layer = instance.layers[layer_index];
+			auto& states = instance.resource->getStates();
+			const Controller::State& state = states[layer.state];
+			bool is_end = advancePhase(&layer.phase, time_delta, getNodeLength(instance, state.node), state);
+
+			if (layer.prev_state >= 0)
+			{
+				const Controller::State& prev = states[layer.prev_state];
+				advancePhase(&layer.prev_phase, time_delta, getNodeLength(instance, prev.node), prev);
+				layer.advanceTransition(time_delta);
+			}
+
+			int transition = instance.resource->findTransition(layer_index, layer.state, instance.inputs.begin(), is_end);
+			if (transition < 0) return;
+
+			const Controller::Transition& taken = instance.resource->getTransitions()[transition];
+			layer.startTransition(taken.to, taken.duration);
+		}
+
+
+		// state machines keep running on frames without evaluation, so transitions are not delayed
+		void advanceController(ControllerInstance& instance, float time_delta)
+		{
+			if (instance.bone_remaps.empty()) return;
+
+			for (int i = 0; i < instance.layers.size(); ++i)
+			{
+				advanceLayer(instance, i, time_delta);
+			}
+		}
+
+
+		void updateController(ControllerInstance& instance, float time_delta)
+		{
+			if (instance.bone_remaps.empty()) return;
+
+			auto* pose = m_render_scene->getPose(instance.renderable);
+			auto* model = m_render_scene->getRenderableModel(instance.renderable);
+			if (!pose) return;
+
+			Pose* bind_pose = m_pose_pool.acquire(pose->getCount());
+			model->getPose(*bind_pose);
+			bind_pose->computeRelative(*model);
+
+			Pose* layer_pose = nullptr;
+			auto& layers = instance.resource->getLayers();
+			for (int i = 0; i < layers.size(); ++i)
+			{
+				if (i > 0 && layers[i].weight <= 0)
+				{
+					advanceLayer(instance, i, time_delta);
+					continue;
+				}
+
+				Pose* target = pose;
+				if (i > 0)
+				{
+					if (!layer_pose) layer_pose = m_pose_pool.acquire(pose->getCount());
+					target = layer_pose;
+				}
+				copyPose(*bind_pose, *target);
+				evaluateLayer(instance, i, *bind_pose, *model, *target);
+				if (layers[i].additive && i > 0)
+				{
+					addPose(*pose, *layer_pose, *bind_pose, layers[i].weight);
+				}
+				else if (i > 0)
+				{
+					pose->blend(*layer_pose, layers[i].weight);
+				}
+				advanceLayer(instance, i, time_delta);
+			}
+
+			if (layer_pose) m_pose_pool.release(layer_pose);
+			m_pose_pool.release(bind_pose);
+			pose->computeAbsolute(*model);
+			pose->computeSkinningMatrices(*model);
+		}
+
+
+		void setControllerInput(ComponentIndex cmp, const char* name, float value)
+		{
+			auto& instance = m_controllers[cmp];
+			if (!instance.resource || instance.inputs.empty()) return;
+
+			int index = instance.resource->getInputIndex(crc32(name));
+			if (index >= 0) instance.inputs[index] = value;
+		}
+
+
+		float getControllerInput(ComponentIndex cmp, const char* name)
+		{
+			auto& instance = m_controllers[cmp];
+			if (!instance.resource || instance.inputs.empty()) return 0;
+
+			int index = instance.resource->getInputIndex(crc32(name));
+			return index >= 0 ? instance.inputs[index] : 0;
+		}
+
+
+		void setControllerState(ComponentIndex cmp, int layer, const char* state, float fade_duration)
+		{
+			auto& instance = m_controllers[cmp];
+			if (!instance.resource || layer < 0 || layer >= instance.layers.size()) return;
+
+			int index = instance.resource->getStateIndex(layer, crc32(state));
+			if (index < 0) return;
+			instance.layers[layer].startTransition(index, fade_duration);
+		}
+
+
+		Path getControllerSource(ComponentIndex cmp)
+		{
+			auto* controller = m_controllers[cmp].resource;
+			return controller ? controller->getPath() : Path("");
+		}
+
+
+		void setControllerSource(ComponentIndex cmp, const Path& path)
+		{
+			auto& instance = m_controllers[cmp];
+			unloadController(instance.resource);
+			instance.resource = path.isValid() ? loadController(path) : nullptr;
+			instance.inputs.clear();
+			instance.layers.clear();
+		}
+
+
+		Controller* loadController(const Path& path)
+		{
+			ResourceManager& rm = m_engine.getResourceManager();
+			return static_cast<Controller*>(rm.get(ResourceManager::ANIMATION_CONTROLLER)->load(path));
 		}
 
 
@@ -329,6 +1002,14 @@ namespace Lumix
 					break;
 				}
 			}
+			for (auto& controller : m_controllers)
+			{
+				if (controller.entity == entity)
+				{
+					controller.renderable = cmp;
+					break;
+				}
+			}
 		}
 
 
@@ -343,6 +1024,14 @@ namespace Lumix
 					break;
 				}
 			}
+			for (auto& controller : m_controllers)
+			{
+				if (controller.entity == entity)
+				{
+					controller.renderable = INVALID_COMPONENT;
+					break;
+				}
+			}
 		}
 
 
@@ -364,9 +1053,11 @@ namespace Lumix
 			animable.flags &= ~Animable::FREE;
 			animable.renderable = INVALID_COMPONENT;
 			animable.animation = nullptr;
+			animable.bone_remap = nullptr;
 			animable.entity = entity;
 			animable.time_scale = 1;
 			animable.start_time = 0;
+			animable.lod = LOD_FULL;
 
 			ComponentIndex renderable = m_render_scene->getRenderableComponent(entity);
 			if (renderable >= 0)
@@ -379,6 +1070,29 @@ namespace Lumix
 		}
 
 
+		ComponentIndex createController(Entity entity)
+		{
+			int cmp = m_controllers.size();
+			for (int i = 0, c = m_controllers.size(); i < c; ++i)
+			{
+				if (m_controllers[i].flags & ControllerInstance::FREE)
+				{
+					cmp = i;
+					break;
+				}
+			}
+			auto& controller = cmp < m_controllers.size() ? m_controllers[cmp] : m_controllers.emplace(m_allocator);
+			controller.flags = 0;
+			controller.entity = entity;
+			controller.resource = nullptr;
+			controller.lod = LOD_FULL;
+			controller.renderable = m_render_scene->getRenderableComponent(entity);
+
+			m_universe.addComponent(entity, ANIM_CONTROLLER_HASH, this, cmp);
+			return cmp;
+		}
+
+
 		IPlugin& getPlugin() const override { return m_anim_system; }
 
 
@@ -386,8 +1100,16 @@ namespace Lumix
 		IPlugin& m_anim_system;
 		Engine& m_engine;
 		Array<Animable> m_animables;
+		Array<ControllerInstance> m_controllers;
+		PosePool m_pose_pool;
+		IAllocator& m_allocator;
 		RenderScene* m_render_scene;
 		bool m_is_game_running;
+		uint32 m_frame;
+		bool m_is_lod_enabled;
+		float m_half_rate_screen_size;
+		float m_quarter_rate_screen_size;
+		int m_lod_stats[LOD_COUNT];
 	};
 
 
@@ -398,8 +1120,11 @@ namespace Lumix
 			: m_allocator(engine.getAllocator())
 			, m_engine(engine)
 			, animation_manager(m_allocator)
+			, controller_manager(m_allocator)
 		{
+			registerLuaAPI(m_engine.getState());
 			PropertyRegister::registerComponentType("animable", "Animable");
+			PropertyRegister::registerComponentType("anim_controller", "Animation controller");
 
 			PropertyRegister::add("animable", LUMIX_NEW(m_allocator, ResourcePropertyDescriptor<AnimationSceneImpl>)("Animation",
 				&AnimationSceneImpl::getAnimation,
@@ -421,6 +1146,14 @@ namespace Lumix
 				FLT_MAX,
 				0.1f,
 				m_allocator));
+
+			PropertyRegister::add("anim_controller",
+				LUMIX_NEW(m_allocator, ResourcePropertyDescriptor<AnimationSceneImpl>)("Source",
+					&AnimationSceneImpl::getControllerSource,
+					&AnimationSceneImpl::setControllerSource,
+					"Animation controller (*.act)",
+					ResourceManager::ANIMATION_CONTROLLER,
+					m_allocator));
 		}
 
 		IScene* createScene(Universe& ctx) override
@@ -443,6 +1176,8 @@ namespace Lumix
 		{
 			animation_manager.create(ResourceManager::ANIMATION,
 				m_engine.getResourceManager());
+			controller_manager.create(ResourceManager::ANIMATION_CONTROLLER,
+				m_engine.getResourceManager());
 			return true;
 		}
 
@@ -452,6 +1187,7 @@ namespace Lumix
 		Lumix::IAllocator& m_allocator;
 		Engine& m_engine;
 		AnimationManager animation_manager;
+		ControllerManager controller_manager;
 
 	private:
 		void operator=(const AnimationSystemImpl&);
@@ -495,13 +1231,14 @@ namespace Lumix
 
 		bool hasResourceManager(uint32 type) const override
 		{
-			return type == ResourceManager::ANIMATION;
+			return type == ResourceManager::ANIMATION || type == ResourceManager::ANIMATION_CONTROLLER;
 		}
 
 
 		uint32 getResourceType(const char* ext) override
 		{
 			if (compareString(ext, "ani") == 0) return ResourceManager::ANIMATION;
+			if (compareString(ext, "act") == 0) return ResourceManager::ANIMATION_CONTROLLER;
 			return 0;
 		}
 
@@ -510,6 +1247,59 @@ namespace Lumix
 	};
 
 
+	struct StudioAppPlugin : StudioApp::IPlugin
+	{
+		explicit StudioAppPlugin(StudioApp& app)
+			: m_app(app)
+		{
+			m_action = LUMIX_NEW(app.getWorldEditor()->getAllocator(), Action)("Animation", "animation");
+			m_action->func.bind<StudioAppPlugin, &StudioAppPlugin::onAction>(this);
+			m_is_window_opened = false;
+		}
+
+
+		void onAction()
+		{
+			m_is_window_opened = !m_is_window_opened;
+		}
+
+
+		void onWindowGUI() override
+		{
+			auto* scene = static_cast<AnimationSceneImpl*>(m_app.getWorldEditor()->getScene(crc32("animation")));
+			if (ImGui::BeginDock("Animation", &m_is_window_opened))
+			{
+				if (ImGui::CollapsingHeader("LOD", nullptr, true, true))
+				{
+					bool is_enabled = scene->isLODEnabled();
+					if (ImGui::Checkbox("Enabled", &is_enabled)) scene->enableLOD(is_enabled);
+					float size = scene->getHalfRateScreenSize();
+					if (ImGui::DragFloat("Half rate below", &size, 0.01f, 0, 1)) scene->setHalfRateScreenSize(size);
+					size = scene->getQuarterRateScreenSize();
+					if (ImGui::DragFloat("Quarter rate below", &size, 0.01f, 0, 1))
+					{
+						scene->setQuarterRateScreenSize(size);
+					}
+				}
+
+				if (ImGui::CollapsingHeader("Stats", nullptr, true, true))
+				{
+					const int* stats = scene->getLODStats();
+					for (int i = 0; i < LOD_COUNT; ++i)
+					{
+						ImGui::LabelText(LOD_NAMES[i], "%d", stats[i]);
+					}
+				}
+			}
+			ImGui::EndDock();
+		}
+
+
+		StudioApp& m_app;
+		bool m_is_window_opened;
+	};
+
+
 	struct PropertyGridPlugin : PropertyGrid::IPlugin
 	{
 		explicit PropertyGridPlugin(StudioApp& app)
@@ -528,6 +1318,8 @@ namespace Lumix
 			if (!animable.animation) return;
 			if (!animable.animation->isReady()) return;
 
+			// the scene does not update while the game is not running
+			scene->prepareBoneRemap(animable);
 			ImGui::Checkbox("Preview", &m_is_playing);
 			if (ImGui::SliderFloat("Time", &animable.time, 0, animable.animation->getLength()))
 			{
@@ -550,6 +1342,22 @@ namespace Lumix
 } // anonymous namespace
 
 
+static void registerLuaAPI(lua_State* L)
+{
+	#define REGISTER_FUNCTION(name) \
+		do {\
+			auto f = &LuaWrapper::wrapMethod<AnimationSceneImpl, decltype(&AnimationSceneImpl::name), &AnimationSceneImpl::name>; \
+			LuaWrapper::createSystemFunction(L, "Animation", #name, f); \
+		} while(false) \
+
+	REGISTER_FUNCTION(setControllerInput);
+	REGISTER_FUNCTION(getControllerInput);
+	REGISTER_FUNCTION(setControllerState);
+
+	#undef REGISTER_FUNCTION
+}
+
+
 LUMIX_STUDIO_ENTRY(animation)
 {
 	auto& allocator = app.getWorldEditor()->getAllocator();
@@ -558,6 +1366,9 @@ LUMIX_STUDIO_ENTRY(animation)
 
 	auto* pg_plugin = LUMIX_NEW(allocator, PropertyGridPlugin)(app);
 	app.getPropertyGrid()->addPlugin(*pg_plugin);
+
+	auto* studio_plugin = LUMIX_NEW(allocator, StudioAppPlugin)(app);
+	app.addPlugin(*studio_plugin);
 }
 
 
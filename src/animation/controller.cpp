@@ -0,0 +1,531 @@
+#include "animation/controller.h"
+#include "animation/animation.h"
+#include "engine/core/crc32.h"
+#include "engine/core/fs/file_system.h"
+#include "engine/core/json_serializer.h"
+#include "engine/core/log.h"
+#include "engine/core/path.h"
+#include "engine/core/profiler.h"
+#include "engine/core/resource_manager.h"
+
+
+namespace Lumix
+{
+
+
+static const uint32 ANY_STATE_HASH = crc32("*");
+
+
+Resource* ControllerManager::createResource(const Path& path)
+{
+	return LUMIX_NEW(m_allocator, Controller)(path, getOwner(), m_allocator);
+}
+
+
+void ControllerManager::destroyResource(Resource& resource)
+{
+	LUMIX_DELETE(m_allocator, static_cast<Controller*>(&resource));
+}
+
+
+Controller::Controller(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
+	: Resource(path, resource_manager, allocator)
+	, m_layers(allocator)
+	, m_states(allocator)
+	, m_transitions(allocator)
+	, m_nodes(allocator)
+	, m_children(allocator)
+	, m_inputs(allocator)
+{
+}
+
+
+Controller::~Controller()
+{
+	ASSERT(isEmpty());
+}
+
+
+int Controller::getInputIndex(uint32 name_hash) const
+{
+	for (int i = 0; i < m_inputs.size(); ++i)
+	{
+		if (m_inputs[i] == name_hash) return i;
+	}
+	return -1;
+}
+
+
+int Controller::getStateIndex(int layer, uint32 name_hash) const
+{
+	const Layer& l = m_layers[layer];
+	for (int i = l.first_state; i < l.first_state + l.states_count; ++i)
+	{
+		if (m_states[i].name_hash == name_hash) return i;
+	}
+	return -1;
+}
+
+
+void Controller::LayerState::reset(int entry_state)
+{
+	state = entry_state;
+	prev_state = -1;
+	phase = 0;
+	prev_phase = 0;
+	transition_time = 0;
+	transition_duration = 0;
+}
+
+
+void Controller::LayerState::startTransition(int to, float duration)
+{
+	prev_state = duration > 0 ? state : -1;
+	prev_phase = phase;
+	transition_time = 0;
+	transition_duration = duration;
+	state = to;
+	phase = 0;
+}
+
+
+void Controller::LayerState::advanceTransition(float time_delta)
+{
+	if (prev_state < 0) return;
+	transition_time += time_delta;
+	if (transition_time >= transition_duration) prev_state = -1;
+}
+
+
+float Controller::LayerState::getTransitionWeight() const
+{
+	if (prev_state < 0 || transition_duration <= 0) return 1;
+	return transition_time / transition_duration;
+}
+
+
+void Controller::getBlendChildren(const Node& node, const float* inputs, int* a, int* b, float* weight) const
+{
+	const int* children = &m_children[node.first_child];
+	float value = inputs[node.input];
+	int last = node.children_count - 1;
+	*weight = 0;
+	if (value <= m_nodes[children[0]].value)
+	{
+		*a = *b = children[0];
+		return;
+	}
+	if (value >= m_nodes[children[last]].value)
+	{
+		*a = *b = children[last];
+		return;
+	}
+
+	int i = 0;
+	while (value >= m_nodes[children[i + 1]].value) ++i;
+	*a = children[i];
+	*b = children[i + 1];
+	*weight = (value - m_nodes[*a].value) / (m_nodes[*b].value - m_nodes[*a].value);
+}
+
+
+static bool isConditionMet(const Controller::Transition& transition, const float* inputs, bool is_end)
+{
+	switch (transition.condition)
+	{
+		case Controller::Transition::END: return is_end;
+		case Controller::Transition::GREATER: return inputs[transition.input] > transition.value;
+		case Controller::Transition::LESS: return inputs[transition.input] < transition.value;
+	}
+	return false;
+}
+
+
+int Controller::findTransition(int layer, int state, const float* inputs, bool is_end) const
+{
+	const Layer& l = m_layers[layer];
+	for (int i = l.first_transition; i < l.first_transition + l.transitions_count; ++i)
+	{
+		const Transition& transition = m_transitions[i];
+		if (transition.to == state) continue;
+		if (transition.from >= 0 && transition.from != state) continue;
+		if (isConditionMet(transition, inputs, is_end)) return i;
+	}
+	return -1;
+}
+
+
+int Controller::addInput(const char* name)
+{
+	uint32 hash = crc32(name);
+	int index = getInputIndex(hash);
+	if (index >= 0) return index;
+	m_inputs.push(hash);
+	return m_inputs.size() - 1;
+}
+
+
+int Controller::parseNode(JsonSerializer& serializer)
+{
+	int index = m_nodes.size();
+	Node& node = m_nodes.emplace();
+	node.type = Node::CLIP;
+	node.value = 0;
+	node.animation = nullptr;
+	node.input = -1;
+	node.first_child = 0;
+	node.children_count = 0;
+
+	Array<int> children(getAllocator());
+	char label[50];
+	serializer.deserializeObjectBegin();
+	while (!serializer.isObjectEnd())
+	{
+		serializer.deserializeLabel(label, lengthOf(label));
+		if (compareString(label, "value") == 0)
+		{
+			serializer.deserialize(m_nodes[index].value, 0);
+		}
+		else if (compareString(label, "animation") == 0)
+		{
+			Path path;
+			serializer.deserialize(path, Path(""));
+			auto* manager = m_resource_manager.get(ResourceManager::ANIMATION);
+			Animation* animation = static_cast<Animation*>(manager->load(path));
+			addDependency(*animation);
+			m_nodes[index].animation = animation;
+		}
+		else if (compareString(label, "blend") == 0)
+		{
+			char input[50];
+			serializer.deserialize(input, lengthOf(input), "");
+			m_nodes[index].type = Node::BLEND_1D;
+			m_nodes[index].input = addInput(input);
+		}
+		else if (compareString(label, "children") == 0)
+		{
+			serializer.deserializeArrayBegin();
+			while (!serializer.isArrayEnd())
+			{
+				serializer.nextArrayItem();
+				int child = parseNode(serializer);
+				if (child < 0) return -1;
+				children.push(child);
+			}
+			serializer.deserializeArrayEnd();
+		}
+		else
+		{
+			g_log_warning.log("Animation") << "Unknown parameter " << label << " in " << getPath();
+		}
+	}
+	serializer.deserializeObjectEnd();
+
+	Node& parsed = m_nodes[index];
+	if (parsed.type == Node::CLIP)
+	{
+		if (!parsed.animation || !children.empty())
+		{
+			g_log_error.log("Animation") << "Clip without an animation in " << getPath();
+			return -1;
+		}
+		return index;
+	}
+
+	if (parsed.animation || children.empty())
+	{
+		g_log_error.log("Animation") << "Blend node without children in " << getPath();
+		return -1;
+	}
+
+	// sorted, so evaluation finds the neighbours of the input value in one pass
+	for (int i = 1; i < children.size(); ++i)
+	{
+		int child = children[i];
+		int j = i - 1;
+		for (; j >= 0 && m_nodes[children[j]].value > m_nodes[child].value; --j)
+		{
+			children[j + 1] = children[j];
+		}
+		children[j + 1] = child;
+	}
+	parsed.first_child = m_children.size();
+	parsed.children_count = children.size();
+	for (int child : children)
+	{
+		m_children.push(child);
+	}
+	return index;
+}
+
+
+bool Controller::parseState(JsonSerializer& serializer, State& state)
+{
+	state.name_hash = 0;
+	state.node = -1;
+	state.speed = 1;
+	state.loop = true;
+
+	char label[50];
+	serializer.deserializeObjectBegin();
+	while (!serializer.isObjectEnd())
+	{
+		serializer.deserializeLabel(label, lengthOf(label));
+		if (compareString(label, "name") == 0)
+		{
+			char name[50];
+			serializer.deserialize(name, lengthOf(name), "");
+			state.name_hash = crc32(name);
+		}
+		else if (compareString(label, "speed") == 0)
+		{
+			serializer.deserialize(state.speed, 1);
+		}
+		else if (compareString(label, "loop") == 0)
+		{
+			serializer.deserialize(state.loop, true);
+		}
+		else if (compareString(label, "node") == 0)
+		{
+			state.node = parseNode(serializer);
+			if (state.node < 0) return false;
+		}
+		else
+		{
+			g_log_warning.log("Animation") << "Unknown parameter " << label << " in " << getPath();
+		}
+	}
+	serializer.deserializeObjectEnd();
+
+	if (state.node < 0)
+	{
+		g_log_error.log("Animation") << "State without a node in " << getPath();
+		return false;
+	}
+	return true;
+}
+
+
+bool Controller::parseTransition(JsonSerializer& serializer,
+	Transition& transition,
+	uint32* from_hash,
+	uint32* to_hash)
+{
+	transition.from = -1;
+	transition.to = -1;
+	transition.duration = 0.2f;
+	transition.condition = Transition::END;
+	transition.input = -1;
+	transition.value = 0;
+	*from_hash = ANY_STATE_HASH;
+	*to_hash = 0;
+
+	char label[50];
+	char tmp[50];
+	serializer.deserializeObjectBegin();
+	while (!serializer.isObjectEnd())
+	{
+		serializer.deserializeLabel(label, lengthOf(label));
+		if (compareString(label, "from") == 0)
+		{
+			serializer.deserialize(tmp, lengthOf(tmp), "*");
+			*from_hash = crc32(tmp);
+		}
+		else if (compareString(label, "to") == 0)
+		{
+			serializer.deserialize(tmp, lengthOf(tmp), "");
+			*to_hash = crc32(tmp);
+		}
+		else if (compareString(label, "duration") == 0)
+		{
+			serializer.deserialize(transition.duration, 0.2f);
+		}
+		else if (compareString(label, "input") == 0)
+		{
+			serializer.deserialize(tmp, lengthOf(tmp), "");
+			transition.input = addInput(tmp);
+		}
+		else if (compareString(label, "greater") == 0)
+		{
+			serializer.deserialize(transition.value, 0);
+			transition.condition = Transition::GREATER;
+		}
+		else if (compareString(label, "less") == 0)
+		{
+			serializer.deserialize(transition.value, 0);
+			transition.condition = Transition::LESS;
+		}
+		else
+		{
+			g_log_warning.log("Animation") << "Unknown parameter " << label << " in " << getPath();
+		}
+	}
+	serializer.deserializeObjectEnd();
+
+	if (transition.condition != Transition::END && transition.input < 0)
+	{
+		g_log_error.log("Animation") << "Transition condition without an input in " << getPath();
+		return false;
+	}
+	return true;
+}
+
+
+bool Controller::parseLayer(JsonSerializer& serializer)
+{
+	Layer& layer = m_layers.emplace();
+	layer.name_hash = 0;
+	layer.weight = 1;
+	layer.additive = false;
+	layer.first_state = m_states.size();
+	layer.states_count = 0;
+	layer.first_transition = m_transitions.size();
+	layer.transitions_count = 0;
+	int layer_index = m_layers.size() - 1;
+
+	// states can be listed after transitions, so names are resolved at the end of the layer
+	Array<uint32> from_hashes(getAllocator());
+	Array<uint32> to_hashes(getAllocator());
+	char label[50];
+	serializer.deserializeObjectBegin();
+	while (!serializer.isObjectEnd())
+	{
+		serializer.deserializeLabel(label, lengthOf(label));
+		if (compareString(label, "name") == 0)
+		{
+			char name[50];
+			serializer.deserialize(name, lengthOf(name), "");
+			m_layers[layer_index].name_hash = crc32(name);
+		}
+		else if (compareString(label, "weight") == 0)
+		{
+			serializer.deserialize(m_layers[layer_index].weight, 1);
+		}
+		else if (compareString(label, "additive") == 0)
+		{
+			serializer.deserialize(m_layers[layer_index].additive, false);
+		}
+		else if (compareString(label, "states") == 0)
+		{
+			serializer.deserializeArrayBegin();
+			while (!serializer.isArrayEnd())
+			{
+				serializer.nextArrayItem();
+				State state;
+				if (!parseState(serializer, state)) return false;
+				m_states.push(state);
+			}
+			serializer.deserializeArrayEnd();
+		}
+		else if (compareString(label, "transitions") == 0)
+		{
+			serializer.deserializeArrayBegin();
+			while (!serializer.isArrayEnd())
+			{
+				serializer.nextArrayItem();
+				Transition transition;
+				uint32 from_hash;
+				uint32 to_hash;
+				if (!parseTransition(serializer, transition, &from_hash, &to_hash)) return false;
+				m_transitions.push(transition);
+				from_hashes.push(from_hash);
+				to_hashes.push(to_hash);
+			}
+			serializer.deserializeArrayEnd();
+		}
+		else
+		{
+			g_log_warning.log("Animation") << "Unknown parameter " << label << " in " << getPath();
+		}
+	}
+	serializer.deserializeObjectEnd();
+
+	Layer& parsed = m_layers[layer_index];
+	parsed.states_count = m_states.size() - parsed.first_state;
+	parsed.transitions_count = m_transitions.size() - parsed.first_transition;
+	if (parsed.states_count == 0)
+	{
+		g_log_error.log("Animation") << "Layer without states in " << getPath();
+		return false;
+	}
+
+	for (int i = 0; i < parsed.transitions_count; ++i)
+	{
+		Transition& transition = m_transitions[parsed.first_transition + i];
+		transition.to = getStateIndex(layer_index, to_hashes[i]);
+		transition.from =
+			from_hashes[i] == ANY_STATE_HASH ? -1 : getStateIndex(layer_index, from_hashes[i]);
+		if (transition.to < 0 || (transition.from < 0 && from_hashes[i] != ANY_STATE_HASH))
+		{
+			g_log_error.log("Animation") << "Transition between unknown states in " << getPath();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void Controller::unload()
+{
+	auto* manager = m_resource_manager.get(ResourceManager::ANIMATION);
+	for (Node& node : m_nodes)
+	{
+		if (!node.animation) continue;
+		removeDependency(*node.animation);
+		manager->unload(*node.animation);
+	}
+	m_layers.clear();
+	m_states.clear();
+	m_transitions.clear();
+	m_nodes.clear();
+	m_children.clear();
+	m_inputs.clear();
+}
+
+
+bool Controller::load(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	JsonSerializer serializer(file, JsonSerializer::READ, getPath(), getAllocator());
+	char label[50];
+	serializer.deserializeObjectBegin();
+	while (!serializer.isObjectEnd())
+	{
+		serializer.deserializeLabel(label, lengthOf(label));
+		if (compareString(label, "layers") == 0)
+		{
+			serializer.deserializeArrayBegin();
+			while (!serializer.isArrayEnd())
+			{
+				serializer.nextArrayItem();
+				if (!parseLayer(serializer)) return false;
+			}
+			serializer.deserializeArrayEnd();
+		}
+		else
+		{
+			g_log_warning.log("Animation") << "Unknown parameter " << label << " in " << getPath();
+		}
+	}
+	serializer.deserializeObjectEnd();
+
+	if (serializer.isError()) return false;
+	if (m_layers.empty())
+	{
+		g_log_error.log("Animation") << "Controller " << getPath() << " without layers";
+		return false;
+	}
+
+	m_size = file.size();
+	return true;
+}
+
+
+IAllocator& Controller::getAllocator()
+{
+	return static_cast<ControllerManager*>(m_resource_manager.get(ResourceManager::ANIMATION_CONTROLLER))
+		->getAllocator();
+}
+
+
+} // ~ namespace Lumix
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "engine/core/array.h"
+#include "engine/core/resource.h"
+#include "engine/core/resource_manager_base.h"
+
+namespace Lumix
+{
+
+namespace FS
+{
+	class IFile;
+}
+
+class Animation;
+class JsonSerializer;
+
+
+class LUMIX_ANIMATION_API ControllerManager : public ResourceManagerBase
+{
+public:
+	explicit ControllerManager(IAllocator& allocator)
+		: ResourceManagerBase(allocator)
+		, m_allocator(allocator)
+	{}
+	~ControllerManager() {}
+	IAllocator& getAllocator() { return m_allocator; }
+
+protected:
+	Resource* createResource(const Path& path) override;
+	void destroyResource(Resource& resource) override;
+
+private:
+	IAllocator& m_allocator;
+};
+
+
+/*
+Animation controller (*.act) - layers of state machines, states play blend trees
+{
+	"layers" : [
+		{
+			"name" : "base", "weight" : 1, "additive" : false,
+			"states" : [
+				{
+					"name" : "locomotion", "speed" : 1, "loop" : true,
+					"node" : {
+						"blend" : "speed",
+						"children" : [
+							{ "value" : 0, "animation" : "models/idle.ani" },
+							{ "value" : 2, "animation" : "models/run.ani" }
+						]
+					}
+				}
+			],
+			"transitions" : [
+				{ "from" : "locomotion", "to" : "jump", "duration" : 0.2, "input" : "jump", "greater" : 0.5 }
+			]
+		}
+	]
+}
+The first state of a layer is the entry state, transitions without "from" can be taken from any state
+and transitions without a condition are taken when the state ends.
+*/
+class LUMIX_ANIMATION_API Controller : public Resource
+{
+public:
+	struct Node
+	{
+		enum Type : uint8
+		{
+			CLIP,
+			BLEND_1D
+		};
+
+		Type type;
+		// position on the parent's blend axis
+		float value;
+		Animation* animation;
+		// input driving BLEND_1D
+		int input;
+		// BLEND_1D children are sorted by value, see getChildren()
+		int first_child;
+		int children_count;
+	};
+
+	struct State
+	{
+		uint32 name_hash;
+		int node;
+		float speed;
+		bool loop;
+	};
+
+	struct Transition
+	{
+		enum Condition : uint8
+		{
+			END,
+			GREATER,
+			LESS
+		};
+
+		// -1 if the transition can be taken from any state
+		int from;
+		int to;
+		float duration;
+		Condition condition;
+		int input;
+		float value;
+	};
+
+	struct Layer
+	{
+		uint32 name_hash;
+		float weight;
+		bool additive;
+		int first_state;
+		int states_count;
+		int first_transition;
+		int transitions_count;
+	};
+
+	// playback of a layer in a controller instance
+	struct LayerState
+	{
+		void reset(int entry_state);
+		// state fades out in duration seconds, 0 switches at once
+		void startTransition(int to, float duration);
+		void advanceTransition(float time_delta);
+		// weight of state, prev_state has the rest
+		float getTransitionWeight() const;
+
+		int state;
+		// state fading out during a transition, -1 if there is no transition
+		int prev_state;
+		// normalized, so clips of different length in one blend stay in sync
+		float phase;
+		float prev_phase;
+		float transition_time;
+		float transition_duration;
+	};
+
+public:
+	Controller(const Path& path, ResourceManager& resource_manager, IAllocator& allocator);
+	~Controller();
+
+	const Array<Layer>& getLayers() const { return m_layers; }
+	const Array<State>& getStates() const { return m_states; }
+	const Array<Transition>& getTransitions() const { return m_transitions; }
+	const Array<Node>& getNodes() const { return m_nodes; }
+	const Array<int>& getChildren() const { return m_children; }
+	int getInputsCount() const { return m_inputs.size(); }
+	int getInputIndex(uint32 name_hash) const;
+	int getStateIndex(int layer, uint32 name_hash) const;
+	// the children of a BLEND_1D node around the input value, weight is the distance between them
+	void getBlendChildren(const Node& node, const float* inputs, int* a, int* b, float* weight) const;
+	// the first transition of the layer which can be taken from state, -1 if there is none
+	int findTransition(int layer, int state, const float* inputs, bool is_end) const;
+
+private:
+	IAllocator& getAllocator();
+	int addInput(const char* name);
+	bool parseLayer(JsonSerializer& serializer);
+	bool parseState(JsonSerializer& serializer, State& state);
+	int parseNode(JsonSerializer& serializer);
+	bool parseTransition(JsonSerializer& serializer,
+		Transition& transition,
+		uint32* from_hash,
+		uint32* to_hash);
+
+	void unload() override;
+	bool load(FS::IFile& file) override;
+
+private:
+	Array<Layer> m_layers;
+	Array<State> m_states;
+	Array<Transition> m_transitions;
+	Array<Node> m_nodes;
+	Array<int> m_children;
+	Array<uint32> m_inputs;
+};
+
+
+} // ~ namespace Lumix
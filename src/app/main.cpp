@@ -32,6 +32,9 @@
 class App
 {
 public:
+	static const int DEFAULT_CAPTURE_FRAMES = 120;
+
+
 	App()
 	{
 		m_universe = nullptr;
@@ -138,6 +141,28 @@ public:
 
 				parser.getCurrent(m_startup_script_path, Lumix::lengthOf(m_startup_script_path));
 			}
+			else if (parser.currentEquals("-profiler_capture"))
+			{
+				if (!parser.next()) break;
+
+				char tmp[32];
+				parser.getCurrent(tmp, Lumix::lengthOf(tmp));
+				int frames_count = 0;
+				Lumix::fromCString(tmp, Lumix::lengthOf(tmp), &frames_count);
+				Lumix::Profiler::setCaptureFrameCount(frames_count);
+			}
+			else if (parser.currentEquals("-profiler_hitch"))
+			{
+				if (!parser.next()) break;
+
+				char tmp[32];
+				parser.getCurrent(tmp, Lumix::lengthOf(tmp));
+				int hitch_ms = 0;
+				Lumix::fromCString(tmp, Lumix::lengthOf(tmp), &hitch_ms);
+				// a hitch capture needs some frames
+				if (Lumix::Profiler::getCaptureFrameCount() == 0) Lumix::Profiler::setCaptureFrameCount(DEFAULT_CAPTURE_FRAMES);
+				Lumix::Profiler::setCaptureHitch(hitch_ms * 0.001f, "profiler_hitch_");
+			}
 		}
 
 		createWindow();
@@ -373,6 +398,7 @@ public:
 			Lumix::MT::sleep(Lumix::uint32(1000 / 60.0f - frame_time * 1000));
 		}
 		handleEvents();
+		Lumix::Profiler::frame();
 	}
 
 
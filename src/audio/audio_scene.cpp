@@ -104,6 +104,10 @@ struct AudioSceneImpl : public AudioScene
 	}
 
 
+	uint32 getUpdateReads() const override { return SceneAccess::TRANSFORMS; }
+	uint32 getUpdateWrites() const override { return 0; }
+
+
 	void update(float time_delta, bool paused) override
 	{
 		if (m_listener.entity != INVALID_ENTITY)
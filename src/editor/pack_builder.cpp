@@ -0,0 +1,243 @@
+#include "pack_builder.h"
+#include "engine/core/array.h"
+#include "engine/core/crc32.h"
+#include "engine/core/fixed_array.h"
+#include "engine/core/fs/os_file.h"
+#include "engine/core/fs/pack_file_device.h"
+#include "engine/core/iallocator.h"
+#include "engine/core/log.h"
+#include "engine/core/lz4.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/path_utils.h"
+#include "engine/core/string.h"
+#include "platform_interface.h"
+#include <cstdlib>
+
+
+namespace PackBuilder
+{
+
+
+typedef Lumix::FS::PackFileDevice::Entry Entry;
+typedef Lumix::FixedArray<char, Lumix::MAX_PATH_LENGTH> FilePath;
+
+
+struct FileEntry
+{
+	Entry entry;
+	FilePath path;
+};
+
+
+static bool includeFileInPack(const char* filename)
+{
+	if (filename[0] == '.') return false;
+	if (Lumix::compareStringN("bin/", filename, 4) == 0) return false;
+	if (Lumix::compareStringN("bin32/", filename, 4) == 0) return false;
+	if (Lumix::compareString("data.pak", filename) == 0) return false;
+	if (Lumix::compareString("error.log", filename) == 0) return false;
+	return true;
+}
+
+
+static bool includeDirInPack(const char* filename)
+{
+	if (filename[0] == '.') return false;
+	if (Lumix::compareStringN("bin", filename, 4) == 0) return false;
+	if (Lumix::compareStringN("bin32", filename, 4) == 0) return false;
+	return true;
+}
+
+
+static void scan(const char* data_dir,
+	const char* dir_path,
+	Lumix::Array<FileEntry>& entries,
+	Lumix::IAllocator& allocator)
+{
+	char full_dir[Lumix::MAX_PATH_LENGTH];
+	Lumix::copyString(full_dir, data_dir);
+	Lumix::catString(full_dir, dir_path);
+	auto* iter = PlatformInterface::createFileIterator(full_dir, allocator);
+	PlatformInterface::FileInfo info;
+	while (PlatformInterface::getNextFile(iter, &info))
+	{
+		char normalized_path[Lumix::MAX_PATH_LENGTH];
+		Lumix::PathUtils::normalize(info.filename, normalized_path, Lumix::lengthOf(normalized_path));
+		if (info.is_directory)
+		{
+			if (!includeDirInPack(normalized_path)) continue;
+
+			char dir[Lumix::MAX_PATH_LENGTH];
+			Lumix::copyString(dir, dir_path);
+			Lumix::catString(dir, normalized_path);
+			Lumix::catString(dir, "/");
+			scan(data_dir, dir, entries, allocator);
+			continue;
+		}
+
+		char path[Lumix::MAX_PATH_LENGTH];
+		Lumix::copyString(path, dir_path);
+		Lumix::catString(path, normalized_path);
+		if (!includeFileInPack(path)) continue;
+
+		auto& entry = entries.emplace();
+		Lumix::copyString(entry.path.data(), entry.path.size(), path);
+		entry.entry.hash = Lumix::crc32(path);
+		entry.entry.flags = 0;
+		entry.entry.offset = 0;
+		entry.entry.size = 0;
+		entry.entry.compressed_size = 0;
+	}
+	PlatformInterface::destroyFileIterator(iter);
+}
+
+
+static int compareEntries(const void* a, const void* b)
+{
+	Lumix::uint32 hash_a = ((const FileEntry*)a)->entry.hash;
+	Lumix::uint32 hash_b = ((const FileEntry*)b)->entry.hash;
+	if (hash_a < hash_b) return -1;
+	return hash_a > hash_b ? 1 : 0;
+}
+
+
+// returns size of the compressed data or 0 if the data does not shrink
+static size_t compressBlocks(const Lumix::uint8* src,
+	size_t size,
+	Lumix::uint32 block_size,
+	Lumix::Array<Lumix::uint8>& out)
+{
+	Lumix::uint32 blocks_count = Lumix::uint32((size + block_size - 1) / block_size);
+	size_t table_size = sizeof(blocks_count) + blocks_count * sizeof(Lumix::uint32);
+	int max_block_size = Lumix::LZ4::getMaxCompressedSize(block_size);
+	out.resize(int(table_size + blocks_count * max_block_size));
+	Lumix::copyMemory(&out[0], &blocks_count, sizeof(blocks_count));
+
+	size_t pos = table_size;
+	for (Lumix::uint32 i = 0; i < blocks_count; ++i)
+	{
+		size_t offset = size_t(i) * block_size;
+		int raw_size = (int)Lumix::Math::minimum(size_t(block_size), size - offset);
+		int stored_size = Lumix::LZ4::compress(src + offset, raw_size, &out[int(pos)], max_block_size);
+		// the reader treats a block of the full size as raw data
+		if (stored_size == 0 || stored_size >= raw_size)
+		{
+			Lumix::copyMemory(&out[int(pos)], src + offset, raw_size);
+			stored_size = raw_size;
+		}
+		Lumix::copyMemory(&out[int(sizeof(blocks_count) + i * sizeof(Lumix::uint32))],
+			&stored_size,
+			sizeof(Lumix::uint32));
+		pos += stored_size;
+	}
+	return pos < size ? pos : 0;
+}
+
+
+bool build(const char* data_dir, const char* dest_path, bool compress, Lumix::IAllocator& allocator)
+{
+	char dir[Lumix::MAX_PATH_LENGTH];
+	Lumix::copyString(dir, data_dir[0] ? data_dir : ".");
+	Lumix::catString(dir, "/");
+
+	Lumix::Array<FileEntry> entries(allocator);
+	entries.reserve(10000);
+	scan(dir, "", entries, allocator);
+	if (entries.empty())
+	{
+		Lumix::g_log_error.log("Editor") << "No files found while trying to create " << dest_path;
+		return false;
+	}
+
+	qsort(&entries[0], entries.size(), sizeof(entries[0]), compareEntries);
+	for (int i = 1; i < entries.size(); ++i)
+	{
+		if (entries[i - 1].entry.hash == entries[i].entry.hash)
+		{
+			Lumix::g_log_error.log("Editor") << "Hash collision between " << entries[i - 1].path.data()
+											 << " and " << entries[i].path.data();
+			return false;
+		}
+	}
+
+	Lumix::FS::OsFile file;
+	if (!file.open(dest_path, Lumix::FS::Mode::CREATE_AND_WRITE, allocator))
+	{
+		Lumix::g_log_error.log("Editor") << "Could not create " << dest_path;
+		return false;
+	}
+
+	Lumix::FS::PackFileDevice::FileHeader header;
+	header.magic = Lumix::FS::PackFileDevice::FILE_MAGIC;
+	header.version = (Lumix::uint32)Lumix::FS::PackFileDevice::FileVersion::LATEST;
+	header.entries_count = entries.size();
+	header.block_size = Lumix::FS::PackFileDevice::DEFAULT_BLOCK_SIZE;
+
+	Lumix::Array<Entry> index(allocator);
+	index.resize(entries.size());
+	// index is written again when offsets and sizes are known
+	file.write(&header, sizeof(header));
+	file.write(&index[0], sizeof(index[0]) * index.size());
+
+	Lumix::uint64 offset = sizeof(header) + sizeof(index[0]) * index.size();
+	Lumix::uint64 total_size = 0;
+	Lumix::Array<Lumix::uint8> data(allocator);
+	Lumix::Array<Lumix::uint8> compressed(allocator);
+	for (int i = 0; i < entries.size(); ++i)
+	{
+		char src_path[Lumix::MAX_PATH_LENGTH];
+		Lumix::copyString(src_path, dir);
+		Lumix::catString(src_path, entries[i].path.data());
+
+		Lumix::FS::OsFile src;
+		if (!src.open(src_path, Lumix::FS::Mode::OPEN_AND_READ, allocator))
+		{
+			file.close();
+			Lumix::g_log_error.log("Editor") << "Could not open " << src_path;
+			return false;
+		}
+		size_t size = src.size();
+		data.resize((int)size);
+		bool success = size == 0 || src.read(&data[0], size);
+		src.close();
+		if (!success)
+		{
+			file.close();
+			Lumix::g_log_error.log("Editor") << "Could not read " << src_path;
+			return false;
+		}
+
+		Entry& entry = index[i];
+		entry = entries[i].entry;
+		entry.offset = offset;
+		entry.size = size;
+		entry.compressed_size = size;
+
+		size_t compressed_size = compress && size > 0
+			? compressBlocks(&data[0], size, header.block_size, compressed)
+			: 0;
+		if (compressed_size > 0)
+		{
+			entry.flags |= Entry::COMPRESSED;
+			entry.compressed_size = compressed_size;
+			file.write(&compressed[0], compressed_size);
+		}
+		else if (size > 0)
+		{
+			file.write(&data[0], size);
+		}
+		offset += entry.compressed_size;
+		total_size += size;
+	}
+
+	file.seek(Lumix::FS::SeekMode::BEGIN, sizeof(header));
+	file.write(&index[0], sizeof(index[0]) * index.size());
+	file.close();
+
+	Lumix::g_log_info.log("Editor") << "Packed " << entries.size() << " files into " << dest_path << ", "
+									<< total_size << " -> " << offset << " bytes";
+	return true;
+}
+
+
+} // namespace PackBuilder
@@ -0,0 +1,20 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+	class IAllocator;
+}
+
+
+namespace PackBuilder
+{
+	// packs all files in data_dir into dest_path readable by Lumix::FS::PackFileDevice
+	LUMIX_EDITOR_API bool build(const char* data_dir,
+		const char* dest_path,
+		bool compress,
+		Lumix::IAllocator& allocator);
+}
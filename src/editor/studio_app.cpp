@@ -27,6 +27,7 @@
 #include "engine/plugin_manager.h"
 #include "log_ui.h"
 #include "metadata.h"
+#include "pack_builder.h"
 #include "imgui/imgui.h"
 #include "platform_interface.h"
 #include "profiler_ui.h"
@@ -1214,78 +1215,6 @@ public:
 	}
 
 
-	static bool includeFileInPack(const char* filename)
-	{
-		if (filename[0] == '.') return false;
-		if (Lumix::compareStringN("bin/", filename, 4) == 0) return false;
-		if (Lumix::compareStringN("bin32/", filename, 4) == 0) return false;
-		if (Lumix::compareString("data.pak", filename) == 0) return false;
-		if (Lumix::compareString("error.log", filename) == 0) return false;
-		return true;
-	}
-
-
-	static bool includeDirInPack(const char* filename)
-	{
-		if (filename[0] == '.') return false;
-		if (Lumix::compareStringN("bin", filename, 4) == 0) return false;
-		if (Lumix::compareStringN("bin32", filename, 4) == 0) return false;
-		return true;
-	}
-
-
-	#pragma pack(1)
-	struct PackFileInfo
-	{
-		Lumix::uint32 hash;
-		Lumix::uint64 offset;
-		Lumix::uint64 size;
-
-		using Path = Lumix::FixedArray<char, Lumix::MAX_PATH_LENGTH>;
-	};
-	#pragma pack()
-
-
-	void packDataScan(const char* dir_path, Lumix::Array<PackFileInfo>& infos, Lumix::Array<PackFileInfo::Path>& paths)
-	{
-		auto* iter = PlatformInterface::createFileIterator(dir_path, m_allocator);
-		PlatformInterface::FileInfo info;
-		while(PlatformInterface::getNextFile(iter, &info))
-		{
-			char normalized_path[Lumix::MAX_PATH_LENGTH];
-			Lumix::PathUtils::normalize(info.filename, normalized_path, Lumix::lengthOf(normalized_path));
-			if(info.is_directory)
-			{
-				if(!includeDirInPack(normalized_path)) continue;
-
-				char dir[Lumix::MAX_PATH_LENGTH] = { 0 };
-				if(dir_path[0] != '.') Lumix::copyString(dir, dir_path);
-				Lumix::catString(dir, info.filename);
-				Lumix::catString(dir, "/");
-				packDataScan(dir, infos, paths);
-				continue;
-			}
-
-			if(!includeFileInPack(normalized_path)) continue;
-
-			auto& out_path = paths.emplace();
-			if(dir_path[0] == '.')
-			{
-				Lumix::copyString(out_path.data(), out_path.size(), normalized_path);
-			}
-			else
-			{
-				Lumix::copyString(out_path.data(), out_path.size(), dir_path);
-				Lumix::catString(out_path.data(), out_path.size(), normalized_path);
-			}
-			auto& out_info = infos.emplace();
-			out_info.hash = Lumix::crc32(out_path.data());
-			out_info.size = PlatformInterface::getFileSize(out_path.data());
-			out_info.offset = ~0UL;
-		}
-	}
-
-
 	void packData()
 	{
 		char dest[Lumix::MAX_PATH_LENGTH];
@@ -1296,60 +1225,7 @@ public:
 		Lumix::catString(dest_dir, "/");
 		Lumix::copyString(dest, dest_dir);
 		Lumix::catString(dest, OUT_FILENAME);
-		Lumix::Array<PackFileInfo> infos(m_allocator);
-		Lumix::Array<PackFileInfo::Path> paths(m_allocator);
-		infos.reserve(10000);
-		paths.reserve(10000);
-		packDataScan("./", infos, paths);
-		if (infos.empty())
-		{
-			Lumix::g_log_error.log("Editor") << "No files found while trying to create " << dest;
-			return;
-		}
-
-		Lumix::FS::OsFile file;
-		if (!file.open(dest, Lumix::FS::Mode::CREATE_AND_WRITE, m_allocator))
-		{
-			Lumix::g_log_error.log("Editor") << "Could not create " << dest;
-			return;
-		}
-
-		int count = infos.size();
-		file.write(&count, sizeof(count));
-		Lumix::uint64 offset = sizeof(count) + sizeof(infos[0]) * count;
-		for (auto& info : infos)
-		{
-			info.offset = offset;
-			offset += info.size;
-		}
-		file.write(&infos[0], sizeof(infos[0]) * count);
-
-		for (auto& path : paths)
-		{
-			Lumix::FS::OsFile src;
-			size_t src_size = PlatformInterface::getFileSize(path.data());
-			if (!src.open(path.data(), Lumix::FS::Mode::OPEN_AND_READ, m_allocator))
-			{
-				file.close();
-				Lumix::g_log_error.log("Editor") << "Could not open " << path.data();
-				return;
-			}
-			Lumix::uint8 buf[4096];
-			for (; src_size > 0; src_size -= Lumix::Math::minimum(sizeof(buf), src_size))
-			{
-				size_t batch_size = Lumix::Math::minimum(sizeof(buf), src_size);
-				if (!src.read(buf, batch_size))
-				{
-					file.close();
-					Lumix::g_log_error.log("Editor") << "Could not read " << path.data();
-					return;
-				}
-				file.write(buf, batch_size);
-			}
-			src.close();
-		}
-
-		file.close();
+		if (!PackBuilder::build(".", dest, true, m_allocator)) return;
 
 		const char* bin_files[] = {
 			"app.exe",
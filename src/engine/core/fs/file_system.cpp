@@ -4,12 +4,13 @@
 #include "engine/core/base_proxy_allocator.h"
 #include "engine/core/fs/disk_file_device.h"
 #include "engine/core/fs/file_system.h"
+#include "engine/core/math_utils.h"
 #include "engine/core/mt/lock_free_fixed_queue.h"
 #include "engine/core/mt/task.h"
+#include "engine/core/mt/thread.h"
 #include "engine/core/mt/transaction.h"
 #include "engine/core/path.h"
 #include "engine/core/profiler.h"
-#include "engine/core/queue.h"
 #include "engine/core/string.h"
 
 
@@ -33,20 +34,135 @@ struct AsyncItem
 
 	IFile* m_file;
 	ReadCallback m_cb;
+	ReadCallback m_decode_cb;
 	Mode m_mode;
 	char m_path[MAX_PATH_LENGTH];
 	uint8 m_flags;
 };
 
-static const int32 C_MAX_TRANS = 16;
+static const int32 C_MAX_TRANS = 64;
+static const int32 C_MAX_WORKERS = 8;
 
 typedef MT::Transaction<AsyncItem> AsynTrans;
 typedef MT::LockFreeFixedQueue<AsynTrans, C_MAX_TRANS> TransQueue;
-typedef Queue<AsynTrans*, C_MAX_TRANS> InProgressQueue;
-typedef Array<AsyncItem> ItemsTable;
+typedef Array<AsynTrans*> InProgressTable;
 typedef Array<IFileDevice*> DevicesTable;
 
 
+// Unbounded FIFO of not yet dispatched requests, one ring per priority.
+class PendingQueue
+{
+public:
+	explicit PendingQueue(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+		for (auto& ring : m_rings)
+		{
+			ring.buffer = nullptr;
+			ring.capacity = 0;
+			ring.rd = ring.wr = 0;
+		}
+	}
+
+
+	~PendingQueue()
+	{
+		for (auto& ring : m_rings)
+		{
+			m_allocator.deallocate(ring.buffer);
+		}
+	}
+
+
+	bool empty() const
+	{
+		for (auto& ring : m_rings)
+		{
+			if (ring.rd != ring.wr) return false;
+		}
+		return true;
+	}
+
+
+	AsyncItem& push(Priority::Value priority)
+	{
+		Ring& ring = m_rings[priority];
+		if (ring.wr - ring.rd == ring.capacity) grow(ring);
+		AsyncItem& item = ring.buffer[ring.wr & (ring.capacity - 1)];
+		++ring.wr;
+		return item;
+	}
+
+
+	AsyncItem* front()
+	{
+		for (int i = Priority::COUNT - 1; i >= 0; --i)
+		{
+			Ring& ring = m_rings[i];
+			if (ring.rd != ring.wr) return &ring.buffer[ring.rd & (ring.capacity - 1)];
+		}
+		return nullptr;
+	}
+
+
+	void pop()
+	{
+		for (int i = Priority::COUNT - 1; i >= 0; --i)
+		{
+			Ring& ring = m_rings[i];
+			if (ring.rd != ring.wr)
+			{
+				++ring.rd;
+				return;
+			}
+		}
+		ASSERT(false);
+	}
+
+
+	template <typename F> void forEach(F f)
+	{
+		for (auto& ring : m_rings)
+		{
+			for (uint32 i = ring.rd; i != ring.wr; ++i)
+			{
+				f(ring.buffer[i & (ring.capacity - 1)]);
+			}
+		}
+	}
+
+private:
+	struct Ring
+	{
+		AsyncItem* buffer;
+		uint32 capacity;
+		uint32 rd;
+		uint32 wr;
+	};
+
+
+	void grow(Ring& ring)
+	{
+		uint32 new_capacity = ring.capacity == 0 ? 64 : ring.capacity << 1;
+		auto* new_buffer = (AsyncItem*)m_allocator.allocate(sizeof(AsyncItem) * new_capacity);
+		uint32 count = ring.wr - ring.rd;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			copyMemory(&new_buffer[i], &ring.buffer[(ring.rd + i) & (ring.capacity - 1)], sizeof(AsyncItem));
+		}
+		m_allocator.deallocate(ring.buffer);
+		ring.buffer = new_buffer;
+		ring.capacity = new_capacity;
+		ring.rd = 0;
+		ring.wr = count;
+	}
+
+
+	IAllocator& m_allocator;
+	Ring m_rings[Priority::COUNT];
+};
+
+
 void IFile::release()
 {
 	getDevice().destroyFile(this);
@@ -83,8 +199,13 @@ public:
 
 			if ((tr->data.m_flags & E_IS_OPEN) == E_IS_OPEN)
 			{
-				tr->data.m_flags |=
-					tr->data.m_file->open(Path(tr->data.m_path), tr->data.m_mode) ? E_SUCCESS : E_FAIL;
+				bool success = tr->data.m_file->open(Path(tr->data.m_path), tr->data.m_mode);
+				if (tr->data.m_decode_cb.isValid())
+				{
+					PROFILE_BLOCK("decode");
+					tr->data.m_decode_cb.invoke(*tr->data.m_file, success);
+				}
+				tr->data.m_flags |= success ? E_SUCCESS : E_FAIL;
 			}
 			else if ((tr->data.m_flags & E_CLOSE) == E_CLOSE)
 			{
@@ -106,32 +227,41 @@ private:
 class FileSystemImpl : public FileSystem
 {
 public:
-	explicit FileSystemImpl(IAllocator& allocator)
+	FileSystemImpl(IAllocator& allocator, int workers_count)
 		: m_allocator(allocator)
-		, m_in_progress(m_allocator)
-		, m_pending(m_allocator)
+		, m_tasks(m_allocator)
 		, m_devices(m_allocator)
+		, m_pending(m_allocator)
+		, m_in_progress(m_allocator)
 	{
-		m_task = LUMIX_NEW(m_allocator, FSTask)(&m_transaction_queue, m_allocator);
-		m_task->create("FSTask");
-		m_task->run();
+		if (workers_count <= 0) workers_count = (int)MT::getCPUsCount() / 2;
+		workers_count = Math::clamp(workers_count, 1, C_MAX_WORKERS);
+		m_in_progress.reserve(C_MAX_TRANS);
+		for (int i = 0; i < workers_count; ++i)
+		{
+			FSTask* task = LUMIX_NEW(m_allocator, FSTask)(&m_transaction_queue, m_allocator);
+			task->create("FSTask");
+			task->run();
+			m_tasks.push(task);
+		}
 	}
 
 	~FileSystemImpl()
 	{
-		m_task->stop();
-		m_task->destroy();
-		while (!m_in_progress.empty())
+		for (auto* task : m_tasks)
 		{
-			auto* trans = m_in_progress.front();
-			m_in_progress.pop();
-			if (trans->data.m_file) close(*trans->data.m_file);
+			task->stop();
 		}
-		for (auto& i : m_pending)
+		for (auto* task : m_tasks)
 		{
-			close(*i.m_file);
+			task->destroy();
+			LUMIX_DELETE(m_allocator, task);
 		}
-		LUMIX_DELETE(m_allocator, m_task);
+		for (auto* trans : m_in_progress)
+		{
+			if (trans->data.m_file) close(*trans->data.m_file);
+		}
+		m_pending.forEach([this](AsyncItem& item) { close(*item.m_file); });
 	}
 
 	BaseProxyAllocator& getAllocator() { return m_allocator; }
@@ -140,6 +270,9 @@ public:
 	bool hasWork() const override { return !m_in_progress.empty() || !m_pending.empty(); }
 
 
+	int getWorkersCount() const override { return m_tasks.size(); }
+
+
 	bool mount(IFileDevice* device) override
 	{
 		for (int i = 0; i < m_devices.size(); i++)
@@ -218,16 +351,19 @@ public:
 	bool openAsync(const DeviceList& device_list,
 		const Path& file,
 		int mode,
-		const ReadCallback& call_back) override
+		const ReadCallback& call_back,
+		Priority::Value priority,
+		const ReadCallback& decode_call_back) override
 	{
 		IFile* prev = createFile(device_list);
 
 		if (prev)
 		{
-			AsyncItem& item = m_pending.emplace();
+			AsyncItem& item = m_pending.push(priority);
 
 			item.m_file = prev;
 			item.m_cb = call_back;
+			item.m_decode_cb = decode_call_back;
 			item.m_mode = mode;
 			copyString(item.m_path, file.c_str());
 			item.m_flags = E_IS_OPEN;
@@ -282,10 +418,12 @@ public:
 
 	void closeAsync(IFile& file) override
 	{
-		AsyncItem& item = m_pending.emplace();
+		// closing is cheap and returns OS handles, so it never waits behind reads
+		AsyncItem& item = m_pending.push(Priority::HIGH);
 
 		item.m_file = &file;
 		item.m_cb.bind<closeAsync>();
+		item.m_decode_cb = ReadCallback();
 		item.m_mode = 0;
 		item.m_flags = E_CLOSE;
 	}
@@ -294,13 +432,17 @@ public:
 	void updateAsyncTransactions() override
 	{
 		PROFILE_FUNCTION();
-		while (!m_in_progress.empty())
+		for (int i = 0; i < m_in_progress.size();)
 		{
-			AsynTrans* tr = m_in_progress.front();
-			if (!tr->isCompleted()) break;
+			AsynTrans* tr = m_in_progress[i];
+			if (!tr->isCompleted())
+			{
+				++i;
+				continue;
+			}
 
 			PROFILE_BLOCK("processAsyncTransaction");
-			m_in_progress.pop();
+			m_in_progress.erase(i);
 
 			tr->data.m_cb.invoke(*tr->data.m_file, !!(tr->data.m_flags & E_SUCCESS));
 			if ((tr->data.m_flags & (E_SUCCESS | E_FAIL)) != 0)
@@ -311,24 +453,26 @@ public:
 		}
 
 		int32 can_add = C_MAX_TRANS - m_in_progress.size();
-		while (can_add && !m_pending.empty())
+		while (can_add > 0)
 		{
+			AsyncItem* item = m_pending.front();
+			if (!item) break;
+
 			AsynTrans* tr = m_transaction_queue.alloc(false);
-			if (tr)
-			{
-				AsyncItem& item = m_pending[0];
-				tr->data.m_file = item.m_file;
-				tr->data.m_cb = item.m_cb;
-				tr->data.m_mode = item.m_mode;
-				copyString(tr->data.m_path, sizeof(tr->data.m_path), item.m_path);
-				tr->data.m_flags = item.m_flags;
-				tr->reset();
-
-				m_transaction_queue.push(tr, true);
-				m_in_progress.push(tr);
-				m_pending.erase(0);
-			}
-			can_add--;
+			if (!tr) break;
+
+			tr->data.m_file = item->m_file;
+			tr->data.m_cb = item->m_cb;
+			tr->data.m_decode_cb = item->m_decode_cb;
+			tr->data.m_mode = item->m_mode;
+			copyString(tr->data.m_path, sizeof(tr->data.m_path), item->m_path);
+			tr->data.m_flags = item->m_flags;
+			tr->reset();
+
+			m_transaction_queue.push(tr, true);
+			m_in_progress.push(tr);
+			m_pending.pop();
+			--can_add;
 		}
 	}
 
@@ -348,20 +492,14 @@ public:
 
 	static void closeAsync(IFile&, bool) {}
 
-	void destroy()
-	{
-		m_transaction_queue.abort();
-		m_task->destroy();
-	}
-
 private:
 	BaseProxyAllocator m_allocator;
-	FSTask* m_task;
+	Array<FSTask*> m_tasks;
 	DevicesTable m_devices;
 
-	ItemsTable m_pending;
+	PendingQueue m_pending;
 	TransQueue m_transaction_queue;
-	InProgressQueue m_in_progress;
+	InProgressTable m_in_progress;
 
 	DeviceList m_disk_device;
 	DeviceList m_memory_device;
@@ -369,9 +507,9 @@ private:
 	DeviceList m_save_game_device;
 };
 
-FileSystem* FileSystem::create(IAllocator& allocator)
+FileSystem* FileSystem::create(IAllocator& allocator, int workers_count)
 {
-	return LUMIX_NEW(allocator, FileSystemImpl)(allocator);
+	return LUMIX_NEW(allocator, FileSystemImpl)(allocator, workers_count);
 }
 
 void FileSystem::destroy(FileSystem* fs)
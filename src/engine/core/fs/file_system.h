@@ -85,6 +85,19 @@ protected:
 typedef Delegate<void(IFile&, bool)> ReadCallback;
 
 
+struct Priority
+{
+	enum Value
+	{
+		LOW = 0,
+		NORMAL,
+		HIGH,
+
+		COUNT
+	};
+};
+
+
 struct LUMIX_ENGINE_API DeviceList
 {
 	IFileDevice* m_devices[8];
@@ -94,7 +107,8 @@ struct LUMIX_ENGINE_API DeviceList
 class LUMIX_ENGINE_API FileSystem
 {
 public:
-	static FileSystem* create(IAllocator& allocator);
+	// workers_count == 0 picks the number of I/O threads from the CPU count
+	static FileSystem* create(IAllocator& allocator, int workers_count = 0);
 	static void destroy(FileSystem* fs);
 
 	FileSystem() {}
@@ -104,10 +118,14 @@ public:
 	virtual bool unMount(IFileDevice* device) = 0;
 
 	virtual IFile* open(const DeviceList& device_list, const Path& file, Mode mode) = 0;
+	// decode_call_back, if bound, is invoked on the worker thread right after the file is opened;
+	// call_back is invoked later on the thread calling updateAsyncTransactions
 	virtual bool openAsync(const DeviceList& device_list,
 						   const Path& file,
 						   int mode,
-						   const ReadCallback& call_back) = 0;
+						   const ReadCallback& call_back,
+						   Priority::Value priority = Priority::NORMAL,
+						   const ReadCallback& decode_call_back = ReadCallback()) = 0;
 
 	virtual void close(IFile& file) = 0;
 	virtual void closeAsync(IFile& file) = 0;
@@ -124,6 +142,7 @@ public:
 	virtual void setDefaultDevice(const char* dev) = 0;
 	virtual void setSaveGameDevice(const char* dev) = 0;
 	virtual bool hasWork() const = 0;
+	virtual int getWorkersCount() const = 0;
 };
 
 
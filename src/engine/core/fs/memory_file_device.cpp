@@ -20,6 +20,7 @@ namespace Lumix
 				, m_pos(0)
 				, m_file(file) 
 				, m_write(false)
+				, m_is_borrowed(false)
 				, m_allocator(allocator)
 			{
 			}
@@ -30,7 +31,7 @@ namespace Lumix
 				{
 					m_file->release();
 				}
-				m_allocator.deallocate(m_buffer);
+				if (!m_is_borrowed) m_allocator.deallocate(m_buffer);
 			}
 
 
@@ -51,9 +52,19 @@ namespace Lumix
 						if(mode & Mode::READ)
 						{
 							m_capacity = m_size = m_file->size();
-							m_buffer = (uint8*)m_allocator.allocate(sizeof(uint8) * m_size);
-							m_file->read(m_buffer, m_size);
 							m_pos = 0;
+							// e.g. a mapped pack file, the child keeps it alive until it is closed
+							const void* child_buffer = m_write ? nullptr : m_file->getBuffer();
+							if (child_buffer)
+							{
+								m_buffer = (uint8*)child_buffer;
+								m_is_borrowed = true;
+							}
+							else
+							{
+								m_buffer = (uint8*)m_allocator.allocate(sizeof(uint8) * m_size);
+								m_file->read(m_buffer, m_size);
+							}
 						}
 
 						return true;
@@ -82,8 +93,9 @@ namespace Lumix
 					m_file->close();
 				}
 
-				m_allocator.deallocate(m_buffer);
+				if (!m_is_borrowed) m_allocator.deallocate(m_buffer);
 				m_buffer = nullptr;
+				m_is_borrowed = false;
 			}
 
 			bool read(void* buffer, size_t size) override
@@ -165,6 +177,7 @@ namespace Lumix
 			size_t m_pos;
 			IFile* m_file;
 			bool m_write;
+			bool m_is_borrowed;
 		};
 
 		void MemoryFileDevice::destroyFile(IFile* file)
@@ -40,5 +40,25 @@ namespace Lumix
 		private:
 			struct OsFileImpl* m_impl;
 		};
+
+
+		class LUMIX_ENGINE_API OsFileMapping
+		{
+		public:
+			OsFileMapping();
+			~OsFileMapping();
+
+			bool open(const char* path);
+			void close();
+
+			const uint8* getData() const { return m_data; }
+			size_t size() const { return m_size; }
+
+		private:
+			void* m_file;
+			void* m_mapping;
+			const uint8* m_data;
+			size_t m_size;
+		};
 	} // ~namespace FS
 } // ~namespace Lumix
@@ -1,8 +1,13 @@
 #include "engine/core/fs/file_system.h"
 #include "engine/core/iallocator.h"
+#include "engine/core/log.h"
+#include "engine/core/lz4.h"
+#include "engine/core/math_utils.h"
 #include "engine/core/path.h"
+#include "engine/core/profiler.h"
 #include "engine/core/string.h"
 #include "pack_file_device.h"
+#include <cstdlib>
 
 
 namespace Lumix
@@ -18,62 +23,177 @@ public:
 		: m_device(device)
 		, m_allocator(allocator)
 		, m_local_offset(0)
+		, m_decompressed(nullptr)
 	{
 	}
 
 
+	// called from an I/O worker, so compressed entries are decompressed off the main thread
 	bool open(const Path& path, Mode mode) override
 	{
-		auto iter = m_device.m_files.find(path.getHash());
-		if (iter == m_device.m_files.end()) return false;
-		m_file = iter.value();
+		const PackFileDevice::Entry* entry = m_device.find(path.getHash());
+		if (!entry) return false;
+		m_file = *entry;
 		m_local_offset = 0;
-		return m_device.m_file.seek(SeekMode::BEGIN, (size_t)m_file.offset) == (size_t)m_file.offset;
+		if (m_file.flags & PackFileDevice::Entry::COMPRESSED) return decompress();
+		return true;
 	}
 
 
 	bool read(void* buffer, size_t size) override
 	{
-		if (m_device.m_offset != m_file.offset + m_local_offset)
+		if (m_local_offset + size > m_file.size) return false;
+
+		if (m_decompressed)
 		{
-			if (m_device.m_file.seek(FS::SeekMode::BEGIN, size_t(m_file.offset + m_local_offset)) !=
-				size_t(m_file.offset + m_local_offset))
-			{
-				return false;
-			}
+			copyMemory(buffer, m_decompressed + m_local_offset, size);
+			m_local_offset += size;
+			return true;
 		}
+
+		if (!m_device.read(m_file.offset + m_local_offset, buffer, size)) return false;
 		m_local_offset += size;
-		return m_device.m_file.read(buffer, size);
+		return true;
 	}
 
 
 	size_t seek(SeekMode base, size_t pos) override
 	{
-		m_local_offset = pos;
-		return m_device.m_file.seek(SeekMode::BEGIN, size_t(m_file.offset + pos));
+		switch (base)
+		{
+			case SeekMode::BEGIN: m_local_offset = pos; break;
+			case SeekMode::CURRENT: m_local_offset += pos; break;
+			case SeekMode::END: m_local_offset = (size_t)m_file.size - pos; break;
+			default: ASSERT(false); break;
+		}
+		return m_local_offset;
+	}
+
+
+	const void* getBuffer() const override
+	{
+		if (m_decompressed) return m_decompressed;
+		const uint8* data = m_device.m_mapping.getData();
+		return data ? data + m_file.offset : nullptr;
+	}
+
+
+	void close() override
+	{
+		m_allocator.deallocate(m_decompressed);
+		m_decompressed = nullptr;
+		m_local_offset = 0;
 	}
 
 
 	IFileDevice& getDevice() override { return m_device; }
-	void close() override { m_local_offset = 0; }
 	bool write(const void* buffer, size_t size) override { ASSERT(false); return false; }
-	const void* getBuffer() const override { return nullptr; }
 	size_t size() override { return (size_t)m_file.size; }
 	size_t pos() override { return m_local_offset; }
 
 private:
-	virtual ~PackFile() {}
+	virtual ~PackFile() { m_allocator.deallocate(m_decompressed); }
+
+
+	bool decompress()
+	{
+		PROFILE_FUNCTION();
+		size_t compressed_size = (size_t)m_file.compressed_size;
+		const uint8* src = m_device.m_mapping.getData();
+		uint8* tmp = nullptr;
+		if (src)
+		{
+			src += m_file.offset;
+		}
+		else
+		{
+			tmp = (uint8*)m_allocator.allocate(compressed_size);
+			if (!m_device.read(m_file.offset, tmp, compressed_size))
+			{
+				m_allocator.deallocate(tmp);
+				return false;
+			}
+			src = tmp;
+		}
 
-	PackFileDevice::PackFileInfo m_file;
+		m_decompressed = (uint8*)m_allocator.allocate((size_t)m_file.size);
+		bool success = decompressBlocks(src, compressed_size);
+		m_allocator.deallocate(tmp);
+		if (!success)
+		{
+			m_allocator.deallocate(m_decompressed);
+			m_decompressed = nullptr;
+		}
+		return success;
+	}
+
+
+	bool decompressBlocks(const uint8* src, size_t src_size)
+	{
+		uint32 blocks_count;
+		if (src_size < sizeof(blocks_count)) return false;
+		copyMemory(&blocks_count, src, sizeof(blocks_count));
+		size_t pos = sizeof(blocks_count) + blocks_count * sizeof(uint32);
+		if (pos > src_size) return false;
+
+		const uint32 block_size = m_device.m_block_size;
+		uint64 out_pos = 0;
+		for (uint32 i = 0; i < blocks_count; ++i)
+		{
+			uint32 stored_size;
+			copyMemory(&stored_size, src + sizeof(blocks_count) + i * sizeof(uint32), sizeof(stored_size));
+			if (pos + stored_size > src_size || out_pos >= m_file.size) return false;
+			int raw_size = (int)Math::minimum(uint64(block_size), m_file.size - out_pos);
+			if (stored_size == (uint32)raw_size)
+			{
+				copyMemory(m_decompressed + out_pos, src + pos, raw_size);
+			}
+			else if (LZ4::decompress(src + pos, stored_size, m_decompressed + out_pos, raw_size) != raw_size)
+			{
+				return false;
+			}
+			pos += stored_size;
+			out_pos += raw_size;
+		}
+		return out_pos == m_file.size;
+	}
+
+private:
+	PackFileDevice::Entry m_file;
 	PackFileDevice& m_device;
 	size_t m_local_offset;
+	uint8* m_decompressed;
 	IAllocator& m_allocator;
 }; // class PackFile
 
 
+#pragma pack(1)
+struct LegacyEntry
+{
+	uint32 hash;
+	uint64 offset;
+	uint64 size;
+};
+#pragma pack()
+
+
+static int compareEntries(const void* a, const void* b)
+{
+	uint32 hash_a = ((const PackFileDevice::Entry*)a)->hash;
+	uint32 hash_b = ((const PackFileDevice::Entry*)b)->hash;
+	if (hash_a < hash_b) return -1;
+	return hash_a > hash_b ? 1 : 0;
+}
+
+
 PackFileDevice::PackFileDevice(IAllocator& allocator)
-	: m_allocator(allocator)
-	, m_files(allocator)
+	: m_entries(nullptr)
+	, m_entries_count(0)
+	, m_block_size(DEFAULT_BLOCK_SIZE)
+	, m_index(allocator)
+	, m_offset(0)
+	, m_mutex(false)
+	, m_allocator(allocator)
 {
 }
 
@@ -81,24 +201,175 @@ PackFileDevice::PackFileDevice(IAllocator& allocator)
 PackFileDevice::~PackFileDevice()
 {
 	m_file.close();
+	m_mapping.close();
+}
+
+
+const PackFileDevice::Entry* PackFileDevice::find(uint32 hash) const
+{
+	int low = 0;
+	int high = m_entries_count;
+	while (low < high)
+	{
+		int mid = (low + high) >> 1;
+		if (m_entries[mid].hash < hash) low = mid + 1;
+		else high = mid;
+	}
+	if (low < m_entries_count && m_entries[low].hash == hash) return &m_entries[low];
+	return nullptr;
+}
+
+
+bool PackFileDevice::read(uint64 offset, void* buffer, size_t size)
+{
+	const uint8* data = m_mapping.getData();
+	if (data)
+	{
+		copyMemory(buffer, data + offset, size);
+		return true;
+	}
+
+	// files are opened and read from several I/O workers, the shared cursor must not move in between
+	MT::SpinLock lock(m_mutex);
+	if (m_offset != offset)
+	{
+		if (m_file.seek(FS::SeekMode::BEGIN, (size_t)offset) != offset)
+		{
+			m_offset = ~size_t(0);
+			return false;
+		}
+	}
+	m_offset = size_t(offset + size);
+	return m_file.read(buffer, size);
+}
+
+
+void PackFileDevice::parseLegacyIndex(const uint8* data, int count)
+{
+	m_index.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		LegacyEntry legacy;
+		copyMemory(&legacy, data + i * sizeof(legacy), sizeof(legacy));
+		Entry& entry = m_index[i];
+		entry.hash = legacy.hash;
+		entry.flags = 0;
+		entry.offset = legacy.offset;
+		entry.size = legacy.size;
+		entry.compressed_size = legacy.size;
+	}
+	if (count > 0) qsort(&m_index[0], count, sizeof(m_index[0]), compareEntries);
+	m_entries = m_index.empty() ? nullptr : &m_index[0];
+	m_entries_count = m_index.size();
+}
+
+
+bool PackFileDevice::mountMapped(const char* path)
+{
+	if (!m_mapping.open(path)) return false;
+
+	const uint8* data = m_mapping.getData();
+	size_t size = m_mapping.size();
+	FileHeader header;
+	if (size < sizeof(header)) return false;
+	copyMemory(&header, data, sizeof(header));
+	if (header.magic != FILE_MAGIC)
+	{
+		int32 count;
+		copyMemory(&count, data, sizeof(count));
+		if (count < 0 || sizeof(count) + count * sizeof(LegacyEntry) > size) return false;
+		parseLegacyIndex(data + sizeof(count), count);
+		for (int i = 0; i < m_entries_count; ++i)
+		{
+			if (m_entries[i].offset + m_entries[i].size > size) return false;
+		}
+		return true;
+	}
+	if (header.version > (uint32)FileVersion::LATEST)
+	{
+		g_log_error.log("Core") << "Unsupported version of pack file " << path;
+		return false;
+	}
+	if (header.block_size == 0) return false;
+
+	size_t index_end = sizeof(header) + header.entries_count * sizeof(Entry);
+	if (index_end > size) return false;
+
+	// the index is used directly from the mapping, it's sorted by the builder
+	m_entries = (const Entry*)(data + sizeof(header));
+	m_entries_count = header.entries_count;
+	m_block_size = header.block_size;
+	for (int i = 0; i < m_entries_count; ++i)
+	{
+		const Entry& entry = m_entries[i];
+		if (entry.offset + entry.compressed_size > size) return false;
+		if (i > 0 && m_entries[i - 1].hash >= entry.hash) return false;
+	}
+	return true;
 }
 
 
 bool PackFileDevice::mount(const char* path)
 {
 	m_file.close();
+	m_mapping.close();
+	m_index.clear();
+	m_entries = nullptr;
+	m_entries_count = 0;
+	m_block_size = DEFAULT_BLOCK_SIZE;
+
+	if (mountMapped(path)) return true;
+
+	m_mapping.close();
+	m_index.clear();
+	m_entries = nullptr;
+	m_entries_count = 0;
+	g_log_warning.log("Core") << "Could not map " << path << ", pack file is read through a single file";
+
 	if(!m_file.open(path, Mode::OPEN_AND_READ, m_allocator)) return false;
 
-	int32 count;
-	m_file.read(&count, sizeof(count));
-	for(int i = 0; i < count; ++i)
+	FileHeader header;
+	bool is_versioned = m_file.size() >= sizeof(header) && m_file.read(&header, sizeof(header)) &&
+						header.magic == FILE_MAGIC;
+	if (is_versioned)
+	{
+		if (header.version > (uint32)FileVersion::LATEST || header.block_size == 0)
+		{
+			m_file.close();
+			return false;
+		}
+		m_block_size = header.block_size;
+		m_index.resize(header.entries_count);
+		if (header.entries_count > 0 && !m_file.read(&m_index[0], sizeof(Entry) * header.entries_count))
+		{
+			m_file.close();
+			m_index.clear();
+			return false;
+		}
+	}
+	else
 	{
-		uint32 hash;
-		m_file.read(&hash, sizeof(hash));
-		PackFileInfo info;
-		m_file.read(&info, sizeof(info));
-		m_files.insert(hash, info);
+		int32 count;
+		m_file.seek(SeekMode::BEGIN, 0);
+		if (!m_file.read(&count, sizeof(count)) || count < 0)
+		{
+			m_file.close();
+			return false;
+		}
+		size_t index_size = count * sizeof(LegacyEntry);
+		uint8* tmp = (uint8*)m_allocator.allocate(index_size);
+		bool success = m_file.read(tmp, index_size);
+		if (success) parseLegacyIndex(tmp, count);
+		m_allocator.deallocate(tmp);
+		if (!success)
+		{
+			m_file.close();
+			return false;
+		}
 	}
+
+	m_entries = m_index.empty() ? nullptr : &m_index[0];
+	m_entries_count = m_index.size();
 	m_offset = m_file.pos();
 	return true;
 }
@@ -1,8 +1,9 @@
 #pragma once
 
+#include "engine/core/array.h"
 #include "engine/core/fs/ifile_device.h"
 #include "engine/core/fs/os_file.h"
-#include "engine/core/hash_map.h"
+#include "engine/core/mt/sync.h"
 #include "engine/lumix.h"
 
 
@@ -18,6 +19,42 @@ class IFile;
 class LUMIX_ENGINE_API PackFileDevice : public IFileDevice
 {
 	friend class PackFile;
+public:
+	static const uint32 FILE_MAGIC = 0x5f4c504b; // == '_LPK'
+	static const uint32 DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+	enum class FileVersion : uint32
+	{
+		FIRST,
+
+		LATEST // keep this last
+	};
+
+	// header is followed by Entry[entries_count] sorted by hash and by the data of the entries
+	struct FileHeader
+	{
+		uint32 magic;
+		uint32 version;
+		uint32 entries_count;
+		uint32 block_size;
+	};
+
+	// compressed entry starts with uint32 blocks count and uint32 size of each block,
+	// followed by LZ4 blocks of block_size bytes, block is stored raw if it has the full size
+	struct Entry
+	{
+		enum Flags : uint32
+		{
+			COMPRESSED = 1 << 0
+		};
+
+		uint32 hash;
+		uint32 flags;
+		uint64 offset;
+		uint64 size;
+		uint64 compressed_size;
+	};
+
 public:
 	PackFileDevice(IAllocator& allocator);
 	~PackFileDevice();
@@ -28,15 +65,22 @@ public:
 	bool mount(const char* path);
 
 private:
-	struct PackFileInfo
-	{
-		uint64 offset;
-		uint64 size;
-	};
+	bool mountMapped(const char* path);
+	void parseLegacyIndex(const uint8* data, int count);
+	const Entry* find(uint32 hash) const;
+	bool read(uint64 offset, void* buffer, size_t size);
 
-	HashMap<uint32, PackFileInfo> m_files;
+private:
+	// points to the mapped file or to m_index
+	const Entry* m_entries;
+	int m_entries_count;
+	uint32 m_block_size;
+	Array<Entry> m_index;
+	OsFileMapping m_mapping;
+	// m_file and m_offset are used only when the pack file can not be mapped
 	size_t m_offset;
 	OsFile m_file;
+	MT::SpinMutex m_mutex;
 	IAllocator& m_allocator;
 };
 
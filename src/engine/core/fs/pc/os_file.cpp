@@ -182,5 +182,64 @@ void OsFile::writeEOF()
 }
 
 
+OsFileMapping::OsFileMapping()
+	: m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+	, m_data(nullptr)
+	, m_size(0)
+{
+}
+
+
+OsFileMapping::~OsFileMapping()
+{
+	close();
+}
+
+
+bool OsFileMapping::open(const char* path)
+{
+	close();
+	m_file = ::CreateFile(
+		path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(m_file, &size) || size.QuadPart == 0 || (uint64)size.QuadPart > (size_t)~size_t(0))
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = ::CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping)
+	{
+		close();
+		return false;
+	}
+
+	m_data = (const uint8*)::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	return true;
+}
+
+
+void OsFileMapping::close()
+{
+	if (m_data) ::UnmapViewOfFile(m_data);
+	if (m_mapping) ::CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) ::CloseHandle(m_file);
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+	m_size = 0;
+}
+
+
 } // namespace FS
 } // namespace Lumix
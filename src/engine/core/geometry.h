@@ -167,6 +167,34 @@ public:
 		return true;
 	}
 
+
+	bool intersectAABB(const Vec3& min, const Vec3& max) const
+	{
+		for (const Plane& plane : planes)
+		{
+			// the corner farthest along the plane's normal
+			float x = plane.normal.x > 0 ? max.x : min.x;
+			float y = plane.normal.y > 0 ? max.y : min.y;
+			float z = plane.normal.z > 0 ? max.z : min.z;
+			if (x * plane.normal.x + y * plane.normal.y + z * plane.normal.z + plane.d < 0) return false;
+		}
+		return true;
+	}
+
+
+	bool isAABBInside(const Vec3& min, const Vec3& max) const
+	{
+		for (const Plane& plane : planes)
+		{
+			// the corner nearest along the plane's normal
+			float x = plane.normal.x > 0 ? min.x : max.x;
+			float y = plane.normal.y > 0 ? min.y : max.y;
+			float z = plane.normal.z > 0 ? min.z : max.z;
+			if (x * plane.normal.x + y * plane.normal.y + z * plane.normal.z + plane.d < 0) return false;
+		}
+		return true;
+	}
+
 	enum class Sides : uint32
 	{
 		NEAR_PLANE,
@@ -0,0 +1,209 @@
+#include "engine/core/lz4.h"
+#include "engine/core/string.h"
+
+
+namespace Lumix
+{
+namespace LZ4
+{
+
+
+static const int MIN_MATCH = 4;
+static const int LAST_LITERALS = 5;
+static const int MF_LIMIT = 12;
+static const int MAX_DISTANCE = 0xffff;
+static const int HASH_LOG = 12;
+static const int SKIP_TRIGGER = 6;
+
+
+static uint32 read32(const uint8* ptr)
+{
+	uint32 value;
+	copyMemory(&value, ptr, sizeof(value));
+	return value;
+}
+
+
+static uint32 hash(uint32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+
+static uint8* writeLength(uint8* op, int length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (uint8)length;
+	return op;
+}
+
+
+int getMaxCompressedSize(int src_size)
+{
+	return src_size + src_size / 255 + 16;
+}
+
+
+static uint8* writeLiterals(uint8* op, const uint8* oend, uint8* token, const uint8* literals, int count)
+{
+	if (op + count + count / 255 + 1 > oend) return nullptr;
+	if (count >= 15)
+	{
+		*token = 15 << 4;
+		op = writeLength(op, count - 15);
+	}
+	else
+	{
+		*token = uint8(count << 4);
+	}
+	copyMemory(op, literals, count);
+	return op + count;
+}
+
+
+int compress(const void* src, int src_size, void* dst, int dst_capacity)
+{
+	const uint8* ip = (const uint8*)src;
+	const uint8* base = ip;
+	const uint8* anchor = ip;
+	const uint8* iend = ip + src_size;
+	uint8* op = (uint8*)dst;
+	const uint8* oend = op + dst_capacity;
+
+	if (src_size >= MF_LIMIT + 1)
+	{
+		int32 table[1 << HASH_LOG];
+		setMemory(table, 0, sizeof(table));
+		const uint8* match_limit = iend - MF_LIMIT;
+		const uint8* match_end_limit = iend - LAST_LITERALS;
+		int misses = 1 << SKIP_TRIGGER;
+
+		while (ip < match_limit)
+		{
+			uint32 sequence = read32(ip);
+			uint32 h = hash(sequence);
+			const uint8* ref = base + table[h];
+			table[h] = int32(ip - base);
+
+			if (ref >= ip || ip - ref > MAX_DISTANCE || read32(ref) != sequence)
+			{
+				// step faster through data which does not compress
+				ip += misses++ >> SKIP_TRIGGER;
+				continue;
+			}
+			misses = 1 << SKIP_TRIGGER;
+
+			while (ip > anchor && ref > base && ip[-1] == ref[-1])
+			{
+				--ip;
+				--ref;
+			}
+
+			const uint8* match_end = ip + MIN_MATCH;
+			const uint8* ref_end = ref + MIN_MATCH;
+			while (match_end < match_end_limit && *match_end == *ref_end)
+			{
+				++match_end;
+				++ref_end;
+			}
+
+			if (op >= oend) return 0;
+			uint8* token = op++;
+			op = writeLiterals(op, oend, token, anchor, int(ip - anchor));
+			if (!op) return 0;
+
+			int offset = int(ip - ref);
+			int match_length = int(match_end - ip) - MIN_MATCH;
+			if (op + 2 + match_length / 255 + 1 > oend) return 0;
+			*op++ = uint8(offset);
+			*op++ = uint8(offset >> 8);
+			if (match_length >= 15)
+			{
+				*token |= 15;
+				op = writeLength(op, match_length - 15);
+			}
+			else
+			{
+				*token |= uint8(match_length);
+			}
+
+			ip = match_end;
+			anchor = ip;
+			if (ip - 2 >= base) table[hash(read32(ip - 2))] = int32(ip - 2 - base);
+		}
+	}
+
+	if (op >= oend) return 0;
+	uint8* token = op++;
+	op = writeLiterals(op, oend, token, anchor, int(iend - anchor));
+	if (!op) return 0;
+	return int(op - (uint8*)dst);
+}
+
+
+static bool readLength(const uint8*& ip, const uint8* iend, int& length)
+{
+	uint8 b;
+	do
+	{
+		if (ip >= iend) return false;
+		b = *ip++;
+		length += b;
+	} while (b == 255);
+	return true;
+}
+
+
+int decompress(const void* src, int src_size, void* dst, int dst_capacity)
+{
+	const uint8* ip = (const uint8*)src;
+	const uint8* iend = ip + src_size;
+	uint8* op = (uint8*)dst;
+	uint8* oend = op + dst_capacity;
+
+	while (ip < iend)
+	{
+		uint8 token = *ip++;
+
+		int literals = token >> 4;
+		if (literals == 15 && !readLength(ip, iend, literals)) return -1;
+		if (literals > iend - ip || literals > oend - op) return -1;
+		copyMemory(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		// the last sequence contains only literals
+		if (ip == iend) break;
+
+		if (iend - ip < 2) return -1;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op - (uint8*)dst) return -1;
+
+		int match_length = token & 15;
+		if (match_length == 15 && !readLength(ip, iend, match_length)) return -1;
+		match_length += MIN_MATCH;
+		if (match_length > oend - op) return -1;
+
+		const uint8* ref = op - offset;
+		if (offset >= match_length)
+		{
+			copyMemory(op, ref, match_length);
+			op += match_length;
+		}
+		else
+		{
+			// overlapping match repeats the last offset bytes
+			for (int i = 0; i < match_length; ++i) *op++ = *ref++;
+		}
+	}
+	return int(op - (uint8*)dst);
+}
+
+
+} // namespace LZ4
+} // namespace Lumix
@@ -0,0 +1,26 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// LZ4 block format (no frame header), compatible with the reference implementation
+namespace LZ4
+{
+
+
+LUMIX_ENGINE_API int getMaxCompressedSize(int src_size);
+// returns the number of bytes written to dst, 0 if dst is too small
+LUMIX_ENGINE_API int compress(const void* src, int src_size, void* dst, int dst_capacity);
+// returns the number of bytes written to dst, -1 if src is malformed or does not fit in dst
+LUMIX_ENGINE_API int decompress(const void* src, int src_size, void* dst, int dst_capacity);
+
+
+} // namespace LZ4
+
+
+} // namespace Lumix
@@ -2,14 +2,16 @@
 #include "engine/core/mtjd/base_entry.h"
 
 #include "engine/core/mtjd/manager.h"
+#include "engine/core/mt/sync.h"
 
 namespace Lumix
 {
 	namespace MTJD
 	{
-		BaseEntry::BaseEntry(int32 depend_count, bool sync_event, IAllocator& allocator)
+		BaseEntry::BaseEntry(int32 depend_count, bool sync_event, Manager& manager, IAllocator& allocator)
 			: m_dependency_count(depend_count)
 			, m_allocator(allocator)
+			, m_manager(manager)
 			, m_dependency_table(m_allocator)
 		{
 #if TYPE == MULTI_THREAD
@@ -48,7 +50,15 @@ namespace Lumix
 #if TYPE == MULTI_THREAD
 
 			ASSERT(nullptr != m_sync_event);
-			m_sync_event->wait();
+			while (!m_sync_event->poll())
+			{
+				if (!m_manager.runPendingJob())
+				{
+					// the rest is already running on workers
+					m_sync_event->wait();
+					break;
+				}
+			}
 
 #endif //TYPE == MULTI_THREAD
 		}
@@ -7,8 +7,8 @@ namespace Lumix
 {
 	namespace MTJD
 	{
-		Group::Group(bool sync_event, IAllocator& allocator)
-			: BaseEntry(0, sync_event, allocator)
+		Group::Group(Manager& manager, bool sync_event, IAllocator& allocator)
+			: BaseEntry(0, sync_event, manager, allocator)
 			, m_static_dependency_table(allocator)
 		{
 		}
@@ -84,13 +84,14 @@ namespace Lumix
 		{
 #if TYPE == MULTI_THREAD
 
-			BaseEntry::dependencyReady();
-
 			for (uint32 i = 0, c = m_static_dependency_table.size(); c > i; ++i)
 			{
 				m_static_dependency_table[i]->decrementDependency();
 			}
 
+			// the group can be destroyed by a waiting thread as soon as this triggers the sync event
+			BaseEntry::dependencyReady();
+
 #endif //TYPE == MULTI_THREAD
 		}
 	} // namepsace MTJD
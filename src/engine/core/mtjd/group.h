@@ -9,7 +9,7 @@ namespace Lumix
 		class LUMIX_ENGINE_API Group : public BaseEntry
 		{
 		public:
-			Group(bool sync_event, IAllocator& allocator);
+			Group(Manager& manager, bool sync_event, IAllocator& allocator);
 			~Group();
 
 			void addStaticDependency(BaseEntry* entry);
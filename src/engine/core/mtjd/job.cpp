@@ -2,6 +2,7 @@
 #include "engine/core/mtjd/job.h"
 
 #include "engine/core/mtjd/manager.h"
+#include "engine/core/mt/atomic.h"
 
 namespace Lumix
 {
@@ -12,8 +13,7 @@ Job::Job(int flags,
 	Manager& manager,
 	IAllocator& allocator,
 	IAllocator& job_allocator)
-	: BaseEntry(1, (flags & SYNC_EVENT) != 0, allocator)
-	, m_manager(manager)
+	: BaseEntry(1, (flags & SYNC_EVENT) != 0, manager, allocator)
 	, m_priority(priority)
 	, m_auto_destroy((flags & AUTO_DESTROY) != 0)
 	, m_scheduled(false)
@@ -41,7 +41,6 @@ protected:
 
 	IAllocator& m_job_allocator;
 
-	Manager& m_manager;
 	Priority m_priority;
 	bool m_auto_destroy;
 	bool m_scheduled;
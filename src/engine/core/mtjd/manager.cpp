@@ -2,9 +2,10 @@
 #include "engine/core/mtjd/manager.h"
 
 #include "engine/core/mtjd/job.h"
-#include "engine/core/mtjd/scheduler.h"
 #include "engine/core/mtjd/worker_thread.h"
 
+#include "engine/core/mt/atomic.h"
+#include "engine/core/mt/sync.h"
 #include "engine/core/mt/thread.h"
 
 namespace Lumix
@@ -13,30 +14,28 @@ namespace MTJD
 {
 
 
-struct ManagerImpl : public Manager
-{
-	typedef MT::LockFreeFixedQueue<Job*, 512>	JobsTable;
-	typedef Array<JobTrans*>					TransTable;
+static const int MAX_SEMAPHORE_COUNT = 0x7fffFFFF;
 
 
+struct ManagerImpl : public Manager
+{
 	ManagerImpl(IAllocator& allocator)
-		: m_scheduling_counter(0)
-		, m_scheduler(*this, allocator)
+		: m_allocator(allocator)
 		, m_worker_tasks(allocator)
-		, m_allocator(allocator)
-		, m_pending_trans(allocator)
+		, m_semaphore(0, MAX_SEMAPHORE_COUNT)
+		, m_next_worker(0)
 	{
 #if TYPE == MULTI_THREAD
 		uint32 threads_num = getCpuThreadsCount();
 
-		m_scheduler.create("MTJD::Scheduler");
-		m_scheduler.run();
-
 		m_worker_tasks.reserve(threads_num);
 		for (uint32 i = 0; i < threads_num; ++i)
 		{
-			m_worker_tasks.push(LUMIX_NEW(m_allocator, WorkerTask)(m_allocator));
-			m_worker_tasks[i]->create("MTJD::WorkerTask", this, &m_trans_queue);
+			m_worker_tasks.push(LUMIX_NEW(m_allocator, WorkerTask)(m_worker_tasks, i, m_semaphore, m_allocator));
+		}
+		for (uint32 i = 0; i < threads_num; ++i)
+		{
+			m_worker_tasks[i]->create("MTJD::WorkerTask");
 			m_worker_tasks[i]->setAffinityMask(getAffinityMask(i));
 			m_worker_tasks[i]->run();
 		}
@@ -51,7 +50,11 @@ struct ManagerImpl : public Manager
 		uint32 threads_num = getCpuThreadsCount();
 		for (uint32 i = 0; i < threads_num; ++i)
 		{
-			m_trans_queue.abort();
+			m_worker_tasks[i]->forceExit(false);
+		}
+		for (uint32 i = 0; i < threads_num; ++i)
+		{
+			m_semaphore.signal();
 		}
 
 		for (uint32 i = 0; i < threads_num; ++i)
@@ -60,10 +63,6 @@ struct ManagerImpl : public Manager
 			LUMIX_DELETE(m_allocator, m_worker_tasks[i]);
 		}
 
-		m_scheduler.forceExit(false);
-		m_scheduler.dataSignal();
-		m_scheduler.destroy();
-
 #endif // TYPE == MULTI_THREAD
 	}
 
@@ -81,6 +80,9 @@ struct ManagerImpl : public Manager
 	}
 
 
+	IAllocator& getAllocator() override { return m_allocator; }
+
+
 	void schedule(Job* job) override
 	{
 		ASSERT(job);
@@ -93,9 +95,14 @@ struct ManagerImpl : public Manager
 		{
 			job->m_scheduled = true;
 
-			pushReadyJob(job);
-
-			m_scheduler.dataSignal();
+			// jobs spawned by a worker stay on its deque, others are spread between workers
+			int worker = getCurrentWorker();
+			if (worker < 0)
+			{
+				worker = (uint32)MT::atomicIncrement(&m_next_worker) % (uint32)m_worker_tasks.size();
+			}
+			m_worker_tasks[worker]->getDeque().push(job);
+			m_semaphore.signal();
 		}
 
 #else // TYPE == MULTI_THREAD
@@ -106,111 +113,47 @@ struct ManagerImpl : public Manager
 #endif // TYPE == MULTI_THREAD
 	}
 
-	void scheduleCpu(Job* job)
-	{
-		JobTrans* tr = m_trans_queue.alloc(false);
-		if (tr)
-		{
-			tr->data = job;
-			if (!m_trans_queue.push(tr, false))
-			{
-				m_trans_queue.dealoc(tr);
-				pushReadyJob(job);
-			}
-			else
-			{
-				m_pending_trans.push(tr);
-			}
-		}
-	}
 
-	void doScheduling()
+	bool runPendingJob() override
 	{
 #if TYPE == MULTI_THREAD
 
-		uint32 count = MT::atomicIncrement(&m_scheduling_counter);
-		if (1 == count)
-		{
-			do
-			{
-				for (int i = 0; i < m_pending_trans.size();)
-				{
-					JobTrans* tr = m_pending_trans[i];
-					if (tr->isCompleted())
-					{
-						tr->data->onExecuted();
-						m_trans_queue.dealoc(tr);
-						m_pending_trans.eraseFast(i);
-					}
-					else
-					{
-						++i;
-					}
-				}
-
-				Job* job = getNextReadyJob();
-				if (job)
-				{
-					scheduleCpu(job);
-				}
-
-				count = MT::atomicDecrement(&m_scheduling_counter);
-			} while (0 < count);
-		}
-
-#endif // TYPE == MULTI_THREAD
-	}
+		int worker = getCurrentWorker();
+		Job* job = worker >= 0 ? m_worker_tasks[worker]->getDeque().pop() : nullptr;
+		if (!job) job = WorkerTask::stealJob(m_worker_tasks, worker + 1);
+		if (!job) return false;
 
-	Job* getNextReadyJob()
-	{
-#if TYPE == MULTI_THREAD
+		WorkerTask::runJob(job);
+		return true;
 
-		for (int32 i = 0; i < (int32)Priority::Count; ++i)
-		{
-			if (!m_ready_to_execute[i].isEmpty())
-			{
-				Job** entry = m_ready_to_execute[i].pop(true);
-				Job* ret = *entry;
-				m_ready_to_execute[i].dealoc(entry);
+#else // TYPE == MULTI_THREAD
 
-				return ret;
-			}
-		}
+		return false;
 
 #endif // TYPE == MULTI_THREAD
-
-		return nullptr;
 	}
 
-	void pushReadyJob(Job* job)
-	{
-		ASSERT(job);
-
-#if TYPE == MULTI_THREAD
 
-		Job** jobEntry = m_ready_to_execute[(int32)job->getPriority()].alloc(true);
-		if (jobEntry)
+	int getCurrentWorker() const
+	{
+		uint32 thread_id = MT::getCurrentThreadID();
+		for (int i = 0, c = m_worker_tasks.size(); i < c; ++i)
 		{
-			*jobEntry = job;
-			m_ready_to_execute[(int32)job->getPriority()].push(jobEntry, true);
+			if (m_worker_tasks[i]->getThreadID() == thread_id) return i;
 		}
-
-#endif // TYPE == MULTI_THREAD
+		return -1;
 	}
 
+
 	uint32 getAffinityMask(uint32) const
 	{
 		return MT::getProccessAffinityMask();
 	}
 
 	IAllocator&			m_allocator;
-	JobsTable			m_ready_to_execute[(size_t)Priority::Count];
-	JobTransQueue		m_trans_queue;
-	TransTable			m_pending_trans;
 	Array<WorkerTask*>	m_worker_tasks;
-	Scheduler			m_scheduler;
-
-	volatile int32 m_scheduling_counter;
+	MT::Semaphore		m_semaphore;
+	volatile int32		m_next_worker;
 
 
 }; // struct ManagerImpl
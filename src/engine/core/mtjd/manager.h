@@ -6,12 +6,14 @@
 
 #define TYPE MULTI_THREAD
 
-#include "engine/core/mt/lock_free_fixed_queue.h"
-#include "engine/core/mt/transaction.h"
+#include "engine/lumix.h"
 
 
 namespace Lumix
 {
+
+class IAllocator;
+
 namespace MTJD
 {
 
@@ -22,18 +24,16 @@ class WorkerTask;
 
 class LUMIX_ENGINE_API Manager
 {
-	friend class Scheduler;
 	friend class WorkerTask;
 
 public:
-	typedef MT::Transaction<Job*> JobTrans;
-	typedef MT::LockFreeFixedQueue<JobTrans, 32> JobTransQueue;
-
 	virtual ~Manager() {}
 
 	virtual uint32 getCpuThreadsCount() const = 0;
 	virtual void schedule(Job* job) = 0;
-	virtual void doScheduling() = 0;
+	// executes one ready job on the calling thread, returns false if there is none
+	virtual bool runPendingJob() = 0;
+	virtual IAllocator& getAllocator() = 0;
 
 	static Manager* create(IAllocator& allocator);
 	static void destroy(Manager& manager);
@@ -0,0 +1,64 @@
+#pragma once
+
+
+#include "engine/core/mt/atomic.h"
+#include "engine/core/mtjd/generic_job.h"
+#include "engine/core/mtjd/group.h"
+
+
+namespace Lumix
+{
+
+
+namespace MTJD
+{
+
+
+// calls fn(from, to) for chunks of at most grain items covering [begin, end),
+// chunks are claimed by the worker jobs and by the calling thread, returns when all are done
+template <class T> void parallelFor(Manager& manager, int begin, int end, int grain, T fn)
+{
+	if (end <= begin) return;
+	if (grain < 1) grain = 1;
+
+	int chunks_count = (end - begin + grain - 1) / grain;
+	if (chunks_count == 1)
+	{
+		fn(begin, end);
+		return;
+	}
+
+	volatile int32 next = begin;
+	auto process = [&next, end, grain, &fn]()
+	{
+		for (;;)
+		{
+			int from = MT::atomicAdd(&next, grain);
+			if (from >= end) return;
+			fn(from, from + grain < end ? from + grain : end);
+		}
+	};
+
+	IAllocator& allocator = manager.getAllocator();
+	Group sync_point(manager, true, allocator);
+	// keeps the group from being signaled before all the jobs are scheduled
+	sync_point.incrementDependency();
+	int jobs_count = (int)manager.getCpuThreadsCount();
+	if (jobs_count > chunks_count - 1) jobs_count = chunks_count - 1;
+	for (int i = 0; i < jobs_count; ++i)
+	{
+		Job* job = makeJob(manager, process, allocator);
+		job->addDependency(&sync_point);
+		manager.schedule(job);
+	}
+	sync_point.decrementDependency();
+
+	process();
+	sync_point.sync();
+}
+
+
+} // namespace MTJD
+
+
+} // namespace Lumix
@@ -1,20 +1,87 @@
 #include "engine/lumix.h"
 #include "engine/core/mtjd/worker_thread.h"
 
-#include "engine/core/mtjd/manager.h"
+#include "engine/core/mt/thread.h"
 #include "engine/core/mtjd/job.h"
-
-#define PROFILE_START
-#define PROFILE_STOP
+#include "engine/core/mtjd/manager.h"
+#include "engine/core/profiler.h"
 
 namespace Lumix
 {
 	namespace MTJD
 	{
+		static const int INITIAL_DEQUE_CAPACITY = 64;
+
+
+		JobDeque::JobDeque(IAllocator& allocator)
+			: m_allocator(allocator)
+			, m_mutex(false)
+			, m_capacity(INITIAL_DEQUE_CAPACITY)
+			, m_front(0)
+			, m_back(0)
+		{
+			m_jobs = (Job**)m_allocator.allocate(sizeof(Job*) * m_capacity);
+		}
+
+
+		JobDeque::~JobDeque()
+		{
+			m_allocator.deallocate(m_jobs);
+		}
+
+
+		void JobDeque::push(Job* job)
+		{
+			MT::SpinLock lock(m_mutex);
+			if (m_back - m_front == m_capacity)
+			{
+				Job** jobs = (Job**)m_allocator.allocate(sizeof(Job*) * m_capacity * 2);
+				for (int i = m_front; i < m_back; ++i)
+				{
+					jobs[i - m_front] = m_jobs[i & (m_capacity - 1)];
+				}
+				m_allocator.deallocate(m_jobs);
+				m_jobs = jobs;
+				m_back -= m_front;
+				m_front = 0;
+				m_capacity *= 2;
+			}
+			m_jobs[m_back & (m_capacity - 1)] = job;
+			++m_back;
+		}
+
+
+		Job* JobDeque::pop()
+		{
+			MT::SpinLock lock(m_mutex);
+			if (m_back == m_front) return nullptr;
+			--m_back;
+			return m_jobs[m_back & (m_capacity - 1)];
+		}
+
+
+		Job* JobDeque::steal()
+		{
+			MT::SpinLock lock(m_mutex);
+			if (m_back == m_front) return nullptr;
+			Job* job = m_jobs[m_front & (m_capacity - 1)];
+			++m_front;
+			return job;
+		}
+
+
 #if TYPE == MULTI_THREAD
 
-		WorkerTask::WorkerTask(IAllocator& allocator)
+		WorkerTask::WorkerTask(Array<WorkerTask*>& workers,
+			int index,
+			MT::Semaphore& semaphore,
+			IAllocator& allocator)
 			: Task(allocator)
+			, m_workers(workers)
+			, m_semaphore(semaphore)
+			, m_deque(allocator)
+			, m_index(index)
+			, m_thread_id(0)
 		{
 		}
 
@@ -22,35 +89,38 @@ namespace Lumix
 		{
 		}
 
-		bool WorkerTask::create(const char* name, Manager* manager, Manager::JobTransQueue* trans_queue)
+		Job* WorkerTask::stealJob(Array<WorkerTask*>& workers, int first_worker)
 		{
-			ASSERT(manager);
-			ASSERT(trans_queue);
-
-			m_manager = manager;
-			m_trans_queue = trans_queue;
+			for (int i = 0, c = workers.size(); i < c; ++i)
+			{
+				Job* job = workers[(first_worker + i) % c]->m_deque.steal();
+				if (job) return job;
+			}
+			return nullptr;
+		}
 
-			return Task::create(name);
+		void WorkerTask::runJob(Job* job)
+		{
+			PROFILE_BLOCK(job->getJobName());
+			job->execute();
+			job->onExecuted();
 		}
 
 		int WorkerTask::task()
 		{
-			ASSERT(m_trans_queue);
-
-			while (!m_trans_queue->isAborted())
+			m_thread_id = MT::getCurrentThreadID();
+			while (!isForceExit())
 			{
-				Manager::JobTrans* tr = m_trans_queue->pop(true);
-				if (!tr)
-					break;
-
-				PROFILE_START("WorkerTask");
-				PROFILE_START(tr->data->getJobName());
-				tr->data->execute();
-				tr->setCompleted();
-				PROFILE_STOP(tr->data->getJobName());
-				PROFILE_STOP("WorkerTask");
-
-				m_manager->doScheduling();
+				Job* job = m_deque.pop();
+				if (!job) job = stealJob(m_workers, m_index + 1);
+				if (job)
+				{
+					runJob(job);
+					continue;
+				}
+
+				// every scheduled job signals the semaphore, so no job can be missed while sleeping
+				m_semaphore.wait();
 			}
 
 			return 0;
@@ -1,10 +1,10 @@
 #pragma once
 
 
+#include "engine/core/array.h"
+#include "engine/core/mt/sync.h"
 #include "engine/core/mt/task.h"
-#include "engine/core/mt/lock_free_fixed_queue.h"
 
-#include "engine/core/mtjd/manager.h"
 
 namespace Lumix
 {
@@ -12,19 +12,51 @@ namespace Lumix
 
 	namespace MTJD
 	{
+		class Job;
+
+
+		// ring of jobs, the owner works at the back and other threads steal from the front
+		class JobDeque
+		{
+		public:
+			explicit JobDeque(IAllocator& allocator);
+			~JobDeque();
+
+			void push(Job* job);
+			Job* pop();
+			Job* steal();
+
+		private:
+			IAllocator& m_allocator;
+			MT::SpinMutex m_mutex;
+			Job** m_jobs;
+			int m_capacity;
+			int m_front;
+			int m_back;
+		};
+
+
 		class WorkerTask : public MT::Task
 		{
 		public:
-			WorkerTask(IAllocator& allocator);
+			WorkerTask(Array<WorkerTask*>& workers, int index, MT::Semaphore& semaphore, IAllocator& allocator);
 			~WorkerTask();
 
-			bool create(const char* name, Manager* manager, Manager::JobTransQueue* trans_queue);
+			int task() override;
+
+			JobDeque& getDeque() { return m_deque; }
+			uint32 getThreadID() const { return m_thread_id; }
 
-			virtual int task();
+			// steals from the workers starting with first_worker
+			static Job* stealJob(Array<WorkerTask*>& workers, int first_worker);
+			static void runJob(Job* job);
 
 		private:
-			Manager::JobTransQueue*	m_trans_queue;
-			Manager* m_manager;
+			Array<WorkerTask*>& m_workers;
+			MT::Semaphore& m_semaphore;
+			JobDeque m_deque;
+			int m_index;
+			volatile uint32 m_thread_id;
 		};
 	} // namepsace MTJD
 } // namepsace Lumix
@@ -39,9 +39,12 @@
 #define STATUS_WAIT_0 ((DWORD)0x00000000L)
 #define WAIT_OBJECT_0 ((STATUS_WAIT_0) + 0)
 #define CREATE_SUSPENDED 0x00000004
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
 #define EXCEPTION_EXECUTE_HANDLER 1
 #define GetFileAttributes  GetFileAttributesA
 #define CreateFile CreateFileA
+#define CreateFileMapping CreateFileMappingA
 #define CreateSemaphore CreateSemaphoreA
 #define CreateMutex CreateMutexA
 #define CreateEvent CreateEventA
@@ -491,6 +494,19 @@ WINBASEAPI DWORD WINAPI SetFilePointer(HANDLE hFile,
 	PLONG lpDistanceToMoveHigh,
 	DWORD dwMoveMethod);
 WINBASEAPI BOOL WINAPI SetEndOfFile(HANDLE hFile);
+WINBASEAPI BOOL WINAPI GetFileSizeEx(HANDLE hFile, LARGE_INTEGER* lpFileSize);
+WINBASEAPI HANDLE WINAPI CreateFileMappingA(HANDLE hFile,
+	LPSECURITY_ATTRIBUTES lpFileMappingAttributes,
+	DWORD flProtect,
+	DWORD dwMaximumSizeHigh,
+	DWORD dwMaximumSizeLow,
+	LPCSTR lpName);
+WINBASEAPI LPVOID WINAPI MapViewOfFile(HANDLE hFileMappingObject,
+	DWORD dwDesiredAccess,
+	DWORD dwFileOffsetHigh,
+	DWORD dwFileOffsetLow,
+	SIZE_T dwNumberOfBytesToMap);
+WINBASEAPI BOOL WINAPI UnmapViewOfFile(LPCVOID lpBaseAddress);
 WINBASEAPI HANDLE WINAPI CreateSemaphoreA(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes,
 	LONG lInitialCount,
 	LONG lMaximumCount,
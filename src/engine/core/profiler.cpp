@@ -1,7 +1,11 @@
 #include "profiler.h"
+#include "engine/core/array.h"
+#include "engine/core/fs/os_file.h"
 #include "engine/core/hash_map.h"
 #include "engine/core/log.h"
+#include "engine/core/string.h"
 #include "engine/core/timer.h"
+#include "engine/core/mt/atomic.h"
 #include "engine/core/mt/sync.h"
 #include "engine/core/mt/thread.h"
 
@@ -120,29 +124,94 @@ int getBlockHitCount(Block* block)
 }
 
 
+// fixed size ring per thread, written without locks by the owner thread and read by frame()
+static const int EVENTS_COUNT = 1 << 14;
+// only ends and records can use the last events, so every written begin can be ended
+static const uint32 RESERVED_EVENTS_COUNT = 256;
+
+
+struct Event
+{
+	enum Type : uint8
+	{
+		BEGIN,
+		END,
+		INT,
+		FLOAT
+	};
+
+	uint64 time;
+	const char* name;
+	union
+	{
+		float float_value;
+		int int_value;
+	} value;
+	Type type;
+};
+
+
 struct ThreadData
 {
 	ThreadData() 
 	{
 		root_block = current_block = nullptr;
 		name[0] = '\0';
+		read = write = 0;
+		skipped_depth = 0;
 	}
 
+	Event events[EVENTS_COUNT];
+	// incremented by the owner thread after the event is written
+	volatile uint32 write;
+	// incremented by frame() after the events are added to the blocks
+	volatile uint32 read;
+	// begins which did not fit in the ring, their ends are skipped too, used only by the owner thread
+	int skipped_depth;
+	// the blocks are built only from the events, in frame()
 	Block* root_block;
 	Block* current_block;
 	char name[30];
 };
 
 
+// events of all threads processed in one frame(), kept for the trace export
+struct CaptureFrame
+{
+	struct ThreadEvent
+	{
+		Event event;
+		uint32 thread_id;
+	};
+
+
+	explicit CaptureFrame(IAllocator& allocator)
+		: events(allocator)
+		, is_valid(false)
+	{
+	}
+
+
+	Array<ThreadEvent> events;
+	bool is_valid;
+};
+
+
 struct Instance
 {
 	Instance()
 		: threads(allocator)
 		, frame_listeners(allocator)
+		, capture_frames(allocator)
 		, m_mutex(false)
 	{
 		threads.insert(MT::getCurrentThreadID(), &main_thread);
 		timer = Timer::create(allocator);
+		capture_frame_index = 0;
+		frame_index = 0;
+		frame_start = 0;
+		hitch_threshold = 0;
+		hitch_path[0] = '\0';
 	}
 
 
@@ -153,6 +222,10 @@ struct Instance
 		{
 			if (i != &main_thread) LUMIX_DELETE(allocator, i);
 		}
+		for (auto* i : capture_frames)
+		{
+			LUMIX_DELETE(allocator, i);
+		}
 	}
 
 
@@ -161,6 +234,15 @@ struct Instance
 	HashMap<uint32, ThreadData*> threads;
 	ThreadData main_thread;
 	Timer* timer;
+	// ring of the last frames, capture_frame_index is the oldest one
+	Array<CaptureFrame*> capture_frames;
+	int capture_frame_index;
+	uint32 frame_index;
+	uint64 frame_start;
+	// in seconds, longer frames save the capture to hitch_path
+	float hitch_threshold;
+	char hitch_path[MAX_PATH_LENGTH];
+	// guards the threads map, the blocks and the capture, not taken when events are written
 	MT::SpinMutex m_mutex;
 };
 
@@ -179,103 +261,171 @@ float getBlockLength(Block* block)
 }
 
 
-struct BlockInfo
+static ThreadData& getThreadData()
 {
-	Block* block;
-	ThreadData* thread_data;
-};
+	static LUMIX_THREAD_LOCAL ThreadData* thread_data = nullptr;
+	if (thread_data) return *thread_data;
 
-static BlockInfo getBlock(const char* name)
+	MT::SpinLock lock(g_instance.m_mutex);
+	uint32 thread_id = MT::getCurrentThreadID();
+	auto iter = g_instance.threads.find(thread_id);
+	if (iter == g_instance.threads.end())
+	{
+		g_instance.threads.insert(thread_id, LUMIX_NEW(g_instance.allocator, ThreadData));
+		iter = g_instance.threads.find(thread_id);
+	}
+	thread_data = iter.value();
+	return *thread_data;
+}
+
+
+static Event* allocEvent(ThreadData& data, uint32 reserved_count)
 {
-	auto thread_id = MT::getCurrentThreadID();
+	uint32 write = data.write;
+	if (write - data.read >= EVENTS_COUNT - reserved_count) return nullptr;
+
+	Event* event = &data.events[write & (EVENTS_COUNT - 1)];
+	event->time = g_instance.timer->getRawTimeSinceStart();
+	return event;
+}
+
+
+static void commitEvent(ThreadData& data)
+{
+	// the event must be complete before frame() can see it
+	MT::memoryBarrier();
+	data.write = data.write + 1;
+}
 
-	ThreadData* thread_data = nullptr;
-	{
-		MT::SpinLock lock(g_instance.m_mutex);
-		auto iter = g_instance.threads.find(thread_id);
-		if (iter == g_instance.threads.end())
-		{
-			g_instance.threads.insert(thread_id, LUMIX_NEW(g_instance.allocator, ThreadData));
-			iter = g_instance.threads.find(thread_id);
-		}
 
-		thread_data = iter.value();
+static Block* getBlock(ThreadData& data, const char* name)
+{
+	Block* parent = data.current_block;
+	Block* LUMIX_RESTRICT block = parent ? parent->m_first_child : data.root_block;
+	while (block && block->m_name != name)
+	{
+		block = block->m_next;
 	}
+	if (block) return block;
 
-	if (!thread_data->current_block)
+	block = LUMIX_NEW(g_instance.allocator, Block)(g_instance.allocator);
+	block->m_parent = parent;
+	block->m_first_child = nullptr;
+	block->m_name = name;
+	if (parent)
 	{
-		Block* LUMIX_RESTRICT root = thread_data->root_block;
-		while (root && root->m_name != name)
-		{
-			root = root->m_next;
-		}
-		if (root)
-		{
-			thread_data->current_block = root;
-		}
-		else
-		{
-			Block* root = LUMIX_NEW(g_instance.allocator, Block)(g_instance.allocator);
-			root->m_parent = nullptr;
-			root->m_next = thread_data->root_block;
-			root->m_first_child = nullptr;
-			root->m_name = name;
-			thread_data->root_block = thread_data->current_block = root;
-		}
+		block->m_next = parent->m_first_child;
+		parent->m_first_child = block;
 	}
 	else
 	{
-		Block* LUMIX_RESTRICT child = thread_data->current_block->m_first_child;
-		while (child && child->m_name != name)
+		block->m_next = data.root_block;
+		data.root_block = block;
+	}
+	return block;
+}
+
+
+static void processEvents(ThreadData& data, uint32 thread_id, CaptureFrame* capture)
+{
+	uint32 write = data.write;
+	MT::memoryBarrier();
+	for (uint32 i = data.read; i != write; ++i)
+	{
+		const Event& event = data.events[i & (EVENTS_COUNT - 1)];
+		if (capture)
 		{
-			child = child->m_next;
+			auto& captured = capture->events.emplace();
+			captured.event = event;
+			captured.thread_id = thread_id;
 		}
-		if (!child)
+		switch (event.type)
 		{
-			child = LUMIX_NEW(g_instance.allocator, Block)(g_instance.allocator);
-			child->m_parent = thread_data->current_block;
-			child->m_first_child = nullptr;
-			child->m_name = name;
-			child->m_next = thread_data->current_block->m_first_child;
-			thread_data->current_block->m_first_child = child;
+			case Event::BEGIN:
+			{
+				Block* block = getBlock(data, event.name);
+				auto& hit = block->m_hits.emplace();
+				hit.m_start = event.time;
+				hit.m_length = 0;
+				data.current_block = block;
+				break;
+			}
+			case Event::END:
+			{
+				Block* block = data.current_block;
+				ASSERT(block);
+				if (!block) break;
+				auto& hit = block->m_hits.back();
+				// blocks open during frame() get a hit starting a bit after their begin
+				hit.m_length = event.time > hit.m_start ? event.time - hit.m_start : 0;
+				data.current_block = block->m_parent;
+				break;
+			}
+			case Event::INT:
+			{
+				Block* block = getBlock(data, event.name);
+				if (block->m_type != BlockType::INT)
+				{
+					block->m_values.int_value = 0;
+					block->m_type = BlockType::INT;
+				}
+				block->m_values.int_value += event.value.int_value;
+				break;
+			}
+			case Event::FLOAT:
+			{
+				Block* block = getBlock(data, event.name);
+				block->m_type = BlockType::FLOAT;
+				block->m_values.float_value = event.value.float_value;
+				break;
+			}
 		}
-
-		thread_data->current_block = child;
 	}
-
-	return { thread_data->current_block, thread_data };
+	// the events must be read before the owner thread can overwrite them
+	MT::memoryBarrier();
+	data.read = write;
 }
 
 
 void record(const char* name, float value)
 {
-	auto data = getBlock(name);
-	data.block->m_type = BlockType::FLOAT;
-	data.block->m_values.float_value = value;
-	data.thread_data->current_block = data.block->m_parent;
+	ThreadData& data = getThreadData();
+	Event* event = allocEvent(data, RESERVED_EVENTS_COUNT);
+	if (!event) return;
+
+	event->type = Event::FLOAT;
+	event->name = name;
+	event->value.float_value = value;
+	commitEvent(data);
 }
 
 
 void record(const char* name, int value)
 {
-	auto data = getBlock(name);
-	if (data.block->m_type != BlockType::INT)
-	{
-		data.block->m_values.int_value = 0;
-		data.block->m_type = BlockType::INT;
-	}
-	data.block->m_values.int_value += value;
-	data.thread_data->current_block = data.block->m_parent;
+	ThreadData& data = getThreadData();
+	Event* event = allocEvent(data, RESERVED_EVENTS_COUNT);
+	if (!event) return;
+
+	event->type = Event::INT;
+	event->name = name;
+	event->value.int_value = value;
+	commitEvent(data);
 }
 
 
 void beginBlock(const char* name)
 {
-	auto data = getBlock(name);
+	ThreadData& data = getThreadData();
+	Event* event = data.skipped_depth == 0 ? allocEvent(data, RESERVED_EVENTS_COUNT) : nullptr;
+	if (!event)
+	{
+		++data.skipped_depth;
+		return;
+	}
 
-	auto& hit = data.block->m_hits.emplace();
-	hit.m_start = g_instance.timer->getRawTimeSinceStart();
-	hit.m_length = 0;
+	event->type = Event::BEGIN;
+	event->name = name;
+	commitEvent(data);
 }
 
 
@@ -289,15 +439,7 @@ const char* getThreadName(uint32 thread_id)
 
 void setThreadName(const char* name)
 {
-	MT::SpinLock lock(g_instance.m_mutex);
-	uint32 thread_id = MT::getCurrentThreadID();
-	auto iter = g_instance.threads.find(thread_id);
-	if (iter == g_instance.threads.end())
-	{
-		g_instance.threads.insert(thread_id, LUMIX_NEW(g_instance.allocator, ThreadData));
-		iter = g_instance.threads.find(thread_id);
-	}
-	Lumix::copyString(iter.value()->name, name);
+	Lumix::copyString(getThreadData().name, name);
 }
 
 
@@ -352,44 +494,281 @@ Block* getRootBlock(uint32 thread_id)
 
 void endBlock()
 {
-	auto thread_id = MT::getCurrentThreadID();
+	ThreadData& data = getThreadData();
+	if (data.skipped_depth > 0)
+	{
+		--data.skipped_depth;
+		return;
+	}
+
+	Event* event = allocEvent(data, 0);
+	ASSERT(event);
+	if (!event) return;
+
+	event->type = Event::END;
+	event->name = nullptr;
+	commitEvent(data);
+}
+
+
+static void writeJSONString(FS::OsFile& file, const char* str)
+{
+	char tmp[2] = { 0, 0 };
+	file << "\"";
+	for (const char* c = str; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\') file << "\\";
+		tmp[0] = *c;
+		file << tmp;
+	}
+	file << "\"";
+}
+
+
+// microseconds with three decimals, float does not have enough precision for long sessions
+static void writeTimestamp(FS::OsFile& file, uint64 time)
+{
+	uint64 frequency = g_instance.timer->getFrequency();
+	uint64 nanoseconds = uint64(time / (double)frequency * 1000000000.0);
+	char fraction[] = ".000";
+	uint32 ns = uint32(nanoseconds % 1000);
+	fraction[1] = char('0' + ns / 100);
+	fraction[2] = char('0' + ns / 10 % 10);
+	fraction[3] = char('0' + ns % 10);
+	file << nanoseconds / 1000 << fraction;
+}
+
+
+// the capture copied out of the lock, so the file is written without blocking frame()
+struct CaptureCopy
+{
+	struct ThreadName
+	{
+		uint32 thread_id;
+		char name[30];
+	};
+
 
-	ThreadData* thread_data = nullptr;
+	explicit CaptureCopy(IAllocator& allocator)
+		: thread_names(allocator)
+		, events(allocator)
+	{
+	}
+
+
+	Array<ThreadName> thread_names;
+	// events of all valid frames, the oldest first
+	Array<CaptureFrame::ThreadEvent> events;
+};
+
+
+static void copyCaptureLocked(CaptureCopy& copy)
+{
+	for (auto iter = g_instance.threads.begin(), end = g_instance.threads.end(); iter != end; ++iter)
+	{
+		if (iter.value()->name[0] == '\0') continue;
+		auto& thread_name = copy.thread_names.emplace();
+		thread_name.thread_id = iter.key();
+		copyString(thread_name.name, iter.value()->name);
+	}
+
+	int frames_count = g_instance.capture_frames.size();
+	for (int i = 0; i < frames_count; ++i)
+	{
+		auto* frame = g_instance.capture_frames[(g_instance.capture_frame_index + i) % frames_count];
+		if (!frame->is_valid) continue;
+		for (auto& captured : frame->events)
+		{
+			copy.events.push(captured);
+		}
+	}
+}
+
+
+static bool writeCapture(const CaptureCopy& copy, const char* path)
+{
+	FS::OsFile file;
+	if (!file.open(path, FS::Mode::CREATE_AND_WRITE, g_instance.allocator))
+	{
+		g_log_error.log("Profiler") << "Could not save capture to " << path;
+		return false;
+	}
+
+	// Chrome trace event format, opened by chrome://tracing and Perfetto
+	file << "{\"traceEvents\":[\n";
+	bool is_first = true;
+	for (auto& thread_name : copy.thread_names)
+	{
+		file << (is_first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+			 << thread_name.thread_id << ",\"args\":{\"name\":";
+		writeJSONString(file, thread_name.name);
+		file << "}}";
+		is_first = false;
+	}
+
+	// the oldest frame can contain ends of blocks begun before the capture
+	HashMap<uint32, int> depths(g_instance.allocator);
+	for (auto& captured : copy.events)
+	{
+		const Event& event = captured.event;
+		auto depth_iter = depths.find(captured.thread_id);
+		if (!depth_iter.isValid())
+		{
+			depths.insert(captured.thread_id, 0);
+			depth_iter = depths.find(captured.thread_id);
+		}
+		int& depth = depth_iter.value();
+		if (event.type == Event::END)
+		{
+			if (depth == 0) continue;
+			--depth;
+		}
+		else if (event.type == Event::BEGIN)
+		{
+			++depth;
+		}
+
+		file << (is_first ? "{" : ",\n{");
+		is_first = false;
+		switch (event.type)
+		{
+			case Event::BEGIN:
+				file << "\"ph\":\"B\",\"name\":";
+				writeJSONString(file, event.name);
+				break;
+			case Event::END: file << "\"ph\":\"E\""; break;
+			case Event::INT:
+				file << "\"ph\":\"C\",\"name\":";
+				writeJSONString(file, event.name);
+				file << ",\"args\":{\"value\":" << (int32)event.value.int_value << "}";
+				break;
+			case Event::FLOAT:
+				file << "\"ph\":\"C\",\"name\":";
+				writeJSONString(file, event.name);
+				file << ",\"args\":{\"value\":" << event.value.float_value << "}";
+				break;
+		}
+		file << ",\"pid\":0,\"tid\":" << captured.thread_id << ",\"ts\":";
+		writeTimestamp(file, event.time);
+		file << "}";
+	}
+	file << "\n]}\n";
+	file.close();
+	return true;
+}
+
+
+bool saveCapture(const char* path)
+{
+	CaptureCopy copy(g_instance.allocator);
 	{
 		MT::SpinLock lock(g_instance.m_mutex);
-		auto iter = g_instance.threads.find(thread_id);
-		ASSERT(iter.isValid());
-		thread_data = iter.value();
+		copyCaptureLocked(copy);
 	}
+	return writeCapture(copy, path);
+}
 
-	ASSERT(thread_data->current_block);
-	uint64 now = g_instance.timer->getRawTimeSinceStart();
-	thread_data->current_block->m_hits.back().m_length = now - thread_data->current_block->m_hits.back().m_start;
-	thread_data->current_block = thread_data->current_block->m_parent;
+
+void setCaptureFrameCount(int count)
+{
+	MT::SpinLock lock(g_instance.m_mutex);
+	auto& frames = g_instance.capture_frames;
+	while (frames.size() > count)
+	{
+		LUMIX_DELETE(g_instance.allocator, frames.back());
+		frames.pop();
+	}
+	while (frames.size() < count)
+	{
+		frames.push(LUMIX_NEW(g_instance.allocator, CaptureFrame)(g_instance.allocator));
+	}
+	for (auto* frame : frames)
+	{
+		frame->is_valid = false;
+		frame->events.clear();
+	}
+	g_instance.capture_frame_index = 0;
 }
 
 
-void frame()
+int getCaptureFrameCount()
 {
-	PROFILE_FUNCTION();
+	return g_instance.capture_frames.size();
+}
+
 
+void setCaptureHitch(float frame_time, const char* path)
+{
 	MT::SpinLock lock(g_instance.m_mutex);
-	g_instance.frame_listeners.invoke();
-	uint64 now = g_instance.timer->getRawTimeSinceStart();
+	g_instance.hitch_threshold = frame_time;
+	copyString(g_instance.hitch_path, path);
+	// the frame in progress is measured from now, not from the start of the timer
+	g_instance.frame_start = g_instance.timer->getRawTimeSinceStart();
+}
+
 
-	for (auto* i : g_instance.threads)
+void frame()
+{
+	PROFILE_FUNCTION();
+
+	CaptureCopy hitch_capture(g_instance.allocator);
+	StaticString<MAX_PATH_LENGTH> hitch_path;
+	uint64 frame_time;
+	uint32 frame_index;
+	bool is_hitch;
 	{
-		if (!i->root_block) continue;
-		i->root_block->frame();
-		auto* block = i->current_block;
-		while (block)
+		MT::SpinLock lock(g_instance.m_mutex);
+		CaptureFrame* capture = nullptr;
+		if (!g_instance.capture_frames.empty())
 		{
-			auto& hit = block->m_hits.emplace();
-			hit.m_start = now;
-			hit.m_length = 0;
-			block = block->m_parent;
+			capture = g_instance.capture_frames[g_instance.capture_frame_index];
+			capture->events.clear();
+			capture->is_valid = true;
+			g_instance.capture_frame_index = (g_instance.capture_frame_index + 1) % g_instance.capture_frames.size();
+		}
+		for (auto iter = g_instance.threads.begin(), end = g_instance.threads.end(); iter != end; ++iter)
+		{
+			processEvents(*iter.value(), iter.key(), capture);
+		}
+		g_instance.frame_listeners.invoke();
+		uint64 now = g_instance.timer->getRawTimeSinceStart();
+		frame_index = ++g_instance.frame_index;
+		frame_time = now - g_instance.frame_start;
+		g_instance.frame_start = now;
+
+		is_hitch = capture && g_instance.hitch_threshold > 0 &&
+				   frame_time > uint64(g_instance.hitch_threshold * g_instance.timer->getFrequency());
+		if (is_hitch)
+		{
+			copyCaptureLocked(hitch_capture);
+			hitch_path << g_instance.hitch_path << frame_index << ".json";
+		}
+
+		for (auto* i : g_instance.threads)
+		{
+			if (!i->root_block) continue;
+			i->root_block->frame();
+			auto* block = i->current_block;
+			while (block)
+			{
+				auto& hit = block->m_hits.emplace();
+				hit.m_start = now;
+				hit.m_length = 0;
+				block = block->m_parent;
+			}
 		}
 	}
+
+	if (!is_hitch) return;
+
+	// written out of the lock, the other threads can register meanwhile
+	writeCapture(hitch_capture, hitch_path);
+	g_log_info.log("Profiler") << "Frame " << frame_index << " took "
+							   << float(frame_time / (double)g_instance.timer->getFrequency())
+							   << " s, capture saved to " << hitch_path;
+	// saving must not make the next frame a hitch
+	MT::SpinLock lock(g_instance.m_mutex);
+	g_instance.frame_start = g_instance.timer->getRawTimeSinceStart();
 }
 
 
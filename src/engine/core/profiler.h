@@ -49,6 +49,14 @@ LUMIX_ENGINE_API void endBlock();
 LUMIX_ENGINE_API void frame();
 LUMIX_ENGINE_API DelegateList<void ()>& getFrameListeners();
 
+// keeps the events of the last count frames, 0 disables the capture
+LUMIX_ENGINE_API void setCaptureFrameCount(int count);
+LUMIX_ENGINE_API int getCaptureFrameCount();
+// frames longer than frame_time seconds save the capture to path + frame index + ".json", 0 disables it
+LUMIX_ENGINE_API void setCaptureHitch(float frame_time, const char* path);
+// saves the captured frames as Chrome trace JSON, do not call from frame listeners
+LUMIX_ENGINE_API bool saveCapture(const char* path);
+
 
 struct Scope
 {
@@ -0,0 +1,111 @@
+#include "engine/core/radix_sort.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/mtjd/manager.h"
+#include "engine/core/mtjd/parallel_for.h"
+#include "engine/core/profiler.h"
+#include <cstring>
+
+
+namespace Lumix
+{
+
+
+static const int RADIX_BITS = 8;
+static const int RADIX_SIZE = 1 << RADIX_BITS;
+static const int RADIX_MAX_CHUNKS = 16;
+// below this, the jobs cost more than they save
+static const int RADIX_MIN_CHUNK_SIZE = 4096;
+
+
+void radixSort(MTJD::Manager& manager,
+	uint32* keys,
+	uint32* values,
+	uint32* tmp_keys,
+	uint32* tmp_values,
+	int size)
+{
+	PROFILE_FUNCTION();
+	if (size < 2) return;
+
+	int chunks_count = (size + RADIX_MIN_CHUNK_SIZE - 1) / RADIX_MIN_CHUNK_SIZE;
+	if (chunks_count > RADIX_MAX_CHUNKS) chunks_count = RADIX_MAX_CHUNKS;
+	int chunk_size = (size + chunks_count - 1) / chunks_count;
+
+	// histograms[chunk][digit], turned into scatter offsets before each scatter
+	uint32 histograms[RADIX_MAX_CHUNKS][RADIX_SIZE];
+	uint32* src_keys = keys;
+	uint32* src_values = values;
+	uint32* dst_keys = tmp_keys;
+	uint32* dst_values = tmp_values;
+	for (int shift = 0; shift < 32; shift += RADIX_BITS)
+	{
+		MTJD::parallelFor(manager,
+			0,
+			chunks_count,
+			1,
+			[&histograms, src_keys, size, chunk_size, shift](int from, int to) {
+				for (int chunk = from; chunk < to; ++chunk)
+				{
+					uint32* histogram = histograms[chunk];
+					memset(histogram, 0, sizeof(histograms[chunk]));
+					int end = Math::minimum(size, (chunk + 1) * chunk_size);
+					for (int i = chunk * chunk_size; i < end; ++i)
+					{
+						++histogram[(src_keys[i] >> shift) & (RADIX_SIZE - 1)];
+					}
+				}
+			});
+
+		uint32 offset = 0;
+		bool is_sorted_by_digit = false;
+		for (int digit = 0; digit < RADIX_SIZE; ++digit)
+		{
+			uint32 digit_count = 0;
+			for (int chunk = 0; chunk < chunks_count; ++chunk)
+			{
+				uint32 count = histograms[chunk][digit];
+				histograms[chunk][digit] = offset + digit_count;
+				digit_count += count;
+			}
+			if (digit_count == (uint32)size) is_sorted_by_digit = true;
+			offset += digit_count;
+		}
+		// all keys share the digit, the pass would only copy
+		if (is_sorted_by_digit) continue;
+
+		MTJD::parallelFor(manager,
+			0,
+			chunks_count,
+			1,
+			[&histograms, src_keys, src_values, dst_keys, dst_values, size, chunk_size, shift](
+				int from, int to) {
+				for (int chunk = from; chunk < to; ++chunk)
+				{
+					uint32* offsets = histograms[chunk];
+					int end = Math::minimum(size, (chunk + 1) * chunk_size);
+					for (int i = chunk * chunk_size; i < end; ++i)
+					{
+						uint32 dst = offsets[(src_keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+						dst_keys[dst] = src_keys[i];
+						dst_values[dst] = src_values[i];
+					}
+				}
+			});
+
+		uint32* tmp = src_keys;
+		src_keys = dst_keys;
+		dst_keys = tmp;
+		tmp = src_values;
+		src_values = dst_values;
+		dst_values = tmp;
+	}
+
+	if (src_keys != keys)
+	{
+		memcpy(keys, src_keys, sizeof(keys[0]) * size);
+		memcpy(values, src_values, sizeof(values[0]) * size);
+	}
+}
+
+
+} // namespace Lumix
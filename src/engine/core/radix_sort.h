@@ -0,0 +1,40 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+namespace MTJD
+{
+class Manager;
+}
+
+
+// stable ascending sort of values by keys, the result is in keys and values,
+// tmp_keys and tmp_values must have room for size items, passes are split into jobs
+LUMIX_ENGINE_API void radixSort(MTJD::Manager& manager,
+	uint32* keys,
+	uint32* values,
+	uint32* tmp_keys,
+	uint32* tmp_values,
+	int size);
+
+// maps a float to a key with the same order, negative numbers included
+inline uint32 floatToRadixKey(float value)
+{
+	union
+	{
+		float f;
+		uint32 u;
+	} tmp;
+	tmp.f = value;
+	uint32 mask = (tmp.u & 0x80000000) ? 0xffffffff : 0x80000000;
+	return tmp.u ^ mask;
+}
+
+
+} // namespace Lumix
@@ -19,6 +19,7 @@ Resource::Resource(const Path& path, ResourceManager& resource_manager, IAllocat
 	, m_cb(allocator)
 	, m_resource_manager(resource_manager)
 	, m_is_waiting_for_load(false)
+	, m_is_decoded(false)
 {
 }
 
@@ -56,10 +57,21 @@ void Resource::checkState()
 }
 
 
+void Resource::fileDecoded(FS::IFile& file, bool success)
+{
+	m_is_decoded = success && decode(file);
+}
+
+
 void Resource::fileLoaded(FS::IFile& file, bool success)
 {
 	m_is_waiting_for_load = false;
-	if (m_desired_state != State::READY) return;
+	if (m_desired_state != State::READY)
+	{
+		// doUnload() skipped this while decode() could still be running
+		unload();
+		return;
+	}
 	
 	ASSERT(m_current_state != State::READY);
 	ASSERT(m_empty_dep_count == 1);
@@ -74,7 +86,7 @@ void Resource::fileLoaded(FS::IFile& file, bool success)
 		return;
 	}
 
-	if (!load(file))
+	if (!m_is_decoded || !load(file))
 	{
 		++m_failed_dep_count;
 	}
@@ -88,7 +100,7 @@ void Resource::fileLoaded(FS::IFile& file, bool success)
 void Resource::doUnload()
 {
 	m_desired_state = State::EMPTY;
-	unload();
+	if (!m_is_waiting_for_load) unload();
 	ASSERT(m_empty_dep_count <= 1);
 
 	m_size = 0;
@@ -120,7 +132,9 @@ void Resource::doLoad()
 	FS::FileSystem& fs = m_resource_manager.getFileSystem();
 	FS::ReadCallback cb;
 	cb.bind<Resource, &Resource::fileLoaded>(this);
-	fs.openAsync(fs.getDefaultDevice(), m_path, FS::Mode::OPEN_AND_READ, cb);
+	FS::ReadCallback decode_cb;
+	decode_cb.bind<Resource, &Resource::fileDecoded>(this);
+	fs.openAsync(fs.getDefaultDevice(), m_path, FS::Mode::OPEN_AND_READ, cb, FS::Priority::NORMAL, decode_cb);
 }
 
 
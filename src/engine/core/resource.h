@@ -54,6 +54,10 @@ protected:
 
 	virtual void onBeforeReady() {}
 	virtual void unload(void) = 0;
+	// First loading phase, called on a file system worker thread. It should do the CPU heavy
+	// parsing and must not touch bgfx, other resources or anything read by the main thread
+	// while the resource is not ready. load() is then called on the main thread.
+	virtual bool decode(FS::IFile& file) { return true; }
 	virtual bool load(FS::IFile& file) = 0;
 
 	void onCreated(State state);
@@ -73,6 +77,7 @@ protected:
 
 private:
 	void doLoad();
+	void fileDecoded(FS::IFile& file, bool success);
 	void fileLoaded(FS::IFile& file, bool success);
 	void onStateChanged(State old_state, State new_state);
 	uint32 addRef(void) { return ++m_ref_count; }
@@ -88,6 +93,7 @@ private:
 	uint16 m_failed_dep_count;
 	State m_current_state;
 	bool m_is_waiting_for_load;
+	bool m_is_decoded;
 }; // class Resource
 
 
@@ -34,6 +34,7 @@ public:
 	static const uint32 PHYSICS = 0xE77419F9; // PHYSICS
 	static const uint32 FILE = 0xBA0ADBA4; // FILE
 	static const uint32 SHADER_BINARY = 0xDC8D194B; // SHADER_BINARY
+	static const uint32 ANIMATION_CONTROLLER = 0xec5ba0c2; // ANIMATION_CONTROLLER
 
 	explicit ResourceManager(IAllocator& allocator);
 	~ResourceManager();
@@ -0,0 +1,226 @@
+#include "engine/core/tag_allocator.h"
+#include "engine/core/mt/atomic.h"
+#include "engine/core/mt/sync.h"
+#include "engine/core/profiler.h"
+
+
+namespace Lumix
+{
+
+
+// stored right before the user pointer, the size is needed by deallocate
+struct AllocationHeader
+{
+	size_t offset;
+	size_t size;
+};
+
+
+// keeps the alignment of the source allocator
+static const size_t HEADER_SIZE = 16;
+static_assert(sizeof(AllocationHeader) <= HEADER_SIZE, "AllocationHeader does not fit");
+
+
+static TagAllocator* s_first_allocator = nullptr;
+static MT::SpinMutex s_allocators_mutex(false);
+
+
+static AllocationHeader& getHeader(void* user_ptr)
+{
+	return *((AllocationHeader*)user_ptr - 1);
+}
+
+
+static void* initHeader(void* system_ptr, size_t offset, size_t size)
+{
+	void* user_ptr = (uint8*)system_ptr + offset;
+	AllocationHeader& header = getHeader(user_ptr);
+	header.offset = offset;
+	header.size = size;
+	return user_ptr;
+}
+
+
+static size_t getAlignedOffset(size_t align)
+{
+	return align > HEADER_SIZE ? align : HEADER_SIZE;
+}
+
+
+static int64 atomicAdd64(int64 volatile* addend, int64 value)
+{
+	for (;;)
+	{
+		int64 old_value = *addend;
+		if (MT::compareAndExchange64(addend, old_value + value, old_value)) return old_value + value;
+	}
+}
+
+
+static int64 atomicExchange64(int64 volatile* dest, int64 value)
+{
+	for (;;)
+	{
+		int64 old_value = *dest;
+		if (MT::compareAndExchange64(dest, value, old_value)) return old_value;
+	}
+}
+
+
+static void atomicMax64(int64 volatile* dest, int64 value)
+{
+	for (;;)
+	{
+		int64 old_value = *dest;
+		if (old_value >= value || MT::compareAndExchange64(dest, value, old_value)) return;
+	}
+}
+
+
+TagAllocator::TagAllocator(IAllocator& source, const char* tag)
+	: m_source(source)
+	, m_tag(tag)
+{
+	m_frame_allocation_count = 0;
+	m_frame_allocated_bytes = 0;
+	m_live_bytes = 0;
+	m_peak_bytes = 0;
+
+	MT::SpinLock lock(s_allocators_mutex);
+	m_next = s_first_allocator;
+	s_first_allocator = this;
+}
+
+
+TagAllocator::~TagAllocator()
+{
+	MT::SpinLock lock(s_allocators_mutex);
+	TagAllocator** iter = &s_first_allocator;
+	while (*iter != this)
+	{
+		iter = &(*iter)->m_next;
+	}
+	*iter = m_next;
+}
+
+
+void TagAllocator::onAllocate(size_t size)
+{
+	MT::atomicIncrement(&m_frame_allocation_count);
+	MT::atomicAdd(&m_frame_allocated_bytes, (int32)size);
+	int64 live_bytes = atomicAdd64(&m_live_bytes, (int64)size);
+	atomicMax64(&m_peak_bytes, live_bytes);
+}
+
+
+void TagAllocator::onDeallocate(size_t size)
+{
+	atomicAdd64(&m_live_bytes, -(int64)size);
+}
+
+
+void* TagAllocator::allocate(size_t size)
+{
+	void* system_ptr = m_source.allocate(size + HEADER_SIZE);
+	if (!system_ptr) return nullptr;
+
+	onAllocate(size);
+	return initHeader(system_ptr, HEADER_SIZE, size);
+}
+
+
+void TagAllocator::deallocate(void* ptr)
+{
+	if (!ptr) return;
+
+	AllocationHeader& header = getHeader(ptr);
+	onDeallocate(header.size);
+	m_source.deallocate((uint8*)ptr - header.offset);
+}
+
+
+void* TagAllocator::reallocate(void* ptr, size_t size)
+{
+	if (!ptr) return allocate(size);
+	if (size == 0)
+	{
+		deallocate(ptr);
+		return nullptr;
+	}
+
+	AllocationHeader header = getHeader(ptr);
+	void* system_ptr = m_source.reallocate((uint8*)ptr - header.offset, size + header.offset);
+	if (!system_ptr) return nullptr;
+
+	onDeallocate(header.size);
+	onAllocate(size);
+	return initHeader(system_ptr, header.offset, size);
+}
+
+
+void* TagAllocator::allocate_aligned(size_t size, size_t align)
+{
+	size_t offset = getAlignedOffset(align);
+	void* system_ptr = m_source.allocate_aligned(size + offset, align);
+	if (!system_ptr) return nullptr;
+
+	onAllocate(size);
+	return initHeader(system_ptr, offset, size);
+}
+
+
+void TagAllocator::deallocate_aligned(void* ptr)
+{
+	if (!ptr) return;
+
+	AllocationHeader& header = getHeader(ptr);
+	onDeallocate(header.size);
+	m_source.deallocate_aligned((uint8*)ptr - header.offset);
+}
+
+
+void* TagAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0)
+	{
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+
+	AllocationHeader header = getHeader(ptr);
+	ASSERT(header.offset == getAlignedOffset(align));
+	void* system_ptr = m_source.reallocate_aligned((uint8*)ptr - header.offset, size + header.offset, align);
+	if (!system_ptr) return nullptr;
+
+	onDeallocate(header.size);
+	onAllocate(size);
+	return initHeader(system_ptr, header.offset, size);
+}
+
+
+void TagAllocator::frame()
+{
+	PROFILE_BLOCK("allocations");
+	MT::SpinLock lock(s_allocators_mutex);
+	for (TagAllocator* allocator = s_first_allocator; allocator; allocator = allocator->m_next)
+	{
+		// subtracted instead of zeroed, so allocations made meanwhile are not lost
+		int32 count = allocator->m_frame_allocation_count;
+		MT::atomicSubtract(&allocator->m_frame_allocation_count, count);
+		int32 bytes = allocator->m_frame_allocated_bytes;
+		MT::atomicSubtract(&allocator->m_frame_allocated_bytes, bytes);
+		int64 live_bytes = allocator->m_live_bytes;
+		int64 peak_bytes = atomicExchange64(&allocator->m_peak_bytes, live_bytes);
+
+		Profiler::beginBlock(allocator->m_tag);
+		Profiler::record("allocations", count);
+		Profiler::record("allocated bytes", bytes);
+		Profiler::record("live KB", int(live_bytes >> 10));
+		Profiler::record("peak KB", int(peak_bytes >> 10));
+		Profiler::endBlock();
+	}
+}
+
+
+} // namespace Lumix
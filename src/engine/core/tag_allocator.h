@@ -0,0 +1,53 @@
+#pragma once
+
+
+#include "engine/core/iallocator.h"
+
+
+namespace Lumix
+{
+
+
+// forwards to the source allocator and counts the allocations of one subsystem,
+// frame() sends the counters of all tag allocators to the profiler
+class LUMIX_ENGINE_API TagAllocator : public IAllocator
+{
+public:
+	// tag must outlive the profiler, e.g. a string literal
+	TagAllocator(IAllocator& source, const char* tag);
+	~TagAllocator();
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+
+	IAllocator& getSourceAllocator() { return m_source; }
+	const char* getTag() const { return m_tag; }
+	int getFrameAllocationCount() const { return m_frame_allocation_count; }
+	int getFrameAllocatedBytes() const { return m_frame_allocated_bytes; }
+	int64 getLiveBytes() const { return m_live_bytes; }
+	int64 getPeakBytes() const { return m_peak_bytes; }
+
+	// records the counters since the last frame() and resets them
+	static void frame();
+
+private:
+	void onAllocate(size_t size);
+	void onDeallocate(size_t size);
+
+private:
+	IAllocator& m_source;
+	const char* m_tag;
+	TagAllocator* m_next;
+	volatile int32 m_frame_allocation_count;
+	volatile int32 m_frame_allocated_bytes;
+	volatile int64 m_live_bytes;
+	// the highest m_live_bytes since the last frame()
+	volatile int64 m_peak_bytes;
+};
+
+
+} // namespace Lumix
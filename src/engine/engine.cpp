@@ -9,10 +9,13 @@
 #include "engine/core/path.h"
 #include "engine/core/profiler.h"
 #include "engine/core/resource_manager.h"
+#include "engine/core/tag_allocator.h"
 #include "engine/core/timer.h"
 #include "engine/core/fs/disk_file_device.h"
 #include "engine/core/fs/file_system.h"
 #include "engine/core/fs/memory_file_device.h"
+#include "engine/core/mtjd/generic_job.h"
+#include "engine/core/mtjd/group.h"
 #include "engine/core/mtjd/manager.h"
 #include "engine/debug/debug.h"
 #include "engine/iplugin.h"
@@ -59,18 +62,21 @@ class EngineImpl : public Engine
 public:
 	EngineImpl(const char* base_path0, const char* base_path1, FS::FileSystem* fs, IAllocator& allocator)
 		: m_allocator(allocator)
+		, m_lua_allocator(m_allocator, "lua")
 		, m_resource_manager(m_allocator)
 		, m_mtjd_manager(nullptr)
 		, m_fps(0)
 		, m_is_game_running(false)
 		, m_component_types(m_allocator)
+		, m_scene_jobs(m_allocator)
+		, m_root_scene_jobs(m_allocator)
 		, m_last_time_delta(0)
 		, m_path_manager(m_allocator)
 		, m_time_multiplier(1.0f)
 		, m_paused(false)
 		, m_next_frame(false)
 	{
-		m_state = lua_newstate(luaAllocator, &m_allocator);
+		m_state = lua_newstate(luaAllocator, &m_lua_allocator);
 		luaL_openlibs(m_state);
 		registerLuaAPI();
 
@@ -128,6 +134,24 @@ public:
 	}
 
 
+	static void LUA_setProfilerCaptureFrames(int count)
+	{
+		Profiler::setCaptureFrameCount(count);
+	}
+
+
+	static bool LUA_saveProfilerCapture(const char* path)
+	{
+		return Profiler::saveCapture(path);
+	}
+
+
+	static void LUA_setProfilerHitchCapture(float frame_time, const char* path)
+	{
+		Profiler::setCaptureHitch(frame_time, path);
+	}
+
+
 	static void LUA_startGame(Engine* engine, Universe* universe)
 	{
 		if(engine && universe) engine->startGame(*universe);
@@ -371,6 +395,9 @@ public:
 		REGISTER_FUNCTION(startGame);
 		REGISTER_FUNCTION(hasFilesystemWork);
 		REGISTER_FUNCTION(processFilesystemWork);
+		REGISTER_FUNCTION(setProfilerCaptureFrames);
+		REGISTER_FUNCTION(saveProfilerCapture);
+		REGISTER_FUNCTION(setProfilerHitchCapture);
 
 		#undef REGISTER_FUNCTION
 
@@ -476,7 +503,7 @@ public:
 			return false;
 		}
 
-		HierarchyPlugin* hierarchy = LUMIX_NEW(m_allocator, HierarchyPlugin)(m_allocator);
+		HierarchyPlugin* hierarchy = LUMIX_NEW(m_allocator, HierarchyPlugin)(*m_mtjd_manager, m_allocator);
 		m_plugin_manager->addPlugin(hierarchy);
 
 		m_input_system = InputSystem::create(m_allocator);
@@ -623,6 +650,60 @@ public:
 	}
 
 
+	static bool areScenesConflicting(const IScene& a, const IScene& b)
+	{
+		uint32 a_writes = a.getUpdateWrites();
+		uint32 b_writes = b.getUpdateWrites();
+		return (a_writes & (b.getUpdateReads() | b_writes)) != 0 || (b_writes & a.getUpdateReads()) != 0;
+	}
+
+
+	void updateScenes(Universe& context, float dt)
+	{
+		PROFILE_FUNCTION();
+		Array<IScene*>& scenes = context.getScenes();
+		if (scenes.empty()) return;
+
+		bool paused = m_paused;
+		MTJD::Group sync_point(*m_mtjd_manager, true, m_allocator);
+		m_scene_jobs.clear();
+		m_root_scene_jobs.clear();
+		for (auto* scene : scenes)
+		{
+			MTJD::Job* job = MTJD::makeJob(*m_mtjd_manager,
+				[scene, dt, paused]()
+				{
+					PROFILE_BLOCK(scene->getPlugin().getName());
+					scene->update(dt, paused);
+				},
+				m_allocator);
+			job->addDependency(&sync_point);
+			m_scene_jobs.push(job);
+		}
+
+		// a scene waits for all preceding scenes it conflicts with, so the result does not depend on timing
+		for (int i = 0; i < scenes.size(); ++i)
+		{
+			bool is_root = true;
+			for (int j = 0; j < i; ++j)
+			{
+				if (!areScenesConflicting(*scenes[j], *scenes[i])) continue;
+
+				m_scene_jobs[j]->addDependency(m_scene_jobs[i]);
+				is_root = false;
+			}
+			if (is_root) m_root_scene_jobs.push(m_scene_jobs[i]);
+		}
+
+		// the other jobs are scheduled when their dependencies finish
+		for (auto* job : m_root_scene_jobs)
+		{
+			m_mtjd_manager->schedule(job);
+		}
+		sync_point.sync();
+	}
+
+
 	void update(Universe& context) override
 	{
 		PROFILE_FUNCTION();
@@ -640,16 +721,12 @@ public:
 			dt = 1 / 30.0f;
 		}
 		m_last_time_delta = dt;
-		{
-			PROFILE_BLOCK("update scenes");
-			for (auto* scene : context.getScenes())
-			{
-				scene->update(dt, m_paused);
-			}
-		}
+		updateScenes(context, dt);
 		m_plugin_manager->update(dt, m_paused);
+		context.flushTransformedEntities();
 		m_input_system->update(dt);
 		getFileSystem().updateAsyncTransactions();
+		TagAllocator::frame();
 
 		if (m_next_frame)
 		{
@@ -847,6 +924,7 @@ private:
 
 private:
 	Debug::Allocator m_allocator;
+	TagAllocator m_lua_allocator;
 
 	FS::FileSystem* m_file_system;
 	FS::MemoryFileDevice* m_mem_file_device;
@@ -858,6 +936,8 @@ private:
 	MTJD::Manager* m_mtjd_manager;
 
 	Array<ComponentType> m_component_types;
+	Array<MTJD::Job*> m_scene_jobs;
+	Array<MTJD::Job*> m_root_scene_jobs;
 	PluginManager* m_plugin_manager;
 	InputSystem* m_input_system;
 	Timer* m_timer;
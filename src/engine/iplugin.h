@@ -14,6 +14,23 @@ namespace Lumix
 	class Universe;
 
 
+	// shared data touched by IScene::update, scenes without conflicting access are updated in parallel
+	struct SceneAccess
+	{
+		enum : uint32
+		{
+			// entity transforms and everything changed by Universe::entityTransformed listeners
+			TRANSFORMS = 1 << 0,
+			// renderable poses
+			POSES = 1 << 1,
+			// lua state
+			SCRIPTS = 1 << 2,
+
+			ALL = 0xffffFFFF
+		};
+	};
+
+
 	class LUMIX_ENGINE_API IScene
 	{
 		public:
@@ -31,6 +48,9 @@ namespace Lumix
 			virtual void startGame() {}
 			virtual void stopGame() {}
 			virtual int getVersion() const { return -1; }
+			// SceneAccess flags, by default the scene is not updated together with any other scene
+			virtual uint32 getUpdateReads() const { return SceneAccess::ALL; }
+			virtual uint32 getUpdateWrites() const { return SceneAccess::ALL; }
 	};
 
 
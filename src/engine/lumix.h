@@ -96,11 +96,13 @@ namespace Lumix
 	#define LUMIX_LIBRARY_IMPORT __declspec(dllimport)
 	#define LUMIX_FORCE_INLINE __forceinline
 	#define LUMIX_RESTRICT __restrict
+	#define LUMIX_THREAD_LOCAL __declspec(thread)
 #else 
 	#define LUMIX_LIBRARY_EXPORT __attribute__((visibility("default")))
 	#define LUMIX_LIBRARY_IMPORT 
 	#define LUMIX_FORCE_INLINE __attribute__((always_inline)) inline
 	#define LUMIX_RESTRICT __restrict__
+	#define LUMIX_THREAD_LOCAL __thread
 #endif
 
 #ifdef STATIC_PLUGINS
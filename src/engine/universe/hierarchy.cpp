@@ -1,8 +1,12 @@
 #include "hierarchy.h"
+#include "engine/core/array.h"
 #include "engine/core/blob.h"
 #include "engine/core/crc32.h"
 #include "engine/core/hash_map.h"
 #include "engine/core/json_serializer.h"
+#include "engine/core/matrix.h"
+#include "engine/core/mtjd/parallel_for.h"
+#include "engine/core/profiler.h"
 #include "engine/engine.h"
 #include "universe.h"
 
@@ -12,6 +16,13 @@ namespace Lumix
 
 
 static const Lumix::uint32 HIERARCHY_HASH = Lumix::crc32("hierarchy");
+static const int NODES_PER_JOB = 64;
+
+
+static int compareInts(const void* a, const void* b)
+{
+	return *(const int*)a - *(const int*)b;
+}
 
 
 class HierarchyImpl : public Hierarchy
@@ -19,28 +30,49 @@ class HierarchyImpl : public Hierarchy
 private:
 	typedef HashMap<Entity, Entity> Parents;
 
+	enum NodeFlags : uint8
+	{
+		// moved from outside of the hierarchy, keeps its world transform
+		MOVED = 1 << 0,
+		// its world transform is computed in the current pass
+		UPDATED = 1 << 1,
+		// the hierarchy wrote its transform and ignores the notification
+		WRITTEN = 1 << 2
+	};
+
+	struct Node
+	{
+		Entity entity;
+		Entity parent_entity;
+		// following members are valid only when the nodes are sorted
+		int parent;
+		int depth;
+		int first_child;
+		int children_count;
+		uint8 flags;
+		// relative to the parent's position and rotation
+		Matrix local_matrix;
+	};
+
 public:
-	HierarchyImpl(IPlugin& system, Universe& universe, IAllocator& allocator)
+	HierarchyImpl(IPlugin& system, Universe& universe, MTJD::Manager& mtjd_manager, IAllocator& allocator)
 		: m_universe(universe)
+		, m_mtjd_manager(mtjd_manager)
 		, m_parents(allocator)
-		, m_children(allocator)
 		, m_allocator(allocator)
 		, m_system(system)
+		, m_nodes(allocator)
+		, m_node_map(allocator)
+		, m_world_matrices(allocator)
+		, m_moved_entities(allocator)
+		, m_pass_moved_entities(allocator)
+		, m_moved_nodes(allocator)
+		, m_pass_nodes(allocator)
+		, m_is_sorted(true)
+		, m_is_processing(false)
 	{
-		m_is_processing = false;
 		universe.entityDestroyed().bind<HierarchyImpl, &HierarchyImpl::onEntityDestroyed>(this);
-		universe.entityTransformed().bind<HierarchyImpl, &HierarchyImpl::onEntityMoved>(this);
-	}
-
-
-	~HierarchyImpl()
-	{
-		auto iter = m_children.begin(), end = m_children.end();
-		while (iter != end)
-		{
-			LUMIX_DELETE(m_allocator, iter.value());
-			++iter;
-		}
+		universe.entitiesTransformed().bind<HierarchyImpl, &HierarchyImpl::onEntitiesMoved>(this);
 	}
 
 
@@ -60,15 +92,9 @@ public:
 		if (HIERARCHY_HASH == type)
 		{
 			auto parent_iter = m_parents.find(component);
-
 			if (parent_iter.isValid())
 			{
-				auto iter = m_children.find(parent_iter.value());
-				if (iter != m_children.end())
-				{
-					LUMIX_DELETE(m_allocator, iter.value());
-					m_children.erase(iter);
-				}
+				unlinkNode(component);
 				m_parents.erase(parent_iter);
 			}
 			
@@ -79,6 +105,8 @@ public:
 
 	IPlugin& getPlugin() const override { return m_system; }
 	void update(float time_delta, bool paused) override {}
+	uint32 getUpdateReads() const override { return 0; }
+	uint32 getUpdateWrites() const override { return 0; }
 	bool ownComponentType(uint32 type) const override { return HIERARCHY_HASH == type; }
 	Universe& getUniverse() override { return m_universe; }
 	IAllocator& getAllocator() { return m_allocator; }
@@ -91,61 +119,277 @@ public:
 	}
 
 
+	Node* getNode(Entity entity)
+	{
+		auto iter = m_node_map.find(entity);
+		return iter.isValid() ? &m_nodes[iter.value()] : nullptr;
+	}
+
+
+	Node& getOrCreateNode(Entity entity)
+	{
+		auto iter = m_node_map.find(entity);
+		if (iter.isValid()) return m_nodes[iter.value()];
+
+		m_node_map.insert(entity, m_nodes.size());
+		Node& node = m_nodes.emplace();
+		node.entity = entity;
+		node.parent_entity = INVALID_ENTITY;
+		node.parent = -1;
+		node.depth = 0;
+		node.first_child = 0;
+		node.children_count = 0;
+		node.flags = 0;
+		node.local_matrix = Matrix::IDENTITY;
+		m_is_sorted = false;
+		return node;
+	}
+
+
+	void unlinkNode(Entity entity)
+	{
+		Node* node = getNode(entity);
+		if (!node) return;
+
+		node->parent_entity = INVALID_ENTITY;
+		m_is_sorted = false;
+	}
+
+
 	void onEntityDestroyed(Entity entity)
 	{
-		auto iter = m_children.find(entity);
-		if (iter != m_children.end())
+		Node* node = getNode(entity);
+		if (!node) return;
+
+		for (Node& child : m_nodes)
 		{
-			for (auto& x : *iter.value())
+			if (child.parent_entity != entity) continue;
+
+			child.parent_entity = INVALID_ENTITY;
+			m_parents.erase(child.entity);
+		}
+		node->entity = INVALID_ENTITY;
+		node->parent_entity = INVALID_ENTITY;
+		m_node_map.erase(entity);
+		m_parents.erase(entity);
+		m_is_sorted = false;
+	}
+
+
+	// orders the nodes breadth first, so they are sorted by depth and children of a node are contiguous
+	void sortNodes()
+	{
+		if (m_is_sorted) return;
+		m_is_sorted = true;
+
+		m_node_map.clear();
+		for (int i = 0; i < m_nodes.size(); ++i)
+		{
+			if (m_nodes[i].entity != INVALID_ENTITY) m_node_map.insert(m_nodes[i].entity, i);
+		}
+
+		// children of every node are linked in a list through m_pass_nodes
+		Array<int>& next_sibling = m_pass_nodes;
+		Array<int>& first_child = m_moved_nodes;
+		next_sibling.clear();
+		first_child.clear();
+		for (int i = 0; i < m_nodes.size(); ++i)
+		{
+			next_sibling.push(-1);
+			first_child.push(-1);
+			m_nodes[i].children_count = 0;
+		}
+		for (int i = m_nodes.size() - 1; i >= 0; --i)
+		{
+			const Node& node = m_nodes[i];
+			if (node.entity == INVALID_ENTITY || node.parent_entity == INVALID_ENTITY) continue;
+			int parent = m_node_map[node.parent_entity];
+			next_sibling[i] = first_child[parent];
+			first_child[parent] = i;
+			++m_nodes[parent].children_count;
+		}
+
+		Array<Node> sorted(m_allocator);
+		sorted.reserve(m_nodes.size());
+		for (int i = 0; i < m_nodes.size(); ++i)
+		{
+			const Node& node = m_nodes[i];
+			if (node.entity == INVALID_ENTITY || node.parent_entity != INVALID_ENTITY) continue;
+			// roots without children and without the component are not needed anymore
+			if (node.children_count == 0 && !m_parents.find(node.entity).isValid()) continue;
+
+			Node& root = sorted.emplace(node);
+			root.parent = -1;
+			root.depth = 0;
+		}
+
+		for (int i = 0; i < sorted.size(); ++i)
+		{
+			int old_index = m_node_map[sorted[i].entity];
+			sorted[i].first_child = sorted.size();
+			for (int child = first_child[old_index]; child >= 0; child = next_sibling[child])
 			{
-				m_parents.erase(x.m_entity);
+				Node& node = sorted.emplace(m_nodes[child]);
+				node.parent = i;
+				node.depth = sorted[i].depth + 1;
 			}
-			LUMIX_DELETE(m_allocator, iter.value());
-			m_children.erase(iter);
 		}
+
+		m_nodes.swap(sorted);
+		m_node_map.clear();
+		for (int i = 0; i < m_nodes.size(); ++i)
+		{
+			m_node_map.insert(m_nodes[i].entity, i);
+		}
+		m_world_matrices.resize(m_nodes.size());
+		m_pass_nodes.clear();
+		m_moved_nodes.clear();
 	}
 
 
-	void onEntityMoved(Entity entity)
+	const Matrix& getParentWorldMatrix(const Node& node, Matrix& tmp) const
 	{
-		bool was_processing = m_is_processing;
-		m_is_processing = true;
-		Children::iterator iter = m_children.find(entity);
-		if (iter.isValid())
+		const Node& parent = m_nodes[node.parent];
+		if (parent.flags & UPDATED) return m_world_matrices[node.parent];
+		tmp = m_universe.getPositionAndRotation(parent.entity);
+		return tmp;
+	}
+
+
+	void computeWorldMatrix(int index)
+	{
+		Node& node = m_nodes[index];
+		Matrix tmp;
+		if (node.flags & MOVED)
 		{
-			Matrix parent_matrix = m_universe.getPositionAndRotation(entity);
-			Array<Child>& children = *iter.value();
-			for (int i = 0, c = children.size(); i < c; ++i)
+			m_world_matrices[index] = m_universe.getPositionAndRotation(node.entity);
+			if (node.parent >= 0)
 			{
-				m_universe.setMatrix(
-					children[i].m_entity, parent_matrix * children[i].m_local_matrix);
+				Matrix inv_parent_matrix = getParentWorldMatrix(node, tmp);
+				inv_parent_matrix.inverse();
+				node.local_matrix = inv_parent_matrix * m_world_matrices[index];
 			}
+			return;
 		}
-		m_is_processing = was_processing;
 
-		if (m_is_processing) return;
+		m_world_matrices[index] = getParentWorldMatrix(node, tmp) * node.local_matrix;
+	}
 
-		Parents::iterator parent_iter = m_parents.find(entity);
-		if (parent_iter.isValid())
+
+	void pushPassNode(int index)
+	{
+		Node& node = m_nodes[index];
+		if (node.flags & UPDATED) return;
+		node.flags |= UPDATED;
+		m_pass_nodes.push(index);
+	}
+
+
+	// visits only moved nodes and their subtrees, one depth level at a time
+	void updateMovedSubtrees()
+	{
+		PROFILE_FUNCTION();
+		sortNodes();
+
+		m_moved_nodes.clear();
+		for (Entity entity : m_pass_moved_entities)
 		{
-			Entity parent(parent_iter.value());
-			Children::iterator child_iter = m_children.find(parent);
-			if (child_iter.isValid())
+			auto iter = m_node_map.find(entity);
+			if (iter.isValid()) m_moved_nodes.push(iter.value());
+		}
+		if (m_moved_nodes.empty()) return;
+		qsort(&m_moved_nodes[0], m_moved_nodes.size(), sizeof(m_moved_nodes[0]), compareInts);
+
+		m_pass_nodes.clear();
+		int moved_idx = 0;
+		int level_begin = 0;
+		int level_end = 0;
+		for (;;)
+		{
+			int next_level_begin = m_pass_nodes.size();
+			for (int i = level_begin; i < level_end; ++i)
+			{
+				const Node& parent = m_nodes[m_pass_nodes[i]];
+				for (int j = 0; j < parent.children_count; ++j)
+				{
+					pushPassNode(parent.first_child + j);
+				}
+			}
+
+			int depth = -1;
+			if (m_pass_nodes.size() > next_level_begin)
+			{
+				depth = m_nodes[m_pass_nodes[next_level_begin]].depth;
+			}
+			else if (moved_idx < m_moved_nodes.size())
+			{
+				depth = m_nodes[m_moved_nodes[moved_idx]].depth;
+			}
+			if (depth < 0) break;
+
+			while (moved_idx < m_moved_nodes.size() && m_nodes[m_moved_nodes[moved_idx]].depth == depth)
 			{
-				Array<Child>& children = *child_iter.value();
-				for (int i = 0, c = children.size(); i < c; ++i)
+				pushPassNode(m_moved_nodes[moved_idx]);
+				++moved_idx;
+			}
+
+			level_begin = next_level_begin;
+			level_end = m_pass_nodes.size();
+			// nodes on the same level depend only on the previous level
+			MTJD::parallelFor(m_mtjd_manager,
+				level_begin,
+				level_end,
+				NODES_PER_JOB,
+				[this](int from, int to)
 				{
-					if (children[i].m_entity == entity)
+					for (int i = from; i < to; ++i)
 					{
-						Matrix inv_parent_matrix = m_universe.getPositionAndRotation(parent);
-						inv_parent_matrix.inverse();
-						children[i].m_local_matrix =
-							inv_parent_matrix * m_universe.getPositionAndRotation(entity);
-						break;
+						computeWorldMatrix(m_pass_nodes[i]);
 					}
-				}
+				});
+		}
+
+		// setMatrix can call listeners, which can change the nodes, so no references are kept
+		for (int i = 0; i < m_pass_nodes.size(); ++i)
+		{
+			int index = m_pass_nodes[i];
+			uint8 flags = m_nodes[index].flags;
+			m_nodes[index].flags = flags & ~(MOVED | UPDATED);
+			if (flags & MOVED) continue;
+
+			m_nodes[index].flags |= WRITTEN;
+			m_universe.setMatrix(m_nodes[index].entity, m_world_matrices[index]);
+		}
+	}
+
+
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			Node* node = getNode(entities[i]);
+			if (!node) continue;
+			if (node->flags & WRITTEN)
+			{
+				node->flags &= ~WRITTEN;
+				continue;
 			}
+			if (node->flags & MOVED) continue;
+
+			node->flags |= MOVED;
+			m_moved_entities.push(entities[i]);
+		}
+
+		// moves made by listeners while the hierarchy writes transforms are handled by the running loop
+		if (m_is_processing) return;
+		m_is_processing = true;
+		while (!m_moved_entities.empty())
+		{
+			m_pass_moved_entities.swap(m_moved_entities);
+			updateMovedSubtrees();
+			m_pass_moved_entities.clear();
 		}
+		m_is_processing = false;
 	}
 
 
@@ -153,7 +397,7 @@ public:
 	{
 		Parents::iterator parent_iter = m_parents.find(cmp);
 
-		if (parent_iter.isValid())
+		if (parent_iter.isValid() && parent_iter.value() != INVALID_ENTITY)
 		{
 			Quat parent_rot = m_universe.getRotation(parent_iter.value());
 			Vec3 parent_pos = m_universe.getPosition(parent_iter.value());
@@ -167,21 +411,8 @@ public:
 
 	Vec3 getLocalPosition(ComponentIndex cmp) override
 	{
-		Parents::iterator parent_iter = m_parents.find(cmp);
-
-		if (parent_iter.isValid() && parent_iter.value() != INVALID_ENTITY)
-		{
-			auto child_iter = m_children.find(parent_iter.value());
-			ASSERT(child_iter.isValid());
-
-			for (auto& child : *child_iter.value())
-			{
-				if (child.m_entity == cmp)
-				{
-					return child.m_local_matrix.getTranslation();
-				}
-			}
-		}
+		Node* node = getNode(cmp);
+		if (node && node->parent_entity != INVALID_ENTITY) return node->local_matrix.getTranslation();
 
 		return m_universe.getPosition(cmp);
 	}
@@ -191,7 +422,7 @@ public:
 	{
 		Parents::iterator parent_iter = m_parents.find(entity);
 
-		if (parent_iter.isValid())
+		if (parent_iter.isValid() && parent_iter.value() != INVALID_ENTITY)
 		{
 			Quat parent_rot = m_universe.getRotation(parent_iter.value());
 			m_universe.setRotation(entity, rotation * parent_rot);
@@ -204,49 +435,31 @@ public:
 
 	Quat getLocalRotation(ComponentIndex cmp) override
 	{
-		Parents::iterator parent_iter = m_parents.find(cmp);
-
-		if (parent_iter.isValid())
+		Node* node = getNode(cmp);
+		if (node && node->parent_entity != INVALID_ENTITY)
 		{
-			auto child_iter = m_children.find(parent_iter.value());
-			ASSERT(child_iter.isValid());
-
-			for (auto& child : *child_iter.value())
-			{
-				if (child.m_entity == cmp)
-				{
-					Quat rot;
-					child.m_local_matrix.getRotation(rot);
-					return rot;
-				}
-			}
+			Quat rot;
+			node->local_matrix.getRotation(rot);
+			return rot;
 		}
 
 		return m_universe.getRotation(cmp);
 	}
 
-	const Children& getAllChildren() const override { return m_children; }
-
 
 	void setParent(ComponentIndex child, Entity parent) override
 	{
+		if (child == parent) return;
+		// cycles are not allowed
+		for (Entity e = parent; e != INVALID_ENTITY; e = getParent(e))
+		{
+			if (e == child) return;
+		}
+
 		Parents::iterator old_parent_iter = m_parents.find(child);
 		if (old_parent_iter.isValid())
 		{
-			if (old_parent_iter.value() != INVALID_ENTITY)
-			{
-				Children::iterator child_iter = m_children.find(old_parent_iter.value());
-				ASSERT(child_iter.isValid());
-				Array<Child>& children = *child_iter.value();
-				for (int i = 0; i < children.size(); ++i)
-				{
-					if (children[i].m_entity == child)
-					{
-						children.erase(i);
-						break;
-					}
-				}
-			}
+			unlinkNode(child);
 			m_parents.erase(old_parent_iter);
 		}
 
@@ -254,17 +467,13 @@ public:
 		{
 			m_parents.insert(child, parent);
 
-			Children::iterator child_iter = m_children.find(parent);
-			if (!child_iter.isValid())
-			{
-				m_children.insert(parent, LUMIX_NEW(m_allocator, Array<Child>)(m_allocator));
-				child_iter = m_children.find(parent);
-			}
-			Child& c = child_iter.value()->emplace();
-			c.m_entity = child;
+			getOrCreateNode(parent);
+			Node& node = getOrCreateNode(child);
+			node.parent_entity = parent;
 			Matrix inv_parent_matrix = m_universe.getPositionAndRotation(parent);
 			inv_parent_matrix.inverse();
-			c.m_local_matrix = inv_parent_matrix * m_universe.getPositionAndRotation(child);
+			node.local_matrix = inv_parent_matrix * m_universe.getPositionAndRotation(child);
+			m_is_sorted = false;
 		}
 	}
 
@@ -309,30 +518,27 @@ public:
 	}
 
 
-	Array<Child>* getChildren(Entity parent) override
-	{
-		Children::iterator iter = m_children.find(parent);
-		if (iter.isValid())
-		{
-			return iter.value();
-		}
-		return nullptr;
-	}
-
-
 private:
 	IAllocator& m_allocator;
 	Universe& m_universe;
+	MTJD::Manager& m_mtjd_manager;
 	Parents m_parents;
-	Children m_children;
 	IPlugin& m_system;
+	Array<Node> m_nodes;
+	HashMap<Entity, int> m_node_map;
+	Array<Matrix> m_world_matrices;
+	Array<Entity> m_moved_entities;
+	Array<Entity> m_pass_moved_entities;
+	Array<int> m_moved_nodes;
+	Array<int> m_pass_nodes;
+	bool m_is_sorted;
 	bool m_is_processing;
 };
 
 
 IScene* HierarchyPlugin::createScene(Universe& ctx)
 {
-	return Hierarchy::create(*this, ctx, m_allocator);
+	return Hierarchy::create(*this, ctx, m_mtjd_manager, m_allocator);
 }
 
 
@@ -342,9 +548,12 @@ void HierarchyPlugin::destroyScene(IScene* scene)
 }
 
 
-Hierarchy* Hierarchy::create(IPlugin& system, Universe& universe, IAllocator& allocator)
+Hierarchy* Hierarchy::create(IPlugin& system,
+	Universe& universe,
+	MTJD::Manager& mtjd_manager,
+	IAllocator& allocator)
 {
-	return LUMIX_NEW(allocator, HierarchyImpl)(system, universe, allocator);
+	return LUMIX_NEW(allocator, HierarchyImpl)(system, universe, mtjd_manager, allocator);
 }
 
 
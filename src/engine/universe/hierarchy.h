@@ -2,8 +2,8 @@
 
 
 #include "engine/lumix.h"
-#include "engine/core/matrix.h"
-#include "engine/core/hash_map.h"
+#include "engine/core/quat.h"
+#include "engine/core/vec.h"
 #include "engine/iplugin.h"
 
 
@@ -11,16 +11,24 @@ namespace Lumix
 {
 
 
+	class IAllocator;
 	class InputBlob;
 	class OutputBlob;
 	class Universe;
-	template <typename T> class Array;
+	namespace MTJD
+	{
+	class Manager;
+	}
 
 
 	class HierarchyPlugin : public IPlugin
 	{
 	public:
-		explicit HierarchyPlugin(IAllocator& allocator) : m_allocator(allocator) {}
+		HierarchyPlugin(MTJD::Manager& mtjd_manager, IAllocator& allocator)
+			: m_mtjd_manager(mtjd_manager)
+			, m_allocator(allocator)
+		{
+		}
 
 		bool create() override { return true; }
 		void destroy() override {}
@@ -30,6 +38,7 @@ namespace Lumix
 		void destroyScene(IScene*) override;
 	
 	private:
+		MTJD::Manager& m_mtjd_manager;
 		IAllocator& m_allocator;
 	};
 
@@ -37,17 +46,10 @@ namespace Lumix
 	class Hierarchy : public IScene
 	{
 		public:
-			class Child
-			{
-				public:
-					Entity m_entity;
-					Matrix m_local_matrix;
-			};
-
-			typedef HashMap<int32, Array<Child>*> Children;
-
-		public:
-			static Hierarchy* create(IPlugin& system, Universe& universe, IAllocator& allocator);
+			static Hierarchy* create(IPlugin& system,
+				Universe& universe,
+				MTJD::Manager& mtjd_manager,
+				IAllocator& allocator);
 			static void destroy(Hierarchy* hierarchy);
 
 			virtual ~Hierarchy() {}
@@ -58,8 +60,6 @@ namespace Lumix
 			virtual Quat getLocalRotation(ComponentIndex cmp) = 0;
 			virtual void setParent(ComponentIndex cmp, Entity parent) = 0;
 			virtual Entity getParent(ComponentIndex cmp) = 0;
-			virtual Array<Child>* getChildren(Entity parent) = 0;
-			virtual const Children& getAllChildren() const = 0;
 	};
 
 
@@ -23,17 +23,33 @@ Universe::Universe(IAllocator& allocator)
 	: m_allocator(allocator)
 	, m_name_to_id_map(m_allocator)
 	, m_id_to_name_map(m_allocator)
-	, m_transformations(m_allocator)
+	, m_entities(m_allocator)
+	, m_positions(m_allocator)
+	, m_rotations(m_allocator)
+	, m_scales(m_allocator)
+	, m_world_matrices(m_allocator)
+	, m_is_world_matrix_dirty(m_allocator)
+	, m_dirty_world_matrices(m_allocator)
 	, m_component_added(m_allocator)
 	, m_component_destroyed(m_allocator)
 	, m_entity_created(m_allocator)
 	, m_entity_destroyed(m_allocator)
 	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
 	, m_entity_map(m_allocator)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
-{
-	m_transformations.reserve(RESERVED_ENTITIES_COUNT);
+	, m_is_transform_batching(false)
+	, m_transformed_mask(m_allocator)
+	, m_transformed_entities(m_allocator)
+	, m_flushed_entities(m_allocator)
+{
+	m_entities.reserve(RESERVED_ENTITIES_COUNT);
+	m_positions.reserve(RESERVED_ENTITIES_COUNT);
+	m_rotations.reserve(RESERVED_ENTITIES_COUNT);
+	m_scales.reserve(RESERVED_ENTITIES_COUNT);
+	m_world_matrices.reserve(RESERVED_ENTITIES_COUNT);
+	m_is_world_matrix_dirty.reserve(RESERVED_ENTITIES_COUNT);
 	m_entity_map.reserve(RESERVED_ENTITIES_COUNT);
 }
 
@@ -65,27 +81,121 @@ void Universe::addScene(IScene* scene)
 
 const Vec3& Universe::getPosition(Entity entity) const
 {
-	return m_transformations[m_entity_map[entity]].position;
+	return m_positions[m_entity_map[entity]];
 }
 
 
 const Quat& Universe::getRotation(Entity entity) const
 {
-	return m_transformations[m_entity_map[entity]].rotation;
+	return m_rotations[m_entity_map[entity]];
+}
+
+
+void Universe::invalidateWorldMatrix(int dense_idx)
+{
+	// listeners are called right away and most of them need the matrix
+	if (!m_is_transform_batching)
+	{
+		updateWorldMatrix(dense_idx);
+		return;
+	}
+
+	if (m_is_world_matrix_dirty[dense_idx]) return;
+	m_is_world_matrix_dirty[dense_idx] = true;
+	m_dirty_world_matrices.push(m_entities[dense_idx]);
+}
+
+
+void Universe::updateWorldMatrix(int dense_idx)
+{
+	Matrix& mtx = m_world_matrices[dense_idx];
+	m_rotations[dense_idx].toMatrix(mtx);
+	mtx.setTranslation(m_positions[dense_idx]);
+	mtx.multiply3x3(m_scales[dense_idx]);
+	m_is_world_matrix_dirty[dense_idx] = false;
+}
+
+
+void Universe::updateWorldMatrices()
+{
+	for (Entity entity : m_dirty_world_matrices)
+	{
+		// the entity could have been destroyed, or its dense index reused
+		if (!hasEntity(entity)) continue;
+		int dense_idx = m_entity_map[entity];
+		if (m_is_world_matrix_dirty[dense_idx]) updateWorldMatrix(dense_idx);
+	}
+	m_dirty_world_matrices.clear();
+}
+
+
+void Universe::transformChanged(Entity entity)
+{
+	if (!m_is_transform_batching)
+	{
+		m_entity_moved.invoke(entity);
+		m_entities_moved.invoke(&entity, 1);
+		return;
+	}
+
+	int word = entity >> 5;
+	uint32 bit = 1U << (entity & 31);
+	while (m_transformed_mask.size() <= word) m_transformed_mask.push(0);
+	if (m_transformed_mask[word] & bit) return;
+
+	m_transformed_mask[word] |= bit;
+	m_transformed_entities.push(entity);
+}
+
+
+void Universe::setTransformBatching(bool enable)
+{
+	flushTransformedEntities();
+	m_is_transform_batching = enable;
+}
+
+
+void Universe::flushTransformedEntities()
+{
+	while (!m_transformed_entities.empty())
+	{
+		updateWorldMatrices();
+		m_flushed_entities.swap(m_transformed_entities);
+		for (int i = m_flushed_entities.size() - 1; i >= 0; --i)
+		{
+			Entity entity = m_flushed_entities[i];
+			m_transformed_mask[entity >> 5] &= ~(1U << (entity & 31));
+			if (!hasEntity(entity)) m_flushed_entities.erase(i);
+		}
+
+		if (!m_flushed_entities.empty())
+		{
+			m_entities_moved.invoke(&m_flushed_entities[0], m_flushed_entities.size());
+			for (Entity entity : m_flushed_entities)
+			{
+				m_entity_moved.invoke(entity);
+			}
+		}
+		m_flushed_entities.clear();
+	}
 }
 
 
 void Universe::setRotation(Entity entity, const Quat& rot)
 {
-	m_transformations[m_entity_map[entity]].rotation = rot;
-	entityTransformed().invoke(entity);
+	int dense_idx = m_entity_map[entity];
+	m_rotations[dense_idx] = rot;
+	invalidateWorldMatrix(dense_idx);
+	transformChanged(entity);
 }
 
 
 void Universe::setRotation(Entity entity, float x, float y, float z, float w)
 {
-	m_transformations[m_entity_map[entity]].rotation.set(x, y, z, w);
-	entityTransformed().invoke(entity);
+	int dense_idx = m_entity_map[entity];
+	m_rotations[dense_idx].set(x, y, z, w);
+	invalidateWorldMatrix(dense_idx);
+	transformChanged(entity);
 }
 
 
@@ -97,48 +207,60 @@ bool Universe::hasEntity(Entity entity) const
 
 void Universe::setMatrix(Entity entity, const Matrix& mtx)
 {
-	Quat rot;
-	mtx.getRotation(rot);
-	m_transformations[m_entity_map[entity]].position = mtx.getTranslation();
-	m_transformations[m_entity_map[entity]].rotation = rot;
-	entityTransformed().invoke(entity);
+	int dense_idx = m_entity_map[entity];
+	mtx.getRotation(m_rotations[dense_idx]);
+	m_positions[dense_idx] = mtx.getTranslation();
+	invalidateWorldMatrix(dense_idx);
+	transformChanged(entity);
 }
 
 
 Matrix Universe::getPositionAndRotation(Entity entity) const
 {
 	Matrix mtx;
-	auto& transform = m_transformations[m_entity_map[entity]];
-	transform.rotation.toMatrix(mtx);
-	mtx.setTranslation(transform.position);
+	int dense_idx = m_entity_map[entity];
+	m_rotations[dense_idx].toMatrix(mtx);
+	mtx.setTranslation(m_positions[dense_idx]);
 	return mtx;
 }
 
 
+void Universe::setPositionAndRotation(Entity entity, const Vec3& pos, const Quat& rot)
+{
+	int dense_idx = m_entity_map[entity];
+	m_positions[dense_idx] = pos;
+	m_rotations[dense_idx] = rot;
+	invalidateWorldMatrix(dense_idx);
+	transformChanged(entity);
+}
+
+
 Matrix Universe::getMatrix(Entity entity) const
 {
+	int dense_idx = m_entity_map[entity];
+	if (!m_is_world_matrix_dirty[dense_idx]) return m_world_matrices[dense_idx];
+
 	Matrix mtx;
-	auto& transform = m_transformations[m_entity_map[entity]];
-	transform.rotation.toMatrix(mtx);
-	mtx.setTranslation(transform.position);
-	mtx.multiply3x3(transform.scale);
+	m_rotations[dense_idx].toMatrix(mtx);
+	mtx.setTranslation(m_positions[dense_idx]);
+	mtx.multiply3x3(m_scales[dense_idx]);
 	return mtx;
 }
 
 
 void Universe::setPosition(Entity entity, float x, float y, float z)
 {
-	auto& transform = m_transformations[m_entity_map[entity]];
-	transform.position.set(x, y, z);
-	entityTransformed().invoke(entity);
+	setPosition(entity, Vec3(x, y, z));
 }
 
 
 void Universe::setPosition(Entity entity, const Vec3& pos)
 {
-	auto& transform = m_transformations[m_entity_map[entity]];
-	transform.position = pos;
-	entityTransformed().invoke(entity);
+	int dense_idx = m_entity_map[entity];
+	m_positions[dense_idx] = pos;
+	// translation does not need the rotation, so a valid matrix stays valid
+	if (!m_is_world_matrix_dirty[dense_idx]) m_world_matrices[dense_idx].setTranslation(pos);
+	transformChanged(entity);
 }
 
 
@@ -167,6 +289,18 @@ const char* Universe::getEntityName(Entity entity) const
 }
 
 
+void Universe::pushTransform(Entity entity, const Vec3& position, const Quat& rotation, float scale)
+{
+	m_entities.push(entity);
+	m_positions.push(position);
+	m_rotations.push(rotation);
+	m_scales.push(scale);
+	m_world_matrices.emplace();
+	m_is_world_matrix_dirty.push(false);
+	updateWorldMatrix(m_entities.size() - 1);
+}
+
+
 void Universe::createEntity(Entity entity)
 {
 	ASSERT(entity >= 0);
@@ -187,13 +321,8 @@ void Universe::createEntity(Entity entity)
 	{
 		m_entity_map[prev_id] = m_entity_map[entity];
 	}
-	m_entity_map[entity] = m_transformations.size();
-
-	Transformation& trans = m_transformations.emplace();
-	trans.position.set(0, 0, 0);
-	trans.rotation.set(0, 0, 0, 1);
-	trans.scale = 1;
-	trans.entity = entity;
+	m_entity_map[entity] = m_entities.size();
+	pushTransform(entity, Vec3(0, 0, 0), Quat(0, 0, 0, 1), 1);
 
 	m_entity_created.invoke(entity);
 }
@@ -206,19 +335,15 @@ Entity Universe::createEntity(const Vec3& position, const Quat& rotation)
 	{
 		global_id = m_first_free_slot;
 		m_first_free_slot = -m_entity_map[m_first_free_slot];
-		m_entity_map[global_id] = m_transformations.size();
+		m_entity_map[global_id] = m_entities.size();
 	}
 	else
 	{
 		global_id = m_entity_map.size();
-		m_entity_map.push(m_transformations.size());
+		m_entity_map.push(m_entities.size());
 	}
 
-	Transformation& trans = m_transformations.emplace();
-	trans.position = position;
-	trans.rotation = rotation;
-	trans.scale = 1;
-	trans.entity = global_id;
+	pushTransform(global_id, position, rotation, 1);
 	m_entity_created.invoke(global_id);
 
 	return global_id;
@@ -229,9 +354,15 @@ void Universe::destroyEntity(Entity entity)
 {
 	if (entity < 0 || m_entity_map[entity] < 0) return;
 
-	int last_item_id = m_transformations.back().entity;
-	m_entity_map[last_item_id] = m_entity_map[entity];
-	m_transformations.eraseFast(m_entity_map[entity]);
+	int dense_idx = m_entity_map[entity];
+	int last_item_id = m_entities.back();
+	m_entity_map[last_item_id] = dense_idx;
+	m_entities.eraseFast(dense_idx);
+	m_positions.eraseFast(dense_idx);
+	m_rotations.eraseFast(dense_idx);
+	m_scales.eraseFast(dense_idx);
+	m_world_matrices.eraseFast(dense_idx);
+	m_is_world_matrix_dirty.eraseFast(dense_idx);
 	m_entity_map[entity] = m_first_free_slot >= 0 ? -m_first_free_slot : INT32_MIN;
 
 	int name_index = m_id_to_name_map.find(entity);
@@ -255,7 +386,7 @@ int Universe::getDenseIdx(Entity entity)
 
 Entity Universe::getEntityFromDenseIdx(int idx)
 {
-	return m_transformations[idx].entity;
+	return m_entities[idx];
 }
 
 
@@ -287,9 +418,16 @@ Entity Universe::getNextEntity(Entity entity)
 
 void Universe::serialize(OutputBlob& serializer)
 {
-	serializer.write((int32)m_transformations.size());
-	serializer.write(
-		&m_transformations[0], sizeof(m_transformations[0]) * m_transformations.size());
+	serializer.write((int32)m_entities.size());
+	for (int i = 0, c = m_entities.size(); i < c; ++i)
+	{
+		Transformation transform;
+		transform.entity = m_entities[i];
+		transform.position = m_positions[i];
+		transform.rotation = m_rotations[i];
+		transform.scale = m_scales[i];
+		serializer.write(transform);
+	}
 	serializer.write((int32)m_id_to_name_map.size());
 	for (int i = 0, c = m_id_to_name_map.size(); i < c; ++i)
 	{
@@ -310,9 +448,19 @@ void Universe::deserialize(InputBlob& serializer)
 {
 	int32 count;
 	serializer.read(count);
-	m_transformations.resize(count);
-
-	serializer.read(&m_transformations[0], sizeof(m_transformations[0]) * m_transformations.size());
+	m_entities.clear();
+	m_positions.clear();
+	m_rotations.clear();
+	m_scales.clear();
+	m_world_matrices.clear();
+	m_is_world_matrix_dirty.clear();
+	m_dirty_world_matrices.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		Transformation transform;
+		serializer.read(transform);
+		pushTransform(transform.entity, transform.position, transform.rotation, transform.scale);
+	}
 
 	serializer.read(count);
 	m_id_to_name_map.clear();
@@ -339,16 +487,16 @@ void Universe::deserialize(InputBlob& serializer)
 
 void Universe::setScale(Entity entity, float scale)
 {
-	auto& transform = m_transformations[m_entity_map[entity]];
-	transform.scale = scale;
-	entityTransformed().invoke(entity);
+	int dense_idx = m_entity_map[entity];
+	m_scales[dense_idx] = scale;
+	invalidateWorldMatrix(dense_idx);
+	transformChanged(entity);
 }
 
 
 float Universe::getScale(Entity entity)
 {
-	auto& transform = m_transformations[m_entity_map[entity]];
-	return transform.scale;
+	return m_scales[m_entity_map[entity]];
 }
 
 
@@ -5,6 +5,7 @@
 #include "engine/core/array.h"
 #include "engine/core/associative_array.h"
 #include "engine/core/delegate_list.h"
+#include "engine/core/matrix.h"
 #include "engine/core/quat.h"
 #include "engine/core/string.h"
 #include "engine/core/vec.h"
@@ -17,7 +18,6 @@ namespace Lumix
 
 class InputBlob;
 class Event;
-struct Matrix;
 class OutputBlob;
 class Universe;
 
@@ -34,7 +34,7 @@ public:
 	void destroyEntity(Entity entity);
 	void addComponent(Entity entity, uint32 component_type, IScene* scene, int index);
 	void destroyComponent(Entity entity, uint32 component_type, IScene* scene, int index);
-	int getEntityCount() const { return m_transformations.size(); }
+	int getEntityCount() const { return m_entities.size(); }
 
 	int getDenseIdx(Entity entity);
 	Entity getEntityFromDenseIdx(int idx);
@@ -47,6 +47,8 @@ public:
 
 	void setMatrix(Entity entity, const Matrix& mtx);
 	Matrix getPositionAndRotation(Entity entity) const;
+	// one change notification instead of two from setPosition and setRotation
+	void setPositionAndRotation(Entity entity, const Vec3& pos, const Quat& rot);
 	Matrix getMatrix(Entity entity) const;
 	void setRotation(Entity entity, float x, float y, float z, float w);
 	void setRotation(Entity entity, const Quat& rot);
@@ -57,7 +59,21 @@ public:
 	const Vec3& getPosition(Entity entity) const;
 	const Quat& getRotation(Entity entity) const;
 
+	// transform streams indexed by getDenseIdx, world matrices are valid after updateWorldMatrices
+	const Vec3* getPositions() const { return m_positions.begin(); }
+	const Quat* getRotations() const { return m_rotations.begin(); }
+	const float* getScales() const { return m_scales.begin(); }
+	const Matrix* getWorldMatrices() const { return m_world_matrices.begin(); }
+	void updateWorldMatrices();
+
+	// while enabled transform changes are only recorded and announced by flushTransformedEntities
+	void setTransformBatching(bool enable);
+	bool isTransformBatching() const { return m_is_transform_batching; }
+	void flushTransformedEntities();
+
 	DelegateList<void(Entity)>& entityTransformed() { return m_entity_moved; }
+	// every moved entity is reported once per batch, entities moved by the listeners are reported in the next batch
+	DelegateList<void(const Entity*, int)>& entitiesTransformed() { return m_entities_moved; }
 	DelegateList<void(Entity)>& entityCreated() { return m_entity_created; }
 	DelegateList<void(Entity)>& entityDestroyed() { return m_entity_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
@@ -71,6 +87,7 @@ public:
 	void addScene(IScene* scene);
 
 private:
+	// serialized form of one entity's transform
 	struct Transformation
 	{
 		Entity entity;
@@ -79,19 +96,36 @@ private:
 		float scale;
 	};
 
+private:
+	void transformChanged(Entity entity);
+	void pushTransform(Entity entity, const Vec3& position, const Quat& rotation, float scale);
+	void invalidateWorldMatrix(int dense_idx);
+	void updateWorldMatrix(int dense_idx);
+
 private:
 	IAllocator& m_allocator;
 	Array<IScene*> m_scenes;
-	Array<Transformation> m_transformations;
+	Array<Entity> m_entities;
+	Array<Vec3> m_positions;
+	Array<Quat> m_rotations;
+	Array<float> m_scales;
+	Array<Matrix> m_world_matrices;
+	Array<bool> m_is_world_matrix_dirty;
+	Array<Entity> m_dirty_world_matrices;
 	Array<int> m_entity_map;
 	AssociativeArray<uint32, uint32> m_name_to_id_map;
 	AssociativeArray<uint32, string> m_id_to_name_map;
 	DelegateList<void(Entity)> m_entity_moved;
+	DelegateList<void(const Entity*, int)> m_entities_moved;
 	DelegateList<void(Entity)> m_entity_created;
 	DelegateList<void(Entity)> m_entity_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_added;
 	int m_first_free_slot;
+	bool m_is_transform_batching;
+	Array<uint32> m_transformed_mask;
+	Array<Entity> m_transformed_entities;
+	Array<Entity> m_flushed_entities;
 };
 
 
@@ -11,6 +11,7 @@
 #include "engine/core/lua_wrapper.h"
 #include "engine/core/path_utils.h"
 #include "engine/core/resource_manager.h"
+#include "engine/core/tag_allocator.h"
 #include "engine/debug/debug.h"
 #include "editor/asset_browser.h"
 #include "editor/ieditor_command.h"
@@ -58,6 +59,7 @@ namespace Lumix
 		LuaScriptManager& getScriptManager() { return m_script_manager; }
 
 		Engine& m_engine;
+		TagAllocator m_tag_allocator;
 		Debug::Allocator m_allocator;
 		LuaScriptManager m_script_manager;
 	};
@@ -1194,7 +1196,8 @@ namespace Lumix
 
 	LuaScriptSystemImpl::LuaScriptSystemImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
+		, m_tag_allocator(engine.getAllocator(), "lua script")
+		, m_allocator(m_tag_allocator)
 		, m_script_manager(m_allocator)
 	{
 		m_script_manager.create(crc32("lua_script"), engine.getResourceManager());
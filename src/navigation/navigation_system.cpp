@@ -270,6 +270,10 @@ struct NavigationScene : public IScene
 	}
 
 
+	uint32 getUpdateReads() const override { return SceneAccess::TRANSFORMS; }
+	uint32 getUpdateWrites() const override { return SceneAccess::TRANSFORMS; }
+
+
 	void update(float time_delta, bool paused) override
 	{
 		for(auto& path : m_paths)
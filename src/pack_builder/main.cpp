@@ -0,0 +1,52 @@
+#include "editor/pack_builder.h"
+#include "engine/core/default_allocator.h"
+#include "engine/core/log.h"
+#include "engine/core/string.h"
+#include <cstdio>
+
+
+static void outputToConsole(const char* system, const char* message)
+{
+	printf("%s: %s\n", system, message);
+}
+
+
+static void printUsage()
+{
+	printf("usage: pack_builder -data_dir <dir> -out <file> [-no_compression]\n");
+}
+
+
+int main(int argc, const char* argv[])
+{
+	Lumix::g_log_info.getCallback().bind<outputToConsole>();
+	Lumix::g_log_warning.getCallback().bind<outputToConsole>();
+	Lumix::g_log_error.getCallback().bind<outputToConsole>();
+
+	char data_dir[Lumix::MAX_PATH_LENGTH] = ".";
+	char out_path[Lumix::MAX_PATH_LENGTH] = "data.pak";
+	bool compress = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (Lumix::compareString(argv[i], "-data_dir") == 0 && i + 1 < argc)
+		{
+			Lumix::copyString(data_dir, argv[++i]);
+		}
+		else if (Lumix::compareString(argv[i], "-out") == 0 && i + 1 < argc)
+		{
+			Lumix::copyString(out_path, argv[++i]);
+		}
+		else if (Lumix::compareString(argv[i], "-no_compression") == 0)
+		{
+			compress = false;
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	Lumix::DefaultAllocator allocator;
+	return PackBuilder::build(data_dir, out_path, compress, allocator) ? 0 : 1;
+}
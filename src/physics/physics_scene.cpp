@@ -7,6 +7,9 @@
 #include "engine/core/log.h"
 #include "engine/core/lua_wrapper.h"
 #include "engine/core/matrix.h"
+#include "engine/core/mt/thread.h"
+#include "engine/core/mtjd/generic_job.h"
+#include "engine/core/mtjd/manager.h"
 #include "engine/core/path.h"
 #include "engine/core/profiler.h"
 #include "engine/core/resource_manager.h"
@@ -29,6 +32,9 @@ static const uint32 BOX_ACTOR_HASH = crc32("box_rigid_actor");
 static const uint32 MESH_ACTOR_HASH = crc32("mesh_rigid_actor");
 static const uint32 CONTROLLER_HASH = crc32("physical_controller");
 static const uint32 HEIGHTFIELD_HASH = crc32("physical_heightfield");
+// the simulation always advances by this step, so the results do not depend on the frame rate
+static const float FIXED_TIME_STEP = 1 / 60.0f;
+static const int MAX_SUBSTEPS = 4;
 
 
 enum class PhysicsSceneVersion : int
@@ -110,6 +116,35 @@ struct InputStream : public physx::PxInputStream
 };
 
 
+// runs PhysX tasks as jobs of the engine instead of on PhysX's own worker threads
+struct CpuDispatcher : public physx::PxCpuDispatcher
+{
+	explicit CpuDispatcher(MTJD::Manager& manager)
+		: manager(manager)
+	{
+	}
+
+
+	void submitTask(physx::PxBaseTask& task) override
+	{
+		physx::PxBaseTask* task_ptr = &task;
+		auto run = [task_ptr]()
+		{
+			task_ptr->run();
+			task_ptr->release();
+		};
+		MTJD::Job* job = MTJD::makeJob(manager, run, manager.getAllocator());
+		manager.schedule(job);
+	}
+
+
+	physx::PxU32 getWorkerCount() const override { return manager.getCpuThreadsCount(); }
+
+
+	MTJD::Manager& manager;
+};
+
+
 static void matrix2Transform(const Matrix& mtx, physx::PxTransform& transform)
 {
 	transform.p.x = mtx.m41;
@@ -198,6 +233,8 @@ struct PhysicsSceneImpl : public PhysicsScene
 			, m_scene(scene)
 			, m_is_dynamic(false)
 			, m_layer(0)
+			, m_is_interpolated(false)
+			, m_is_moved(false)
 		{
 		}
 
@@ -212,6 +249,16 @@ struct PhysicsSceneImpl : public PhysicsScene
 		int getLayer() const { return m_layer; }
 		void setLayer(int layer) { m_layer = layer; }
 
+	public:
+		// the last two simulation results, the entity is interpolated between them
+		physx::PxTransform m_prev_pose;
+		physx::PxTransform m_pose;
+		// the last pose written to the universe or set from it
+		physx::PxTransform m_render_pose;
+		bool m_is_interpolated;
+		// by the last simulation step
+		bool m_is_moved;
+
 	private:
 		void onStateChanged(Resource::State old_state, Resource::State new_state);
 
@@ -230,11 +277,15 @@ struct PhysicsSceneImpl : public PhysicsScene
 		, m_controllers(m_allocator)
 		, m_actors(m_allocator)
 		, m_terrains(m_allocator)
-		, m_dynamic_actors(m_allocator)
 		, m_universe(context)
 		, m_is_game_running(false)
+		, m_is_simulating(false)
+		, m_time_accumulator(0)
+		, m_interpolated_actors(m_allocator)
 		, m_contact_callback(*this)
 		, m_queued_forces(m_allocator)
+		, m_actor_by_entity(m_allocator)
+		, m_controller_by_entity(m_allocator)
 		, m_layers_count(2)
 	{
 		setMemory(m_layers_names, 0, sizeof(m_layers_names));
@@ -324,19 +375,11 @@ struct PhysicsSceneImpl : public PhysicsScene
 		ASSERT(ownComponentType(type));
 		if (type == BOX_ACTOR_HASH || type == MESH_ACTOR_HASH)
 		{
-			for (int i = 0; i < m_actors.size(); ++i)
-			{
-				if (m_actors[i] && m_actors[i]->getEntity() == entity) return i;
-			}
-			return INVALID_COMPONENT;
+			return getEntityIndex(m_actor_by_entity, entity);
 		}
 		if (type == CONTROLLER_HASH)
 		{
-			for (int i = 0; i < m_controllers.size(); ++i)
-			{
-				if (!m_controllers[i].m_is_free && m_controllers[i].m_entity == entity) return i;
-			}
-			return INVALID_COMPONENT;
+			return getEntityIndex(m_controller_by_entity, entity);
 		}
 		if (type == HEIGHTFIELD_HASH)
 		{
@@ -362,6 +405,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 	void setControllerLayer(ComponentIndex cmp, int layer) override
 	{
 		ASSERT(layer < lengthOf(m_layers_names));
+		finishSimulation();
 		m_controllers[cmp].m_layer = layer;
 
 		physx::PxFilterData data;
@@ -379,6 +423,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 	void setActorLayer(ComponentIndex cmp, int layer) override
 	{
 		ASSERT(layer < lengthOf(m_layers_names));
+		finishSimulation();
 		m_actors[cmp]->setLayer(layer);
 		updateFilterData(m_actors[cmp]->getPhysxActor(), m_actors[cmp]->getLayer());
 	}
@@ -390,6 +435,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 	void setHeightfieldLayer(ComponentIndex cmp, int layer) override
 	{
 		ASSERT(layer < lengthOf(m_layers_names));
+		finishSimulation();
 		m_terrains[cmp]->m_layer = layer;
 
 		if (m_terrains[cmp]->m_actor)
@@ -431,6 +477,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void destroyComponent(ComponentIndex cmp, uint32 type) override
 	{
+		finishSimulation();
 		if (type == HEIGHTFIELD_HASH)
 		{
 			Entity entity = m_terrains[cmp]->m_entity;
@@ -442,14 +489,21 @@ struct PhysicsSceneImpl : public PhysicsScene
 		{
 			Entity entity = m_controllers[cmp].m_entity;
 			m_controllers[cmp].m_is_free = true;
+			setEntityIndex(m_controller_by_entity, entity, INVALID_COMPONENT);
 			m_universe.destroyComponent(entity, type, this, cmp);
 		}
 		else if (type == MESH_ACTOR_HASH || type == BOX_ACTOR_HASH)
 		{
 			Entity entity = m_actors[cmp]->getEntity();
+			setEntityIndex(m_actor_by_entity, entity, INVALID_COMPONENT);
+			if (m_actors[cmp]->m_is_interpolated)
+			{
+				m_actors[cmp]->m_is_interpolated = false;
+				m_interpolated_actors.eraseItemFast(cmp);
+			}
 			m_actors[cmp]->setEntity(INVALID_ENTITY);
 			m_actors[cmp]->setPhysxActor(nullptr);
-			m_dynamic_actors.eraseItem(m_actors[cmp]);
+			m_actors[cmp]->setDynamic(false);
 			m_universe.destroyComponent(entity, type, this, cmp);
 		}
 		else
@@ -475,6 +529,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	ComponentIndex createController(Entity entity)
 	{
+		finishSimulation();
 		physx::PxCapsuleControllerDesc cDesc;
 		cDesc.material = m_default_material;
 		cDesc.height = 1.8f;
@@ -494,6 +549,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 		c.m_radius = cDesc.radius;
 		c.m_height = cDesc.height;
 		c.m_layer = 0;
+		setEntityIndex(m_controller_by_entity, entity, m_controllers.size() - 1);
 
 		physx::PxFilterData data;
 		int controller_layer = c.m_layer;
@@ -516,6 +572,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 		RigidActor* actor = LUMIX_NEW(m_allocator, RigidActor)(*this);
 		m_actors.push(actor);
 		actor->setEntity(entity);
+		setEntityIndex(m_actor_by_entity, entity, m_actors.size() - 1);
 
 		physx::PxBoxGeometry geom;
 		geom.halfExtents.x = 1;
@@ -539,6 +596,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 		RigidActor* actor = LUMIX_NEW(m_allocator, RigidActor)(*this);
 		m_actors.push(actor);
 		actor->setEntity(entity);
+		setEntityIndex(m_actor_by_entity, entity, m_actors.size() - 1);
 
 		m_universe.addComponent(
 			entity, MESH_ACTOR_HASH, this, m_actors.size() - 1);
@@ -655,6 +713,8 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void render(RenderScene& render_scene) override
 	{
+		// the render buffer is filled by the running step
+		finishSimulation();
 		m_scene->getNbActors(physx::PxActorTypeSelectionFlag::eRIGID_STATIC);
 		const physx::PxRenderBuffer& rb = m_scene->getRenderBuffer();
 		const physx::PxU32 num_lines = rb.getNbLines();
@@ -672,31 +732,110 @@ struct PhysicsSceneImpl : public PhysicsScene
 	}
 
 
-	void updateDynamicActors()
+	void readActiveTransforms()
+	{
+		PROFILE_FUNCTION();
+		for (int idx : m_interpolated_actors)
+		{
+			m_actors[idx]->m_is_moved = false;
+		}
+
+		// only the actors which moved in the last step, sleeping ones are not reported
+		physx::PxU32 count;
+		const physx::PxActiveTransform* transforms = m_scene->getActiveTransforms(count);
+		for (physx::PxU32 i = 0; i < count; ++i)
+		{
+			const physx::PxActiveTransform& active = transforms[i];
+			Entity entity = (Entity)(intptr_t)active.userData;
+			int idx = getEntityIndex(m_actor_by_entity, entity);
+			// controllers' actors are reported too, updateControllers handles them
+			if (idx < 0 || m_actors[idx]->getPhysxActor() != active.actor) continue;
+
+			RigidActor* actor = m_actors[idx];
+			actor->m_prev_pose = actor->m_pose;
+			actor->m_pose = active.actor2World;
+			actor->m_is_moved = true;
+			if (!actor->m_is_interpolated)
+			{
+				actor->m_is_interpolated = true;
+				m_interpolated_actors.push(idx);
+			}
+		}
+
+		for (int idx : m_interpolated_actors)
+		{
+			RigidActor* actor = m_actors[idx];
+			if (!actor->m_is_moved) actor->m_prev_pose = actor->m_pose;
+		}
+	}
+
+
+	void interpolateDynamicActors(float alpha)
 	{
 		PROFILE_FUNCTION();
-		for (auto* actor : m_dynamic_actors)
+		for (int i = m_interpolated_actors.size() - 1; i >= 0; --i)
 		{
-			physx::PxTransform trans = actor->getPhysxActor()->getGlobalPose();
-			m_universe.setPosition(
-				actor->getEntity(), trans.p.x, trans.p.y, trans.p.z);
-			m_universe.setRotation(
-				actor->getEntity(), trans.q.x, trans.q.y, trans.q.z, trans.q.w);
+			RigidActor* actor = m_actors[m_interpolated_actors[i]];
+			const physx::PxTransform& prev = actor->m_prev_pose;
+			const physx::PxTransform& pose = actor->m_pose;
+			physx::PxTransform render_pose = pose;
+			if (prev == pose)
+			{
+				// stopped, this is the last write
+				actor->m_is_interpolated = false;
+				m_interpolated_actors.eraseFast(i);
+			}
+			else
+			{
+				render_pose.p = prev.p + (pose.p - prev.p) * alpha;
+				Quat rot;
+				nlerp(Quat(prev.q.x, prev.q.y, prev.q.z, prev.q.w),
+					Quat(pose.q.x, pose.q.y, pose.q.z, pose.q.w),
+					&rot,
+					alpha);
+				render_pose.q = physx::PxQuat(rot.x, rot.y, rot.z, rot.w);
+			}
+
+			actor->m_render_pose = render_pose;
+			m_universe.setPositionAndRotation(actor->getEntity(),
+				Vec3(render_pose.p.x, render_pose.p.y, render_pose.p.z),
+				Quat(render_pose.q.x, render_pose.q.y, render_pose.q.z, render_pose.q.w));
+		}
+	}
+
+
+	void stopInterpolation()
+	{
+		for (int idx : m_interpolated_actors)
+		{
+			m_actors[idx]->m_is_interpolated = false;
 		}
+		m_interpolated_actors.clear();
 	}
 
 
-	void simulateScene(float time_delta)
+	void startStep()
 	{
 		PROFILE_FUNCTION();
-		m_scene->simulate(time_delta);
+		m_scene->simulate(FIXED_TIME_STEP);
+		m_is_simulating = true;
 	}
 
 
-	void fetchResults()
+	// the scene can not be changed while a step runs, except the buffered actor writes
+	void finishSimulation()
 	{
+		if (!m_is_simulating) return;
+
 		PROFILE_FUNCTION();
+		// the PhysX tasks are engine jobs, a blocking wait on a worker could starve them
+		while (!m_scene->checkResults(false))
+		{
+			if (!m_cpu_dispatcher->manager.runPendingJob()) MT::yield();
+		}
 		m_scene->fetchResults(true);
+		m_is_simulating = false;
+		readActiveTransforms();
 	}
 
 
@@ -716,8 +855,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 				time_delta,
 				physx::PxControllerFilters());
 
-			float y = (float)p.y - m_controllers[i].m_height * 0.5f - m_controllers[i].m_radius;
-			m_universe.setPosition(m_controllers[i].m_entity, (float)p.x, y, (float)p.z);
+			m_universe.setPosition(m_controllers[i].m_entity, getControllerEntityPosition(i));
 		}
 	}
 
@@ -742,27 +880,38 @@ struct PhysicsSceneImpl : public PhysicsScene
 	}
 
 
+	// contacts fetched in update call lua callbacks, which can access any scene
+	uint32 getUpdateReads() const override { return SceneAccess::ALL; }
+	uint32 getUpdateWrites() const override { return SceneAccess::ALL; }
+
+
 	void update(float time_delta, bool paused) override
 	{
 		if (!m_is_game_running || paused) return;
-		
-		applyQueuedForces();
 
-		time_delta = Math::minimum(1 / 20.0f, time_delta);
-		simulateScene(time_delta);
-		fetchResults();
-		updateDynamicActors();
+		// the step started in the previous frame ran while that frame was rendered
+		finishSimulation();
 		updateControllers(time_delta);
+		applyQueuedForces();
+
+		m_time_accumulator += time_delta;
+		for (int i = 0; i < MAX_SUBSTEPS && m_time_accumulator >= FIXED_TIME_STEP; ++i)
+		{
+			finishSimulation();
+			startStep();
+			m_time_accumulator -= FIXED_TIME_STEP;
+		}
+		// can not keep up, the rest of the time is dropped
+		m_time_accumulator = Math::minimum(m_time_accumulator, FIXED_TIME_STEP);
+
+		// between the last two fetched steps, so one step behind the simulation
+		interpolateDynamicActors(m_time_accumulator / FIXED_TIME_STEP);
 	}
 
 
 	ComponentIndex getActorComponent(Entity entity) override
 	{
-		for (int i = 0; i < m_actors.size(); ++i)
-		{
-			if (m_actors[i]->getEntity() == entity) return i;
-		}
-		return -1;
+		return getEntityIndex(m_actor_by_entity, entity);
 	}
 
 
@@ -770,11 +919,17 @@ struct PhysicsSceneImpl : public PhysicsScene
 	{ 
 		auto* scene = m_universe.getScene(crc32("lua_script"));
 		m_script_scene = static_cast<LuaScriptScene*>(scene);
-		m_is_game_running = true; 
+		m_time_accumulator = 0;
+		m_is_game_running = true;
 	}
 
 
-	void stopGame() override { m_is_game_running = false; }
+	void stopGame() override
+	{
+		finishSimulation();
+		stopInterpolation();
+		m_is_game_running = false;
+	}
 
 
 	float getControllerRadius(ComponentIndex cmp) override
@@ -791,14 +946,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	ComponentIndex getController(Entity entity) override
 	{
-		for (int i = 0; i < m_controllers.size(); ++i)
-		{
-			if (m_controllers[i].m_entity == entity)
-			{
-				return i;
-			}
-		}
-		return INVALID_COMPONENT;
+		return getEntityIndex(m_controller_by_entity, entity);
 	}
 
 
@@ -848,47 +996,62 @@ struct PhysicsSceneImpl : public PhysicsScene
 	}
 
 
-	void onEntityMoved(Entity entity)
+	static int getEntityIndex(const Array<int>& map, Entity entity)
 	{
-		for (int i = 0, c = m_dynamic_actors.size(); i < c; ++i)
-		{
-			if (m_dynamic_actors[i]->getEntity() == entity)
-			{
-				Vec3 pos = m_universe.getPosition(entity);
-				physx::PxVec3 pvec(pos.x, pos.y, pos.z);
-				Quat q = m_universe.getRotation(entity);
-				physx::PxQuat pquat(q.x, q.y, q.z, q.w);
-				physx::PxTransform trans(pvec, pquat);
-				m_dynamic_actors[i]->getPhysxActor()->setGlobalPose(trans,
-																	false);
-				return;
-			}
-		}
+		return entity >= 0 && entity < map.size() ? map[entity] : INVALID_COMPONENT;
+	}
+
+
+	static void setEntityIndex(Array<int>& map, Entity entity, int index)
+	{
+		if (entity < 0) return;
+		while (map.size() <= entity) map.push(INVALID_COMPONENT);
+		map[entity] = index;
+	}
 
-		for (int i = 0, c = m_controllers.size(); i < c; ++i)
+
+	// the controller's capsule is centered, the entity is at its bottom
+	Vec3 getControllerEntityPosition(int idx) const
+	{
+		const Controller& controller = m_controllers[idx];
+		const physx::PxExtendedVec3& p = controller.m_controller->getPosition();
+		float y = (float)p.y - controller.m_height * 0.5f - controller.m_radius;
+		return Vec3((float)p.x, y, (float)p.z);
+	}
+
+
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		for (int i = 0; i < count; ++i)
 		{
-			if (m_controllers[i].m_entity == entity)
+			Entity entity = entities[i];
+			int actor_idx = getEntityIndex(m_actor_by_entity, entity);
+			if (actor_idx >= 0 && m_actors[actor_idx]->getPhysxActor())
 			{
-				Vec3 pos = m_universe.getPosition(entity);
-				pos.y += m_controllers[i].m_height * 0.5f;
-				pos.y += m_controllers[i].m_radius;
-				physx::PxExtendedVec3 pvec(pos.x, pos.y, pos.z);
-				m_controllers[i].m_controller->setPosition(pvec);
-				return;
+				physx::PxRigidActor* physx_actor = m_actors[actor_idx]->getPhysxActor();
+				const Vec3& pos = m_universe.getPosition(entity);
+				const Quat& rot = m_universe.getRotation(entity);
+				physx::PxTransform trans(physx::PxVec3(pos.x, pos.y, pos.z), physx::PxQuat(rot.x, rot.y, rot.z, rot.w));
+				// poses written by interpolateDynamicActors come back here unchanged
+				RigidActor* actor = m_actors[actor_idx];
+				if (!(actor->m_render_pose == trans))
+				{
+					physx_actor->setGlobalPose(trans, false);
+					actor->m_prev_pose = actor->m_pose = actor->m_render_pose = trans;
+				}
 			}
-		}
 
-		for (int i = 0, c = m_actors.size(); i < c; ++i)
-		{
-			if (m_actors[i]->getEntity() == entity)
+			int controller_idx = getEntityIndex(m_controller_by_entity, entity);
+			if (controller_idx >= 0)
 			{
-				Vec3 pos = m_universe.getPosition(entity);
-				physx::PxVec3 pvec(pos.x, pos.y, pos.z);
-				Quat q = m_universe.getRotation(entity);
-				physx::PxQuat pquat(q.x, q.y, q.z, q.w);
-				physx::PxTransform trans(pvec, pquat);
-				m_actors[i]->getPhysxActor()->setGlobalPose(trans, false);
-				return;
+				const Vec3& pos = m_universe.getPosition(entity);
+				// written by updateControllers
+				Vec3 controller_pos = getControllerEntityPosition(controller_idx);
+				if (controller_pos.x == pos.x && controller_pos.y == pos.y && controller_pos.z == pos.z) continue;
+
+				Controller& controller = m_controllers[controller_idx];
+				float y = pos.y + controller.m_height * 0.5f + controller.m_radius;
+				controller.m_controller->setPosition(physx::PxExtendedVec3(pos.x, y, pos.z));
 			}
 		}
 	}
@@ -897,6 +1060,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 	void heightmapLoaded(Heightfield* terrain)
 	{
 		PROFILE_FUNCTION();
+		finishSimulation();
 		Array<physx::PxHeightFieldSample> heights(m_allocator);
 
 		int width = terrain->m_heightmap->getWidth();
@@ -1088,6 +1252,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void updateFilterData()
 	{
+		finishSimulation();
 		for (auto* actor : m_actors)
 		{
 			if (!actor->getPhysxActor()) continue;
@@ -1155,14 +1320,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	bool isDynamic(RigidActor* actor)
 	{
-		for (int i = 0, c = m_dynamic_actors.size(); i < c; ++i)
-		{
-			if (m_dynamic_actors[i] == actor)
-			{
-				return true;
-			}
-		}
-		return false;
+		return actor->isDynamic();
 	}
 
 
@@ -1185,6 +1343,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void setHalfExtents(ComponentIndex cmp, const Vec3& size) override
 	{
+		finishSimulation();
 		physx::PxRigidActor* actor = m_actors[cmp]->getPhysxActor();
 		physx::PxShape* shapes;
 		if (actor->getNbShapes() == 1 &&
@@ -1204,20 +1363,9 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void setIsDynamic(ComponentIndex cmp, bool new_value) override
 	{
-		RigidActor* actor = m_actors[cmp];
-		int dynamic_index = m_dynamic_actors.indexOf(actor);
-		bool is_dynamic = dynamic_index != -1;
-		if (is_dynamic != new_value)
+		if (m_actors[cmp]->isDynamic() != new_value)
 		{
 			m_actors[cmp]->setDynamic(new_value);
-			if (new_value)
-			{
-				m_dynamic_actors.push(actor);
-			}
-			else
-			{
-				m_dynamic_actors.eraseItemFast(actor);
-			}
 			physx::PxShape* shapes;
 			if (m_actors[cmp]->getPhysxActor()->getNbShapes() == 1 &&
 				m_actors[cmp]->getPhysxActor()->getShapes(&shapes, 1, 0))
@@ -1403,7 +1551,8 @@ struct PhysicsSceneImpl : public PhysicsScene
 	void deserializeActors(InputBlob& serializer, int version)
 	{
 		int32 count;
-		m_dynamic_actors.clear();
+		m_actor_by_entity.clear();
+		stopInterpolation();
 		serializer.read(count);
 		for (int i = count; i < m_actors.size(); ++i)
 		{
@@ -1420,15 +1569,12 @@ struct PhysicsSceneImpl : public PhysicsScene
 		{
 			bool is_dynamic;
 			serializer.read(is_dynamic);
-			if (is_dynamic)
-			{
-				m_dynamic_actors.push(m_actors[i]);
-			}
 			m_actors[i]->setDynamic(is_dynamic);
 
 			Entity e;
 			serializer.read(e);
 			m_actors[i]->setEntity(e);
+			setEntityIndex(m_actor_by_entity, e, i);
 
 			if (m_actors[i]->getEntity() != -1)
 			{
@@ -1450,6 +1596,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 			}
 		}
 		m_controllers.clear();
+		m_controller_by_entity.clear();
 		for (int i = 0; i < count; ++i)
 		{
 			int32 index;
@@ -1486,6 +1633,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 				c.m_controller =
 					m_controller_manager->createController(*m_system->getPhysics(), m_scene, cDesc);
 				c.m_entity = e;
+				setEntityIndex(m_controller_by_entity, e, i);
 				m_universe.addComponent(e, CONTROLLER_HASH, this, i);
 			}
 		}
@@ -1545,6 +1693,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void deserialize(InputBlob& serializer, int version) override
 	{
+		finishSimulation();
 		if (version > (int)PhysicsSceneVersion::LAYERS)
 		{
 			serializer.read(m_layers_count);
@@ -1592,6 +1741,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 		auto* physx_actor = static_cast<physx::PxRigidDynamic*>(actor->getPhysxActor());
 		if (!physx_actor) return;
+		finishSimulation();
 		physx_actor->putToSleep();
 	}
 
@@ -1654,10 +1804,17 @@ struct PhysicsSceneImpl : public PhysicsScene
 	physx::PxControllerManager* m_controller_manager;
 	physx::PxMaterial* m_default_material;
 	Array<RigidActor*> m_actors;
-	Array<RigidActor*> m_dynamic_actors;
 	bool m_is_game_running;
+	// a step was started and its results were not fetched yet
+	bool m_is_simulating;
+	float m_time_accumulator;
+	CpuDispatcher* m_cpu_dispatcher;
+	Array<int> m_interpolated_actors;
 
 	Array<QueuedForce> m_queued_forces;
+	// component indices by entity, -1 if the entity has none
+	Array<int> m_actor_by_entity;
+	Array<int> m_controller_by_entity;
 	Array<Controller> m_controllers;
 	Array<Heightfield*> m_terrains;
 	uint32 m_collision_filter[32];
@@ -1672,27 +1829,22 @@ PhysicsScene* PhysicsScene::create(PhysicsSystem& system,
 	IAllocator& allocator)
 {
 	PhysicsSceneImpl* impl = LUMIX_NEW(allocator, PhysicsSceneImpl)(context, allocator);
-	impl->m_universe.entityTransformed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntityMoved>(
+	impl->m_universe.entitiesTransformed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntitiesMoved>(
 		impl);
 	impl->m_engine = &engine;
 	physx::PxSceneDesc sceneDesc(system.getPhysics()->getTolerancesScale());
 	sceneDesc.gravity = physx::PxVec3(0.0f, -9.8f, 0.0f);
-	if (!sceneDesc.cpuDispatcher)
-	{
-		physx::PxDefaultCpuDispatcher* cpu_dispatcher = physx::PxDefaultCpuDispatcherCreate(1);
-		if (!cpu_dispatcher)
-		{
-			g_log_error.log("Physics") << "PxDefaultCpuDispatcherCreate failed!";
-		}
-		sceneDesc.cpuDispatcher = cpu_dispatcher;
-	}
+	impl->m_cpu_dispatcher = LUMIX_NEW(allocator, CpuDispatcher)(engine.getMTJDManager());
+	sceneDesc.cpuDispatcher = impl->m_cpu_dispatcher;
 
 	sceneDesc.filterShader = impl->filterShader;
 	sceneDesc.simulationEventCallback = &impl->m_contact_callback;
+	sceneDesc.flags |= physx::PxSceneFlag::eENABLE_ACTIVETRANSFORMS;
 
 	impl->m_scene = system.getPhysics()->createScene(sceneDesc);
 	if (!impl->m_scene)
 	{
+		LUMIX_DELETE(allocator, impl->m_cpu_dispatcher);
 		LUMIX_DELETE(allocator, impl);
 		return nullptr;
 	}
@@ -1709,9 +1861,11 @@ PhysicsScene* PhysicsScene::create(PhysicsSystem& system,
 void PhysicsScene::destroy(PhysicsScene* scene)
 {
 	PhysicsSceneImpl* impl = static_cast<PhysicsSceneImpl*>(scene);
+	impl->finishSimulation();
 	impl->m_controller_manager->release();
 	impl->m_default_material->release();
 	impl->m_scene->release();
+	LUMIX_DELETE(impl->m_allocator, impl->m_cpu_dispatcher);
 	LUMIX_DELETE(impl->m_allocator, scene);
 }
 
@@ -1758,6 +1912,7 @@ void PhysicsSceneImpl::RigidActor::onStateChanged(Resource::State, Resource::Sta
 
 void PhysicsSceneImpl::RigidActor::setPhysxActor(physx::PxRigidActor* actor)
 {
+	m_scene.finishSimulation();
 	if (m_physx_actor)
 	{
 		m_scene.m_scene->removeActor(*m_physx_actor);
@@ -1770,6 +1925,7 @@ void PhysicsSceneImpl::RigidActor::setPhysxActor(physx::PxRigidActor* actor)
 		actor->setActorFlag(physx::PxActorFlag::eVISUALIZATION, true);
 		actor->userData = (void*)(intptr_t)m_entity;
 		m_scene.updateFilterData(actor, m_layer);
+		m_prev_pose = m_pose = m_render_pose = actor->getGlobalPose();
 	}
 }
 
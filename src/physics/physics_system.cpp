@@ -3,10 +3,10 @@
 #include <PxPhysicsAPI.h>
 
 #include "cooking/PxCooking.h"
-#include "engine/core/base_proxy_allocator.h"
 #include "engine/core/crc32.h"
 #include "engine/core/log.h"
 #include "engine/core/resource_manager.h"
+#include "engine/core/tag_allocator.h"
 #include "editor/studio_app.h"
 #include "editor/utils.h"
 #include "editor/world_editor.h"
@@ -199,7 +199,7 @@ namespace Lumix
 	struct PhysicsSystemImpl : public PhysicsSystem
 	{
 		explicit PhysicsSystemImpl(Engine& engine)
-			: m_allocator(engine.getAllocator())
+			: m_allocator(engine.getAllocator(), "physics")
 			, m_engine(engine)
 			, m_manager(*this, engine.getAllocator())
 		{
@@ -233,7 +233,7 @@ namespace Lumix
 		physx::PxCooking* m_cooking;
 		PhysicsGeometryManager m_manager;
 		Engine& m_engine;
-		BaseProxyAllocator m_allocator;
+		TagAllocator m_allocator;
 	};
 
 
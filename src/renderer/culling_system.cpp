@@ -10,63 +10,399 @@
 #include "engine/core/mtjd/manager.h"
 #include "engine/core/mtjd/job.h"
 
+#include <cfloat>
+#include <emmintrin.h>
+
 namespace Lumix
 {
-typedef Array<int64> LayerMasks;
+// 4 spheres in structure of arrays layout, unused lanes have renderable -1 and layer mask 0
+struct SphereBlock
+{
+	float x[4];
+	float y[4];
+	float z[4];
+	float radius[4];
+	int renderable[4];
+	int64 layer_mask[4];
+};
+typedef Array<SphereBlock> SphereBlocks;
 typedef Array<ComponentIndex> RenderabletoSphereMap;
-typedef Array<int> SphereToRenderableMap;
+
+
+// node of the hierarchy over static spheres, every subtree covers a continuous range of blocks
+struct StaticNode
+{
+	Vec3 min;
+	int32 first_block;
+	Vec3 max;
+	int32 blocks_count;
+	int32 child; // index of the first of two children, -1 for leaves
+};
+
+
+// classification of static spheres for one frustum; it is reused for frustums which differ
+// so little that only spheres in the band around the planes can change their visibility
+struct CachedView
+{
+	explicit CachedView(IAllocator& allocator)
+		: inside(allocator)
+		, boundary(allocator)
+		, last_used(0)
+		, is_valid(false)
+	{
+	}
+
+	Plane planes[(int)Frustum::Sides::COUNT];
+	Vec3 position;
+	float band;
+	float extent;
+	int64 layer_mask;
+	uint32 static_version;
+	uint32 last_used;
+	bool is_valid;
+	Array<Array<int>> inside; // renderables visible with a margin, one list per job
+	Array<Array<int>> boundary; // indices of static spheres in the band, one list per job
+};
+
+
+struct CullingContext
+{
+	const SphereBlocks* static_blocks;
+	const SphereBlocks* dynamic_blocks;
+	const Array<StaticNode>* static_nodes;
+	const Array<int>* static_roots;
+	Frustum frustum;
+	int64 layer_mask;
+	CachedView* view;
+	bool is_cache_hit;
+	int jobs_count;
+};
+
 
 static const int MIN_ENTITIES_PER_THREAD = 50;
+static const int MAX_LEAF_SPHERES = 16;
+static const int STATIC_FLAG = 1 << 30;
+static const int CACHED_VIEWS_COUNT = 8;
+static const int ROOTS_PER_JOB = 4;
+static const float BAND_RATIO = 0.02f;
+static const int PLANES_COUNT = (int)Frustum::Sides::COUNT;
+
+
+static void clearLane(SphereBlock& block, int lane)
+{
+	block.x[lane] = block.y[lane] = block.z[lane] = block.radius[lane] = 0;
+	block.renderable[lane] = -1;
+	block.layer_mask[lane] = 0;
+}
+
+
+static void setLane(SphereBlock& block,
+	int lane,
+	const Vec3& position,
+	float radius,
+	ComponentIndex renderable,
+	int64 layer_mask)
+{
+	block.x[lane] = position.x;
+	block.y[lane] = position.y;
+	block.z[lane] = position.z;
+	block.radius[lane] = radius;
+	block.renderable[lane] = renderable;
+	block.layer_mask[lane] = layer_mask;
+}
+
 
-static void doCulling(int start_index,
-	const Sphere* LUMIX_RESTRICT start,
-	const Sphere* LUMIX_RESTRICT end,
+static Sphere getLaneSphere(const SphereBlock& block, int lane)
+{
+	return Sphere(block.x[lane], block.y[lane], block.z[lane], block.radius[lane]);
+}
+
+
+static int pushLane(SphereBlocks& blocks,
+	int& count,
+	const Vec3& position,
+	float radius,
+	ComponentIndex renderable,
+	int64 layer_mask)
+{
+	int index = count;
+	int lane = index & 3;
+	if (lane == 0)
+	{
+		SphereBlock& new_block = blocks.emplace();
+		for (int i = 0; i < 4; ++i) clearLane(new_block, i);
+	}
+	setLane(blocks[index >> 2], lane, position, radius, renderable, layer_mask);
+	++count;
+	return index;
+}
+
+
+// makes room for count items at the end, the caller shrinks the array to the number of items written
+static int* beginAppend(Array<int>& array, int count)
+{
+	int size = array.size();
+	if (array.capacity() < size + count) array.reserve(Math::maximum(size + count, array.capacity() * 2));
+	array.resize(size + count);
+	return array.begin() + size;
+}
+
+
+// min over planes of distance + radius, the sphere is visible if it is not negative
+static __m128 getSphereDistances(const SphereBlock& block, const Plane* planes)
+{
+	__m128 x = _mm_loadu_ps(block.x);
+	__m128 y = _mm_loadu_ps(block.y);
+	__m128 z = _mm_loadu_ps(block.z);
+	__m128 radius = _mm_loadu_ps(block.radius);
+	__m128 result = _mm_set1_ps(FLT_MAX);
+	for (int i = 0; i < PLANES_COUNT; ++i)
+	{
+		const Plane& plane = planes[i];
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.normal.x)), _mm_mul_ps(y, _mm_set1_ps(plane.normal.y))),
+			_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.normal.z)), _mm_set1_ps(plane.d)));
+		result = _mm_min_ps(result, _mm_add_ps(distance, radius));
+	}
+	return result;
+}
+
+
+static void doCulling(const SphereBlock* LUMIX_RESTRICT start,
+	const SphereBlock* LUMIX_RESTRICT end,
 	const Frustum* LUMIX_RESTRICT frustum,
-	const int64* LUMIX_RESTRICT layer_masks,
-	const int* LUMIX_RESTRICT sphere_to_renderable_map,
 	int64 layer_mask,
 	CullingSystem::Subresults& results)
 {
 	PROFILE_FUNCTION();
-	int i = start_index;
-	ASSERT(results.empty());
-	PROFILE_INT("objects", int(end - start));
-	for (const Sphere *sphere = start; sphere <= end; sphere++, ++i)
+	int count = int(end - start) * 4;
+	PROFILE_INT("objects", count);
+	if (count == 0) return;
+
+	// every lane is written and the output position advances only for visible ones
+	int size = results.size();
+	int* LUMIX_RESTRICT out = beginAppend(results, count);
+	int out_count = 0;
+	__m128 zero = _mm_setzero_ps();
+	for (const SphereBlock* block = start; block != end; ++block)
+	{
+		int mask = _mm_movemask_ps(_mm_cmpge_ps(getSphereDistances(*block, frustum->planes), zero));
+		for (int j = 0; j < 4; ++j)
+		{
+			out[out_count] = block->renderable[j];
+			out_count += ((mask >> j) & 1) & (int)((block->layer_mask[j] & layer_mask) != 0);
+		}
+	}
+	results.resize(size + out_count);
+}
+
+
+static void acceptBlocks(const SphereBlock* LUMIX_RESTRICT start,
+	const SphereBlock* LUMIX_RESTRICT end,
+	int64 layer_mask,
+	CullingSystem::Subresults& results,
+	Array<int>& inside)
+{
+	int size = results.size();
+	int* LUMIX_RESTRICT out = beginAppend(results, int(end - start) * 4);
+	int out_count = 0;
+	for (const SphereBlock* block = start; block != end; ++block)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			out[out_count] = block->renderable[j];
+			out_count += (int)((block->layer_mask[j] & layer_mask) != 0);
+		}
+	}
+	results.resize(size + out_count);
+	copyMemory(beginAppend(inside, out_count), out, out_count * sizeof(int));
+}
+
+
+static void classifyBlocks(const SphereBlock* LUMIX_RESTRICT start,
+	const SphereBlock* LUMIX_RESTRICT end,
+	int first_index,
+	const Frustum& frustum,
+	float band,
+	int64 layer_mask,
+	CullingSystem::Subresults& results,
+	Array<int>& inside,
+	Array<int>& boundary)
+{
+	int count = int(end - start) * 4;
+	int size = results.size();
+	int inside_size = inside.size();
+	int boundary_size = boundary.size();
+	int* LUMIX_RESTRICT out = beginAppend(results, count);
+	int* LUMIX_RESTRICT inside_out = beginAppend(inside, count);
+	int* LUMIX_RESTRICT boundary_out = beginAppend(boundary, count);
+	int out_count = 0;
+	int inside_count = 0;
+	int boundary_count = 0;
+	__m128 zero = _mm_setzero_ps();
+	__m128 band4 = _mm_set1_ps(band);
+	__m128 neg_band4 = _mm_set1_ps(-band);
+	int index = first_index;
+	for (const SphereBlock* block = start; block != end; ++block, index += 4)
+	{
+		__m128 distances = getSphereDistances(*block, frustum.planes);
+		int visible_mask = _mm_movemask_ps(_mm_cmpge_ps(distances, zero));
+		int inside_mask = _mm_movemask_ps(_mm_cmpge_ps(distances, band4));
+		int boundary_mask = _mm_movemask_ps(_mm_cmpge_ps(distances, neg_band4)) & ~inside_mask;
+		for (int j = 0; j < 4; ++j)
+		{
+			int layer = (int)((block->layer_mask[j] & layer_mask) != 0);
+			out[out_count] = block->renderable[j];
+			out_count += ((visible_mask >> j) & 1) & layer;
+			inside_out[inside_count] = block->renderable[j];
+			inside_count += ((inside_mask >> j) & 1) & layer;
+			boundary_out[boundary_count] = index + j;
+			boundary_count += ((boundary_mask >> j) & 1) & layer;
+		}
+	}
+	results.resize(size + out_count);
+	inside.resize(inside_size + inside_count);
+	boundary.resize(boundary_size + boundary_count);
+}
+
+
+static void cullStaticNodes(const CullingContext& context,
+	int root,
+	CullingSystem::Subresults& results,
+	Array<int>& inside,
+	Array<int>& boundary)
+{
+	const Array<StaticNode>& nodes = *context.static_nodes;
+	const SphereBlock* blocks = context.static_blocks->begin();
+	const Plane* planes = context.frustum.planes;
+	float band = context.view->band;
+
+	int stack[64];
+	int stack_size = 1;
+	stack[0] = root;
+	while (stack_size > 0)
+	{
+		const StaticNode& node = nodes[stack[--stack_size]];
+		bool is_outside = false;
+		bool is_inside = true;
+		for (int i = 0; i < PLANES_COUNT; ++i)
+		{
+			const Plane& plane = planes[i];
+			float max_distance = (plane.normal.x > 0 ? node.max.x : node.min.x) * plane.normal.x +
+								 (plane.normal.y > 0 ? node.max.y : node.min.y) * plane.normal.y +
+								 (plane.normal.z > 0 ? node.max.z : node.min.z) * plane.normal.z + plane.d;
+			if (max_distance < -band)
+			{
+				is_outside = true;
+				break;
+			}
+			float min_distance = (plane.normal.x > 0 ? node.min.x : node.max.x) * plane.normal.x +
+								 (plane.normal.y > 0 ? node.min.y : node.max.y) * plane.normal.y +
+								 (plane.normal.z > 0 ? node.min.z : node.max.z) * plane.normal.z + plane.d;
+			if (min_distance < band) is_inside = false;
+		}
+		if (is_outside) continue;
+
+		const SphereBlock* start = blocks + node.first_block;
+		const SphereBlock* end = start + node.blocks_count;
+		if (is_inside)
+		{
+			acceptBlocks(start, end, context.layer_mask, results, inside);
+		}
+		else if (node.child < 0)
+		{
+			classifyBlocks(start,
+				end,
+				node.first_block * 4,
+				context.frustum,
+				band,
+				context.layer_mask,
+				results,
+				inside,
+				boundary);
+		}
+		else
+		{
+			ASSERT(stack_size + 2 <= lengthOf(stack));
+			stack[stack_size++] = node.child;
+			stack[stack_size++] = node.child + 1;
+		}
+	}
+}
+
+
+static void cullStatic(const CullingContext& context, int job_index, CullingSystem::Subresults& results)
+{
+	PROFILE_FUNCTION();
+	CachedView& view = *context.view;
+	if (context.is_cache_hit)
 	{
-		if (frustum->isSphereInside(sphere->m_position, sphere->m_radius) &&
-			((layer_masks[i] & layer_mask) != 0))
+		const SphereBlocks& blocks = *context.static_blocks;
+		for (int i = job_index; i < view.inside.size(); i += context.jobs_count)
 		{
-			results.push(sphere_to_renderable_map[i]);
+			const Array<int>& inside = view.inside[i];
+			copyMemory(beginAppend(results, inside.size()), inside.begin(), inside.size() * sizeof(int));
+			for (int sphere_index : view.boundary[i])
+			{
+				const SphereBlock& block = blocks[sphere_index >> 2];
+				int lane = sphere_index & 3;
+				Sphere sphere = getLaneSphere(block, lane);
+				if (context.frustum.isSphereInside(sphere.m_position, sphere.m_radius))
+				{
+					results.push(block.renderable[lane]);
+				}
+			}
 		}
+		return;
 	}
+
+	Array<int>& inside = view.inside[job_index];
+	Array<int>& boundary = view.boundary[job_index];
+	inside.clear();
+	boundary.clear();
+	const Array<int>& roots = *context.static_roots;
+	for (int i = job_index; i < roots.size(); i += context.jobs_count)
+	{
+		cullStaticNodes(context, roots[i], results, inside, boundary);
+	}
+}
+
+
+static void cull(const CullingContext& context,
+	int job_index,
+	int dynamic_start,
+	int dynamic_end,
+	CullingSystem::Subresults& results)
+{
+	cullStatic(context, job_index, results);
+	const SphereBlock* dynamic_blocks = context.dynamic_blocks->begin();
+	doCulling(dynamic_blocks + dynamic_start,
+		dynamic_blocks + dynamic_end,
+		&context.frustum,
+		context.layer_mask,
+		results);
 }
 
+
 class CullingJob : public MTJD::Job
 {
 public:
-	CullingJob(const CullingSystem::InputSpheres& spheres,
-		const LayerMasks& layer_masks,
-		const SphereToRenderableMap& sphere_to_renderable_map,
-		int64 layer_mask,
+	CullingJob(const CullingContext& context,
+		int job_index,
 		CullingSystem::Subresults& results,
 		int start,
 		int end,
-		const Frustum& frustum,
 		MTJD::Manager& manager,
 		IAllocator& allocator,
 		IAllocator& job_allocator)
 		: Job(Job::AUTO_DESTROY, MTJD::Priority::Default, manager, allocator, job_allocator)
-		, m_spheres(spheres)
+		, m_context(context)
+		, m_job_index(job_index)
 		, m_results(results)
 		, m_start(start)
 		, m_end(end)
-		, m_frustum(frustum)
-		, m_layer_masks(layer_masks)
-		, m_layer_mask(layer_mask)
-		, m_sphere_to_renderable_map(sphere_to_renderable_map)
 	{
 		setJobName("CullingJob");
-		m_results.reserve(end - start);
 		ASSERT(m_results.empty());
 		m_is_executed = false;
 	}
@@ -76,26 +412,16 @@ public:
 	void execute() override
 	{
 		ASSERT(m_results.empty() && !m_is_executed);
-		doCulling(m_start,
-			&m_spheres[m_start],
-			&m_spheres[m_end],
-			&m_frustum,
-			&m_layer_masks[0],
-			&m_sphere_to_renderable_map[0],
-			m_layer_mask,
-			m_results);
+		cull(m_context, m_job_index, m_start, m_end, m_results);
 		m_is_executed = true;
 	}
 
 private:
-	const CullingSystem::InputSpheres& m_spheres;
+	const CullingContext& m_context;
+	int m_job_index;
 	CullingSystem::Subresults& m_results;
-	const LayerMasks& m_layer_masks;
-	const SphereToRenderableMap& m_sphere_to_renderable_map;
-	int64 m_layer_mask;
 	int m_start;
 	int m_end;
-	const Frustum& m_frustum;
 	bool m_is_executed;
 };
 
@@ -105,23 +431,35 @@ public:
 	CullingSystemImpl(MTJD::Manager& mtjd_manager, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_job_allocator(allocator)
-		, m_spheres(allocator)
+		, m_dynamic_blocks(allocator)
+		, m_dynamic_count(0)
+		, m_static_blocks(allocator)
+		, m_static_count(0)
+		, m_static_holes_count(0)
+		, m_static_nodes(allocator)
+		, m_static_roots(allocator)
+		, m_is_static_dirty(false)
+		, m_static_version(0)
+		, m_views(allocator)
+		, m_cull_counter(0)
 		, m_result(allocator)
-		, m_sync_point(true, allocator)
-		, m_mtjd_manager(mtjd_manager)
-		, m_layer_masks(m_allocator)
-		, m_sphere_to_renderable_map(m_allocator)
 		, m_renderable_to_sphere_map(m_allocator)
+		, m_mtjd_manager(mtjd_manager)
+		, m_sync_point(mtjd_manager, true, allocator)
+		, m_is_async_result(false)
 	{
 		m_result.emplace(m_allocator);
 		m_renderable_to_sphere_map.reserve(5000);
-		m_sphere_to_renderable_map.reserve(5000);
-		m_spheres.reserve(5000);
+		m_static_blocks.reserve(5000 / 4);
 		int cpu_count = (int)m_mtjd_manager.getCpuThreadsCount();
 		while (m_result.size() < cpu_count)
 		{
 			m_result.emplace(m_allocator);
 		}
+		for (int i = 0; i < CACHED_VIEWS_COUNT; ++i)
+		{
+			m_views.emplace(m_allocator);
+		}
 	}
 
 
@@ -130,10 +468,16 @@ public:
 
 	void clear() override
 	{
-		m_spheres.clear();
-		m_layer_masks.clear();
+		m_dynamic_blocks.clear();
+		m_dynamic_count = 0;
+		m_static_blocks.clear();
+		m_static_count = 0;
+		m_static_holes_count = 0;
+		m_static_nodes.clear();
+		m_static_roots.clear();
+		m_is_static_dirty = false;
+		++m_static_version;
 		m_renderable_to_sphere_map.clear();
-		m_sphere_to_renderable_map.clear();
 	}
 
 
@@ -156,24 +500,15 @@ public:
 		{
 			m_result[i].clear();
 		}
-		if (!m_spheres.empty())
-		{
-			doCulling(0,
-				&m_spheres[0],
-				&m_spheres.back(),
-				&frustum,
-				&m_layer_masks[0],
-				&m_sphere_to_renderable_map[0],
-				layer_mask,
-				m_result[0]);
-		}
+		prepareContext(frustum, layer_mask, 1);
+		cull(m_context, 0, 0, m_dynamic_blocks.size(), m_result[0]);
 		m_is_async_result = false;
 	}
 
 
 	void cullToFrustumAsync(const Frustum& frustum, int64 layer_mask) override
 	{
-		int count = m_spheres.size();
+		int count = m_static_count + m_dynamic_count;
 		for(auto& i : m_result)
 		{
 			i.clear();
@@ -193,21 +528,19 @@ public:
 		m_is_async_result = true;
 
 		int cpu_count = m_mtjd_manager.getCpuThreadsCount();
-		int step = count / cpu_count;
-		int i = 0;
+		prepareContext(frustum, layer_mask, cpu_count);
+		int blocks_count = m_dynamic_blocks.size();
+		int step = blocks_count / cpu_count;
 		CullingJob* jobs[16];
 		ASSERT(lengthOf(jobs) >= cpu_count);
-		for (; i < cpu_count - 1; i++)
+		for (int i = 0; i < cpu_count; i++)
 		{
 			m_result[i].clear();
-			CullingJob* cj = LUMIX_NEW(m_job_allocator, CullingJob)(m_spheres,
-				m_layer_masks,
-				m_sphere_to_renderable_map,
-				layer_mask,
+			CullingJob* cj = LUMIX_NEW(m_job_allocator, CullingJob)(m_context,
+				i,
 				m_result[i],
 				i * step,
-				(i + 1) * step - 1,
-				frustum,
+				i == cpu_count - 1 ? blocks_count : (i + 1) * step,
 				m_mtjd_manager,
 				m_allocator,
 				m_job_allocator);
@@ -215,22 +548,7 @@ public:
 			jobs[i] = cj;
 		}
 
-		m_result[i].clear();
-		CullingJob* cj = LUMIX_NEW(m_job_allocator, CullingJob)(m_spheres,
-			m_layer_masks,
-			m_sphere_to_renderable_map,
-			layer_mask,
-			m_result[i],
-			i * step,
-			count - 1,
-			frustum,
-			m_mtjd_manager,
-			m_allocator,
-			m_job_allocator);
-		cj->addDependency(&m_sync_point);
-		jobs[i] = cj;
-
-		for (i = 0; i < cpu_count; ++i)
+		for (int i = 0; i < cpu_count; ++i)
 		{
 			m_mtjd_manager.schedule(jobs[i]);
 		}
@@ -239,13 +557,17 @@ public:
 
 	void setLayerMask(ComponentIndex renderable, int64 layer) override
 	{
-		m_layer_masks[m_renderable_to_sphere_map[renderable]] = layer;
+		int location = m_renderable_to_sphere_map[renderable];
+		int lane;
+		getBlock(location, &lane).layer_mask[lane] = layer;
+		if (location & STATIC_FLAG) ++m_static_version;
 	}
 
 
 	int64 getLayerMask(ComponentIndex renderable) override
 	{
-		return m_layer_masks[m_renderable_to_sphere_map[renderable]];
+		int lane;
+		return getBlock(m_renderable_to_sphere_map[renderable], &lane).layer_mask[lane];
 	}
 
 
@@ -257,77 +579,400 @@ public:
 			return;
 		}
 
-		m_spheres.push(sphere);
-		m_sphere_to_renderable_map.push(renderable);
-		while(renderable >= m_renderable_to_sphere_map.size())
+		int index = pushLane(m_static_blocks, m_static_count, sphere.m_position, sphere.m_radius, renderable, 1);
+		setLocation(renderable, STATIC_FLAG | index);
+		m_is_static_dirty = true;
+	}
+
+
+	void addDynamic(ComponentIndex renderable, const Sphere& sphere) override
+	{
+		if (renderable < m_renderable_to_sphere_map.size() && m_renderable_to_sphere_map[renderable] != -1)
 		{
-			m_renderable_to_sphere_map.push(-1);
+			ASSERT(false);
+			return;
 		}
-		m_renderable_to_sphere_map[renderable] = m_spheres.size() - 1;
-		m_layer_masks.push(1);
+
+		int index = pushLane(m_dynamic_blocks, m_dynamic_count, sphere.m_position, sphere.m_radius, renderable, 1);
+		setLocation(renderable, index);
 	}
 
 
 	void removeStatic(ComponentIndex renderable) override
 	{
-		int index = m_renderable_to_sphere_map[renderable];
-		if (index < 0) return;
-		ASSERT(index < m_spheres.size());
+		int location = m_renderable_to_sphere_map[renderable];
+		if (location < 0) return;
 
-		m_renderable_to_sphere_map[m_sphere_to_renderable_map.back()] = index;
-		m_spheres[index] = m_spheres.back();
-		m_sphere_to_renderable_map[index] = m_sphere_to_renderable_map.back();
-		m_layer_masks[index] = m_layer_masks.back();
-
-		m_spheres.pop();
-		m_sphere_to_renderable_map.pop();
-		m_layer_masks.pop();
+		if (location & STATIC_FLAG)
+		{
+			// the hole is removed when the hierarchy is rebuilt
+			int index = location & ~STATIC_FLAG;
+			clearLane(m_static_blocks[index >> 2], index & 3);
+			++m_static_holes_count;
+			++m_static_version;
+			if (m_static_holes_count * 2 > m_static_count) m_is_static_dirty = true;
+		}
+		else
+		{
+			ASSERT(location < m_dynamic_count);
+			int last = m_dynamic_count - 1;
+			SphereBlock& block = m_dynamic_blocks[location >> 2];
+			SphereBlock& last_block = m_dynamic_blocks[last >> 2];
+			int lane = location & 3;
+			int last_lane = last & 3;
+			m_renderable_to_sphere_map[last_block.renderable[last_lane]] = location;
+			Sphere last_sphere = getLaneSphere(last_block, last_lane);
+			setLane(block,
+				lane,
+				last_sphere.m_position,
+				last_sphere.m_radius,
+				last_block.renderable[last_lane],
+				last_block.layer_mask[last_lane]);
+
+			clearLane(last_block, last_lane);
+			if (last_lane == 0) m_dynamic_blocks.pop();
+			--m_dynamic_count;
+		}
 		m_renderable_to_sphere_map[renderable] = -1;
 	}
 
 
 	void updateBoundingRadius(float radius, ComponentIndex renderable) override
 	{
-		m_spheres[m_renderable_to_sphere_map[renderable]].m_radius = radius;
+		if (!makeDynamic(renderable)) return;
+		int index = m_renderable_to_sphere_map[renderable];
+		m_dynamic_blocks[index >> 2].radius[index & 3] = radius;
 	}
 
 
 	void updateBoundingPosition(const Vec3& position, ComponentIndex renderable) override
 	{
-		m_spheres[m_renderable_to_sphere_map[renderable]].m_position = position;
+		if (!makeDynamic(renderable)) return;
+		int index = m_renderable_to_sphere_map[renderable];
+		SphereBlock& block = m_dynamic_blocks[index >> 2];
+		block.x[index & 3] = position.x;
+		block.y[index & 3] = position.y;
+		block.z[index & 3] = position.z;
 	}
 
 
 	void insert(const InputSpheres& spheres, const Array<ComponentIndex>& renderables) override
 	{
+		m_static_blocks.reserve((m_static_count + spheres.size() + 3) >> 2);
 		for (int i = 0; i < spheres.size(); i++)
 		{
-			m_spheres.push(spheres[i]);
-			while(m_renderable_to_sphere_map.size() <= renderables[i])
+			int index = pushLane(
+				m_static_blocks, m_static_count, spheres[i].m_position, spheres[i].m_radius, renderables[i], 1);
+			setLocation(renderables[i], STATIC_FLAG | index);
+		}
+		m_is_static_dirty = true;
+	}
+
+
+	Sphere getSphere(ComponentIndex renderable) override
+	{
+		int lane;
+		const SphereBlock& block = getBlock(m_renderable_to_sphere_map[renderable], &lane);
+		return getLaneSphere(block, lane);
+	}
+
+
+private:
+	struct StaticItem
+	{
+		Vec3 position;
+		float radius;
+		ComponentIndex renderable;
+		int64 layer_mask;
+	};
+
+
+	SphereBlock& getBlock(int location, int* lane)
+	{
+		int index = location & ~STATIC_FLAG;
+		*lane = index & 3;
+		SphereBlocks& blocks = (location & STATIC_FLAG) ? m_static_blocks : m_dynamic_blocks;
+		return blocks[index >> 2];
+	}
+
+
+	void setLocation(ComponentIndex renderable, int location)
+	{
+		while(renderable >= m_renderable_to_sphere_map.size())
+		{
+			m_renderable_to_sphere_map.push(-1);
+		}
+		m_renderable_to_sphere_map[renderable] = location;
+	}
+
+
+	// static objects which move are culled with the dynamic ones from then on,
+	// returns false for hidden or removed objects, they must stay out of the culling
+	bool makeDynamic(ComponentIndex renderable)
+	{
+		if (renderable >= m_renderable_to_sphere_map.size()) return false;
+		int location = m_renderable_to_sphere_map[renderable];
+		if (location < 0) return false;
+		if ((location & STATIC_FLAG) == 0) return true;
+
+		int lane;
+		const SphereBlock& block = getBlock(location, &lane);
+		Sphere sphere = getLaneSphere(block, lane);
+		int64 layer_mask = block.layer_mask[lane];
+		removeStatic(renderable);
+		int index =
+			pushLane(m_dynamic_blocks, m_dynamic_count, sphere.m_position, sphere.m_radius, renderable, layer_mask);
+		setLocation(renderable, index);
+		return true;
+	}
+
+
+	static Vec3 minCoords(const Vec3& a, const Vec3& b)
+	{
+		return Vec3(Math::minimum(a.x, b.x), Math::minimum(a.y, b.y), Math::minimum(a.z, b.z));
+	}
+
+
+	static Vec3 maxCoords(const Vec3& a, const Vec3& b)
+	{
+		return Vec3(Math::maximum(a.x, b.x), Math::maximum(a.y, b.y), Math::maximum(a.z, b.z));
+	}
+
+
+	// partially sorts items so the first n have the smallest coordinates on the axis
+	static void selectNth(StaticItem* items, int count, int n, int axis)
+	{
+		int left = 0;
+		int right = count - 1;
+		while (left < right)
+		{
+			float pivot = (&items[(left + right) >> 1].position.x)[axis];
+			int i = left;
+			int j = right;
+			while (i <= j)
+			{
+				while ((&items[i].position.x)[axis] < pivot) ++i;
+				while ((&items[j].position.x)[axis] > pivot) --j;
+				if (i <= j)
+				{
+					StaticItem tmp = items[i];
+					items[i] = items[j];
+					items[j] = tmp;
+					++i;
+					--j;
+				}
+			}
+			if (n <= j)
 			{
-				m_renderable_to_sphere_map.push(-1);
+				right = j;
+			}
+			else if (n >= i)
+			{
+				left = i;
+			}
+			else
+			{
+				break;
 			}
-			m_renderable_to_sphere_map[renderables[i]] = m_spheres.size() - 1;
-			m_sphere_to_renderable_map.push(renderables[i]);
-			m_layer_masks.push(1);
 		}
 	}
 
 
-	const Sphere& getSphere(ComponentIndex renderable) override
+	void buildNode(int node_index, StaticItem* items, int count)
 	{
-		return m_spheres[m_renderable_to_sphere_map[renderable]];
+		Vec3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vec3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		Vec3 centers_min = min;
+		Vec3 centers_max = max;
+		for (int i = 0; i < count; ++i)
+		{
+			Vec3 extent(items[i].radius, items[i].radius, items[i].radius);
+			min = minCoords(min, items[i].position - extent);
+			max = maxCoords(max, items[i].position + extent);
+			centers_min = minCoords(centers_min, items[i].position);
+			centers_max = maxCoords(centers_max, items[i].position);
+		}
+		int first_block = m_static_blocks.size();
+		m_static_nodes[node_index].min = min;
+		m_static_nodes[node_index].max = max;
+		m_static_nodes[node_index].first_block = first_block;
+
+		if (count <= MAX_LEAF_SPHERES)
+		{
+			int lanes_count = first_block * 4;
+			for (int i = 0; i < count; ++i)
+			{
+				const StaticItem& item = items[i];
+				pushLane(m_static_blocks, lanes_count, item.position, item.radius, item.renderable, item.layer_mask);
+			}
+			m_static_nodes[node_index].blocks_count = m_static_blocks.size() - first_block;
+			m_static_nodes[node_index].child = -1;
+			return;
+		}
+
+		Vec3 size = centers_max - centers_min;
+		int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+		// children must start on a block boundary
+		int split = ((count >> 1) + 3) & ~3;
+		selectNth(items, count, split, axis);
+
+		int child = m_static_nodes.size();
+		m_static_nodes.emplace();
+		m_static_nodes.emplace();
+		m_static_nodes[node_index].child = child;
+		buildNode(child, items, split);
+		buildNode(child + 1, items + split, count - split);
+		m_static_nodes[node_index].blocks_count = m_static_blocks.size() - first_block;
+	}
+
+
+	void rebuildStatic()
+	{
+		PROFILE_FUNCTION();
+		Array<StaticItem> items(m_allocator);
+		items.reserve(m_static_count - m_static_holes_count);
+		for (int i = 0; i < m_static_count; ++i)
+		{
+			const SphereBlock& block = m_static_blocks[i >> 2];
+			int lane = i & 3;
+			if (block.renderable[lane] < 0) continue;
+			StaticItem& item = items.emplace();
+			item.position.set(block.x[lane], block.y[lane], block.z[lane]);
+			item.radius = block.radius[lane];
+			item.renderable = block.renderable[lane];
+			item.layer_mask = block.layer_mask[lane];
+		}
+
+		m_static_blocks.clear();
+		m_static_nodes.clear();
+		m_static_roots.clear();
+		if (!items.empty())
+		{
+			m_static_nodes.emplace();
+			buildNode(0, &items[0], items.size());
+		}
+		m_static_count = m_static_blocks.size() * 4;
+		m_static_holes_count = m_static_count - items.size();
+		for (int i = 0; i < m_static_count; ++i)
+		{
+			int renderable = m_static_blocks[i >> 2].renderable[i & 3];
+			if (renderable >= 0) m_renderable_to_sphere_map[renderable] = STATIC_FLAG | i;
+		}
+
+		// split the hierarchy to several subtrees so jobs can share the work
+		if (!m_static_nodes.empty()) m_static_roots.push(0);
+		int roots_count = (int)m_mtjd_manager.getCpuThreadsCount() * ROOTS_PER_JOB;
+		for (int i = 0; i < m_static_roots.size() && m_static_roots.size() < roots_count;)
+		{
+			const StaticNode& node = m_static_nodes[m_static_roots[i]];
+			if (node.child < 0)
+			{
+				++i;
+				continue;
+			}
+			m_static_roots[i] = node.child;
+			m_static_roots.push(node.child + 1);
+		}
+
+		m_is_static_dirty = false;
+		++m_static_version;
+	}
+
+
+	// upper bound of how much the distance of any static sphere to any plane changed
+	static float getPlanesDelta(const CachedView& view, const Frustum& frustum)
+	{
+		float delta = 0;
+		for (int i = 0; i < PLANES_COUNT; ++i)
+		{
+			Vec3 normal_delta = frustum.planes[i].normal - view.planes[i].normal;
+			float d_delta = frustum.planes[i].d - view.planes[i].d;
+			float plane_delta = normal_delta.length() * view.extent +
+								Math::abs(dotProduct(normal_delta, view.position) + d_delta);
+			delta = Math::maximum(delta, plane_delta);
+		}
+		return delta;
+	}
+
+
+	CachedView& findView(const Frustum& frustum, int64 layer_mask, bool* is_cache_hit)
+	{
+		CachedView* oldest = &m_views[0];
+		for (auto& view : m_views)
+		{
+			if (view.is_valid && view.layer_mask == layer_mask && view.static_version == m_static_version &&
+				getPlanesDelta(view, frustum) <= view.band)
+			{
+				*is_cache_hit = true;
+				return view;
+			}
+			if (view.last_used < oldest->last_used) oldest = &view;
+		}
+		*is_cache_hit = false;
+		return *oldest;
+	}
+
+
+	void prepareContext(const Frustum& frustum, int64 layer_mask, int jobs_count)
+	{
+		if (m_is_static_dirty) rebuildStatic();
+
+		CachedView& view = findView(frustum, layer_mask, &m_context.is_cache_hit);
+		view.last_used = ++m_cull_counter;
+		if (!m_context.is_cache_hit)
+		{
+			for (int i = 0; i < PLANES_COUNT; ++i) view.planes[i] = frustum.planes[i];
+			view.position = frustum.position;
+			view.band = frustum.radius > 0 ? frustum.radius * BAND_RATIO : 0;
+			view.extent = 0;
+			if (!m_static_nodes.empty())
+			{
+				// distance to the farthest corner of the static bounds
+				const StaticNode& root = m_static_nodes[0];
+				Vec3 to_min = root.min - view.position;
+				Vec3 to_max = root.max - view.position;
+				Vec3 farthest(Math::maximum(Math::abs(to_min.x), Math::abs(to_max.x)),
+					Math::maximum(Math::abs(to_min.y), Math::abs(to_max.y)),
+					Math::maximum(Math::abs(to_min.z), Math::abs(to_max.z)));
+				view.extent = farthest.length();
+			}
+			view.layer_mask = layer_mask;
+			view.static_version = m_static_version;
+			view.is_valid = true;
+			while (view.inside.size() < jobs_count) view.inside.emplace(m_allocator);
+			while (view.boundary.size() < jobs_count) view.boundary.emplace(m_allocator);
+			while (view.inside.size() > jobs_count) view.inside.pop();
+			while (view.boundary.size() > jobs_count) view.boundary.pop();
+		}
+
+		m_context.static_blocks = &m_static_blocks;
+		m_context.dynamic_blocks = &m_dynamic_blocks;
+		m_context.static_nodes = &m_static_nodes;
+		m_context.static_roots = &m_static_roots;
+		m_context.frustum = frustum;
+		m_context.layer_mask = layer_mask;
+		m_context.view = &view;
+		m_context.jobs_count = jobs_count;
 	}
 
 
 private:
 	IAllocator& m_allocator;
 	FreeList<CullingJob, 16> m_job_allocator;
-	InputSpheres m_spheres;
+	SphereBlocks m_dynamic_blocks;
+	int m_dynamic_count;
+	SphereBlocks m_static_blocks; // in the order of the hierarchy's leaves, new ones at the end
+	int m_static_count;
+	int m_static_holes_count;
+	Array<StaticNode> m_static_nodes;
+	Array<int> m_static_roots; // subtrees split between culling jobs
+	bool m_is_static_dirty;
+	uint32 m_static_version;
+	Array<CachedView> m_views;
+	uint32 m_cull_counter;
+	CullingContext m_context;
 	Results m_result;
-	LayerMasks m_layer_masks;
 	RenderabletoSphereMap m_renderable_to_sphere_map;
-	SphereToRenderableMap m_sphere_to_renderable_map;
 
 	MTJD::Manager& m_mtjd_manager;
 	MTJD::Group m_sync_point;
@@ -345,4 +990,4 @@ void CullingSystem::destroy(CullingSystem& culling_system)
 {
 	LUMIX_DELETE(static_cast<CullingSystemImpl&>(culling_system).getAllocator(), &culling_system);
 }
-}
\ No newline at end of file
+}
@@ -37,7 +37,10 @@ namespace Lumix
 		virtual void cullToFrustum(const Frustum& frustum, int64 layer_mask) = 0;
 		virtual void cullToFrustumAsync(const Frustum& frustum, int64 layer_mask) = 0;
 
+		// static objects are kept in a hierarchy, they become dynamic when their bounds are updated
 		virtual void addStatic(ComponentIndex renderable, const Sphere& sphere) = 0;
+		virtual void addDynamic(ComponentIndex renderable, const Sphere& sphere) = 0;
+		// removes both static and dynamic objects
 		virtual void removeStatic(ComponentIndex renderable) = 0;
 
 		virtual void setLayerMask(ComponentIndex renderable, int64 layer) = 0;
@@ -47,6 +50,6 @@ namespace Lumix
 		virtual void updateBoundingPosition(const Vec3& position, int index) = 0;
 
 		virtual void insert(const InputSpheres& spheres, const Array<ComponentIndex>& renderables) = 0;
-		virtual const Sphere& getSphere(ComponentIndex renderable) = 0;
+		virtual Sphere getSphere(ComponentIndex renderable) = 0;
 	};
 } // ~namespace Lux
\ No newline at end of file
@@ -851,6 +851,75 @@ struct ConvertTask : public Lumix::MT::Task
 	}
 
 
+	static float getPositionError(const Lumix::Vec3& a, const Lumix::Vec3& b, float t, const Lumix::Vec3& value)
+	{
+		Lumix::Vec3 interpolated;
+		Lumix::lerp(a, b, &interpolated, t);
+		return (interpolated - value).length();
+	}
+
+
+	static float getRotationError(const Lumix::Quat& a, const Lumix::Quat& b, float t, const Lumix::Quat& value)
+	{
+		Lumix::Quat interpolated;
+		Lumix::nlerp(a, b, &interpolated, t);
+		float dot = fabs(interpolated.x * value.x + interpolated.y * value.y + interpolated.z * value.z +
+						 interpolated.w * value.w);
+		return 2 * acos(Lumix::Math::minimum(dot, 1.0f));
+	}
+
+
+	static void writePositionTrack(Lumix::OutputBlob& blob,
+		const Lumix::Vec3* positions,
+		const Lumix::Array<int>& keys,
+		Lumix::Array<Lumix::uint16>& packed)
+	{
+		Lumix::Vec3 min = positions[keys[0]];
+		Lumix::Vec3 max = min;
+		for (int key : keys)
+		{
+			const Lumix::Vec3& pos = positions[key];
+			min.set(Lumix::Math::minimum(min.x, pos.x),
+				Lumix::Math::minimum(min.y, pos.y),
+				Lumix::Math::minimum(min.z, pos.z));
+			max.set(Lumix::Math::maximum(max.x, pos.x),
+				Lumix::Math::maximum(max.y, pos.y),
+				Lumix::Math::maximum(max.z, pos.z));
+		}
+		Lumix::Vec3 extent = max - min;
+
+		blob.write((Lumix::uint32)keys.size());
+		blob.write(min);
+		blob.write(extent);
+		for (int key : keys) blob.write((Lumix::uint16)key);
+		packed.resize(keys.size() * 3);
+		for (int i = 0; i < keys.size(); ++i)
+		{
+			const Lumix::Vec3& pos = positions[keys[i]];
+			packed[i * 3] = Lumix::Animation::packPosition(pos.x, min.x, extent.x);
+			packed[i * 3 + 1] = Lumix::Animation::packPosition(pos.y, min.y, extent.y);
+			packed[i * 3 + 2] = Lumix::Animation::packPosition(pos.z, min.z, extent.z);
+		}
+		blob.write(&packed[0], sizeof(packed[0]) * packed.size());
+	}
+
+
+	static void writeRotationTrack(Lumix::OutputBlob& blob,
+		const Lumix::Quat* rotations,
+		const Lumix::Array<int>& keys,
+		Lumix::Array<Lumix::uint16>& packed)
+	{
+		blob.write((Lumix::uint32)keys.size());
+		for (int key : keys) blob.write((Lumix::uint16)key);
+		packed.resize(keys.size() * 3);
+		for (int i = 0; i < keys.size(); ++i)
+		{
+			Lumix::Animation::packRotation(rotations[keys[i]], &packed[i * 3]);
+		}
+		blob.write(&packed[0], sizeof(packed[0]) * packed.size());
+	}
+
+
 	bool saveLumixAnimations()
 	{
 		if (!m_dialog.m_import_animations) return true;
@@ -897,20 +966,29 @@ struct ConvertTask : public Lumix::MT::Task
 											   ? 25
 											   : (animation->mTicksPerSecond == 1 ? 30 : animation->mTicksPerSecond));
 				header.magic = Lumix::Animation::HEADER_MAGIC;
-				header.version = 1;
+				header.version = (Lumix::uint32)Lumix::Animation::Version::COMPRESSED;
 
 				file.write(&header, sizeof(header));
 				float anim_length = getLength(animation);
-				int frame_count = Lumix::Math::maximum(int(anim_length * header.fps), 1);
+				int frame_count = Lumix::Math::clamp(int(anim_length * header.fps), 1, 0xffff);
 				file.write(&frame_count, sizeof(frame_count));
 				int bone_count = (int)animation->mNumChannels;
 				file.write(&bone_count, sizeof(bone_count));
 
-				Lumix::Array<Lumix::Vec3> positions(m_dialog.m_editor.getAllocator());
-				Lumix::Array<Lumix::Quat> rotations(m_dialog.m_editor.getAllocator());
-
-				positions.resize(bone_count * frame_count);
-				rotations.resize(bone_count * frame_count);
+				auto& allocator = m_dialog.m_editor.getAllocator();
+				Lumix::Array<Lumix::Vec3> positions(allocator);
+				Lumix::Array<Lumix::Quat> rotations(allocator);
+				Lumix::Array<int> position_keys(allocator);
+				Lumix::Array<int> rotation_keys(allocator);
+				Lumix::Array<Lumix::uint16> packed(allocator);
+				Lumix::OutputBlob tracks(allocator);
+				Lumix::uint32 position_key_count = 0;
+				Lumix::uint32 rotation_key_count = 0;
+				float max_position_error = m_dialog.m_model.animation_position_error;
+				float max_rotation_error = Lumix::Math::degreesToRadians(m_dialog.m_model.animation_rotation_error);
+
+				positions.resize(frame_count);
+				rotations.resize(frame_count);
 
 				for (unsigned int channel_idx = 0; channel_idx < animation->mNumChannels; ++channel_idx)
 				{
@@ -926,20 +1004,27 @@ struct ConvertTask : public Lumix::MT::Task
 						pos.x *= scale.x;
 						pos.y *= scale.y;
 						pos.z *= scale.z;
-						positions[frame * bone_count + channel_idx] = pos;
-						rotations[frame * bone_count + channel_idx] = getRotation(channel, frame, header.fps);
+						positions[frame] = pos;
+						rotations[frame] = getRotation(channel, frame, header.fps);
 					}
+
+					Lumix::Animation::reduceKeys(&positions[0], frame_count, max_position_error, getPositionError, position_keys);
+					Lumix::Animation::reduceKeys(&rotations[0], frame_count, max_rotation_error, getRotationError, rotation_keys);
+					position_key_count += position_keys.size();
+					rotation_key_count += rotation_keys.size();
+					writePositionTrack(tracks, &positions[0], position_keys, packed);
+					writeRotationTrack(tracks, &rotations[0], rotation_keys, packed);
 				}
 
-				file.write((const char*)&positions[0], sizeof(positions[0]) * positions.size());
-				file.write((const char*)&rotations[0], sizeof(rotations[0]) * rotations.size());
+				file.write(&position_key_count, sizeof(position_key_count));
+				file.write(&rotation_key_count, sizeof(rotation_key_count));
 				for (unsigned int channel_idx = 0; channel_idx < animation->mNumChannels; ++channel_idx)
 				{
 					const aiNodeAnim* channel = animation->mChannels[channel_idx];
 					uint32_t hash = Lumix::crc32(channel->mNodeName.C_Str());
 					file.write((const char*)&hash, sizeof(hash));
 				}
-
+				file.write(tracks.getData(), tracks.getPos());
 
 				file.close();
 			}
@@ -1919,6 +2004,8 @@ ImportAssetDialog::ImportAssetDialog(StudioApp& app)
 {
 	m_model.make_convex = false;
 	m_model.mesh_scale = 1;
+	m_model.animation_position_error = 0.001f;
+	m_model.animation_rotation_error = 0.1f;
 	m_model.remove_doubles = false;
 	m_model.create_billboard_lod = false;
 	m_model.lods[0] = 10;
@@ -2563,6 +2650,16 @@ int ImportAssetDialog::importAsset(lua_State* L)
 		m_model.mesh_scale = Lumix::LuaWrapper::toType<float>(L, -1);
 	}
 	lua_pop(L, 1);
+	if (lua_getfield(L, 2, "animation_position_error") == LUA_TNUMBER)
+	{
+		m_model.animation_position_error = Lumix::LuaWrapper::toType<float>(L, -1);
+	}
+	lua_pop(L, 1);
+	if (lua_getfield(L, 2, "animation_rotation_error") == LUA_TNUMBER)
+	{
+		m_model.animation_rotation_error = Lumix::LuaWrapper::toType<float>(L, -1);
+	}
+	lua_pop(L, 1);
 
 	if (lua_getfield(L, 2, "output_dir") == LUA_TSTRING)
 	{
@@ -2858,6 +2955,11 @@ void ImportAssetDialog::onWindowGUI()
 			{
 				ImGui::Checkbox(
 					Lumix::StaticString<50>("Import animations (", animations_count, ")"), &m_import_animations);
+				if (m_import_animations)
+				{
+					ImGui::DragFloat("Max position error", &m_model.animation_position_error, 0.0001f, 0, FLT_MAX, "%.4f");
+					ImGui::DragFloat("Max rotation error (deg)", &m_model.animation_rotation_error, 0.01f, 0, 180);
+				}
 			}
 
 			onMeshesGUI();
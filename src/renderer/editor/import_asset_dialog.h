@@ -133,6 +133,8 @@ class ImportAssetDialog : public StudioApp::IPlugin
 		struct ModelData
 		{
 			float mesh_scale;
+			float animation_position_error;
+			float animation_rotation_error;
 			float lods[4];
 			bool create_billboard_lod;
 			bool optimize_mesh_on_import;
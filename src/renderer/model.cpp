@@ -65,6 +65,11 @@ Model::Model(const Path& path, ResourceManager& resource_manager, IAllocator& al
 	, m_bones(m_allocator)
 	, m_indices(m_allocator)
 	, m_vertices(m_allocator)
+	, m_bvh(m_allocator)
+	, m_material_paths(m_allocator)
+	, m_decoded_vertices(nullptr)
+	, m_decoded_indices(nullptr)
+	, m_bones_hash(0)
 	, m_vertices_handle(BGFX_INVALID_HANDLE)
 	, m_indices_handle(BGFX_INVALID_HANDLE)
 {
@@ -86,85 +91,61 @@ RayCastModelHit Model::castRay(const Vec3& origin,
 							   const Matrix& model_transform)
 {
 	RayCastModelHit hit;
-	hit.m_is_hit = false;
-	if (!isReady()) return hit;
+	castRays(&origin, &dir, 1, model_transform, &hit);
+	return hit;
+}
+
+
+void Model::castRays(const Vec3* origins,
+	const Vec3* dirs,
+	int count,
+	const Matrix& model_transform,
+	RayCastModelHit* hits)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		hits[i].m_is_hit = false;
+		hits[i].m_origin = origins[i];
+		hits[i].m_dir = dirs[i];
+	}
+	if (!isReady()) return;
 
 	Matrix inv = model_transform;
 	inv.inverse();
-	Vec3 local_origin = inv.multiplyPosition(origin);
-	Vec3 local_dir = static_cast<Vec3>(inv * Vec4(dir.x, dir.y, dir.z, 0));
 
-	const Array<Vec3>& vertices = m_vertices;
-	uint16* indices16 = (uint16*)&m_indices[0];
-	uint32* indices32 = (uint32*)&m_indices[0];
-	int vertex_offset = 0;
-	bool is16 = m_flags & (uint32)Model::Flags::INDICES_16BIT;
-	for (int mesh_index = 0; mesh_index < m_meshes.size(); ++mesh_index)
+	// rays are processed in local space, t is the same as in world space
+	static const int BATCH_SIZE = 64;
+	Vec3 local_origins[BATCH_SIZE];
+	Vec3 local_dirs[BATCH_SIZE];
+	TriangleBVH::Hit bvh_hits[BATCH_SIZE];
+	for (int first = 0; first < count; first += BATCH_SIZE)
 	{
-		int indices_end = m_meshes[mesh_index].indices_offset + m_meshes[mesh_index].indices_count;
-		for(int i = m_meshes[mesh_index].indices_offset; i < indices_end; i += 3)
+		int batch_size = Math::minimum(BATCH_SIZE, count - first);
+		for (int i = 0; i < batch_size; ++i)
 		{
-			Vec3 p0, p1, p2;
-			if(is16)
-			{
-				p0 = vertices[vertex_offset + indices16[i]];
-				p1 = vertices[vertex_offset + indices16[i + 1]];
-				p2 = vertices[vertex_offset + indices16[i + 2]];
-			}
-			else
-			{
-				p0 = vertices[vertex_offset + indices32[i]];
-				p1 = vertices[vertex_offset + indices32[i + 1]];
-				p2 = vertices[vertex_offset + indices32[i + 2]];
-			}
-			Vec3 normal = crossProduct(p1 - p0, p2 - p0);
-			float q = dotProduct(normal, local_dir);
-			if (q == 0)
-			{
-				continue;
-			}
-			float d = -dotProduct(normal, p0);
-			float t = -(dotProduct(normal, local_origin) + d) / q;
-			if (t < 0)
-			{
-				continue;
-			}
-			Vec3 hit_point = local_origin + local_dir * t;
-
-			Vec3 edge0 = p1 - p0;
-			Vec3 VP0 = hit_point - p0;
-			if (dotProduct(normal, crossProduct(edge0, VP0)) < 0)
-			{
-				continue;
-			}
-
-			Vec3 edge1 = p2 - p1;
-			Vec3 VP1 = hit_point - p1;
-			if (dotProduct(normal, crossProduct(edge1, VP1)) < 0)
-			{
-				continue;
-			}
+			const Vec3& dir = dirs[first + i];
+			local_origins[i] = inv.multiplyPosition(origins[first + i]);
+			local_dirs[i] = static_cast<Vec3>(inv * Vec4(dir.x, dir.y, dir.z, 0));
+		}
 
-			Vec3 edge2 = p0 - p2;
-			Vec3 VP2 = hit_point - p2;
-			if (dotProduct(normal, crossProduct(edge2, VP2)) < 0)
-			{
-				continue;
-			}
+		if (batch_size == 1)
+		{
+			bvh_hits[0] = m_bvh.castRay(local_origins[0], local_dirs[0], FLT_MAX);
+		}
+		else
+		{
+			m_bvh.castRays(local_origins, local_dirs, batch_size, FLT_MAX, bvh_hits);
+		}
 
-			if (!hit.m_is_hit || hit.m_t > t)
-			{
-				hit.m_is_hit = true;
-				hit.m_t = t;
-				hit.m_mesh = &m_meshes[mesh_index];
-			}
+		for (int i = 0; i < batch_size; ++i)
+		{
+			if (!bvh_hits[i].is_hit) continue;
+			RayCastModelHit& hit = hits[first + i];
+			hit.m_is_hit = true;
+			hit.m_t = bvh_hits[i].t;
+			hit.m_mesh = &m_meshes[bvh_hits[i].tag];
 		}
-		vertex_offset += m_meshes[mesh_index].attribute_array_size /
-						 m_meshes[mesh_index].vertex_def.getStride();
 	}
-	hit.m_origin = origin;
-	hit.m_dir = dir;
-	return hit;
 }
 
 
@@ -288,6 +269,7 @@ void Model::create(const bgfx::VertexDecl& def,
 	m_indices.resize(indices_size);
 	copyMemory(&m_indices[0], indices_data, indices_size);
 
+	m_flags = 0;
 	m_vertices.resize(attributes_size / def.getStride());
 	computeRuntimeData((const uint8*)attributes_data);
 
@@ -326,6 +308,48 @@ void Model::computeRuntimeData(const uint8* vertices)
 
 	m_bounding_radius = sqrt(bounding_radius_squared);
 	m_aabb = AABB(min_vertex, max_vertex);
+
+	buildBVH();
+}
+
+
+void Model::buildBVH()
+{
+	int triangles_count = 0;
+	for (const Mesh& mesh : m_meshes) triangles_count += mesh.indices_count / 3;
+	if (triangles_count == 0 || m_vertices.empty())
+	{
+		m_bvh.clear();
+		return;
+	}
+
+	Array<uint32> indices(m_allocator);
+	Array<int> mesh_indices(m_allocator);
+	indices.resize(triangles_count * 3);
+	mesh_indices.resize(triangles_count);
+
+	const uint16* indices16 = (const uint16*)&m_indices[0];
+	const uint32* indices32 = (const uint32*)&m_indices[0];
+	bool is16 = (m_flags & (uint32)Model::Flags::INDICES_16BIT) != 0;
+	int vertex_offset = 0;
+	int triangle = 0;
+	for (int mesh_index = 0; mesh_index < m_meshes.size(); ++mesh_index)
+	{
+		const Mesh& mesh = m_meshes[mesh_index];
+		int indices_end = mesh.indices_offset + mesh.indices_count / 3 * 3;
+		for (int i = mesh.indices_offset; i < indices_end; i += 3)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				indices[triangle * 3 + j] = vertex_offset + (is16 ? indices16[i + j] : indices32[i + j]);
+			}
+			mesh_indices[triangle] = mesh_index;
+			++triangle;
+		}
+		vertex_offset += mesh.attribute_array_size / mesh.vertex_def.getStride();
+	}
+
+	m_bvh.build(&m_vertices[0], &indices[0], &mesh_indices[0], triangles_count);
 }
 
 
@@ -336,23 +360,21 @@ bool Model::parseGeometry(FS::IFile& file)
 	if (indices_count <= 0) return false;
 
 	int index_size = (m_flags & (uint32)Model::Flags::INDICES_16BIT) ? 2 : 4;
-	m_indices.resize(indices_count * index_size);
-	file.read(&m_indices[0], index_size * indices_count);
+	int indices_size = index_size * indices_count;
+	m_indices.resize(indices_size);
+	file.read(&m_indices[0], indices_size);
 
 	int32 vertices_size = 0;
 	file.read(&vertices_size, sizeof(vertices_size));
 	if (vertices_size <= 0) return false;
 
-	ASSERT(!bgfx::isValid(m_vertices_handle));
-	const bgfx::Memory* vertices_mem = bgfx::alloc(vertices_size);
-	file.read(vertices_mem->data, vertices_size);
-	m_vertices_handle = bgfx::createVertexBuffer(vertices_mem, m_meshes[0].vertex_def);
+	ASSERT(!m_decoded_vertices && !m_decoded_indices);
+	m_decoded_vertices = (uint8*)m_allocator.allocate(vertices_size);
+	file.read(m_decoded_vertices, vertices_size);
 	m_vertices_size = vertices_size;
 
-	ASSERT(!bgfx::isValid(m_indices_handle));
-	int indices_size = index_size * indices_count;
-	const bgfx::Memory* mem = bgfx::copy(&m_indices[0], indices_size);
-	m_indices_handle = bgfx::createIndexBuffer(mem, index_size == 4 ? BGFX_BUFFER_INDEX32 : 0);
+	m_decoded_indices = (uint8*)m_allocator.allocate(indices_size);
+	copyMemory(m_decoded_indices, &m_indices[0], indices_size);
 
 	int vertex_count = 0;
 	for (int i = 0; i < m_meshes.size(); ++i)
@@ -361,7 +383,7 @@ bool Model::parseGeometry(FS::IFile& file)
 	}
 	m_vertices.resize(vertex_count);
 
-	computeRuntimeData(vertices_mem->data);
+	computeRuntimeData(m_decoded_vertices);
 
 	return true;
 }
@@ -375,6 +397,7 @@ bool Model::parseBones(FS::IFile& file)
 		return false;
 	}
 	m_bones.reserve(bone_count);
+	m_bones_hash = 0;
 	for (int i = 0; i < bone_count; ++i)
 	{
 		Model::Bone& b = m_bones.emplace(m_allocator);
@@ -388,7 +411,10 @@ bool Model::parseBones(FS::IFile& file)
 		file.read(tmp, len);
 		tmp[len] = 0;
 		b.name = tmp;
-		m_bone_map.insert(crc32(b.name.c_str()), m_bones.size() - 1);
+		uint32 name_hash = crc32(b.name.c_str());
+		m_bone_map.insert(name_hash, m_bones.size() - 1);
+		uint32 hashes[] = { m_bones_hash, name_hash };
+		m_bones_hash = crc32(hashes, sizeof(hashes));
 		file.read(&len, sizeof(len));
 		if (len >= MAX_PATH_LENGTH)
 		{
@@ -461,6 +487,7 @@ bool Model::parseMeshes(FS::IFile& file)
 	if (object_count <= 0) return false;
 
 	m_meshes.reserve(object_count);
+	m_material_paths.reserve(object_count);
 	char model_dir[MAX_PATH_LENGTH];
 	PathUtils::getDir(model_dir, MAX_PATH_LENGTH, getPath().c_str());
 	for (int i = 0; i < object_count; ++i)
@@ -478,9 +505,6 @@ bool Model::parseMeshes(FS::IFile& file)
 		catString(material_path, material_name);
 		catString(material_path, ".mat");
 
-		auto* material_manager = m_resource_manager.get(ResourceManager::MATERIAL);
-		Material* material = static_cast<Material*>(material_manager->load(Path(material_path)));
-
 		int32 attribute_array_offset = 0;
 		file.read(&attribute_array_offset, sizeof(attribute_array_offset));
 		int32 attribute_array_size = 0;
@@ -491,11 +515,7 @@ bool Model::parseMeshes(FS::IFile& file)
 		file.read(&mesh_tri_count, sizeof(mesh_tri_count));
 
 		file.read(&str_size, sizeof(str_size));
-		if (str_size >= MAX_PATH_LENGTH)
-		{
-			material_manager->unload(*material);
-			return false;
-		}
+		if (str_size >= MAX_PATH_LENGTH) return false;
 
 		char mesh_name[MAX_PATH_LENGTH];
 		mesh_name[str_size] = 0;
@@ -504,14 +524,14 @@ bool Model::parseMeshes(FS::IFile& file)
 		bgfx::VertexDecl def;
 		parseVertexDef(file, &def);
 		m_meshes.emplace(def,
-						 material,
+						 nullptr,
 						 attribute_array_offset,
 						 attribute_array_size,
 						 indices_offset,
 						 mesh_tri_count * 3,
 						 mesh_name,
 						 m_allocator);
-		addDependency(*material);
+		m_material_paths.emplace(material_path);
 	}
 	return true;
 }
@@ -535,7 +555,7 @@ bool Model::parseLODs(FS::IFile& file)
 }
 
 
-bool Model::load(FS::IFile& file)
+bool Model::decode(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
 	FileHeader header;
@@ -561,7 +581,6 @@ bool Model::load(FS::IFile& file)
 
 	if (parseMeshes(file) && parseGeometry(file) && parseBones(file) && parseLODs(file))
 	{
-		m_size = file.size();
 		return true;
 	}
 
@@ -569,16 +588,67 @@ bool Model::load(FS::IFile& file)
 	return false;
 }
 
+
+static void releaseDecodedData(void* ptr, void* user_data)
+{
+	static_cast<IAllocator*>(user_data)->deallocate(ptr);
+}
+
+
+bool Model::load(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	auto* material_manager = m_resource_manager.get(ResourceManager::MATERIAL);
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		Material* material = static_cast<Material*>(material_manager->load(m_material_paths[i]));
+		m_meshes[i].material = material;
+		addDependency(*material);
+	}
+	m_material_paths.clear();
+
+	ASSERT(!bgfx::isValid(m_vertices_handle));
+	const bgfx::Memory* vertices_mem =
+		bgfx::makeRef(m_decoded_vertices, m_vertices_size, releaseDecodedData, &m_allocator);
+	m_vertices_handle = bgfx::createVertexBuffer(vertices_mem, m_meshes[0].vertex_def);
+
+	ASSERT(!bgfx::isValid(m_indices_handle));
+	bool is16 = (m_flags & (uint32)Model::Flags::INDICES_16BIT) != 0;
+	const bgfx::Memory* indices_mem =
+		bgfx::makeRef(m_decoded_indices, m_indices.size(), releaseDecodedData, &m_allocator);
+	m_indices_handle = bgfx::createIndexBuffer(indices_mem, is16 ? 0 : BGFX_BUFFER_INDEX32);
+
+	m_decoded_vertices = nullptr;
+	m_decoded_indices = nullptr;
+	m_size = file.size();
+	return true;
+}
+
+
+void Model::freeDecodedData()
+{
+	m_allocator.deallocate(m_decoded_vertices);
+	m_allocator.deallocate(m_decoded_indices);
+	m_decoded_vertices = nullptr;
+	m_decoded_indices = nullptr;
+	m_material_paths.clear();
+}
+
+
 void Model::unload(void)
 {
 	auto* material_manager = m_resource_manager.get(ResourceManager::MATERIAL);
 	for (int i = 0; i < m_meshes.size(); ++i)
 	{
+		// meshes of a model which was only decoded do not have materials yet
+		if (!m_meshes[i].material) continue;
 		removeDependency(*m_meshes[i].material);
 		material_manager->unload(*m_meshes[i].material);
 	}
 	m_meshes.clear();
 	m_bones.clear();
+	m_bvh.clear();
+	freeDecodedData();
 
 	if(bgfx::isValid(m_vertices_handle)) bgfx::destroyVertexBuffer(m_vertices_handle);
 	if(bgfx::isValid(m_indices_handle)) bgfx::destroyIndexBuffer(m_indices_handle);
@@ -9,6 +9,7 @@
 #include "engine/core/string.h"
 #include "engine/core/vec.h"
 #include "engine/core/resource.h"
+#include "renderer/triangle_bvh.h"
 #include <bgfx/bgfx.h>
 
 
@@ -149,9 +150,16 @@ public:
 	const Bone& getBone(int i) const { return m_bones[i]; }
 	int getFirstNonrootBoneIndex() const { return m_first_nonroot_bone_index; }
 	BoneMap::iterator getBoneIndex(uint32 hash) { return m_bone_map.find(hash); }
+	// hash of the bone names in order, models with the same skeleton have the same hash
+	uint32 getBonesHash() const { return m_bones_hash; }
 	void getPose(Pose& pose);
 	float getBoundingRadius() const { return m_bounding_radius; }
 	RayCastModelHit castRay(const Vec3& origin, const Vec3& dir, const Matrix& model_transform);
+	void castRays(const Vec3* origins,
+		const Vec3* dirs,
+		int count,
+		const Matrix& model_transform,
+		RayCastModelHit* hits);
 	const AABB& getAABB() const { return m_aabb; }
 	LOD* getLODs() { return m_lods; }
 	Array<uint8>& getIndices() { return m_indices; }
@@ -172,8 +180,11 @@ private:
 	bool parseLODs(FS::IFile& file);
 	int getBoneIdx(const char* name);
 	void computeRuntimeData(const uint8* vertices);
+	void buildBVH();
+	void freeDecodedData();
 
 	void unload(void) override;
+	bool decode(FS::IFile& file) override;
 	bool load(FS::IFile& file) override;
 
 private:
@@ -185,9 +196,14 @@ private:
 	Array<Bone> m_bones;
 	Array<uint8> m_indices;
 	Array<Vec3> m_vertices;
+	TriangleBVH m_bvh;
+	Array<Path> m_material_paths;
+	uint8* m_decoded_vertices;
+	uint8* m_decoded_indices;
 	LOD m_lods[MAX_LOD_COUNT];
 	float m_bounding_radius;
 	BoneMap m_bone_map;
+	uint32 m_bones_hash;
 	AABB m_aabb;
 	uint32 m_flags;
 	int m_first_nonroot_bone_index;
@@ -11,6 +11,7 @@
 #include "renderer/render_scene.h"
 #include "engine/universe/universe.h"
 #include <cmath>
+#include <emmintrin.h>
 
 
 enum class ParticleEmitterVersion : int
@@ -60,6 +61,126 @@ static ParticleEmitter::ModuleBase* createModule(uint32 type, ParticleEmitter& e
 }
 
 
+// 4 Vec3s (12 floats) <-> x, y and z of 4 particles
+static LUMIX_FORCE_INLINE void loadVec3x4(const Vec3* src, __m128* x, __m128* y, __m128* z)
+{
+	const float* f = &src->x;
+	__m128 a = _mm_loadu_ps(f);
+	__m128 b = _mm_loadu_ps(f + 4);
+	__m128 c = _mm_loadu_ps(f + 8);
+	*x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	*y = _mm_shuffle_ps(
+		_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	*z = _mm_shuffle_ps(
+		_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+
+static LUMIX_FORCE_INLINE void storeVec3x4(Vec3* dst, __m128 x, __m128 y, __m128 z)
+{
+	float* f = &dst->x;
+	_mm_storeu_ps(f,
+		_mm_shuffle_ps(
+			_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(f + 4,
+		_mm_shuffle_ps(
+			_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(f + 8,
+		_mm_shuffle_ps(
+			_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+
+// dst[i] += src[i] * scale
+static void addScaled(float* LUMIX_RESTRICT dst, const float* LUMIX_RESTRICT src, float scale, int count)
+{
+	__m128 scale4 = _mm_set1_ps(scale);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 value = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), scale4));
+		_mm_storeu_ps(dst + i, value);
+	}
+	for (; i < count; ++i)
+	{
+		dst[i] += src[i] * scale;
+	}
+}
+
+
+// dst[i] += value, 4 Vec3s are 3 registers with the value repeated in them
+static void addToAll(Vec3* dst, const Vec3& value, int count)
+{
+	__m128 a = _mm_setr_ps(value.x, value.y, value.z, value.x);
+	__m128 b = _mm_setr_ps(value.y, value.z, value.x, value.y);
+	__m128 c = _mm_setr_ps(value.z, value.x, value.y, value.z);
+	float* f = &dst->x;
+	int i = 0;
+	for (; i + 4 <= count; i += 4, f += 12)
+	{
+		_mm_storeu_ps(f, _mm_add_ps(_mm_loadu_ps(f), a));
+		_mm_storeu_ps(f + 4, _mm_add_ps(_mm_loadu_ps(f + 4), b));
+		_mm_storeu_ps(f + 8, _mm_add_ps(_mm_loadu_ps(f + 8), c));
+	}
+	for (; i < count; ++i)
+	{
+		dst[i] += value;
+	}
+}
+
+
+// dst[i] = curve sampled at rel_life[i]
+static void sampleCurve(float* LUMIX_RESTRICT dst,
+	const float* LUMIX_RESTRICT rel_life,
+	const Array<float>& sampled,
+	int count)
+{
+	int last = sampled.size() - 1;
+	const float* values = &sampled[0];
+	__m128 scale = _mm_set1_ps((float)last);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 float_idx = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(rel_life + i), zero), one), scale);
+		__m128i idx4 = _mm_cvttps_epi32(float_idx);
+		__m128 w = _mm_sub_ps(float_idx, _mm_cvtepi32_ps(idx4));
+		int idx[4];
+		_mm_storeu_si128((__m128i*)idx, idx4);
+		__m128 v0 = _mm_setr_ps(values[idx[0]], values[idx[1]], values[idx[2]], values[idx[3]]);
+		__m128 v1 = _mm_setr_ps(values[Math::minimum(idx[0] + 1, last)],
+			values[Math::minimum(idx[1] + 1, last)],
+			values[Math::minimum(idx[2] + 1, last)],
+			values[Math::minimum(idx[3] + 1, last)]);
+		_mm_storeu_ps(dst + i, _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), w)));
+	}
+	for (; i < count; ++i)
+	{
+		float float_idx = last * Math::clamp(rel_life[i], 0.0f, 1.0f);
+		int idx = (int)float_idx;
+		int next_idx = Math::minimum(idx + 1, last);
+		float w = float_idx - idx;
+		dst[i] = values[idx] * (1 - w) + values[next_idx] * w;
+	}
+}
+
+
+// removes particles with rel_life > 1 from values, the order of the rest is kept,
+// rel_life can point to values
+template <typename T>
+static void compactParticles(Array<T>& values, const float* rel_life, int first_dead)
+{
+	T* data = &values[0];
+	int dst = first_dead;
+	for (int i = first_dead + 1, c = values.size(); i < c; ++i)
+	{
+		if (rel_life[i] <= 1) data[dst++] = data[i];
+	}
+	values.resize(dst);
+}
+
+
 ParticleEmitter::ModuleBase::ModuleBase(ParticleEmitter& emitter)
 	: m_emitter(emitter)
 {
@@ -89,11 +210,7 @@ void ParticleEmitter::ForceModule::update(float time_delta)
 {
 	if (m_emitter.m_velocity.empty()) return;
 
-	Vec3* LUMIX_RESTRICT particle_velocity = &m_emitter.m_velocity[0];
-	for (int i = 0, c = m_emitter.m_velocity.size(); i < c; ++i)
-	{
-		particle_velocity[i] += m_acceleration * time_delta;
-	}
+	addToAll(&m_emitter.m_velocity[0], m_acceleration * time_delta, m_emitter.m_velocity.size());
 }
 
 
@@ -136,6 +253,8 @@ void ParticleEmitter::AttractorModule::update(float time_delta)
 
 	Vec3* LUMIX_RESTRICT particle_pos = &m_emitter.m_position[0];
 	Vec3* LUMIX_RESTRICT particle_vel = &m_emitter.m_velocity[0];
+	int count = m_emitter.m_position.size();
+	float force = m_force * time_delta;
 
 	for(int i = 0; i < m_count; ++i)
 	{
@@ -144,12 +263,33 @@ void ParticleEmitter::AttractorModule::update(float time_delta)
 		if (!m_emitter.m_universe.hasEntity(entity)) continue;
 		Vec3 pos = m_emitter.m_universe.getPosition(entity);
 
-		for(int i = m_emitter.m_position.size() - 1; i >= 0; --i)
+		__m128 center_x = _mm_set1_ps(pos.x);
+		__m128 center_y = _mm_set1_ps(pos.y);
+		__m128 center_z = _mm_set1_ps(pos.z);
+		__m128 force4 = _mm_set1_ps(force);
+		int j = 0;
+		for (; j + 4 <= count; j += 4)
 		{
-			Vec3 to_center = pos - particle_pos[i];
+			__m128 px, py, pz, vx, vy, vz;
+			loadVec3x4(particle_pos + j, &px, &py, &pz);
+			loadVec3x4(particle_vel + j, &vx, &vy, &vz);
+			__m128 dx = _mm_sub_ps(center_x, px);
+			__m128 dy = _mm_sub_ps(center_y, py);
+			__m128 dz = _mm_sub_ps(center_z, pz);
+			__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			// normalized direction * force / dist2
+			__m128 k = _mm_div_ps(force4, _mm_mul_ps(dist2, _mm_sqrt_ps(dist2)));
+			vx = _mm_add_ps(vx, _mm_mul_ps(dx, k));
+			vy = _mm_add_ps(vy, _mm_mul_ps(dy, k));
+			vz = _mm_add_ps(vz, _mm_mul_ps(dz, k));
+			storeVec3x4(particle_vel + j, vx, vy, vz);
+		}
+		for (; j < count; ++j)
+		{
+			Vec3 to_center = pos - particle_pos[j];
 			float dist2 = to_center.squaredLength();
 			to_center *= 1 / sqrt(dist2);
-			particle_vel[i] = particle_vel[i] + to_center * (m_force / dist2) * time_delta;
+			particle_vel[j] = particle_vel[j] + to_center * (force / dist2);
 		}
 	}
 }
@@ -225,6 +365,7 @@ void ParticleEmitter::PlaneModule::update(float time_delta)
 
 	Vec3* LUMIX_RESTRICT particle_pos = &m_emitter.m_position[0];
 	Vec3* LUMIX_RESTRICT particle_vel = &m_emitter.m_velocity[0];
+	int count = m_emitter.m_position.size();
 
 	for (int i = 0; i < m_count; ++i)
 	{
@@ -234,13 +375,41 @@ void ParticleEmitter::PlaneModule::update(float time_delta)
 		Vec3 normal = m_emitter.m_universe.getRotation(entity) * Vec3(0, 1, 0);
 		float D = -dotProduct(normal, m_emitter.m_universe.getPosition(entity));
 
-		for (int i = m_emitter.m_position.size() - 1; i >= 0; --i)
+		__m128 nx = _mm_set1_ps(normal.x);
+		__m128 ny = _mm_set1_ps(normal.y);
+		__m128 nz = _mm_set1_ps(normal.z);
+		__m128 d4 = _mm_set1_ps(D);
+		__m128 bounce = _mm_set1_ps(m_bounce);
+		__m128 zero = _mm_setzero_ps();
+		int j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128 px, py, pz;
+			loadVec3x4(particle_pos + j, &px, &py, &pz);
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_add_ps(_mm_mul_ps(nz, pz), d4));
+			__m128 below = _mm_cmplt_ps(dist, zero);
+			if (_mm_movemask_ps(below) == 0) continue;
+
+			__m128 vx, vy, vz;
+			loadVec3x4(particle_vel + j, &vx, &vy, &vz);
+			__m128 ndotv2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vx), _mm_mul_ps(ny, vy)), _mm_mul_ps(nz, vz));
+			ndotv2 = _mm_add_ps(ndotv2, ndotv2);
+			__m128 rx = _mm_mul_ps(_mm_sub_ps(vx, _mm_mul_ps(nx, ndotv2)), bounce);
+			__m128 ry = _mm_mul_ps(_mm_sub_ps(vy, _mm_mul_ps(ny, ndotv2)), bounce);
+			__m128 rz = _mm_mul_ps(_mm_sub_ps(vz, _mm_mul_ps(nz, ndotv2)), bounce);
+			vx = _mm_or_ps(_mm_and_ps(below, rx), _mm_andnot_ps(below, vx));
+			vy = _mm_or_ps(_mm_and_ps(below, ry), _mm_andnot_ps(below, vy));
+			vz = _mm_or_ps(_mm_and_ps(below, rz), _mm_andnot_ps(below, vz));
+			storeVec3x4(particle_vel + j, vx, vy, vz);
+		}
+		for (; j < count; ++j)
 		{
-			const auto& pos = particle_pos[i];
+			const auto& pos = particle_pos[j];
 			if (dotProduct(normal, pos) + D < 0)
 			{
-				float NdotV = dotProduct(normal, particle_vel[i]);
-				particle_vel[i] = (particle_vel[i] - normal * (2 * NdotV)) * m_bounce;
+				float NdotV = dotProduct(normal, particle_vel[j]);
+				particle_vel[j] = (particle_vel[j] - normal * (2 * NdotV)) * m_bounce;
 			}
 		}
 	}
@@ -284,11 +453,12 @@ void ParticleEmitter::SpawnShapeModule::spawnParticle(int index)
 {
 	// ugly and ~0.1% from uniform distribution, but still faster than the correct solution
 	float r2 = m_radius * m_radius;
+	RandomGenerator& random = m_emitter.m_random;
 	for (int i = 0; i < 10; ++i)
 	{
-		Vec3 v(m_radius * Math::randFloat(-1, 1),
-			m_radius * Math::randFloat(-1, 1),
-			m_radius * Math::randFloat(-1, 1));
+		Vec3 v(m_radius * random.randFloat(-1, 1),
+			m_radius * random.randFloat(-1, 1),
+			m_radius * random.randFloat(-1, 1));
 
 		if (v.squaredLength() < r2)
 		{
@@ -324,9 +494,9 @@ ParticleEmitter::LinearMovementModule::LinearMovementModule(ParticleEmitter& emi
 
 void ParticleEmitter::LinearMovementModule::spawnParticle(int index)
 {
-	m_emitter.m_velocity[index].x = m_x.getRandom();
-	m_emitter.m_velocity[index].y = m_y.getRandom();
-	m_emitter.m_velocity[index].z = m_z.getRandom();
+	m_emitter.m_velocity[index].x = m_x.getRandom(m_emitter.m_random);
+	m_emitter.m_velocity[index].y = m_y.getRandom(m_emitter.m_random);
+	m_emitter.m_velocity[index].z = m_z.getRandom(m_emitter.m_random);
 }
 
 
@@ -432,18 +602,7 @@ void ParticleEmitter::AlphaModule::update(float)
 {
 	if(m_emitter.m_alpha.empty()) return;
 
-	float* LUMIX_RESTRICT particle_alpha = &m_emitter.m_alpha[0];
-	float* LUMIX_RESTRICT rel_life = &m_emitter.m_rel_life[0];
-	int size = m_sampled.size() - 1;
-	float float_size = (float)size;
-	for(int i = 0, c = m_emitter.m_size.size(); i < c; ++i)
-	{
-		float float_idx = float_size * rel_life[i];
-		int idx = (int)float_idx;
-		int next_idx = Math::minimum(idx + 1, size);
-		float w = float_idx - idx;
-		particle_alpha[i] = m_sampled[idx] * (1 - w) + m_sampled[next_idx] * w;
-	}
+	sampleCurve(&m_emitter.m_alpha[0], &m_emitter.m_rel_life[0], m_sampled, m_emitter.m_alpha.size());
 }
 
 
@@ -498,19 +657,7 @@ void ParticleEmitter::SizeModule::update(float)
 {
 	if (m_emitter.m_size.empty()) return;
 
-	float* LUMIX_RESTRICT particle_size = &m_emitter.m_size[0];
-	float* LUMIX_RESTRICT rel_life = &m_emitter.m_rel_life[0];
-	int size = m_sampled.size() - 1;
-	float float_size = (float)size;
-	for (int i = 0, c = m_emitter.m_size.size(); i < c; ++i)
-	{
-		float float_idx = float_size * rel_life[i];
-		int idx = (int)float_idx;
-		int next_idx = Math::minimum(idx + 1, size);
-		float w = float_idx - idx;
-		particle_size[i] = m_sampled[idx] * (1 - w) + m_sampled[next_idx] * w;
-		PROFILE_INT("Test", int(particle_size[i] * 1000));
-	}
+	sampleCurve(&m_emitter.m_size[0], &m_emitter.m_rel_life[0], m_sampled, m_emitter.m_size.size());
 }
 
 
@@ -525,7 +672,7 @@ ParticleEmitter::RandomRotationModule::RandomRotationModule(ParticleEmitter& emi
 
 void ParticleEmitter::RandomRotationModule::spawnParticle(int index)
 {
-	m_emitter.m_rotation[index] = Math::randFloat(0, Math::PI * 2);
+	m_emitter.m_rotation[index] = m_emitter.m_random.randFloat(0, Math::PI * 2);
 }
 
 
@@ -533,6 +680,29 @@ const uint32 ParticleEmitter::RandomRotationModule::s_type = Lumix::crc32("rando
 
 
 
+RandomGenerator::RandomGenerator(uint32 seed)
+	: state(seed ? seed : 1)
+{
+}
+
+
+uint32 RandomGenerator::rand()
+{
+	// xorshift32
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+float RandomGenerator::randFloat(float from, float to)
+{
+	float t = (rand() >> 8) * (1.0f / (1 << 24));
+	return from + (to - from) * t;
+}
+
+
 Interval::Interval()
 	: from(0)
 	, to(0)
@@ -546,10 +716,10 @@ IntInterval::IntInterval()
 }
 
 
-int IntInterval::getRandom() const
+int IntInterval::getRandom(RandomGenerator& random) const
 {
-	if (from == to) return from;
-	return Math::rand(from, to);
+	if (from >= to) return from;
+	return from + int(random.rand() % uint32(to - from + 1));
 }
 
 
@@ -566,9 +736,9 @@ void Interval::check()
 }
 
 
-float Interval::getRandom() const
+float Interval::getRandom(RandomGenerator& random) const
 {
-	return Math::randFloat(from, to);
+	return random.randFloat(from, to);
 }
 
 
@@ -587,6 +757,7 @@ ParticleEmitter::ParticleEmitter(Entity entity, Universe& universe, IAllocator&
 	, m_entity(entity)
 	, m_size(allocator)
 	, m_material(nullptr)
+	, m_random(Math::rand())
 {
 	m_spawn_period.from = 1;
 	m_spawn_period.to = 2;
@@ -637,11 +808,11 @@ void ParticleEmitter::spawnParticle()
 	m_position.push(m_universe.getPosition(m_entity));
 	m_rotation.push(0);
 	m_rotational_speed.push(0);
-	m_life.push(m_initial_life.getRandom());
+	m_life.push(m_initial_life.getRandom(m_random));
 	m_rel_life.push(0.0f);
 	m_alpha.push(1);
 	m_velocity.push(Vec3(0, 0, 0));
-	m_size.push(m_initial_size.getRandom());
+	m_size.push(m_initial_size.getRandom(m_random));
 	for (auto* module : m_modules)
 	{
 		module->spawnParticle(m_life.size() - 1);
@@ -655,38 +826,48 @@ void ParticleEmitter::addModule(ModuleBase* module)
 }
 
 
-void ParticleEmitter::destroyParticle(int index)
-{
-	for (auto* module : m_modules)
-	{
-		module->destoryParticle(index);
-	}
-	m_life.eraseFast(index);
-	m_rel_life.eraseFast(index);
-	m_position.eraseFast(index);
-	m_velocity.eraseFast(index);
-	m_rotation.eraseFast(index);
-	m_rotational_speed.eraseFast(index);
-	m_alpha.eraseFast(index);
-	m_size.eraseFast(index);
-}
-
-
 void ParticleEmitter::updateLives(float time_delta)
 {
-	for (int i = 0, c = m_rel_life.size(); i < c; ++i)
-	{
-		float rel_life = m_rel_life[i];
-		rel_life += time_delta / m_life[i];
-		m_rel_life[i] = rel_life;
-
-		if (rel_life > 1)
+	int count = m_rel_life.size();
+	if (count == 0) return;
+
+	float* LUMIX_RESTRICT rel_life = &m_rel_life[0];
+	const float* LUMIX_RESTRICT life = &m_life[0];
+	__m128 time_delta4 = _mm_set1_ps(time_delta);
+	__m128 one = _mm_set1_ps(1);
+	int first_dead = count;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 value = _mm_add_ps(_mm_loadu_ps(rel_life + i), _mm_div_ps(time_delta4, _mm_loadu_ps(life + i)));
+		_mm_storeu_ps(rel_life + i, value);
+		int dead_mask = _mm_movemask_ps(_mm_cmpgt_ps(value, one));
+		if (dead_mask && first_dead == count)
 		{
-			destroyParticle(i);
-			--i;
-			--c;
+			first_dead = i;
+			while ((dead_mask & 1) == 0)
+			{
+				dead_mask >>= 1;
+				++first_dead;
+			}
 		}
 	}
+	for (; i < count; ++i)
+	{
+		rel_life[i] += time_delta / life[i];
+		if (rel_life[i] > 1 && first_dead == count) first_dead = i;
+	}
+	if (first_dead == count) return;
+
+	// dead particles are removed in one pass per attribute, rel_life is the last one since it is the mask
+	compactParticles(m_life, rel_life, first_dead);
+	compactParticles(m_position, rel_life, first_dead);
+	compactParticles(m_velocity, rel_life, first_dead);
+	compactParticles(m_rotation, rel_life, first_dead);
+	compactParticles(m_rotational_speed, rel_life, first_dead);
+	compactParticles(m_alpha, rel_life, first_dead);
+	compactParticles(m_size, rel_life, first_dead);
+	compactParticles(m_rel_life, rel_life, first_dead);
 }
 
 
@@ -746,19 +927,17 @@ void ParticleEmitter::deserialize(InputBlob& blob, ResourceManager& manager, boo
 
 void ParticleEmitter::updatePositions(float time_delta)
 {
-	for (int i = 0, c = m_position.size(); i < c; ++i)
-	{
-		m_position[i] += m_velocity[i] * time_delta;
-	}
+	if (m_position.empty()) return;
+
+	addScaled(&m_position[0].x, &m_velocity[0].x, time_delta, m_position.size() * 3);
 }
 
 
 void ParticleEmitter::updateRotations(float time_delta)
 {
-	for (int i = 0, c = m_rotation.size(); i < c; ++i)
-	{
-		m_rotation[i] += m_rotational_speed[i] * time_delta;
-	}
+	if (m_rotation.empty()) return;
+
+	addScaled(&m_rotation[0], &m_rotational_speed[0], time_delta, m_rotation.size());
 }
 
 
@@ -781,9 +960,9 @@ void ParticleEmitter::spawnParticles(float time_delta)
 
 	while (m_next_spawn_time < 0)
 	{
-		m_next_spawn_time += m_spawn_period.getRandom();
+		m_next_spawn_time += m_spawn_period.getRandom(m_random);
 
-		int spawn_count = m_spawn_count.getRandom();
+		int spawn_count = m_spawn_count.getRandom(m_random);
 		for (int i = 0; i < spawn_count; ++i)
 		{
 			spawnParticle();
@@ -810,9 +989,9 @@ struct InitialVelocityModule : public ParticleEmitter::ModuleBase
 	void spawnParticle(int index) override
 	{
 		Vec3 v;
-		v.x = m_x.getRandom();
-		v.y = m_y.getRandom();
-		v.z = m_z.getRandom();
+		v.x = m_x.getRandom(m_emitter.m_random);
+		v.y = m_y.getRandom(m_emitter.m_random);
+		v.z = m_z.getRandom(m_emitter.m_random);
 		m_emitter.m_velocity[index] = v;
 	}
 };
@@ -21,13 +21,24 @@ class Universe;
 class WorldEditor;
 
 
+// every emitter has its own generator, so emitters can be updated in parallel
+struct LUMIX_RENDERER_API RandomGenerator
+{
+	explicit RandomGenerator(uint32 seed);
+	uint32 rand();
+	float randFloat(float from, float to);
+
+	uint32 state;
+};
+
+
 struct IntInterval
 {
 	int from;
 	int to;
 
 	IntInterval();
-	int getRandom() const;
+	int getRandom(RandomGenerator& random) const;
 };
 
 
@@ -38,7 +49,7 @@ struct Interval
 
 
 	Interval();
-	float getRandom() const;
+	float getRandom(RandomGenerator& random) const;
 
 	void check();
 	void checkZero();
@@ -65,7 +76,6 @@ public:
 
 		virtual ~ModuleBase() {}
 		virtual void spawnParticle(int /*index*/) {}
-		virtual void destoryParticle(int /*index*/) {}
 		virtual void update(float /*time_delta*/) {}
 		virtual void serialize(OutputBlob& blob) = 0;
 		virtual void deserialize(InputBlob& blob, int version) = 0;
@@ -229,10 +239,10 @@ public:
 
 	Array<ModuleBase*> m_modules;
 	Entity m_entity;
+	RandomGenerator m_random;
 
 private:
 	void spawnParticle();
-	void destroyParticle(int index);
 	void spawnParticles(float time_delta);
 	void updateLives(float time_delta);
 	void updatePositions(float time_delta);
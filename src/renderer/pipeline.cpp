@@ -7,7 +7,10 @@
 #include "engine/core/lifo_allocator.h"
 #include "engine/core/log.h"
 #include "engine/core/lua_wrapper.h"
+#include "engine/core/mtjd/manager.h"
+#include "engine/core/mtjd/parallel_for.h"
 #include "engine/core/profiler.h"
+#include "engine/core/radix_sort.h"
 #include "engine/engine.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/frame_buffer.h"
@@ -24,6 +27,7 @@
 #include "engine/universe/universe.h"
 #include <bgfx/bgfx.h>
 #include <cmath>
+#include <cstdlib>
 
 
 namespace Lumix
@@ -32,6 +36,9 @@ namespace Lumix
 
 static const float SHADOW_CAM_NEAR = 50.0f;
 static const float SHADOW_CAM_FAR = 5000.0f;
+static const int MAX_BONES = 128;
+static const int MIN_PARTICLE_INSTANCE_CAPACITY = 4096;
+static const int PARTICLES_PER_JOB = 4096;
 
 
 struct InstanceData
@@ -45,6 +52,24 @@ struct InstanceData
 };
 
 
+struct ParticleInstance
+{
+	Vec4 pos;
+	Vec4 alpha_and_rotation;
+};
+
+
+// particles of emitters sharing a material, drawn with one call
+struct ParticleBatch
+{
+	Material* material;
+	int first;
+	int count;
+	// of the farthest particle, batches are drawn back to front
+	uint32 key;
+};
+
+
 struct View
 {
 	uint8 bgfx_id;
@@ -247,6 +272,14 @@ struct PipelineImpl : public Pipeline
 		, m_tmp_grasses(allocator)
 		, m_tmp_meshes(allocator)
 		, m_tmp_local_lights(allocator)
+		, m_tmp_emitters(allocator)
+		, m_particle_instances(allocator)
+		, m_particle_keys(allocator)
+		, m_particle_indices(allocator)
+		, m_particle_tmp_keys(allocator)
+		, m_particle_tmp_indices(allocator)
+		, m_particle_batches(allocator)
+		, m_particle_emitter_offsets(allocator)
 		, m_uniforms(allocator)
 		, m_renderer(renderer)
 		, m_default_framebuffer(nullptr)
@@ -268,6 +301,11 @@ struct PipelineImpl : public Pipeline
 			.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
 			.end();
 
+		m_particle_instance_decl.begin()
+			.add(bgfx::Attrib::TexCoord7, 4, bgfx::AttribType::Float)
+			.add(bgfx::Attrib::TexCoord6, 4, bgfx::AttribType::Float)
+			.end();
+
 		m_is_wireframe = false;
 		m_view_x = m_view_y = 0;
 		m_has_shadowmap_define_idx = m_renderer.getShaderDefineIdx("HAS_SHADOWMAP");
@@ -444,6 +482,22 @@ struct PipelineImpl : public Pipeline
 		uint16 indices[] = { 0, 1, 2, 0, 2, 3 };
 		const bgfx::Memory* index_mem = bgfx::copy(indices, sizeof(indices));
 		m_particle_index_buffer = bgfx::createIndexBuffer(index_mem);
+
+		m_particle_instance_capacity = MIN_PARTICLE_INSTANCE_CAPACITY;
+		m_particle_instance_offset = 0;
+		m_particle_instance_buffer =
+			bgfx::createDynamicVertexBuffer(m_particle_instance_capacity, m_particle_instance_decl);
+	}
+
+
+	void growParticleInstanceBuffer()
+	{
+		if (m_particle_instance_offset <= m_particle_instance_capacity) return;
+
+		while (m_particle_instance_capacity < m_particle_instance_offset) m_particle_instance_capacity *= 2;
+		bgfx::destroyDynamicVertexBuffer(m_particle_instance_buffer);
+		m_particle_instance_buffer =
+			bgfx::createDynamicVertexBuffer(m_particle_instance_capacity, m_particle_instance_decl);
 	}
 
 
@@ -544,69 +598,78 @@ struct PipelineImpl : public Pipeline
 		bgfx::destroyIndexBuffer(m_cube_ib);
 		bgfx::destroyIndexBuffer(m_particle_index_buffer);
 		bgfx::destroyVertexBuffer(m_particle_vertex_buffer);
+		bgfx::destroyDynamicVertexBuffer(m_particle_instance_buffer);
 	}
 
 
-	void renderParticlesFromEmitter(const ParticleEmitter& emitter)
+	static int compareEmitterMaterials(const void* a, const void* b)
 	{
-		static const int PARTICLE_BATCH_SIZE = 256;
+		Material* material_a = (*(const ParticleEmitter**)a)->getMaterial();
+		Material* material_b = (*(const ParticleEmitter**)b)->getMaterial();
+		if (material_a == material_b) return 0;
+		return material_a < material_b ? -1 : 1;
+	}
+
 
-		if (emitter.m_life.empty()) return;
-		if (!emitter.getMaterial()) return;
-		if (!emitter.getMaterial()->isReady()) return;
+	static int compareParticleBatches(const void* a, const void* b)
+	{
+		uint32 key_a = ((const ParticleBatch*)a)->key;
+		uint32 key_b = ((const ParticleBatch*)b)->key;
+		if (key_a == key_b) return 0;
+		return key_a < key_b ? -1 : 1;
+	}
 
-		Material* material = emitter.getMaterial();
 
-		const bgfx::InstanceDataBuffer* instance_buffer = nullptr;
-		struct Instance
+	void fillParticleInstances(int emitter_idx, int first, const Vec3& camera_pos, const Vec3& camera_dir)
+	{
+		const ParticleEmitter& emitter = *m_tmp_emitters[emitter_idx];
+		ParticleInstance* instances = &m_particle_instances[first];
+		uint32* keys = &m_particle_keys[first];
+		uint32* indices = &m_particle_indices[first];
+		for (int i = 0, c = emitter.m_life.size(); i < c; ++i)
 		{
-			Vec4 pos;
-			Vec4 alpha_and_rotation;
-		};
-		Instance* instance = nullptr;
+			const Vec3& pos = emitter.m_position[i];
+			instances[i].pos = Vec4(pos, emitter.m_size[i]);
+			instances[i].alpha_and_rotation = Vec4(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
+			// ascending keys put the farthest particles first
+			keys[i] = ~floatToRadixKey(dotProduct(pos - camera_pos, camera_dir));
+			indices[i] = first + i;
+		}
+	}
+
 
+	void submitParticleBatch(const ParticleBatch& batch, int buffer_offset)
+	{
 		auto& view = m_views[m_current_render_views[0]];
-		for (int i = 0, c = emitter.m_life.size(); i < c; ++i)
+		Material* material = batch.material;
+		if (buffer_offset >= 0)
+		{
+			bgfx::setInstanceDataBuffer(m_particle_instance_buffer, buffer_offset + batch.first, batch.count);
+		}
+		else
 		{
-			if (i % PARTICLE_BATCH_SIZE == 0)
+			// this frame has more particles than the persistent buffer, it grows in the next frame
+			uint16 stride = (uint16)sizeof(ParticleInstance);
+			if (!bgfx::checkAvailInstanceDataBuffer(batch.count, stride)) return;
+			const bgfx::InstanceDataBuffer* instance_buffer = bgfx::allocInstanceDataBuffer(batch.count, stride);
+			ParticleInstance* instances = (ParticleInstance*)instance_buffer->data;
+			for (int i = 0; i < batch.count; ++i)
 			{
-				if (instance_buffer)
-				{
-					executeCommandBuffer(material->getCommandBuffer(), material);
-					executeCommandBuffer(view.command_buffer.buffer, material);
-
-					bgfx::setInstanceDataBuffer(instance_buffer, PARTICLE_BATCH_SIZE);
-					bgfx::setVertexBuffer(m_particle_vertex_buffer);
-					bgfx::setIndexBuffer(m_particle_index_buffer);
-					bgfx::setStencil(view.stencil, BGFX_STENCIL_NONE);
-					bgfx::setState(view.render_state | material->getRenderStates());
-					++m_stats.draw_call_count;
-					m_stats.instance_count += PARTICLE_BATCH_SIZE;
-					m_stats.triangle_count += PARTICLE_BATCH_SIZE * 2;
-					bgfx::submit(view.bgfx_id, material->getShaderInstance().m_program_handles[view.pass_idx]);
-				}
-
-				instance_buffer = bgfx::allocInstanceDataBuffer(PARTICLE_BATCH_SIZE, sizeof(Instance));
-				instance = (Instance*)instance_buffer->data;
+				instances[i] = m_particle_instances[m_particle_indices[batch.first + i]];
 			}
-
-			instance->pos = Vec4(emitter.m_position[i], emitter.m_size[i]);
-			instance->alpha_and_rotation = Vec4(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
-			++instance;
+			bgfx::setInstanceDataBuffer(instance_buffer, batch.count);
 		}
 
 		executeCommandBuffer(material->getCommandBuffer(), material);
 		executeCommandBuffer(view.command_buffer.buffer, material);
 
-		int instance_count = emitter.m_life.size() % PARTICLE_BATCH_SIZE;
-		bgfx::setInstanceDataBuffer(instance_buffer, instance_count);
 		bgfx::setVertexBuffer(m_particle_vertex_buffer);
 		bgfx::setIndexBuffer(m_particle_index_buffer);
 		bgfx::setStencil(view.stencil, BGFX_STENCIL_NONE);
 		bgfx::setState(view.render_state | material->getRenderStates());
 		++m_stats.draw_call_count;
-		m_stats.instance_count += instance_count;
-		m_stats.triangle_count += instance_count * 2;
+		m_stats.instance_count += batch.count;
+		m_stats.triangle_count += batch.count * 2;
 		bgfx::submit(view.bgfx_id, material->getShaderInstance().m_program_handles[view.pass_idx]);
 	}
 
@@ -614,12 +677,100 @@ struct PipelineImpl : public Pipeline
 	void renderParticles()
 	{
 		PROFILE_FUNCTION();
-		const auto& emitters = m_scene->getParticleEmitters();
-		for (const auto* emitter : emitters)
+		m_tmp_emitters.clear();
+		int total_count = 0;
+		for (const auto* emitter : m_scene->getParticleEmitters())
+		{
+			if (!emitter || emitter->m_life.empty()) continue;
+			if (!emitter->getMaterial() || !emitter->getMaterial()->isReady()) continue;
+
+			m_tmp_emitters.push(emitter);
+			total_count += emitter->m_life.size();
+		}
+		if (m_tmp_emitters.empty()) return;
+
+		// emitters sharing a material end up next to each other and are merged into one batch
+		qsort(&m_tmp_emitters[0], m_tmp_emitters.size(), sizeof(m_tmp_emitters[0]), compareEmitterMaterials);
+
+		Vec3 camera_pos(0, 0, 0);
+		Vec3 camera_dir(0, 0, 0);
+		if (m_applied_camera >= 0)
+		{
+			Universe& universe = m_scene->getUniverse();
+			Entity camera_entity = m_scene->getCameraEntity(m_applied_camera);
+			camera_pos = universe.getPosition(camera_entity);
+			camera_dir = universe.getRotation(camera_entity) * Vec3(0, 0, -1);
+		}
+
+		m_particle_instances.resize(total_count);
+		m_particle_keys.resize(total_count);
+		m_particle_indices.resize(total_count);
+		m_particle_tmp_keys.resize(total_count);
+		m_particle_tmp_indices.resize(total_count);
+		m_particle_batches.clear();
+
+		m_particle_emitter_offsets.clear();
+		int offset = 0;
+		for (const auto* emitter : m_tmp_emitters)
 		{
-			if (!emitter) continue;
+			Material* material = emitter->getMaterial();
+			if (m_particle_batches.empty() || m_particle_batches.back().material != material)
+			{
+				ParticleBatch& batch = m_particle_batches.emplace();
+				batch.material = material;
+				batch.first = offset;
+				batch.count = 0;
+			}
+			m_particle_batches.back().count += emitter->m_life.size();
+			m_particle_emitter_offsets.push(offset);
+			offset += emitter->m_life.size();
+		}
+
+		MTJD::Manager& manager = m_renderer.getEngine().getMTJDManager();
+		MTJD::parallelFor(manager,
+			0,
+			m_tmp_emitters.size(),
+			1,
+			[this, &camera_pos, &camera_dir](int from, int to) {
+				for (int i = from; i < to; ++i)
+				{
+					fillParticleInstances(i, m_particle_emitter_offsets[i], camera_pos, camera_dir);
+				}
+			});
+
+		for (ParticleBatch& batch : m_particle_batches)
+		{
+			radixSort(manager,
+				&m_particle_keys[batch.first],
+				&m_particle_indices[batch.first],
+				&m_particle_tmp_keys[batch.first],
+				&m_particle_tmp_indices[batch.first],
+				batch.count);
+			batch.key = m_particle_keys[batch.first];
+		}
+		// particles of different batches can not be interleaved, so whole batches are sorted
+		qsort(&m_particle_batches[0], m_particle_batches.size(), sizeof(m_particle_batches[0]), compareParticleBatches);
+
+		int buffer_offset = -1;
+		if (m_particle_instance_offset + total_count <= m_particle_instance_capacity)
+		{
+			PROFILE_BLOCK("Particle Instances Upload");
+			buffer_offset = m_particle_instance_offset;
+			const bgfx::Memory* mem = bgfx::alloc((uint32)(total_count * sizeof(ParticleInstance)));
+			ParticleInstance* instances = (ParticleInstance*)mem->data;
+			MTJD::parallelFor(manager, 0, total_count, PARTICLES_PER_JOB, [this, instances](int from, int to) {
+				for (int i = from; i < to; ++i)
+				{
+					instances[i] = m_particle_instances[m_particle_indices[i]];
+				}
+			});
+			bgfx::updateDynamicVertexBuffer(m_particle_instance_buffer, buffer_offset, mem);
+		}
+		m_particle_instance_offset += total_count;
 
-			renderParticlesFromEmitter(*emitter);
+		for (const ParticleBatch& batch : m_particle_batches)
+		{
+			submitParticleBatch(batch, buffer_offset);
 		}
 	}
 
@@ -1857,22 +2008,11 @@ struct PipelineImpl : public Pipeline
 		Material* material = mesh.material;
 		auto& shader_instance = mesh.material->getShaderInstance();
 
-		Matrix bone_mtx[128];
-
-		const Pose& pose = *renderable.pose;
-		const Model& model = *renderable.model;
-		Vec3* poss = pose.getPositions();
-		Quat* rots = pose.getRotations();
-
-		ASSERT(pose.getCount() <= lengthOf(bone_mtx));
-		for (int bone_index = 0, bone_count = pose.getCount(); bone_index < bone_count;
-		++bone_index)
-		{
-			auto& bone = model.getBone(bone_index);
-			rots[bone_index].toMatrix(bone_mtx[bone_index]);
-			bone_mtx[bone_index].translate(poss[bone_index]);
-			bone_mtx[bone_index] = bone_mtx[bone_index] * bone.inv_bind_matrix;
-		}
+		Pose& pose = *renderable.pose;
+		// no-op unless the pose was changed outside of the animation system
+		pose.computeSkinningMatrices(*renderable.model);
+		const Matrix* bone_mtx = pose.getSkinningMatrices();
+		ASSERT(pose.getCount() <= MAX_BONES);
 
 		for (int i = 0; i < m_current_render_view_count; ++i)
 		{
@@ -2268,6 +2408,8 @@ struct PipelineImpl : public Pipeline
 		m_pass_idx = -1;
 		m_current_framebuffer = m_default_framebuffer;
 		m_instance_data_idx = 0;
+		growParticleInstanceBuffer();
+		m_particle_instance_offset = 0;
 		m_point_light_shadowmaps.clear();
 		for (int i = 0; i < lengthOf(m_terrain_instances); ++i)
 		{
@@ -2492,6 +2634,20 @@ struct PipelineImpl : public Pipeline
 	Array<const TerrainInfo*> m_tmp_terrains;
 	Array<GrassInfo> m_tmp_grasses;
 	Array<ComponentIndex> m_tmp_local_lights;
+	Array<const ParticleEmitter*> m_tmp_emitters;
+	Array<ParticleInstance> m_particle_instances;
+	Array<uint32> m_particle_keys;
+	Array<uint32> m_particle_indices;
+	Array<uint32> m_particle_tmp_keys;
+	Array<uint32> m_particle_tmp_indices;
+	Array<ParticleBatch> m_particle_batches;
+	Array<int> m_particle_emitter_offsets;
+	bgfx::VertexDecl m_particle_instance_decl;
+	// persistent, reused by all renderParticles calls in a frame, grows between frames
+	bgfx::DynamicVertexBufferHandle m_particle_instance_buffer;
+	int m_particle_instance_capacity;
+	// instances requested in this frame, even those which did not fit
+	int m_particle_instance_offset;
 
 	bgfx::UniformHandle m_mat_color_shininess_uniform;
 	bgfx::UniformHandle m_bone_matrices_uniform;
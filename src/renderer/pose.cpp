@@ -15,8 +15,10 @@ Pose::Pose(IAllocator& allocator)
 {
 	m_positions = 0;
 	m_rotations = 0;
+	m_skinning_matrices = 0;
 	m_count = 0;
 	m_is_absolute = false;
+	m_is_skinning_dirty = true;
 }
 
 
@@ -24,6 +26,7 @@ Pose::~Pose()
 {
 	m_allocator.deallocate(m_positions);
 	m_allocator.deallocate(m_rotations);
+	m_allocator.deallocate(m_skinning_matrices);
 }
 
 
@@ -34,6 +37,7 @@ void Pose::blend(Pose& rhs, float weight)
 	{
 		return;
 	}
+	m_is_skinning_dirty = true;
 	weight = Math::clamp(weight, 0.0f, 1.0f);
 	float inv = 1.0f - weight;
 	for (int i = 0, c = m_count; i < c; ++i)
@@ -47,18 +51,24 @@ void Pose::blend(Pose& rhs, float weight)
 void Pose::resize(int count)
 {
 	m_is_absolute = false;
+	m_is_skinning_dirty = true;
+	// pooled poses are resized every time they are reused
+	if (count == m_count) return;
 	m_allocator.deallocate(m_positions);
 	m_allocator.deallocate(m_rotations);
+	m_allocator.deallocate(m_skinning_matrices);
 	m_count = count;
 	if(m_count)
 	{
 		m_positions = static_cast<Vec3*>(m_allocator.allocate(sizeof(Vec3) * count));
 		m_rotations = static_cast<Quat*>(m_allocator.allocate(sizeof(Quat) * count));
+		m_skinning_matrices = static_cast<Matrix*>(m_allocator.allocate(sizeof(Matrix) * count));
 	}
 	else
 	{
 		m_positions = nullptr;
 		m_rotations = nullptr;
+		m_skinning_matrices = nullptr;
 	}
 }
 
@@ -74,6 +84,7 @@ void Pose::computeAbsolute(Model& model)
 		m_rotations[i] = m_rotations[i] * m_rotations[parent];
 	}
 	m_is_absolute = true;
+	m_is_skinning_dirty = true;
 }
 
 
@@ -88,6 +99,7 @@ void Pose::computeRelative(Model& model)
 		m_rotations[i] = m_rotations[i] * -m_rotations[parent];
 	}
 	m_is_absolute = false;
+	m_is_skinning_dirty = true;
 }
 
 
@@ -101,4 +113,22 @@ void Pose::setMatrices(Matrix* mtx) const
 }
 
 
+// the palette is shared by all meshes and views of the pose until the pose changes
+void Pose::computeSkinningMatrices(const Model& model)
+{
+	if (!m_is_skinning_dirty) return;
+	ASSERT(m_is_absolute);
+	ASSERT(model.getBoneCount() == m_count);
+
+	for (int i = 0, c = m_count; i < c; ++i)
+	{
+		Matrix& mtx = m_skinning_matrices[i];
+		m_rotations[i].toMatrix(mtx);
+		mtx.translate(m_positions[i]);
+		mtx = mtx * model.getBone(i).inv_bind_matrix;
+	}
+	m_is_skinning_dirty = false;
+}
+
+
 } // ~namespace Lumix
@@ -23,13 +23,16 @@ class LUMIX_RENDERER_API Pose
 
 		void resize(int count);
 		void setMatrices(Matrix* mtx) const;
+		void computeSkinningMatrices(const Model& model);
+		const Matrix* getSkinningMatrices() const { return m_skinning_matrices; }
+		bool isSkinningDirty() const { return m_is_skinning_dirty; }
 		int getCount() const { return m_count; }
 		Vec3* getPositions() const { return m_positions; }
 		Quat* getRotations() const { return m_rotations; }
 		void computeAbsolute(Model& model);
 		void computeRelative(Model& model);
-		void setIsRelative() { m_is_absolute = false; }
-		void setIsAbsolute() { m_is_absolute = true; }
+		void setIsRelative() { m_is_absolute = false; m_is_skinning_dirty = true; }
+		void setIsAbsolute() { m_is_absolute = true; m_is_skinning_dirty = true; }
 		void blend(Pose& rhs, float weight);
 
 	private:
@@ -39,9 +42,11 @@ class LUMIX_RENDERER_API Pose
 	private:
 		IAllocator& m_allocator;
 		bool m_is_absolute;
+		bool m_is_skinning_dirty;
 		int32 m_count;
 		Vec3* m_positions;
 		Quat* m_rotations;
+		Matrix* m_skinning_matrices;
 };
 
 
@@ -10,7 +10,7 @@
 #include "engine/core/log.h"
 #include "engine/core/lua_wrapper.h"
 #include "engine/core/math_utils.h"
-#include "engine/core/mtjd/generic_job.h"
+#include "engine/core/mtjd/parallel_for.h"
 #include "engine/core/mtjd/job.h"
 #include "engine/core/mtjd/manager.h"
 #include "engine/core/profiler.h"
@@ -31,6 +31,7 @@
 #include "renderer/pose.h"
 #include "renderer/renderer.h"
 #include "renderer/shader.h"
+#include "renderer/spatial_index.h"
 #include "renderer/terrain.h"
 #include "renderer/texture.h"
 
@@ -58,6 +59,10 @@ static const uint32 PARTICLE_EMITTER_SIZE_HASH = crc32("particle_emitter_size");
 static const uint32 GLOBAL_LIGHT_HASH = crc32("global_light");
 static const uint32 CAMERA_HASH = crc32("camera");
 static const uint32 TERRAIN_HASH = crc32("terrain");
+static const int MOVED_RENDERABLES_PER_JOB = 256;
+// moved renderables tested against one light, smaller batches are updated on the calling thread
+static const int LIGHT_TESTS_PER_JOB = 1024;
+static const int PARTICLE_EMITTERS_PER_JOB = 4;
 
 
 struct PointLight
@@ -170,8 +175,6 @@ public:
 		, m_debug_lines(m_allocator)
 		, m_debug_points(m_allocator)
 		, m_temporary_infos(m_allocator)
-		, m_sync_point(true, m_allocator)
-		, m_jobs(m_allocator)
 		, m_active_global_light_uid(-1)
 		, m_global_light_last_uid(-1)
 		, m_point_light_last_uid(-1)
@@ -182,9 +185,12 @@ public:
 		, m_is_game_running(false)
 		, m_particle_emitters(m_allocator)
 		, m_point_lights_map(m_allocator)
+		, m_spatial_index(m_allocator)
+		, m_moved_entities_mask(m_allocator)
+		, m_moved_renderables(m_allocator)
 	{
-		m_universe.entityTransformed()
-			.bind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed()
+			.bind<RenderSceneImpl, &RenderSceneImpl::onEntitiesMoved>(this);
 		m_culling_system =
 			CullingSystem::create(m_engine.getMTJDManager(), m_allocator);
 		m_time = 0;
@@ -197,8 +203,8 @@ public:
 		auto& rm = m_engine.getResourceManager();
 		auto* material_manager = static_cast<MaterialManager*>(rm.get(ResourceManager::MATERIAL));
 
-		m_universe.entityTransformed()
-			.unbind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed()
+			.unbind<RenderSceneImpl, &RenderSceneImpl::onEntitiesMoved>(this);
 
 		for (int i = 0; i < m_model_loaded_callbacks.size(); ++i)
 		{
@@ -406,6 +412,10 @@ public:
 	}
 
 
+	uint32 getUpdateReads() const override { return SceneAccess::TRANSFORMS; }
+	uint32 getUpdateWrites() const override { return 0; }
+
+
 	void update(float dt, bool paused) override
 	{
 		PROFILE_FUNCTION();
@@ -455,12 +465,20 @@ public:
 
 		if (m_is_game_running && !paused)
 		{
-			for (auto* emitter : m_particle_emitters)
-			{
-				if (!emitter) continue;
-
-				emitter->update(dt);
-			}
+			// emitters only read the universe and have their own random generators
+			MTJD::parallelFor(m_engine.getMTJDManager(),
+				0,
+				m_particle_emitters.size(),
+				PARTICLE_EMITTERS_PER_JOB,
+				[this, dt](int from, int to)
+				{
+					PROFILE_BLOCK("Particle Emitters Job");
+					for (int i = from; i < to; ++i)
+					{
+						auto* emitter = m_particle_emitters[i];
+						if (emitter) emitter->update(dt);
+					}
+				});
 		}
 	}
 
@@ -709,6 +727,7 @@ public:
 			}
 		}
 		m_culling_system->clear();
+		m_spatial_index.clear();
 		m_renderables.clear();
 		m_renderables.reserve(size);
 		for (int i = 0; i < size; ++i)
@@ -1576,53 +1595,135 @@ public:
 	}
 
 
-	void onEntityMoved(Entity entity)
+	bool isEntityMoved(Entity entity) const
 	{
-		ComponentIndex cmp = (ComponentIndex)entity;
+		return entity >= 0 && entity < m_moved_entities_mask.size() && m_moved_entities_mask[entity];
+	}
+
 
-		if (cmp < m_renderables.size() && m_renderables[cmp].entity != INVALID_ENTITY &&
-			m_renderables[cmp].model && m_renderables[cmp].model->isReady())
+	void updateLightInfluencedGeometry(int light_idx)
+	{
+		if (isEntityMoved(m_point_lights[light_idx].m_entity))
 		{
-			Renderable& r = m_renderables[cmp];
-			r.matrix = m_universe.getMatrix(entity);
-			m_culling_system->updateBoundingPosition(m_universe.getPosition(entity), cmp);
-			if (r.model && r.model->isReady())
+			detectLightInfluencedGeometry(light_idx);
+			return;
+		}
+		if (m_moved_renderables.empty()) return;
+
+		Array<int>& influenced_geometry = m_light_influenced_geometry[light_idx];
+		for (int i = influenced_geometry.size() - 1; i >= 0; --i)
+		{
+			if (isEntityMoved(m_renderables[influenced_geometry[i]].entity))
 			{
-				float radius = m_universe.getScale(entity) * r.model->getBoundingRadius();
-				m_culling_system->updateBoundingRadius(radius, cmp);
+				influenced_geometry.eraseFast(i);
 			}
+		}
 
-			if(m_is_forward_rendered)
+		Frustum frustum = getPointLightFrustum(light_idx);
+		for (ComponentIndex cmp : m_moved_renderables)
+		{
+			const Renderable& r = m_renderables[cmp];
+			if (frustum.isSphereInside(r.matrix.getTranslation(), r.model->getBoundingRadius()))
 			{
-				float bounding_radius = r.model ? r.model->getBoundingRadius() : 1;
-				for (int light_idx = 0, c = m_point_lights.size(); light_idx < c; ++light_idx)
-				{
-					for (int j = 0, c2 = m_light_influenced_geometry[light_idx].size(); j < c2; ++j)
-					{
-						if(m_light_influenced_geometry[light_idx][j] == cmp)
-						{
-							m_light_influenced_geometry[light_idx].eraseFast(j);
-							break;
-						}
-					}
+				influenced_geometry.push(cmp);
+			}
+		}
+	}
 
-					Vec3 pos = m_universe.getPosition(r.entity);
-					Frustum frustum = getPointLightFrustum(light_idx);
-					if(frustum.isSphereInside(pos, bounding_radius))
-					{
-						m_light_influenced_geometry[light_idx].push(cmp);
-					}
+
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		PROFILE_FUNCTION();
+		m_moved_renderables.clear();
+		Entity max_entity = -1;
+		for (int i = 0; i < count; ++i)
+		{
+			Entity entity = entities[i];
+			max_entity = Math::maximum(max_entity, entity);
+
+			ComponentIndex cmp = (ComponentIndex)entity;
+			if (cmp < m_renderables.size() && m_renderables[cmp].entity != INVALID_ENTITY &&
+				m_renderables[cmp].model && m_renderables[cmp].model->isReady())
+			{
+				m_moved_renderables.push(cmp);
+			}
+		}
+		// most moves are single entities without renderables, e.g. cameras
+		if (m_moved_renderables.empty() && (!m_is_forward_rendered || m_point_lights.empty())) return;
+
+		if (max_entity >= m_moved_entities_mask.size()) m_moved_entities_mask.resize(max_entity + 1);
+		for (int i = 0; i < count; ++i)
+		{
+			m_moved_entities_mask[entities[i]] = true;
+		}
+
+		bool is_light_moved = false;
+		if (m_is_forward_rendered)
+		{
+			for (const PointLight& light : m_point_lights)
+			{
+				if (isEntityMoved(light.m_entity))
+				{
+					is_light_moved = true;
+					break;
 				}
 			}
 		}
 
-		for (int i = 0, c = m_point_lights.size(); i < c; ++i)
+		if (m_moved_renderables.empty() && !is_light_moved)
 		{
-			if (m_point_lights[i].m_entity == entity)
+			for (int i = 0; i < count; ++i)
 			{
-				detectLightInfluencedGeometry(i);
-				break;
+				m_moved_entities_mask[entities[i]] = false;
 			}
+			return;
+		}
+
+		MTJD::Manager& manager = m_engine.getMTJDManager();
+		MTJD::parallelFor(manager,
+			0,
+			m_moved_renderables.size(),
+			MOVED_RENDERABLES_PER_JOB,
+			[this](int from, int to)
+			{
+				for (int i = from; i < to; ++i)
+				{
+					Renderable& r = m_renderables[m_moved_renderables[i]];
+					r.matrix = m_universe.getMatrix(r.entity);
+				}
+			});
+
+		// culling system and spatial index are not thread safe
+		for (ComponentIndex cmp : m_moved_renderables)
+		{
+			Renderable& r = m_renderables[cmp];
+			Vec3 position = r.matrix.getTranslation();
+			float radius = m_universe.getScale(r.entity) * r.model->getBoundingRadius();
+			m_culling_system->updateBoundingPosition(position, cmp);
+			m_culling_system->updateBoundingRadius(radius, cmp);
+			m_spatial_index.update(cmp, Sphere(position, radius));
+		}
+
+		// every light owns its list, so the lights are independent, small batches run in one chunk
+		if (m_is_forward_rendered)
+		{
+			int lights_per_job = Math::maximum(LIGHT_TESTS_PER_JOB / Math::maximum(m_moved_renderables.size(), 1), 1);
+			MTJD::parallelFor(manager,
+				0,
+				m_point_lights.size(),
+				lights_per_job,
+				[this](int from, int to)
+				{
+					for (int i = from; i < to; ++i)
+					{
+						updateLightInfluencedGeometry(i);
+					}
+				});
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			m_moved_entities_mask[entities[i]] = false;
 		}
 	}
 
@@ -1763,15 +1864,19 @@ public:
 	{
 		if (!m_renderables[cmp].model || !m_renderables[cmp].model->isReady()) return;
 
-		Sphere sphere(m_universe.getPosition(m_renderables[cmp].entity),
-			m_renderables[cmp].model->getBoundingRadius());
+		Entity entity = m_renderables[cmp].entity;
+		Sphere sphere(m_universe.getPosition(entity),
+			m_universe.getScale(entity) * m_renderables[cmp].model->getBoundingRadius());
 		m_culling_system->addStatic(cmp, sphere);
+		m_spatial_index.remove(cmp);
+		m_spatial_index.add(cmp, sphere);
 	}
 
 
 	void hideRenderable(ComponentIndex cmp) override
 	{
 		m_culling_system->removeStatic(cmp);
+		m_spatial_index.remove(cmp);
 	}
 
 
@@ -2021,26 +2126,11 @@ public:
 	}
 
 	
-	void runJobs(Array<MTJD::Job*>& jobs, MTJD::Group& sync_point)
-	{
-		PROFILE_FUNCTION();
-		for (int i = 0; i < jobs.size(); ++i)
-		{
-			m_engine.getMTJDManager().schedule(jobs[i]);
-		}
-		if (!jobs.empty())
-		{
-			sync_point.sync();
-		}
-	}
-
-
 	void fillTemporaryInfos(const CullingSystem::Results& results,
 		const Frustum& frustum,
 		const Vec3& lod_ref_point)
 	{
 		PROFILE_FUNCTION();
-		m_jobs.clear();
 
 		while (m_temporary_infos.size() < results.size())
 		{
@@ -2050,16 +2140,20 @@ public:
 		{
 			m_temporary_infos.pop();
 		}
-		for (int subresult_index = 0; subresult_index < results.size(); ++subresult_index)
-		{
-			Array<RenderableMesh>& subinfos = m_temporary_infos[subresult_index];
-			subinfos.clear();
-			if (results[subresult_index].empty()) continue;
 
-			MTJD::Job* job = MTJD::makeJob(m_engine.getMTJDManager(),
-				[&subinfos, this, &results, subresult_index, &frustum, lod_ref_point]()
+		MTJD::parallelFor(m_engine.getMTJDManager(),
+			0,
+			results.size(),
+			1,
+			[this, &results, lod_ref_point](int from, int to)
+			{
+				PROFILE_BLOCK("Temporary Info Job");
+				for (int subresult_index = from; subresult_index < to; ++subresult_index)
 				{
-					PROFILE_BLOCK("Temporary Info Job");
+					Array<RenderableMesh>& subinfos = m_temporary_infos[subresult_index];
+					subinfos.clear();
+					if (results[subresult_index].empty()) continue;
+
 					PROFILE_INT("Renderable count", results[subresult_index].size());
 					Vec3 ref_point = lod_ref_point;
 					const int* LUMIX_RESTRICT raw_subresults = &results[subresult_index][0];
@@ -2079,12 +2173,8 @@ public:
 							info.mesh = &renderable->meshes[j];
 						}
 					}
-				},
-				m_allocator);
-			job->addDependency(&m_sync_point);
-			m_jobs.push(job);
-		}
-		runJobs(m_jobs, m_sync_point);
+				}
+			});
 	}
 
 
@@ -2199,7 +2289,7 @@ public:
 		{
 			ComponentIndex renderable_cmp = m_light_influenced_geometry[light_index][j];
 			Renderable& renderable = m_renderables[renderable_cmp];
-			const Sphere& sphere = m_culling_system->getSphere(renderable_cmp);
+			Sphere sphere = m_culling_system->getSphere(renderable_cmp);
 			if (frustum.isSphereInside(sphere.m_position, sphere.m_radius))
 			{
 				for (int k = 0, kc = renderable.model->getMeshCount(); k < kc; ++k)
@@ -2237,15 +2327,12 @@ public:
 	{
 		PROFILE_FUNCTION();
 
-		const CullingSystem::Results* results = cull(frustum);
-		if (!results) return;
-
-		for (auto& subresults : *results)
+		Array<ComponentIndex> renderables(m_allocator);
+		m_spatial_index.getInFrustum(frustum, renderables);
+		entities.reserve(entities.size() + renderables.size());
+		for (ComponentIndex renderable_cmp : renderables)
 		{
-			for (ComponentIndex renderable_cmp : subresults)
-			{
-				entities.push(m_renderables[renderable_cmp].entity);
-			}
+			entities.push(m_renderables[renderable_cmp].entity);
 		}
 	}
 
@@ -2871,28 +2958,26 @@ public:
 		PROFILE_FUNCTION();
 		RayCastModelHit hit;
 		hit.m_is_hit = false;
-		Universe& universe = getUniverse();
-		for (int i = 0; i < m_renderables.size(); ++i)
+		float dir_length = dir.length();
+		if (dir_length > 0)
 		{
-			auto& r = m_renderables[i];
-			if (ignored_renderable != i && r.model)
+			Array<SpatialIndex::RayHit> candidates(m_allocator);
+			m_spatial_index.getOnRay(origin, dir * (1 / dir_length), candidates);
+			for (auto& candidate : candidates)
 			{
-				const Vec3& pos = r.matrix.getTranslation();
-				float radius = r.model->getBoundingRadius();
-				float scale = universe.getScale(r.entity);
-				Vec3 intersection;
-				if (dotProduct(pos - origin, pos - origin) < radius * radius ||
-					Math::getRaySphereIntersection(origin, dir, pos, radius * scale, intersection))
+				// candidates are sorted, the rest can not be closer than the current hit
+				if (hit.m_is_hit && candidate.t > hit.m_t * dir_length) break;
+				if (candidate.renderable == ignored_renderable) continue;
+
+				auto& r = m_renderables[candidate.renderable];
+				RayCastModelHit new_hit = r.model->castRay(origin, dir, r.matrix);
+				if (new_hit.m_is_hit && (!hit.m_is_hit || new_hit.m_t < hit.m_t))
 				{
-					RayCastModelHit new_hit = r.model->castRay(origin, dir, r.matrix);
-					if (new_hit.m_is_hit && (!hit.m_is_hit || new_hit.m_t < hit.m_t))
-					{
-						new_hit.m_component = i;
-						new_hit.m_entity = r.entity;
-						new_hit.m_component_type = RENDERABLE_HASH;
-						hit = new_hit;
-						hit.m_is_hit = true;
-					}
+					new_hit.m_component = candidate.renderable;
+					new_hit.m_entity = r.entity;
+					new_hit.m_component_type = RENDERABLE_HASH;
+					hit = new_hit;
+					hit.m_is_hit = true;
 				}
 			}
 		}
@@ -3166,6 +3251,7 @@ public:
 			m_light_influenced_geometry[i].eraseItemFast(component);
 		}
 		m_culling_system->removeStatic(component);
+		m_spatial_index.remove(component);
 	}
 
 
@@ -3195,12 +3281,15 @@ public:
 		Sphere sphere(r.matrix.getTranslation(), bounding_radius * scale);
 		m_culling_system->addStatic(component, sphere);
 		m_culling_system->setLayerMask(component, r.layer_mask);
+		m_spatial_index.remove(component);
+		m_spatial_index.add(component, sphere);
 		ASSERT(!r.pose);
 		if (model->getBoneCount() > 0)
 		{
 			r.pose = LUMIX_NEW(m_allocator, Pose)(m_allocator);
 			r.pose->resize(model->getBoneCount());
 			model->getPose(*r.pose);
+			r.pose->computeSkinningMatrices(*model);
 			int skinned_define_idx = m_renderer.getShaderDefineIdx("SKINNED");
 			for (int i = 0; i < model->getMeshCount(); ++i)
 			{
@@ -3379,6 +3468,7 @@ public:
 			if (old_model->isReady())
 			{
 				m_culling_system->removeStatic(component);
+				m_spatial_index.remove(component);
 			}
 			old_model->getResourceManager().get(ResourceManager::MODEL)->unload(*old_model);
 		}
@@ -3407,22 +3497,10 @@ public:
 		if (!m_is_forward_rendered) return;
 
 		Frustum frustum = getPointLightFrustum(light_index);
-		m_culling_system->cullToFrustum(frustum, 0xffffFFFF);
-		const CullingSystem::Results& results =
-			m_culling_system->getResult();
 		Array<int>& influenced_geometry =
 			m_light_influenced_geometry[light_index];
 		influenced_geometry.clear();
-		for (int i = 0; i < results.size(); ++i)
-		{
-			const CullingSystem::Subresults& subresult = results[i];
-			influenced_geometry.reserve(influenced_geometry.size() +
-										subresult.size());
-			for (int j = 0, c = subresult.size(); j < c; ++j)
-			{
-				influenced_geometry.push(subresult[j]);
-			}
-		}
+		m_spatial_index.getInFrustum(frustum, influenced_geometry);
 	}
 
 
@@ -3705,10 +3783,11 @@ private:
 	Array<DebugLine> m_debug_lines;
 	Array<DebugPoint> m_debug_points;
 	CullingSystem* m_culling_system;
+	SpatialIndex m_spatial_index;
+	Array<bool> m_moved_entities_mask;
+	Array<ComponentIndex> m_moved_renderables;
 	Array<ParticleEmitter*> m_particle_emitters;
 	Array<Array<RenderableMesh>> m_temporary_infos;
-	MTJD::Group m_sync_point;
-	Array<MTJD::Job*> m_jobs;
 	float m_time;
 	bool m_is_forward_rendered;
 	bool m_is_grass_enabled;
@@ -8,6 +8,7 @@
 #include "engine/core/profiler.h"
 #include "engine/core/resource_manager.h"
 #include "engine/core/string.h"
+#include "engine/core/tag_allocator.h"
 #include "engine/debug/debug.h"
 #include "engine/engine.h"
 #include "engine/property_descriptor.h"
@@ -610,12 +611,13 @@ struct RendererImpl : public Renderer
 
 	explicit RendererImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
-		, m_texture_manager(m_allocator)
-		, m_model_manager(m_allocator)
-		, m_material_manager(*this, m_allocator)
-		, m_shader_manager(*this, m_allocator)
-		, m_shader_binary_manager(*this, m_allocator)
+		, m_allocator(engine.getAllocator(), "renderer")
+		, m_resource_allocator(engine.getAllocator(), "resources")
+		, m_texture_manager(m_resource_allocator)
+		, m_model_manager(m_resource_allocator)
+		, m_material_manager(*this, m_resource_allocator)
+		, m_shader_manager(*this, m_resource_allocator)
+		, m_shader_binary_manager(*this, m_resource_allocator)
 		, m_passes(m_allocator)
 		, m_shader_defines(m_allocator)
 		, m_bgfx_allocator(m_allocator)
@@ -817,7 +819,8 @@ struct RendererImpl : public Renderer
 
 
 	Engine& m_engine;
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
+	TagAllocator m_resource_allocator;
 	Array<ShaderCombinations::Pass> m_passes;
 	Array<ShaderDefine> m_shader_defines;
 	CallbackStub m_callback_stub;
@@ -0,0 +1,478 @@
+#include "renderer/spatial_index.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/profiler.h"
+#include <cmath>
+#include <cstdlib>
+
+
+namespace Lumix
+{
+
+
+static const float FAT_MARGIN_RATIO = 0.25f;
+static const int STACK_SIZE = 128;
+
+
+static float getHalfArea(const Vec3& min, const Vec3& max)
+{
+	Vec3 size = max - min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+
+static Vec3 minCoords(const Vec3& a, const Vec3& b)
+{
+	return Vec3(Math::minimum(a.x, b.x), Math::minimum(a.y, b.y), Math::minimum(a.z, b.z));
+}
+
+
+static Vec3 maxCoords(const Vec3& a, const Vec3& b)
+{
+	return Vec3(Math::maximum(a.x, b.x), Math::maximum(a.y, b.y), Math::maximum(a.z, b.z));
+}
+
+
+static int compareRayHits(const void* a, const void* b)
+{
+	float t_a = ((const SpatialIndex::RayHit*)a)->t;
+	float t_b = ((const SpatialIndex::RayHit*)b)->t;
+	if (t_a < t_b) return -1;
+	return t_a > t_b ? 1 : 0;
+}
+
+
+SpatialIndex::SpatialIndex(IAllocator& allocator)
+	: m_nodes(allocator)
+	, m_renderable_to_node(allocator)
+	, m_root(-1)
+	, m_free_list(-1)
+	, m_count(0)
+{
+}
+
+
+void SpatialIndex::clear()
+{
+	m_nodes.clear();
+	m_renderable_to_node.clear();
+	m_root = -1;
+	m_free_list = -1;
+	m_count = 0;
+}
+
+
+int SpatialIndex::allocateNode()
+{
+	int index = m_free_list;
+	if (index < 0)
+	{
+		index = m_nodes.size();
+		m_nodes.emplace();
+	}
+	else
+	{
+		m_free_list = m_nodes[index].parent;
+	}
+	Node& node = m_nodes[index];
+	node.parent = -1;
+	node.child1 = -1;
+	node.child2 = -1;
+	node.height = 0;
+	node.renderable = INVALID_COMPONENT;
+	return index;
+}
+
+
+void SpatialIndex::freeNode(int node)
+{
+	m_nodes[node].parent = m_free_list;
+	m_nodes[node].height = -1;
+	m_free_list = node;
+}
+
+
+void SpatialIndex::setFatBounds(Node& node, const Sphere& sphere)
+{
+	float radius = sphere.m_radius * (1 + FAT_MARGIN_RATIO);
+	Vec3 extent(radius, radius, radius);
+	node.center = sphere.m_position;
+	node.radius = sphere.m_radius;
+	node.min = sphere.m_position - extent;
+	node.max = sphere.m_position + extent;
+}
+
+
+bool SpatialIndex::has(ComponentIndex renderable) const
+{
+	return renderable >= 0 && renderable < m_renderable_to_node.size() && m_renderable_to_node[renderable] >= 0;
+}
+
+
+void SpatialIndex::add(ComponentIndex renderable, const Sphere& sphere)
+{
+	if (has(renderable))
+	{
+		ASSERT(false);
+		return;
+	}
+
+	while (renderable >= m_renderable_to_node.size()) m_renderable_to_node.push(-1);
+	int leaf = allocateNode();
+	m_nodes[leaf].renderable = renderable;
+	setFatBounds(m_nodes[leaf], sphere);
+	m_renderable_to_node[renderable] = leaf;
+	insertLeaf(leaf);
+	++m_count;
+}
+
+
+void SpatialIndex::remove(ComponentIndex renderable)
+{
+	if (!has(renderable)) return;
+
+	int leaf = m_renderable_to_node[renderable];
+	removeLeaf(leaf);
+	freeNode(leaf);
+	m_renderable_to_node[renderable] = -1;
+	--m_count;
+}
+
+
+void SpatialIndex::update(ComponentIndex renderable, const Sphere& sphere)
+{
+	if (!has(renderable)) return;
+
+	int leaf = m_renderable_to_node[renderable];
+	Node& node = m_nodes[leaf];
+	Vec3 extent(sphere.m_radius, sphere.m_radius, sphere.m_radius);
+	Vec3 min = sphere.m_position - extent;
+	Vec3 max = sphere.m_position + extent;
+	bool is_contained = min.x >= node.min.x && min.y >= node.min.y && min.z >= node.min.z &&
+						max.x <= node.max.x && max.y <= node.max.y && max.z <= node.max.z;
+	// shrinking a lot needs reinsertion too, otherwise the fat bounds would only grow
+	float fat_radius = (node.max.x - node.min.x) * 0.5f;
+	if (is_contained && sphere.m_radius * (1 + 2 * FAT_MARGIN_RATIO) > fat_radius)
+	{
+		node.center = sphere.m_position;
+		node.radius = sphere.m_radius;
+		return;
+	}
+
+	removeLeaf(leaf);
+	setFatBounds(m_nodes[leaf], sphere);
+	insertLeaf(leaf);
+}
+
+
+void SpatialIndex::insertLeaf(int leaf)
+{
+	if (m_root < 0)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = -1;
+		return;
+	}
+
+	// find the sibling with the smallest increase of the surface area
+	Vec3 leaf_min = m_nodes[leaf].min;
+	Vec3 leaf_max = m_nodes[leaf].max;
+	int index = m_root;
+	while (!m_nodes[index].isLeaf())
+	{
+		const Node& node = m_nodes[index];
+		float area = getHalfArea(node.min, node.max);
+		float combined_area = getHalfArea(minCoords(node.min, leaf_min), maxCoords(node.max, leaf_max));
+		float cost = 2 * combined_area;
+		float inheritance_cost = 2 * (combined_area - area);
+
+		float child_costs[2];
+		int children[2] = {node.child1, node.child2};
+		for (int i = 0; i < 2; ++i)
+		{
+			const Node& child = m_nodes[children[i]];
+			float child_area = getHalfArea(minCoords(child.min, leaf_min), maxCoords(child.max, leaf_max));
+			if (!child.isLeaf()) child_area -= getHalfArea(child.min, child.max);
+			child_costs[i] = child_area + inheritance_cost;
+		}
+
+		if (cost < child_costs[0] && cost < child_costs[1]) break;
+		index = child_costs[0] < child_costs[1] ? children[0] : children[1];
+	}
+
+	int sibling = index;
+	int old_parent = m_nodes[sibling].parent;
+	int new_parent = allocateNode();
+	Node& parent = m_nodes[new_parent];
+	parent.parent = old_parent;
+	parent.min = minCoords(leaf_min, m_nodes[sibling].min);
+	parent.max = maxCoords(leaf_max, m_nodes[sibling].max);
+	parent.height = m_nodes[sibling].height + 1;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+
+	if (old_parent >= 0)
+	{
+		if (m_nodes[old_parent].child1 == sibling)
+		{
+			m_nodes[old_parent].child1 = new_parent;
+		}
+		else
+		{
+			m_nodes[old_parent].child2 = new_parent;
+		}
+	}
+	else
+	{
+		m_root = new_parent;
+	}
+	m_nodes[sibling].parent = new_parent;
+	m_nodes[leaf].parent = new_parent;
+
+	fixUpwards(m_nodes[leaf].parent);
+}
+
+
+void SpatialIndex::removeLeaf(int leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = -1;
+		return;
+	}
+
+	int parent = m_nodes[leaf].parent;
+	int grand_parent = m_nodes[parent].parent;
+	int sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+	if (grand_parent >= 0)
+	{
+		if (m_nodes[grand_parent].child1 == parent)
+		{
+			m_nodes[grand_parent].child1 = sibling;
+		}
+		else
+		{
+			m_nodes[grand_parent].child2 = sibling;
+		}
+		m_nodes[sibling].parent = grand_parent;
+		freeNode(parent);
+		fixUpwards(grand_parent);
+	}
+	else
+	{
+		m_root = sibling;
+		m_nodes[sibling].parent = -1;
+		freeNode(parent);
+	}
+}
+
+
+void SpatialIndex::fixUpwards(int index)
+{
+	while (index >= 0)
+	{
+		index = balance(index);
+		Node& node = m_nodes[index];
+		const Node& child1 = m_nodes[node.child1];
+		const Node& child2 = m_nodes[node.child2];
+		node.height = 1 + Math::maximum(child1.height, child2.height);
+		node.min = minCoords(child1.min, child2.min);
+		node.max = maxCoords(child1.max, child2.max);
+		index = node.parent;
+	}
+}
+
+
+// rotates the higher child up if the subtree is unbalanced, returns the new subtree root
+int SpatialIndex::balance(int index_a)
+{
+	Node& a = m_nodes[index_a];
+	if (a.isLeaf() || a.height < 2) return index_a;
+
+	int index_b = a.child1;
+	int index_c = a.child2;
+	Node& b = m_nodes[index_b];
+	Node& c = m_nodes[index_c];
+	int balance = c.height - b.height;
+
+	auto replaceInParent = [this](int parent, int old_child, int new_child) {
+		if (parent < 0)
+		{
+			m_root = new_child;
+		}
+		else if (m_nodes[parent].child1 == old_child)
+		{
+			m_nodes[parent].child1 = new_child;
+		}
+		else
+		{
+			m_nodes[parent].child2 = new_child;
+		}
+	};
+
+	if (balance > 1)
+	{
+		int index_f = c.child1;
+		int index_g = c.child2;
+		Node& f = m_nodes[index_f];
+		Node& g = m_nodes[index_g];
+
+		c.child1 = index_a;
+		c.parent = a.parent;
+		a.parent = index_c;
+		replaceInParent(c.parent, index_a, index_c);
+
+		int index_up = f.height > g.height ? index_f : index_g;
+		int index_down = f.height > g.height ? index_g : index_f;
+		Node& up = m_nodes[index_up];
+		Node& down = m_nodes[index_down];
+		c.child2 = index_up;
+		a.child2 = index_down;
+		down.parent = index_a;
+		a.min = minCoords(b.min, down.min);
+		a.max = maxCoords(b.max, down.max);
+		c.min = minCoords(a.min, up.min);
+		c.max = maxCoords(a.max, up.max);
+		a.height = 1 + Math::maximum(b.height, down.height);
+		c.height = 1 + Math::maximum(a.height, up.height);
+		return index_c;
+	}
+
+	if (balance < -1)
+	{
+		int index_d = b.child1;
+		int index_e = b.child2;
+		Node& d = m_nodes[index_d];
+		Node& e = m_nodes[index_e];
+
+		b.child1 = index_a;
+		b.parent = a.parent;
+		a.parent = index_b;
+		replaceInParent(b.parent, index_a, index_b);
+
+		int index_up = d.height > e.height ? index_d : index_e;
+		int index_down = d.height > e.height ? index_e : index_d;
+		Node& up = m_nodes[index_up];
+		Node& down = m_nodes[index_down];
+		b.child2 = index_up;
+		a.child1 = index_down;
+		down.parent = index_a;
+		a.min = minCoords(c.min, down.min);
+		a.max = maxCoords(c.max, down.max);
+		b.min = minCoords(a.min, up.min);
+		b.max = maxCoords(a.max, up.max);
+		a.height = 1 + Math::maximum(c.height, down.height);
+		b.height = 1 + Math::maximum(a.height, up.height);
+		return index_b;
+	}
+
+	return index_a;
+}
+
+
+void SpatialIndex::addSubtree(int node, Array<ComponentIndex>& renderables) const
+{
+	int stack[STACK_SIZE];
+	int stack_size = 1;
+	stack[0] = node;
+	while (stack_size > 0)
+	{
+		const Node& n = m_nodes[stack[--stack_size]];
+		if (n.isLeaf())
+		{
+			renderables.push(n.renderable);
+			continue;
+		}
+		ASSERT(stack_size + 2 <= STACK_SIZE);
+		stack[stack_size++] = n.child1;
+		stack[stack_size++] = n.child2;
+	}
+}
+
+
+void SpatialIndex::getInFrustum(const Frustum& frustum, Array<ComponentIndex>& renderables) const
+{
+	PROFILE_FUNCTION();
+	if (m_root < 0) return;
+
+	int stack[STACK_SIZE];
+	int stack_size = 1;
+	stack[0] = m_root;
+	while (stack_size > 0)
+	{
+		int index = stack[--stack_size];
+		const Node& node = m_nodes[index];
+		if (node.isLeaf())
+		{
+			if (frustum.isSphereInside(node.center, node.radius))
+			{
+				renderables.push(node.renderable);
+			}
+			continue;
+		}
+
+		if (!frustum.intersectAABB(node.min, node.max)) continue;
+		if (frustum.isAABBInside(node.min, node.max))
+		{
+			// whole subtree is visible, no need to test its nodes
+			addSubtree(index, renderables);
+			continue;
+		}
+		ASSERT(stack_size + 2 <= STACK_SIZE);
+		stack[stack_size++] = node.child1;
+		stack[stack_size++] = node.child2;
+	}
+}
+
+
+void SpatialIndex::getOnRay(const Vec3& origin, const Vec3& dir, Array<RayHit>& hits) const
+{
+	PROFILE_FUNCTION();
+	if (m_root < 0) return;
+
+	int first_hit = hits.size();
+	Vec3 inv_dir(dir.x != 0 ? 1 / dir.x : 1e20f, dir.y != 0 ? 1 / dir.y : 1e20f, dir.z != 0 ? 1 / dir.z : 1e20f);
+	int stack[STACK_SIZE];
+	int stack_size = 1;
+	stack[0] = m_root;
+	while (stack_size > 0)
+	{
+		const Node& node = m_nodes[stack[--stack_size]];
+		if (node.isLeaf())
+		{
+			Vec3 l = node.center - origin;
+			float radius_squared = node.radius * node.radius;
+			float tca = dotProduct(l, dir);
+			float d2 = dotProduct(l, l) - tca * tca;
+			bool is_origin_inside = dotProduct(l, l) < radius_squared;
+			if (!is_origin_inside && (tca < 0 || d2 > radius_squared)) continue;
+
+			RayHit& hit = hits.emplace();
+			hit.renderable = node.renderable;
+			hit.t = is_origin_inside ? 0 : tca - sqrtf(radius_squared - d2);
+			continue;
+		}
+
+		float tx1 = (node.min.x - origin.x) * inv_dir.x;
+		float tx2 = (node.max.x - origin.x) * inv_dir.x;
+		float ty1 = (node.min.y - origin.y) * inv_dir.y;
+		float ty2 = (node.max.y - origin.y) * inv_dir.y;
+		float tz1 = (node.min.z - origin.z) * inv_dir.z;
+		float tz2 = (node.max.z - origin.z) * inv_dir.z;
+		float tmin = Math::maximum(Math::maximum(Math::minimum(tx1, tx2), Math::minimum(ty1, ty2)),
+			Math::maximum(Math::minimum(tz1, tz2), 0.0f));
+		float tmax = Math::minimum(Math::minimum(Math::maximum(tx1, tx2), Math::maximum(ty1, ty2)),
+			Math::maximum(tz1, tz2));
+		if (tmin > tmax) continue;
+
+		ASSERT(stack_size + 2 <= STACK_SIZE);
+		stack[stack_size++] = node.child1;
+		stack[stack_size++] = node.child2;
+	}
+
+	int count = hits.size() - first_hit;
+	if (count > 1) qsort(&hits[first_hit], count, sizeof(hits[0]), compareRayHits);
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,73 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+#include "engine/core/array.h"
+#include "engine/core/geometry.h"
+
+
+namespace Lumix
+{
+
+
+// dynamic AABB tree over bounding spheres of renderables, leaves have enlarged bounds
+// so small moves do not change the tree
+class LUMIX_RENDERER_API SpatialIndex
+{
+public:
+	struct RayHit
+	{
+		ComponentIndex renderable;
+		float t; // where the ray enters the bounding sphere
+	};
+
+public:
+	explicit SpatialIndex(IAllocator& allocator);
+
+	void clear();
+	void add(ComponentIndex renderable, const Sphere& sphere);
+	void remove(ComponentIndex renderable);
+	void update(ComponentIndex renderable, const Sphere& sphere);
+	bool has(ComponentIndex renderable) const;
+	int getCount() const { return m_count; }
+
+	void getInFrustum(const Frustum& frustum, Array<ComponentIndex>& renderables) const;
+	// dir must be normalized, hits are sorted by t
+	void getOnRay(const Vec3& origin, const Vec3& dir, Array<RayHit>& hits) const;
+
+private:
+	struct Node
+	{
+		Vec3 min;
+		Vec3 max;
+		Vec3 center;
+		float radius;
+		int parent; // next free node if the node is not used
+		int child1;
+		int child2;
+		int height; // 0 for leaves, -1 for free nodes
+		ComponentIndex renderable;
+
+		bool isLeaf() const { return child1 < 0; }
+	};
+
+private:
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void fixUpwards(int node);
+	void setFatBounds(Node& node, const Sphere& sphere);
+	void addSubtree(int node, Array<ComponentIndex>& renderables) const;
+
+private:
+	Array<Node> m_nodes;
+	Array<int> m_renderable_to_node;
+	int m_root;
+	int m_free_list;
+	int m_count;
+};
+
+
+} // namespace Lumix
@@ -6,7 +6,6 @@
 #include "engine/core/resource_manager.h"
 #include "engine/core/resource_manager_base.h"
 #include "renderer/texture.h"
-#include "renderer/texture_manager.h"
 #include <bgfx/bgfx.h>
 #include <cmath>
 
@@ -42,6 +41,8 @@ Texture::Texture(const Path& path,
 	, m_data(m_allocator)
 	, m_BPP(-1)
 	, m_depth(-1)
+	, m_decoded_data(nullptr)
+	, m_decoded_size(0)
 {
 	m_atlas_size = -1;
 	m_flags = 0;
@@ -349,7 +350,22 @@ void Texture::onDataUpdated(int x, int y, int w, int h)
 }
 
 
-bool Texture::loadRaw(FS::IFile& file)
+static void releaseDecodedData(void* ptr, void* user_data)
+{
+	static_cast<IAllocator*>(user_data)->deallocate(ptr);
+}
+
+
+const bgfx::Memory* Texture::takeDecodedData()
+{
+	auto* mem = bgfx::makeRef(m_decoded_data, m_decoded_size, releaseDecodedData, &m_allocator);
+	m_decoded_data = nullptr;
+	m_decoded_size = 0;
+	return mem;
+}
+
+
+bool Texture::decodeRaw(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
 	size_t size = file.size();
@@ -357,21 +373,41 @@ bool Texture::loadRaw(FS::IFile& file)
 	m_width = (int)sqrt(size / m_BPP);
 	m_height = m_width;
 
-	if (m_data_reference)
+	const uint16* src_mem = (const uint16*)file.getBuffer();
+	uint16* tmp = nullptr;
+	if (!src_mem)
 	{
-		m_data.resize((int)size);
-		file.read(&m_data[0], size);
+		tmp = (uint16*)m_allocator.allocate(size);
+		file.read(tmp, size);
+		src_mem = tmp;
 	}
 
-	const uint16* src_mem = (const uint16*)file.getBuffer();
-	const bgfx::Memory* mem = bgfx::alloc(m_width * m_height * sizeof(float));
-	float* dst_mem = (float*)mem->data;
+	m_decoded_size = m_width * m_height * (uint32)sizeof(float);
+	m_decoded_data = (uint8*)m_allocator.allocate(m_decoded_size);
+	float* dst_mem = (float*)m_decoded_data;
 
 	for (int i = 0; i < m_width * m_height; ++i)
 	{
 		dst_mem[i] = src_mem[i] / 65535.0f;
 	}
 
+	m_allocator.deallocate(tmp);
+	m_depth = 1;
+	return true;
+}
+
+
+bool Texture::loadRaw(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	if (m_data_reference)
+	{
+		size_t size = file.size();
+		m_data.resize((int)size);
+		file.seek(FS::SeekMode::BEGIN, 0);
+		file.read(&m_data[0], size);
+	}
+
 	m_texture_handle = bgfx::createTexture2D(
 		(uint16_t)m_width, (uint16_t)m_height, 1, bgfx::TextureFormat::R32F, m_flags, nullptr);
 	bgfx::updateTexture2D(
@@ -381,20 +417,18 @@ bool Texture::loadRaw(FS::IFile& file)
 		0,
 		(uint16_t)m_width,
 		(uint16_t)m_height,
-		mem);
-	m_depth = 1;
+		takeDecodedData());
 	return bgfx::isValid(m_texture_handle);
 }
 
 
-bool Texture::loadTGA(FS::IFile& file)
+bool Texture::decodeTGA(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
 	TGAHeader header;
 	file.read(&header, sizeof(header));
 
 	int color_mode = header.bitsPerPixel / 8;
-	int image_size = header.width * header.height * 4;
 	if (header.dataType != 2)
 	{
 		g_log_error.log("Renderer") << "Unsupported texture format " << getPath().c_str();
@@ -407,42 +441,68 @@ bool Texture::loadTGA(FS::IFile& file)
 		return false;
 	}
 
-	m_width = header.width;
-	m_height = header.height;
-	TextureManager* manager = static_cast<TextureManager*>(
-		getResourceManager().get(ResourceManager::TEXTURE));
-	if (m_data_reference)
+	int pixel_count = header.width * header.height;
+	size_t src_size = pixel_count * color_mode;
+	if (file.size() < file.pos() + src_size)
+	{
+		g_log_error.log("Renderer") << "Texture " << getPath().c_str() << " is truncated";
+		return false;
+	}
+
+	const uint8* src = (const uint8*)file.getBuffer();
+	uint8* tmp = nullptr;
+	if (src)
+	{
+		src += file.pos();
+	}
+	else
 	{
-		m_data.resize(image_size);
+		tmp = (uint8*)m_allocator.allocate(src_size);
+		file.read(tmp, src_size);
+		src = tmp;
 	}
-	uint8* image_dest = m_data_reference
-							  ? &m_data[0]
-							  : (uint8*)manager->getBuffer(image_size);
 
-	// Targa is BGR, swap to RGB, add alpha and flip Y axis
+	m_width = header.width;
+	m_height = header.height;
+	m_decoded_size = pixel_count * 4;
+	m_decoded_data = (uint8*)m_allocator.allocate(m_decoded_size);
+	uint8* image_dest = m_decoded_data;
+
+	// Targa is BGR, swap to RGB and add alpha
 	for (long y = 0; y < header.height; y++)
 	{
-		long read_index = y * header.width * color_mode;
-		long write_index = ((header.imageDescriptor & 32) != 0)
-							   ? read_index
-							   : y * header.width * 4;
+		const uint8* read = src + y * header.width * color_mode;
+		uint8* write = image_dest + y * header.width * 4;
 		for (long x = 0; x < header.width; x++)
 		{
-			file.read(&image_dest[write_index + 2], sizeof(uint8));
-			file.read(&image_dest[write_index + 1], sizeof(uint8));
-			file.read(&image_dest[write_index + 0], sizeof(uint8));
-			if (color_mode == 4)
-				file.read(&image_dest[write_index + 3], sizeof(uint8));
-			else
-				image_dest[write_index + 3] = 255;
-			write_index += 4;
+			write[0] = read[2];
+			write[1] = read[1];
+			write[2] = read[0];
+			write[3] = color_mode == 4 ? read[3] : 255;
+			read += color_mode;
+			write += 4;
 		}
 	}
+
+	m_allocator.deallocate(tmp);
 	m_BPP = 4;
+	m_depth = 1;
+	return true;
+}
+
+
+bool Texture::loadTGA(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	if (m_data_reference)
+	{
+		m_data.resize(m_decoded_size);
+		copyMemory(&m_data[0], m_decoded_data, m_decoded_size);
+	}
 
 	m_texture_handle = bgfx::createTexture2D(
-		header.width,
-		header.height,
+		(uint16_t)m_width,
+		(uint16_t)m_height,
 		1,
 		bgfx::TextureFormat::RGBA8,
 		m_flags,
@@ -452,10 +512,9 @@ bool Texture::loadTGA(FS::IFile& file)
 		0,
 		0,
 		0,
-		header.width,
-		header.height,
-		bgfx::copy(image_dest, header.width * header.height * 4));
-	m_depth = 1;
+		(uint16_t)m_width,
+		(uint16_t)m_height,
+		takeDecodedData());
 	return bgfx::isValid(m_texture_handle);
 }
 
@@ -480,14 +539,24 @@ void Texture::removeDataReference()
 }
 
 
+bool Texture::decodeDDS(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	m_decoded_size = (uint32)file.size();
+	m_decoded_data = (uint8*)m_allocator.allocate(m_decoded_size);
+	if (file.getBuffer())
+	{
+		copyMemory(m_decoded_data, file.getBuffer(), m_decoded_size);
+		return true;
+	}
+	return file.read(m_decoded_data, m_decoded_size);
+}
+
+
 bool Texture::loadDDS(FS::IFile& file)
 {
 	bgfx::TextureInfo info;
-	m_texture_handle =
-		bgfx::createTexture(bgfx::copy(file.getBuffer(), (uint32)file.size()),
-							m_flags,
-							0,
-							&info);
+	m_texture_handle = bgfx::createTexture(takeDecodedData(), m_flags, 0, &info);
 	m_BPP = -1;
 	m_width = info.width;
 	m_height = info.height;
@@ -496,18 +565,51 @@ bool Texture::loadDDS(FS::IFile& file)
 }
 
 
+static bool hasExtension(const Path& path, const char* ext)
+{
+	size_t len = path.length();
+	return len > 3 && compareString(path.c_str() + len - 4, ext) == 0;
+}
+
+
+bool Texture::decode(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+
+	bool decoded = false;
+	if (hasExtension(getPath(), ".dds"))
+	{
+		decoded = decodeDDS(file);
+	}
+	else if (hasExtension(getPath(), ".raw"))
+	{
+		decoded = decodeRaw(file);
+	}
+	else
+	{
+		decoded = decodeTGA(file);
+	}
+	if (!decoded)
+	{
+		g_log_warning.log("Renderer") << "Error loading texture " << getPath().c_str();
+		m_allocator.deallocate(m_decoded_data);
+		m_decoded_data = nullptr;
+		m_decoded_size = 0;
+	}
+	return decoded;
+}
+
+
 bool Texture::load(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
 
-	const char* path = getPath().c_str();
-	size_t len = getPath().length();
 	bool loaded = false;
-	if (len > 3 && compareString(path + len - 4, ".dds") == 0)
+	if (hasExtension(getPath(), ".dds"))
 	{
 		loaded = loadDDS(file);
 	}
-	else if (len > 3 && compareString(path + len - 4, ".raw") == 0)
+	else if (hasExtension(getPath(), ".raw"))
 	{
 		loaded = loadRaw(file);
 	}
@@ -517,7 +619,7 @@ bool Texture::load(FS::IFile& file)
 	}
 	if (!loaded)
 	{
-		g_log_warning.log("Renderer") << "Error loading texture " << path;
+		g_log_warning.log("Renderer") << "Error loading texture " << getPath().c_str();
 		return false;
 	}
 
@@ -534,6 +636,9 @@ void Texture::unload(void)
 		m_texture_handle = BGFX_INVALID_HANDLE;
 	}
 	m_data.clear();
+	m_allocator.deallocate(m_decoded_data);
+	m_decoded_data = nullptr;
+	m_decoded_size = 0;
 }
 
 
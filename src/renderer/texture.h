@@ -45,13 +45,17 @@ class LUMIX_RENDERER_API Texture : public Resource
 		void setAtlasSize(int size) { m_atlas_size = size; }
 
 	private:
-		bool load3D(FS::IFile& file);
+		bool decodeDDS(FS::IFile& file);
+		bool decodeTGA(FS::IFile& file);
+		bool decodeRaw(FS::IFile& file);
 		bool loadDDS(FS::IFile& file);
 		bool loadTGA(FS::IFile& file);
 		bool loadRaw(FS::IFile& file);
+		const bgfx::Memory* takeDecodedData();
 		void saveTGA();
 
 		void unload(void) override;
+		bool decode(FS::IFile& file) override;
 		bool load(FS::IFile& file) override;
 
 	private:
@@ -64,6 +68,8 @@ class LUMIX_RENDERER_API Texture : public Resource
 		int m_data_reference;
 		uint32 m_flags;
 		Array<uint8> m_data;
+		uint8* m_decoded_data;
+		uint32 m_decoded_size;
 		bgfx::TextureHandle m_texture_handle;
 };
 
@@ -10,14 +10,11 @@ namespace Lumix
 		: ResourceManagerBase(allocator)
 		, m_allocator(allocator)
 	{
-		m_buffer = nullptr;
-		m_buffer_size = -1;
 	}
 
 
 	TextureManager::~TextureManager()
 	{
-		m_allocator.deallocate(m_buffer);
 	}
 
 
@@ -30,20 +27,4 @@ namespace Lumix
 	{
 		LUMIX_DELETE(m_allocator, static_cast<Texture*>(&resource));
 	}
-
-	uint8* TextureManager::getBuffer(int32 size)
-	{
-		if (m_buffer_size < size)
-		{
-			m_allocator.deallocate(m_buffer);
-			m_buffer = nullptr;
-			m_buffer_size = -1;
-		}
-		if (m_buffer == nullptr)
-		{
-			m_buffer = (uint8*)m_allocator.allocate(sizeof(uint8) * size);
-			m_buffer_size = size;
-		}
-		return m_buffer;
-	}
 }
\ No newline at end of file
@@ -10,15 +10,11 @@ namespace Lumix
 		explicit TextureManager(IAllocator& allocator);
 		~TextureManager();
 
-		uint8* getBuffer(int32 size);
-
 	protected:
 		Resource* createResource(const Path& path) override;
 		void destroyResource(Resource& resource) override;
 
 	private:
 		IAllocator& m_allocator;
-		uint8* m_buffer;
-		int32 m_buffer_size;
 	};
 }
\ No newline at end of file
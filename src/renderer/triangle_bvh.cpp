@@ -0,0 +1,492 @@
+#include "renderer/triangle_bvh.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/profiler.h"
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+
+
+namespace Lumix
+{
+
+
+static const int MAX_LEAF_SIZE = 4;
+static const int BINS_COUNT = 8;
+static const int MAX_DEPTH = 48;
+// deeper nodes are split at the median, so the depth stays below MAX_DEPTH + 32
+static const int STACK_SIZE = MAX_DEPTH + 40;
+
+
+struct BuildTriangle
+{
+	Vec3 min;
+	Vec3 max;
+	Vec3 centroid;
+};
+
+
+struct BuildItem
+{
+	int node;
+	int begin;
+	int end;
+	int depth;
+};
+
+
+static float getComponent(const Vec3& v, int axis)
+{
+	return (&v.x)[axis];
+}
+
+
+static void addPoint(Vec3& min, Vec3& max, const Vec3& p)
+{
+	min.set(Math::minimum(min.x, p.x), Math::minimum(min.y, p.y), Math::minimum(min.z, p.z));
+	max.set(Math::maximum(max.x, p.x), Math::maximum(max.y, p.y), Math::maximum(max.z, p.z));
+}
+
+
+static float getHalfArea(const Vec3& min, const Vec3& max)
+{
+	Vec3 size = max - min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+
+static float safeInverse(float value)
+{
+	// avoids NaNs in the slab test for axis aligned rays
+	if (fabsf(value) < 1e-20f) return value < 0 ? -1e20f : 1e20f;
+	return 1 / value;
+}
+
+
+// partially sorts order so that the element at mid is the one which would be there if sorted by centroid
+static void selectMedian(Array<int>& order, const Array<BuildTriangle>& triangles, int begin, int end, int mid, int axis)
+{
+	int left = begin;
+	int right = end - 1;
+	while (left < right)
+	{
+		float pivot = getComponent(triangles[order[(left + right) >> 1]].centroid, axis);
+		int i = left;
+		int j = right;
+		while (i <= j)
+		{
+			while (getComponent(triangles[order[i]].centroid, axis) < pivot) ++i;
+			while (getComponent(triangles[order[j]].centroid, axis) > pivot) --j;
+			if (i <= j)
+			{
+				int tmp = order[i];
+				order[i] = order[j];
+				order[j] = tmp;
+				++i;
+				--j;
+			}
+		}
+		if (mid <= j) right = j;
+		else if (mid >= i) left = i;
+		else break;
+	}
+}
+
+
+TriangleBVH::TriangleBVH(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_nodes(allocator)
+	, m_packs(allocator)
+	, m_tags(allocator)
+{
+}
+
+
+void TriangleBVH::clear()
+{
+	m_nodes.clear();
+	m_packs.clear();
+	m_tags.clear();
+}
+
+
+// splits along the longest centroid axis using binned surface area heuristic
+static int split(Array<int>& order, const Array<BuildTriangle>& triangles, int begin, int end, int depth)
+{
+	Vec3 cmin(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vec3 cmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = begin; i < end; ++i) addPoint(cmin, cmax, triangles[order[i]].centroid);
+
+	Vec3 extent = cmax - cmin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	float axis_min = getComponent(cmin, axis);
+	float axis_extent = getComponent(extent, axis);
+	int mid = begin + (end - begin) / 2;
+	if (axis_extent <= 0) return mid;
+
+	if (depth >= MAX_DEPTH)
+	{
+		// keep the tree shallow enough for the fixed traversal stack
+		selectMedian(order, triangles, begin, end, mid, axis);
+		return mid;
+	}
+
+	struct Bin
+	{
+		Vec3 min;
+		Vec3 max;
+		int count;
+	} bins[BINS_COUNT];
+	for (auto& bin : bins)
+	{
+		bin.min.set(FLT_MAX, FLT_MAX, FLT_MAX);
+		bin.max.set(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		bin.count = 0;
+	}
+
+	float scale = BINS_COUNT / axis_extent;
+	auto getBin = [&](int triangle) {
+		int bin = int((getComponent(triangles[triangle].centroid, axis) - axis_min) * scale);
+		return Math::minimum(bin, BINS_COUNT - 1);
+	};
+	for (int i = begin; i < end; ++i)
+	{
+		const BuildTriangle& tri = triangles[order[i]];
+		Bin& bin = bins[getBin(order[i])];
+		addPoint(bin.min, bin.max, tri.min);
+		addPoint(bin.min, bin.max, tri.max);
+		++bin.count;
+	}
+
+	float right_area[BINS_COUNT];
+	int right_count[BINS_COUNT];
+	Vec3 rmin(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vec3 rmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	int count = 0;
+	for (int i = BINS_COUNT - 1; i > 0; --i)
+	{
+		if (bins[i].count > 0)
+		{
+			addPoint(rmin, rmax, bins[i].min);
+			addPoint(rmin, rmax, bins[i].max);
+		}
+		count += bins[i].count;
+		right_area[i] = count > 0 ? getHalfArea(rmin, rmax) : 0;
+		right_count[i] = count;
+	}
+
+	Vec3 lmin(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vec3 lmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	count = 0;
+	float best_cost = FLT_MAX;
+	int best_bin = -1;
+	for (int i = 1; i < BINS_COUNT; ++i)
+	{
+		if (bins[i - 1].count > 0)
+		{
+			addPoint(lmin, lmax, bins[i - 1].min);
+			addPoint(lmin, lmax, bins[i - 1].max);
+		}
+		count += bins[i - 1].count;
+		if (count == 0 || right_count[i] == 0) continue;
+		float cost = count * getHalfArea(lmin, lmax) + right_count[i] * right_area[i];
+		if (cost < best_cost)
+		{
+			best_cost = cost;
+			best_bin = i;
+		}
+	}
+	if (best_bin < 0) return mid;
+
+	int left = begin;
+	int right = end - 1;
+	while (left <= right)
+	{
+		if (getBin(order[left]) < best_bin)
+		{
+			++left;
+		}
+		else
+		{
+			int tmp = order[left];
+			order[left] = order[right];
+			order[right] = tmp;
+			--right;
+		}
+	}
+	return left;
+}
+
+
+void TriangleBVH::build(const Vec3* vertices, const uint32* indices, const int* tags, int triangles_count)
+{
+	PROFILE_FUNCTION();
+	clear();
+	if (triangles_count <= 0) return;
+
+	Array<BuildTriangle> triangles(m_allocator);
+	Array<int> order(m_allocator);
+	triangles.resize(triangles_count);
+	order.resize(triangles_count);
+	for (int i = 0; i < triangles_count; ++i)
+	{
+		const Vec3& p0 = vertices[indices[i * 3]];
+		const Vec3& p1 = vertices[indices[i * 3 + 1]];
+		const Vec3& p2 = vertices[indices[i * 3 + 2]];
+		BuildTriangle& tri = triangles[i];
+		tri.min = tri.max = p0;
+		addPoint(tri.min, tri.max, p1);
+		addPoint(tri.min, tri.max, p2);
+		tri.centroid = (tri.min + tri.max) * 0.5f;
+		order[i] = i;
+	}
+
+	m_tags.resize(triangles_count);
+	for (int i = 0; i < triangles_count; ++i) m_tags[i] = tags ? tags[i] : 0;
+
+	m_nodes.reserve(triangles_count * 2 / MAX_LEAF_SIZE + 1);
+	m_packs.reserve(triangles_count / MAX_LEAF_SIZE + 1);
+	m_nodes.emplace();
+
+	BuildItem stack[STACK_SIZE];
+	int stack_size = 1;
+	stack[0] = {0, 0, triangles_count, 0};
+	while (stack_size > 0)
+	{
+		BuildItem item = stack[--stack_size];
+
+		Vec3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vec3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int i = item.begin; i < item.end; ++i)
+		{
+			addPoint(min, max, triangles[order[i]].min);
+			addPoint(min, max, triangles[order[i]].max);
+		}
+		m_nodes[item.node].min = min;
+		m_nodes[item.node].max = max;
+
+		int count = item.end - item.begin;
+		if (count <= MAX_LEAF_SIZE)
+		{
+			m_nodes[item.node].offset = m_packs.size();
+			m_nodes[item.node].count = count;
+
+			TrianglePack& pack = m_packs.emplace();
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				int triangle = lane < count ? order[item.begin + lane] : -1;
+				Vec3 p0(0, 0, 0);
+				Vec3 e1(0, 0, 0);
+				Vec3 e2(0, 0, 0);
+				if (triangle >= 0)
+				{
+					p0 = vertices[indices[triangle * 3]];
+					e1 = vertices[indices[triangle * 3 + 1]] - p0;
+					e2 = vertices[indices[triangle * 3 + 2]] - p0;
+				}
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					pack.v0[axis][lane] = getComponent(p0, axis);
+					pack.e1[axis][lane] = getComponent(e1, axis);
+					pack.e2[axis][lane] = getComponent(e2, axis);
+				}
+				pack.triangle[lane] = triangle;
+			}
+			continue;
+		}
+
+		int mid = split(order, triangles, item.begin, item.end, item.depth);
+		if (mid == item.begin || mid == item.end) mid = item.begin + count / 2;
+
+		int children = m_nodes.size();
+		m_nodes.emplace();
+		m_nodes.emplace();
+		m_nodes[item.node].offset = children;
+		m_nodes[item.node].count = 0;
+		ASSERT(stack_size + 2 <= STACK_SIZE);
+		stack[stack_size++] = {children + 1, mid, item.end, item.depth + 1};
+		stack[stack_size++] = {children, item.begin, mid, item.depth + 1};
+	}
+}
+
+
+void TriangleBVH::intersectPack(const TrianglePack& pack, const Vec3& origin, const Vec3& dir, Hit& hit) const
+{
+	// Moller-Trumbore, 4 triangles at once
+	__m128 dx = _mm_set1_ps(dir.x);
+	__m128 dy = _mm_set1_ps(dir.y);
+	__m128 dz = _mm_set1_ps(dir.z);
+	__m128 e1x = _mm_loadu_ps(pack.e1[0]);
+	__m128 e1y = _mm_loadu_ps(pack.e1[1]);
+	__m128 e1z = _mm_loadu_ps(pack.e1[2]);
+	__m128 e2x = _mm_loadu_ps(pack.e2[0]);
+	__m128 e2y = _mm_loadu_ps(pack.e2[1]);
+	__m128 e2z = _mm_loadu_ps(pack.e2[2]);
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 valid = _mm_cmpneq_ps(det, zero);
+	__m128 inv_det = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(valid, det), _mm_andnot_ps(valid, one)));
+
+	__m128 tx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(pack.v0[0]));
+	__m128 ty = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(pack.v0[1]));
+	__m128 tz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(pack.v0[2]));
+	__m128 u = _mm_mul_ps(
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	__m128 v = _mm_mul_ps(
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+	__m128 t = _mm_mul_ps(
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+	valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+
+	int mask = _mm_movemask_ps(valid);
+	if (mask == 0) return;
+
+	float ts[4];
+	_mm_storeu_ps(ts, t);
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		if ((mask & (1 << lane)) == 0 || ts[lane] >= hit.t) continue;
+		hit.is_hit = true;
+		hit.t = ts[lane];
+		hit.triangle = pack.triangle[lane];
+		hit.tag = m_tags[hit.triangle];
+	}
+}
+
+
+TriangleBVH::Hit TriangleBVH::castRay(const Vec3& origin, const Vec3& dir, float max_t) const
+{
+	Hit hit;
+	hit.is_hit = false;
+	hit.t = max_t;
+	hit.triangle = -1;
+	hit.tag = -1;
+	if (m_nodes.empty()) return hit;
+
+	Vec3 inv_dir(safeInverse(dir.x), safeInverse(dir.y), safeInverse(dir.z));
+	int stack[STACK_SIZE];
+	int stack_size = 1;
+	stack[0] = 0;
+	while (stack_size > 0)
+	{
+		const Node& node = m_nodes[stack[--stack_size]];
+
+		float tx1 = (node.min.x - origin.x) * inv_dir.x;
+		float tx2 = (node.max.x - origin.x) * inv_dir.x;
+		float ty1 = (node.min.y - origin.y) * inv_dir.y;
+		float ty2 = (node.max.y - origin.y) * inv_dir.y;
+		float tz1 = (node.min.z - origin.z) * inv_dir.z;
+		float tz2 = (node.max.z - origin.z) * inv_dir.z;
+		float tmin = Math::maximum(Math::maximum(Math::minimum(tx1, tx2), Math::minimum(ty1, ty2)),
+			Math::maximum(Math::minimum(tz1, tz2), 0.0f));
+		float tmax = Math::minimum(Math::minimum(Math::maximum(tx1, tx2), Math::maximum(ty1, ty2)),
+			Math::maximum(tz1, tz2));
+		if (tmin > tmax || tmin > hit.t) continue;
+
+		if (node.count > 0)
+		{
+			intersectPack(m_packs[node.offset], origin, dir, hit);
+			continue;
+		}
+
+		// visit the child on the side of the ray's origin first
+		const Node& left = m_nodes[node.offset];
+		const Node& right = m_nodes[node.offset + 1];
+		Vec3 left_center = left.min + left.max;
+		Vec3 right_center = right.min + right.max;
+		bool left_first = dotProduct(left_center - right_center, dir) < 0;
+		stack[stack_size++] = left_first ? node.offset + 1 : node.offset;
+		stack[stack_size++] = left_first ? node.offset : node.offset + 1;
+	}
+	return hit;
+}
+
+
+void TriangleBVH::castRays(const Vec3* origins, const Vec3* dirs, int count, float max_t, Hit* hits) const
+{
+	PROFILE_FUNCTION();
+	for (int i = 0; i < count; ++i)
+	{
+		hits[i].is_hit = false;
+		hits[i].t = max_t;
+		hits[i].triangle = -1;
+		hits[i].tag = -1;
+	}
+	if (m_nodes.empty()) return;
+
+	for (int first = 0; first < count; first += 4)
+	{
+		int packet_size = Math::minimum(4, count - first);
+		float ox[4], oy[4], oz[4], idx[4], idy[4], idz[4], best[4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			// unused lanes repeat the last ray and are never read back
+			int ray = first + Math::minimum(lane, packet_size - 1);
+			ox[lane] = origins[ray].x;
+			oy[lane] = origins[ray].y;
+			oz[lane] = origins[ray].z;
+			idx[lane] = safeInverse(dirs[ray].x);
+			idy[lane] = safeInverse(dirs[ray].y);
+			idz[lane] = safeInverse(dirs[ray].z);
+		}
+		__m128 ox4 = _mm_loadu_ps(ox);
+		__m128 oy4 = _mm_loadu_ps(oy);
+		__m128 oz4 = _mm_loadu_ps(oz);
+		__m128 idx4 = _mm_loadu_ps(idx);
+		__m128 idy4 = _mm_loadu_ps(idy);
+		__m128 idz4 = _mm_loadu_ps(idz);
+		__m128 zero = _mm_setzero_ps();
+		int lanes_mask = (1 << packet_size) - 1;
+
+		int stack[STACK_SIZE];
+		int stack_size = 1;
+		stack[0] = 0;
+		while (stack_size > 0)
+		{
+			const Node& node = m_nodes[stack[--stack_size]];
+
+			for (int lane = 0; lane < 4; ++lane) best[lane] = hits[first + Math::minimum(lane, packet_size - 1)].t;
+			__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), ox4), idx4);
+			__m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), ox4), idx4);
+			__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), oy4), idy4);
+			__m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), oy4), idy4);
+			__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), oz4), idz4);
+			__m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), oz4), idz4);
+			__m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+				_mm_max_ps(_mm_min_ps(tz1, tz2), zero));
+			__m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_max_ps(tz1, tz2));
+			__m128 active = _mm_and_ps(_mm_cmple_ps(tmin, tmax), _mm_cmple_ps(tmin, _mm_loadu_ps(best)));
+			int mask = _mm_movemask_ps(active) & lanes_mask;
+			if (mask == 0) continue;
+
+			if (node.count > 0)
+			{
+				const TrianglePack& pack = m_packs[node.offset];
+				for (int lane = 0; lane < packet_size; ++lane)
+				{
+					if (mask & (1 << lane)) intersectPack(pack, origins[first + lane], dirs[first + lane], hits[first + lane]);
+				}
+				continue;
+			}
+
+			stack[stack_size++] = node.offset + 1;
+			stack[stack_size++] = node.offset;
+		}
+	}
+}
+
+
+} // namespace Lumix
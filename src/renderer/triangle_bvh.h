@@ -0,0 +1,67 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+#include "engine/core/array.h"
+#include "engine/core/vec.h"
+
+
+namespace Lumix
+{
+
+
+// bounding volume hierarchy over static triangles, leaves store 4 triangles for the SIMD ray test
+class LUMIX_RENDERER_API TriangleBVH
+{
+public:
+	struct Hit
+	{
+		bool is_hit;
+		float t;
+		int triangle;
+		int tag;
+	};
+
+public:
+	explicit TriangleBVH(IAllocator& allocator);
+
+	// indices contain 3 vertex indices per triangle, tags (optional) are returned in hits
+	void build(const Vec3* vertices, const uint32* indices, const int* tags, int triangles_count);
+	void clear();
+	bool isEmpty() const { return m_nodes.empty(); }
+
+	// dir does not need to be normalized, t is in the units of dir
+	Hit castRay(const Vec3& origin, const Vec3& dir, float max_t) const;
+	// traverses the tree with packets of 4 rays, faster than castRay for coherent rays
+	void castRays(const Vec3* origins, const Vec3* dirs, int count, float max_t, Hit* hits) const;
+
+private:
+	struct Node
+	{
+		Vec3 min;
+		int32 offset; // index of the first child or of the leaf's pack
+		Vec3 max;
+		int32 count; // number of triangles in leaf, 0 for inner nodes
+	};
+
+	// 4 triangles in structure of arrays layout, v0 and edges v1 - v0, v2 - v0
+	struct TrianglePack
+	{
+		float v0[3][4];
+		float e1[3][4];
+		float e2[3][4];
+		int32 triangle[4];
+	};
+
+private:
+	void intersectPack(const TrianglePack& pack, const Vec3& origin, const Vec3& dir, Hit& hit) const;
+
+private:
+	IAllocator& m_allocator;
+	Array<Node> m_nodes;
+	Array<TrianglePack> m_packs;
+	Array<int> m_tags;
+};
+
+
+} // namespace Lumix
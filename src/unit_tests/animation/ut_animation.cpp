@@ -0,0 +1,139 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "animation/animation.h"
+#include "engine/core/array.h"
+#include "engine/core/quat.h"
+#include "engine/core/vec.h"
+
+#include <cmath>
+
+
+namespace
+{
+	float getFloatError(const float& a, const float& b, float t, const float& value)
+	{
+		return fabsf(a + (b - a) * t - value);
+	}
+
+
+	float getTrackValue(int frame)
+	{
+		if (frame < 10) return frame * 0.5f;
+		if (frame < 20) return 5.0f;
+		return 5.0f + sinf((frame - 20) * 0.3f);
+	}
+
+
+	void UT_animation_pack_position(const char* params)
+	{
+		const float MIN = -3.0f;
+		const float EXTENT = 8.0f;
+		// half of the quantization step
+		const float MAX_ERROR = EXTENT / 0xffff * 0.5f + 0.00001f;
+
+		LUMIX_EXPECT(Lumix::Animation::packPosition(MIN, MIN, EXTENT) == 0);
+		LUMIX_EXPECT(Lumix::Animation::packPosition(MIN + EXTENT, MIN, EXTENT) == 0xffff);
+		LUMIX_EXPECT(Lumix::Animation::unpackPosition(0, MIN, EXTENT) == MIN);
+		LUMIX_EXPECT(Lumix::Animation::unpackPosition(0xffff, MIN, EXTENT) == MIN + EXTENT);
+
+		for (int i = 0; i <= 1000; ++i)
+		{
+			float value = MIN + EXTENT * i / 1000.0f;
+			Lumix::uint16 packed = Lumix::Animation::packPosition(value, MIN, EXTENT);
+			LUMIX_EXPECT_CLOSE_EQ(Lumix::Animation::unpackPosition(packed, MIN, EXTENT), value, MAX_ERROR);
+		}
+
+		// values out of the range are clamped
+		LUMIX_EXPECT(Lumix::Animation::packPosition(MIN - 1, MIN, EXTENT) == 0);
+		LUMIX_EXPECT(Lumix::Animation::packPosition(MIN + EXTENT + 1, MIN, EXTENT) == 0xffff);
+
+		// constant tracks have zero extent
+		Lumix::uint16 packed = Lumix::Animation::packPosition(MIN, MIN, 0);
+		LUMIX_EXPECT(Lumix::Animation::unpackPosition(packed, MIN, 0) == MIN);
+	}
+
+
+	void UT_animation_pack_rotation(const char* params)
+	{
+		Lumix::Quat rotations[] = {
+			Lumix::Quat(0, 0, 0, 1),
+			Lumix::Quat(0, 0, 0, -1),
+			Lumix::Quat(1, 0, 0, 0),
+			Lumix::Quat(0, -1, 0, 0),
+			Lumix::Quat(0.5f, -0.5f, 0.5f, -0.5f),
+		};
+		for (const Lumix::Quat& rot : rotations)
+		{
+			Lumix::uint16 packed[3];
+			Lumix::Animation::packRotation(rot, packed);
+			Lumix::Quat unpacked = Lumix::Animation::unpackRotation(packed);
+			// q and -q are the same rotation
+			float dot = rot.x * unpacked.x + rot.y * unpacked.y + rot.z * unpacked.z + rot.w * unpacked.w;
+			LUMIX_EXPECT_CLOSE_EQ(fabsf(dot), 1.0f, 0.0001f);
+		}
+
+		for (int i = 0; i < 200; ++i)
+		{
+			Lumix::Vec3 axis(sinf(i * 0.7f), cosf(i * 1.3f), sinf(i * 0.4f + 1));
+			axis.normalize();
+			Lumix::Quat rot(axis, i * 0.1f - 10);
+			Lumix::uint16 packed[3];
+			Lumix::Animation::packRotation(rot, packed);
+			Lumix::Quat unpacked = Lumix::Animation::unpackRotation(packed);
+
+			float length = sqrtf(unpacked.x * unpacked.x + unpacked.y * unpacked.y + unpacked.z * unpacked.z +
+								 unpacked.w * unpacked.w);
+			LUMIX_EXPECT_CLOSE_EQ(length, 1.0f, 0.0001f);
+			float dot = rot.x * unpacked.x + rot.y * unpacked.y + rot.z * unpacked.z + rot.w * unpacked.w;
+			LUMIX_EXPECT_CLOSE_EQ(fabsf(dot), 1.0f, 0.0001f);
+		}
+	}
+
+
+	void UT_animation_reduce_keys(const char* params)
+	{
+		const int FRAME_COUNT = 60;
+		const float MAX_ERROR = 0.01f;
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<int> keys(allocator);
+
+		float constant[FRAME_COUNT];
+		for (float& value : constant) value = 2.0f;
+		Lumix::Animation::reduceKeys(constant, FRAME_COUNT, MAX_ERROR, getFloatError, keys);
+		LUMIX_EXPECT(keys.size() == 1);
+		LUMIX_EXPECT(keys[0] == 0);
+
+		float linear[FRAME_COUNT];
+		for (int i = 0; i < FRAME_COUNT; ++i) linear[i] = i * 0.25f;
+		Lumix::Animation::reduceKeys(linear, FRAME_COUNT, MAX_ERROR, getFloatError, keys);
+		LUMIX_EXPECT(keys.size() == 2);
+		LUMIX_EXPECT(keys[0] == 0);
+		LUMIX_EXPECT(keys[1] == FRAME_COUNT - 1);
+
+		float values[FRAME_COUNT];
+		for (int i = 0; i < FRAME_COUNT; ++i) values[i] = getTrackValue(i);
+		Lumix::Animation::reduceKeys(values, FRAME_COUNT, MAX_ERROR, getFloatError, keys);
+		LUMIX_EXPECT(keys.size() > 3);
+		LUMIX_EXPECT(keys.size() < FRAME_COUNT);
+		LUMIX_EXPECT(keys[0] == 0);
+		LUMIX_EXPECT(keys.back() == FRAME_COUNT - 1);
+
+		// the keys are increasing, as the animation loader requires, and the frames between them
+		// are interpolated within the error
+		for (int i = 1; i < keys.size(); ++i)
+		{
+			LUMIX_EXPECT(keys[i] > keys[i - 1]);
+			int from = keys[i - 1];
+			int to = keys[i];
+			for (int frame = from; frame <= to; ++frame)
+			{
+				float t = (frame - from) / float(to - from);
+				LUMIX_EXPECT(getFloatError(values[from], values[to], t, values[frame]) <= MAX_ERROR);
+			}
+		}
+	}
+}
+
+REGISTER_TEST("unit_tests/animation/pack_position", UT_animation_pack_position, "")
+REGISTER_TEST("unit_tests/animation/pack_rotation", UT_animation_pack_rotation, "")
+REGISTER_TEST("unit_tests/animation/reduce_keys", UT_animation_reduce_keys, "")
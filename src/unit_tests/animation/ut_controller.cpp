@@ -0,0 +1,310 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "animation/animation.h"
+#include "animation/controller.h"
+#include "engine/core/crc32.h"
+#include "engine/core/fs/disk_file_device.h"
+#include "engine/core/fs/file_system.h"
+#include "engine/core/fs/os_file.h"
+#include "engine/core/mt/thread.h"
+#include "engine/core/path.h"
+#include "engine/core/resource_manager.h"
+
+
+namespace
+{
+	const char* CONTROLLER_PATH = "unit_tests/controller.act";
+	const char* IDLE_PATH = "unit_tests/controller_idle.ani";
+	const char* RUN_PATH = "unit_tests/controller_run.ani";
+
+	// the children of the blend are not sorted, the parser sorts them
+	const char* CONTROLLER_SOURCE =
+		"{ \"layers\" : [\n"
+		"	{ \"name\" : \"base\",\n"
+		"		\"states\" : [\n"
+		"			{ \"name\" : \"locomotion\", \"node\" : { \"blend\" : \"speed\", \"children\" : [\n"
+		"				{ \"value\" : 4, \"animation\" : \"unit_tests/controller_run.ani\" },\n"
+		"				{ \"value\" : 0, \"animation\" : \"unit_tests/controller_idle.ani\" },\n"
+		"				{ \"value\" : 1.5, \"animation\" : \"unit_tests/controller_run.ani\" } ] } },\n"
+		"			{ \"name\" : \"jump\", \"speed\" : 2, \"loop\" : false,\n"
+		"				\"node\" : { \"animation\" : \"unit_tests/controller_idle.ani\" } } ],\n"
+		"		\"transitions\" : [\n"
+		"			{ \"from\" : \"locomotion\", \"to\" : \"jump\", \"duration\" : 0.25, \"input\" : \"jump\", \"greater\" : 0.5 },\n"
+		"			{ \"from\" : \"jump\", \"to\" : \"locomotion\", \"duration\" : 0.5 } ] },\n"
+		"	{ \"name\" : \"upper\", \"weight\" : 0.5, \"additive\" : true,\n"
+		"		\"states\" : [ { \"name\" : \"wave\", \"node\" : { \"animation\" : \"unit_tests/controller_run.ani\" } } ],\n"
+		"		\"transitions\" : [ { \"to\" : \"wave\", \"input\" : \"speed\", \"less\" : 0 } ] }\n"
+		"] }\n";
+
+
+	// compressed animation without bones, the controller needs only the length
+	bool writeAnimation(const char* path, int frame_count, Lumix::IAllocator& allocator)
+	{
+		Lumix::FS::OsFile file;
+		if (!file.open(path, Lumix::FS::Mode::CREATE_AND_WRITE, allocator)) return false;
+		Lumix::Animation::Header header;
+		header.magic = Lumix::Animation::HEADER_MAGIC;
+		header.version = (Lumix::uint32)Lumix::Animation::Version::COMPRESSED;
+		header.fps = 30;
+		Lumix::int32 bone_count = 0;
+		Lumix::uint32 key_count = 0;
+		file.write(&header, sizeof(header));
+		file.write(&frame_count, sizeof(frame_count));
+		file.write(&bone_count, sizeof(bone_count));
+		file.write(&key_count, sizeof(key_count));
+		file.write(&key_count, sizeof(key_count));
+		file.close();
+		return true;
+	}
+
+
+	bool writeController(Lumix::IAllocator& allocator)
+	{
+		Lumix::FS::OsFile file;
+		if (!file.open(CONTROLLER_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator)) return false;
+		file.write(CONTROLLER_SOURCE, Lumix::stringLength(CONTROLLER_SOURCE));
+		file.close();
+		return true;
+	}
+
+
+	struct ControllerLoader
+	{
+		explicit ControllerLoader(Lumix::IAllocator& allocator)
+			: path_manager(allocator)
+			, disk_file_device("disk", "", allocator)
+			, resource_manager(allocator)
+			, animation_manager(allocator)
+			, controller_manager(allocator)
+		{
+			file_system = Lumix::FS::FileSystem::create(allocator);
+			file_system->mount(&disk_file_device);
+			file_system->setDefaultDevice("disk");
+			resource_manager.create(*file_system);
+			animation_manager.create(Lumix::ResourceManager::ANIMATION, resource_manager);
+			controller_manager.create(Lumix::ResourceManager::ANIMATION_CONTROLLER, resource_manager);
+
+			controller = static_cast<Lumix::Controller*>(controller_manager.load(Lumix::Path(CONTROLLER_PATH)));
+			// the animations start loading when the controller is loaded
+			while (file_system->hasWork())
+			{
+				file_system->updateAsyncTransactions();
+				Lumix::MT::yield();
+			}
+		}
+
+
+		~ControllerLoader()
+		{
+			controller_manager.unload(*controller);
+			controller_manager.destroy();
+			animation_manager.destroy();
+			resource_manager.destroy();
+			file_system->unMount(&disk_file_device);
+			Lumix::FS::FileSystem::destroy(file_system);
+		}
+
+
+		Lumix::PathManager path_manager;
+		Lumix::FS::DiskFileDevice disk_file_device;
+		Lumix::FS::FileSystem* file_system;
+		Lumix::ResourceManager resource_manager;
+		Lumix::AnimationManager animation_manager;
+		Lumix::ControllerManager controller_manager;
+		Lumix::Controller* controller;
+	};
+
+
+	void UT_controller_parse(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		LUMIX_EXPECT(writeAnimation(IDLE_PATH, 31, allocator));
+		LUMIX_EXPECT(writeAnimation(RUN_PATH, 16, allocator));
+		LUMIX_EXPECT(writeController(allocator));
+
+		ControllerLoader loader(allocator);
+		const Lumix::Controller& controller = *loader.controller;
+		LUMIX_EXPECT(controller.isReady());
+		if (!controller.isReady()) return;
+
+		auto& layers = controller.getLayers();
+		LUMIX_EXPECT(layers.size() == 2);
+		LUMIX_EXPECT(layers[0].name_hash == Lumix::crc32("base"));
+		LUMIX_EXPECT(layers[0].weight == 1);
+		LUMIX_EXPECT(!layers[0].additive);
+		LUMIX_EXPECT(layers[0].states_count == 2);
+		LUMIX_EXPECT(layers[0].transitions_count == 2);
+		LUMIX_EXPECT(layers[1].weight == 0.5f);
+		LUMIX_EXPECT(layers[1].additive);
+		LUMIX_EXPECT(layers[1].states_count == 1);
+
+		LUMIX_EXPECT(controller.getInputsCount() == 2);
+		int speed = controller.getInputIndex(Lumix::crc32("speed"));
+		int jump_input = controller.getInputIndex(Lumix::crc32("jump"));
+		LUMIX_EXPECT(speed >= 0);
+		LUMIX_EXPECT(jump_input >= 0);
+		LUMIX_EXPECT(controller.getInputIndex(Lumix::crc32("unknown")) == -1);
+
+		int locomotion = controller.getStateIndex(0, Lumix::crc32("locomotion"));
+		int jump = controller.getStateIndex(0, Lumix::crc32("jump"));
+		LUMIX_EXPECT(locomotion == layers[0].first_state);
+		LUMIX_EXPECT(jump == layers[0].first_state + 1);
+		LUMIX_EXPECT(controller.getStateIndex(1, Lumix::crc32("jump")) == -1);
+
+		auto& states = controller.getStates();
+		LUMIX_EXPECT(states[jump].speed == 2);
+		LUMIX_EXPECT(!states[jump].loop);
+		LUMIX_EXPECT(states[locomotion].loop);
+
+		auto& nodes = controller.getNodes();
+		const Lumix::Controller::Node& blend = nodes[states[locomotion].node];
+		LUMIX_EXPECT(blend.type == Lumix::Controller::Node::BLEND_1D);
+		LUMIX_EXPECT(blend.input == speed);
+		LUMIX_EXPECT(blend.children_count == 3);
+		const int* children = &controller.getChildren()[blend.first_child];
+		LUMIX_EXPECT(nodes[children[0]].value == 0);
+		LUMIX_EXPECT(nodes[children[1]].value == 1.5f);
+		LUMIX_EXPECT(nodes[children[2]].value == 4);
+		LUMIX_EXPECT(nodes[children[0]].animation->getPath() == Lumix::Path(IDLE_PATH));
+		LUMIX_EXPECT(nodes[children[2]].animation->getFrameCount() == 16);
+		LUMIX_EXPECT(nodes[states[jump].node].type == Lumix::Controller::Node::CLIP);
+
+		auto& transitions = controller.getTransitions();
+		const Lumix::Controller::Transition& to_jump = transitions[layers[0].first_transition];
+		LUMIX_EXPECT(to_jump.from == locomotion);
+		LUMIX_EXPECT(to_jump.to == jump);
+		LUMIX_EXPECT(to_jump.duration == 0.25f);
+		LUMIX_EXPECT(to_jump.condition == Lumix::Controller::Transition::GREATER);
+		LUMIX_EXPECT(to_jump.input == jump_input);
+		LUMIX_EXPECT(to_jump.value == 0.5f);
+		const Lumix::Controller::Transition& to_locomotion = transitions[layers[0].first_transition + 1];
+		LUMIX_EXPECT(to_locomotion.condition == Lumix::Controller::Transition::END);
+		const Lumix::Controller::Transition& any_state = transitions[layers[1].first_transition];
+		LUMIX_EXPECT(any_state.from == -1);
+		LUMIX_EXPECT(any_state.condition == Lumix::Controller::Transition::LESS);
+	}
+
+
+	void UT_controller_blend_1d(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		LUMIX_EXPECT(writeAnimation(IDLE_PATH, 31, allocator));
+		LUMIX_EXPECT(writeAnimation(RUN_PATH, 16, allocator));
+		LUMIX_EXPECT(writeController(allocator));
+
+		ControllerLoader loader(allocator);
+		const Lumix::Controller& controller = *loader.controller;
+		LUMIX_EXPECT(controller.isReady());
+		if (!controller.isReady()) return;
+
+		auto& nodes = controller.getNodes();
+		int locomotion = controller.getStateIndex(0, Lumix::crc32("locomotion"));
+		const Lumix::Controller::Node& blend = nodes[controller.getStates()[locomotion].node];
+		const int* children = &controller.getChildren()[blend.first_child];
+		float inputs[2] = {};
+		int a, b;
+		float weight;
+
+		// below the first and above the last threshold only the border child plays
+		inputs[blend.input] = -1;
+		controller.getBlendChildren(blend, inputs, &a, &b, &weight);
+		LUMIX_EXPECT(a == children[0]);
+		LUMIX_EXPECT(b == children[0]);
+		LUMIX_EXPECT(weight == 0);
+		inputs[blend.input] = 10;
+		controller.getBlendChildren(blend, inputs, &a, &b, &weight);
+		LUMIX_EXPECT(a == children[2]);
+		LUMIX_EXPECT(b == children[2]);
+		LUMIX_EXPECT(weight == 0);
+
+		// exactly at the thresholds the child plays alone
+		float thresholds[] = { 0, 1.5f, 4 };
+		for (int i = 0; i < 3; ++i)
+		{
+			inputs[blend.input] = thresholds[i];
+			controller.getBlendChildren(blend, inputs, &a, &b, &weight);
+			LUMIX_EXPECT(a == children[i]);
+			LUMIX_EXPECT(weight == 0);
+		}
+
+		// between the thresholds the weight is linear
+		inputs[blend.input] = 0.75f;
+		controller.getBlendChildren(blend, inputs, &a, &b, &weight);
+		LUMIX_EXPECT(a == children[0]);
+		LUMIX_EXPECT(b == children[1]);
+		LUMIX_EXPECT_CLOSE_EQ(weight, 0.5f, 0.0001f);
+		inputs[blend.input] = 3.5f;
+		controller.getBlendChildren(blend, inputs, &a, &b, &weight);
+		LUMIX_EXPECT(a == children[1]);
+		LUMIX_EXPECT(b == children[2]);
+		LUMIX_EXPECT_CLOSE_EQ(weight, 0.8f, 0.0001f);
+	}
+
+
+	void UT_controller_transition(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		LUMIX_EXPECT(writeAnimation(IDLE_PATH, 31, allocator));
+		LUMIX_EXPECT(writeAnimation(RUN_PATH, 16, allocator));
+		LUMIX_EXPECT(writeController(allocator));
+
+		ControllerLoader loader(allocator);
+		const Lumix::Controller& controller = *loader.controller;
+		LUMIX_EXPECT(controller.isReady());
+		if (!controller.isReady()) return;
+
+		int locomotion = controller.getStateIndex(0, Lumix::crc32("locomotion"));
+		int jump = controller.getStateIndex(0, Lumix::crc32("jump"));
+		int jump_input = controller.getInputIndex(Lumix::crc32("jump"));
+		float inputs[2] = {};
+
+		Lumix::Controller::LayerState layer;
+		layer.reset(controller.getLayers()[0].first_state);
+		LUMIX_EXPECT(layer.state == locomotion);
+		LUMIX_EXPECT(layer.getTransitionWeight() == 1);
+		LUMIX_EXPECT(controller.findTransition(0, layer.state, inputs, false) == -1);
+
+		inputs[jump_input] = 1;
+		int transition = controller.findTransition(0, layer.state, inputs, false);
+		LUMIX_EXPECT(transition >= 0);
+		if (transition < 0) return;
+		const Lumix::Controller::Transition& to_jump = controller.getTransitions()[transition];
+		LUMIX_EXPECT(to_jump.to == jump);
+
+		// the previous state fades out linearly over the duration
+		layer.phase = 0.3f;
+		layer.startTransition(to_jump.to, to_jump.duration);
+		LUMIX_EXPECT(layer.state == jump);
+		LUMIX_EXPECT(layer.prev_state == locomotion);
+		LUMIX_EXPECT(layer.prev_phase == 0.3f);
+		LUMIX_EXPECT(layer.phase == 0);
+		LUMIX_EXPECT(layer.getTransitionWeight() == 0);
+		layer.advanceTransition(0.1f);
+		LUMIX_EXPECT_CLOSE_EQ(layer.getTransitionWeight(), 0.4f, 0.0001f);
+		layer.advanceTransition(0.1f);
+		LUMIX_EXPECT_CLOSE_EQ(layer.getTransitionWeight(), 0.8f, 0.0001f);
+		LUMIX_EXPECT(layer.prev_state == locomotion);
+		layer.advanceTransition(0.1f);
+		LUMIX_EXPECT(layer.prev_state == -1);
+		LUMIX_EXPECT(layer.getTransitionWeight() == 1);
+
+		// transitions without a condition are taken only at the end of the state
+		LUMIX_EXPECT(controller.findTransition(0, layer.state, inputs, false) == -1);
+		LUMIX_EXPECT(controller.findTransition(0, layer.state, inputs, true) >= 0);
+
+		// zero duration switches at once
+		layer.startTransition(locomotion, 0);
+		LUMIX_EXPECT(layer.state == locomotion);
+		LUMIX_EXPECT(layer.prev_state == -1);
+		LUMIX_EXPECT(layer.getTransitionWeight() == 1);
+
+		// transitions into the current state are skipped, even from any state
+		inputs[controller.getInputIndex(Lumix::crc32("speed"))] = -1;
+		int wave = controller.getStateIndex(1, Lumix::crc32("wave"));
+		LUMIX_EXPECT(controller.findTransition(1, wave, inputs, false) == -1);
+	}
+}
+
+REGISTER_TEST("unit_tests/animation/controller_parse", UT_controller_parse, "")
+REGISTER_TEST("unit_tests/animation/controller_blend_1d", UT_controller_blend_1d, "")
+REGISTER_TEST("unit_tests/animation/controller_transition", UT_controller_transition, "")
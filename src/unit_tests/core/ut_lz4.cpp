@@ -0,0 +1,57 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+#include "engine/core/array.h"
+#include "engine/core/lz4.h"
+#include "engine/core/string.h"
+
+
+static void roundTrip(const Lumix::uint8* data, int size, Lumix::IAllocator& allocator)
+{
+	Lumix::Array<Lumix::uint8> compressed(allocator);
+	Lumix::Array<Lumix::uint8> decompressed(allocator);
+	compressed.resize(Lumix::LZ4::getMaxCompressedSize(size));
+	decompressed.resize(size + 1);
+
+	int compressed_size = Lumix::LZ4::compress(data, size, &compressed[0], compressed.size());
+	LUMIX_EXPECT(compressed_size > 0);
+	int decompressed_size =
+		Lumix::LZ4::decompress(&compressed[0], compressed_size, &decompressed[0], decompressed.size());
+	LUMIX_EXPECT(decompressed_size == size);
+	if (size > 0) LUMIX_EXPECT(Lumix::compareMemory(&decompressed[0], data, size) == 0);
+}
+
+
+void UT_lz4(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+
+	const char* text = "LumixEngine LumixEngine LumixEngine LumixEngine LumixEngine";
+	roundTrip((const Lumix::uint8*)text, Lumix::stringLength(text), allocator);
+	roundTrip((const Lumix::uint8*)text, 1, allocator);
+	roundTrip((const Lumix::uint8*)text, 0, allocator);
+
+	Lumix::Array<Lumix::uint8> data(allocator);
+	data.resize(100000);
+	Lumix::uint32 seed = 0x12345678;
+	for (int i = 0; i < data.size(); ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = i % 1000 < 500 ? Lumix::uint8(i % 7) : Lumix::uint8(seed >> 16);
+	}
+	roundTrip(&data[0], data.size(), allocator);
+
+	Lumix::uint8 zeros[1000];
+	Lumix::setMemory(zeros, 0, sizeof(zeros));
+	Lumix::uint8 compressed[100];
+	int compressed_size = Lumix::LZ4::compress(zeros, sizeof(zeros), compressed, sizeof(compressed));
+	LUMIX_EXPECT(compressed_size > 0);
+	LUMIX_EXPECT(compressed_size < 30);
+	Lumix::uint8 small[100];
+	LUMIX_EXPECT(Lumix::LZ4::compress(&data[0], data.size(), small, sizeof(small)) == 0);
+
+	Lumix::uint8 out[1000];
+	LUMIX_EXPECT(Lumix::LZ4::decompress(compressed, compressed_size, out, 999) == -1);
+	LUMIX_EXPECT(Lumix::LZ4::decompress(compressed, compressed_size, out, sizeof(out)) == sizeof(out));
+	LUMIX_EXPECT(Lumix::LZ4::decompress(compressed, compressed_size - 1, out, sizeof(out)) != sizeof(out));
+}
+
+REGISTER_TEST("unit_tests/core/lz4", UT_lz4, "")
@@ -1,6 +1,7 @@
 #include "unit_tests/suite/lumix_unit_tests.h"
 #include "engine/core/mtjd/job.h"
 #include "engine/core/mtjd/manager.h"
+#include "engine/core/mtjd/parallel_for.h"
 
 
 namespace
@@ -192,5 +193,43 @@ void UT_MTJDFrameworkDependencyTest(const char* params)
 	allocator.deallocate(jobs);
 }
 
+void UT_MTJDParallelForTest(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+
+	for (int32 grain = 1; grain < BUFFER_SIZE * 2; grain = grain * 3 + 1)
+	{
+		for (int32 j = 0; j < BUFFER_SIZE; j++)
+		{
+			IN1_BUFFER[0][j] = (float)j;
+			OUT_BUFFER[0][j] = 0;
+		}
+
+		Lumix::MTJD::parallelFor(*manager, 0, BUFFER_SIZE, grain, [](int from, int to) {
+			for (int i = from; i < to; ++i)
+			{
+				OUT_BUFFER[0][i] += IN1_BUFFER[0][i] + 1;
+			}
+		});
+
+		for (int32 j = 0; j < BUFFER_SIZE; j++)
+		{
+			LUMIX_EXPECT(OUT_BUFFER[0][j] == (float)j + 1);
+		}
+	}
+
+	volatile int32 count = 0;
+	Lumix::MTJD::parallelFor(*manager, 0, TESTS_COUNT, 1, [manager, &count](int from, int to) {
+		Lumix::MTJD::parallelFor(*manager, 0, BUFFER_SIZE, 100, [&count](int from, int to) {
+			Lumix::MT::atomicAdd(&count, to - from);
+		});
+	});
+	LUMIX_EXPECT(count == TESTS_COUNT * BUFFER_SIZE);
+
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
 REGISTER_TEST("unit_tests/core/mtjd/frameworkTest", UT_MTJDFrameworkTest, "")
-REGISTER_TEST("unit_tests/core/mtjd/frameworkDependencyTest", UT_MTJDFrameworkDependencyTest, "")
\ No newline at end of file
+REGISTER_TEST("unit_tests/core/mtjd/frameworkDependencyTest", UT_MTJDFrameworkDependencyTest, "")
+REGISTER_TEST("unit_tests/core/mtjd/parallelForTest", UT_MTJDParallelForTest, "")
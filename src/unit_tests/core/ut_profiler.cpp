@@ -0,0 +1,158 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/core/default_allocator.h"
+#include "engine/core/fs/os_file.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/mtjd/manager.h"
+#include "engine/core/mtjd/parallel_for.h"
+#include "engine/core/profiler.h"
+#include "engine/core/string.h"
+
+
+namespace
+{
+	const int JOBS_COUNT = 64;
+	const char* UT_BLOCK_NAME = "ut_profiler_block";
+	const char* UT_RECORD_NAME = "ut_profiler_record";
+
+
+	Lumix::Profiler::Block* findBlock(Lumix::Profiler::Block* block, const char* name)
+	{
+		while (block)
+		{
+			if (Lumix::compareString(Lumix::Profiler::getBlockName(block), name) == 0) return block;
+			auto* child = findBlock(Lumix::Profiler::getBlockFirstChild(block), name);
+			if (child) return child;
+			block = Lumix::Profiler::getBlockNext(block);
+		}
+		return nullptr;
+	}
+
+
+	// the blocks can be read only from the frame listeners
+	struct FrameListener
+	{
+		FrameListener()
+		{
+			Lumix::Profiler::getFrameListeners().bind<FrameListener, &FrameListener::onFrame>(this);
+		}
+
+
+		~FrameListener()
+		{
+			Lumix::Profiler::getFrameListeners().unbind<FrameListener, &FrameListener::onFrame>(this);
+		}
+
+
+		void onFrame()
+		{
+			hits_count = 0;
+			record_sum = 0;
+			for (int i = 0, c = Lumix::Profiler::getThreadCount(); i < c; ++i)
+			{
+				auto* root = Lumix::Profiler::getRootBlock(Lumix::Profiler::getThreadID(i));
+				auto* block = findBlock(root, UT_BLOCK_NAME);
+				if (!block) continue;
+				hits_count += Lumix::Profiler::getBlockHitCount(block);
+				auto* record = findBlock(Lumix::Profiler::getBlockFirstChild(block), UT_RECORD_NAME);
+				if (record) record_sum += Lumix::Profiler::getBlockInt(record);
+			}
+		}
+
+
+		int hits_count;
+		int record_sum;
+	};
+
+
+	void UT_profiler_threads(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+		FrameListener listener;
+		Lumix::Profiler::frame();
+
+		Lumix::MTJD::parallelFor(*manager, 0, JOBS_COUNT, 1, [](int from, int to) {
+			for (int i = from; i < to; ++i)
+			{
+				Lumix::Profiler::beginBlock(UT_BLOCK_NAME);
+				Lumix::Profiler::record(UT_RECORD_NAME, i);
+				Lumix::Profiler::endBlock();
+			}
+		});
+		Lumix::Profiler::frame();
+
+		LUMIX_EXPECT(listener.hits_count == JOBS_COUNT);
+		LUMIX_EXPECT(listener.record_sum == JOBS_COUNT * (JOBS_COUNT - 1) / 2);
+
+		// the blocks are cleared each frame
+		Lumix::Profiler::frame();
+		LUMIX_EXPECT(listener.hits_count == 0);
+
+		Lumix::MTJD::Manager::destroy(*manager);
+	}
+
+
+	void UT_profiler_overflow(const char* params)
+	{
+		FrameListener listener;
+		Lumix::Profiler::frame();
+
+		// much more events than fit in the ring, the blocks which do not fit are dropped
+		Lumix::Profiler::beginBlock(UT_BLOCK_NAME);
+		for (int i = 0; i < 100000; ++i)
+		{
+			Lumix::Profiler::beginBlock(UT_RECORD_NAME);
+			Lumix::Profiler::endBlock();
+		}
+		Lumix::Profiler::endBlock();
+		Lumix::Profiler::frame();
+		LUMIX_EXPECT(listener.hits_count == 1);
+
+		// the dropped events do not break the following frames
+		Lumix::Profiler::beginBlock(UT_BLOCK_NAME);
+		Lumix::Profiler::record(UT_RECORD_NAME, 5);
+		Lumix::Profiler::endBlock();
+		Lumix::Profiler::frame();
+		LUMIX_EXPECT(listener.hits_count == 1);
+		LUMIX_EXPECT(listener.record_sum == 5);
+	}
+
+
+	void UT_profiler_capture(const char* params)
+	{
+		const char* CAPTURE_PATH = "unit_tests/profiler_capture.json";
+		const char* names[] = { "ut_profiler_frame0", "ut_profiler_frame1", "ut_profiler_frame2" };
+		Lumix::Profiler::setCaptureFrameCount(2);
+		Lumix::Profiler::frame();
+		for (const char* name : names)
+		{
+			Lumix::Profiler::beginBlock(name);
+			Lumix::Profiler::record(UT_RECORD_NAME, 3);
+			Lumix::Profiler::endBlock();
+			Lumix::Profiler::frame();
+		}
+		LUMIX_EXPECT(Lumix::Profiler::saveCapture(CAPTURE_PATH));
+		Lumix::Profiler::setCaptureFrameCount(0);
+
+		Lumix::DefaultAllocator allocator;
+		Lumix::FS::OsFile file;
+		LUMIX_EXPECT(file.open(CAPTURE_PATH, Lumix::FS::Mode::OPEN_AND_READ, allocator));
+		char content[4096];
+		size_t size = Lumix::Math::minimum(file.size(), sizeof(content) - 1);
+		file.read(content, size);
+		content[size] = '\0';
+		file.close();
+
+		// only the last two frames are kept
+		LUMIX_EXPECT(Lumix::startsWith(content, "{\"traceEvents\":["));
+		LUMIX_EXPECT(!Lumix::findSubstring(content, names[0]));
+		LUMIX_EXPECT(Lumix::findSubstring(content, names[1]) != nullptr);
+		LUMIX_EXPECT(Lumix::findSubstring(content, names[2]) != nullptr);
+		LUMIX_EXPECT(Lumix::findSubstring(content, "\"ph\":\"C\",\"name\":\"ut_profiler_record\",\"args\":{\"value\":3}") != nullptr);
+	}
+}
+
+REGISTER_TEST("unit_tests/core/profiler_threads", UT_profiler_threads, "")
+REGISTER_TEST("unit_tests/core/profiler_overflow", UT_profiler_overflow, "")
+REGISTER_TEST("unit_tests/core/profiler_capture", UT_profiler_capture, "")
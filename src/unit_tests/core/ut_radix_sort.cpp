@@ -0,0 +1,75 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/core/default_allocator.h"
+#include "engine/core/mtjd/manager.h"
+#include "engine/core/radix_sort.h"
+
+
+namespace
+{
+	const int ITEMS_COUNT = 50000;
+
+	Lumix::uint32 keys[ITEMS_COUNT];
+	Lumix::uint32 values[ITEMS_COUNT];
+	Lumix::uint32 tmp_keys[ITEMS_COUNT];
+	Lumix::uint32 tmp_values[ITEMS_COUNT];
+
+
+	void UT_radix_sort(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+
+		// small and large sets, so both the inline and the job paths run
+		const int sizes[] = { 0, 1, 7, 1000, ITEMS_COUNT };
+		for (int size : sizes)
+		{
+			Lumix::uint32 random = 0x12345678;
+			for (int i = 0; i < size; ++i)
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				// few distinct keys, so the stability is tested too
+				keys[i] = (random % 100) * 0x01010101;
+				values[i] = i;
+			}
+
+			Lumix::radixSort(*manager, keys, values, tmp_keys, tmp_values, size);
+
+			for (int i = 1; i < size; ++i)
+			{
+				LUMIX_EXPECT(keys[i - 1] <= keys[i]);
+				if (keys[i - 1] == keys[i]) LUMIX_EXPECT(values[i - 1] < values[i]);
+			}
+		}
+
+		// keys sharing the high bytes skip passes
+		for (int i = 0; i < 1000; ++i)
+		{
+			keys[i] = 999 - i;
+			values[i] = i;
+		}
+		Lumix::radixSort(*manager, keys, values, tmp_keys, tmp_values, 1000);
+		for (int i = 0; i < 1000; ++i)
+		{
+			LUMIX_EXPECT(keys[i] == (Lumix::uint32)i);
+			LUMIX_EXPECT(values[i] == (Lumix::uint32)(999 - i));
+		}
+
+		Lumix::MTJD::Manager::destroy(*manager);
+	}
+
+
+	void UT_radix_sort_float_keys(const char* params)
+	{
+		const float sorted[] = { -1000.0f, -2.5f, -0.001f, 0.0f, 0.001f, 1.0f, 2.5f, 1000.0f };
+		for (int i = 1; i < Lumix::lengthOf(sorted); ++i)
+		{
+			LUMIX_EXPECT(Lumix::floatToRadixKey(sorted[i - 1]) < Lumix::floatToRadixKey(sorted[i]));
+		}
+	}
+}
+
+REGISTER_TEST("unit_tests/core/radix_sort", UT_radix_sort, "")
+REGISTER_TEST("unit_tests/core/radix_sort_float_keys", UT_radix_sort_float_keys, "")
@@ -0,0 +1,48 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/core/default_allocator.h"
+#include "engine/core/tag_allocator.h"
+
+
+namespace
+{
+	void UT_tag_allocator(const char* params)
+	{
+		Lumix::DefaultAllocator source;
+		Lumix::TagAllocator allocator(source, "unit_tests");
+		Lumix::TagAllocator::frame();
+
+		void* ptr = allocator.allocate(100);
+		LUMIX_EXPECT(((size_t)ptr & 7) == 0);
+		void* aligned = allocator.allocate_aligned(128, 64);
+		LUMIX_EXPECT(((size_t)aligned & 63) == 0);
+		memset(ptr, 1, 100);
+		memset(aligned, 2, 128);
+
+		LUMIX_EXPECT(allocator.getFrameAllocationCount() == 2);
+		LUMIX_EXPECT(allocator.getFrameAllocatedBytes() == 228);
+		LUMIX_EXPECT(allocator.getLiveBytes() == 228);
+		LUMIX_EXPECT(allocator.getPeakBytes() == 228);
+
+		ptr = allocator.reallocate(ptr, 300);
+		LUMIX_EXPECT(((Lumix::uint8*)ptr)[99] == 1);
+		aligned = allocator.reallocate_aligned(aligned, 64, 64);
+		LUMIX_EXPECT(((size_t)aligned & 63) == 0);
+		LUMIX_EXPECT(((Lumix::uint8*)aligned)[63] == 2);
+		LUMIX_EXPECT(allocator.getLiveBytes() == 364);
+		LUMIX_EXPECT(allocator.getPeakBytes() == 428);
+
+		allocator.deallocate(ptr);
+		allocator.deallocate_aligned(aligned);
+		LUMIX_EXPECT(allocator.getLiveBytes() == 0);
+		LUMIX_EXPECT(allocator.getPeakBytes() == 428);
+
+		// frame() resets the per frame counters
+		Lumix::TagAllocator::frame();
+		LUMIX_EXPECT(allocator.getFrameAllocationCount() == 0);
+		LUMIX_EXPECT(allocator.getFrameAllocatedBytes() == 0);
+		LUMIX_EXPECT(allocator.getPeakBytes() == 0);
+	}
+}
+
+REGISTER_TEST("unit_tests/core/tag_allocator", UT_tag_allocator, "")
@@ -1,4 +1,8 @@
 #include "unit_tests/suite/lumix_unit_tests.h"
+#include "engine/core/blob.h"
+#include "engine/core/math_utils.h"
+#include "engine/core/mtjd/manager.h"
+#include "engine/universe/hierarchy.h"
 #include "engine/universe/universe.h"
 
 
@@ -94,6 +98,234 @@ namespace
 			LUMIX_EXPECT(universe.getEntityCount() == 4 - i);
 		}
 	}
+
+	int s_moved_calls = 0;
+	int s_batched_calls = 0;
+	int s_batched_count = 0;
+	Lumix::Entity s_batched_entities[16];
+
+
+	void onEntityMoved(Lumix::Entity entity)
+	{
+		++s_moved_calls;
+	}
+
+
+	void onEntitiesMoved(const Lumix::Entity* entities, int count)
+	{
+		++s_batched_calls;
+		for (int i = 0; i < count && s_batched_count < 16; ++i)
+		{
+			s_batched_entities[s_batched_count++] = entities[i];
+		}
+	}
+
+
+	void UT_universe_transform_batching(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Universe universe(allocator);
+		universe.entityTransformed().bind<&onEntityMoved>();
+		universe.entitiesTransformed().bind<&onEntitiesMoved>();
+
+		static const int ENTITY_COUNT = 40;
+		Lumix::Entity entities[ENTITY_COUNT];
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			entities[i] = universe.createEntity(Lumix::Vec3(0, 0, 0), Lumix::Quat(0, 0, 0, 1));
+		}
+
+		universe.setPosition(entities[0], 1, 2, 3);
+		LUMIX_EXPECT(s_moved_calls == 1);
+		LUMIX_EXPECT(s_batched_calls == 1);
+		LUMIX_EXPECT(s_batched_count == 1);
+		LUMIX_EXPECT(s_batched_entities[0] == entities[0]);
+
+		s_moved_calls = s_batched_calls = s_batched_count = 0;
+		universe.setPositionAndRotation(entities[1], Lumix::Vec3(4, 5, 6), Lumix::Quat(0, 1, 0, 0));
+		LUMIX_EXPECT(s_moved_calls == 1);
+		LUMIX_EXPECT(s_batched_calls == 1);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(entities[1]).y, 5, 0.00001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getRotation(entities[1]).y, 1, 0.00001f);
+
+		s_moved_calls = s_batched_calls = s_batched_count = 0;
+		universe.setTransformBatching(true);
+		LUMIX_EXPECT(universe.isTransformBatching());
+		universe.setPosition(entities[35], 1, 2, 3);
+		universe.setRotation(entities[3], Lumix::Quat(0, 1, 0, 0));
+		universe.setPosition(entities[35], 4, 5, 6);
+		universe.setScale(entities[7], 2);
+		universe.setPosition(entities[3], 1, 1, 1);
+		LUMIX_EXPECT(s_moved_calls == 0);
+		LUMIX_EXPECT(s_batched_calls == 0);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(entities[35]).x, 4, 0.00001f);
+
+		universe.destroyEntity(entities[7]);
+		universe.flushTransformedEntities();
+		LUMIX_EXPECT(s_batched_calls == 1);
+		LUMIX_EXPECT(s_moved_calls == 2);
+		LUMIX_EXPECT(s_batched_count == 2);
+		LUMIX_EXPECT(s_batched_entities[0] == entities[35]);
+		LUMIX_EXPECT(s_batched_entities[1] == entities[3]);
+
+		s_moved_calls = s_batched_calls = s_batched_count = 0;
+		universe.flushTransformedEntities();
+		LUMIX_EXPECT(s_batched_calls == 0);
+
+		universe.setPosition(entities[3], 2, 2, 2);
+		universe.setTransformBatching(false);
+		LUMIX_EXPECT(!universe.isTransformBatching());
+		LUMIX_EXPECT(s_batched_calls == 1);
+		LUMIX_EXPECT(s_moved_calls == 1);
+	}
+
+
+	void expectMatrix(Lumix::Universe& universe, Lumix::Entity entity)
+	{
+		Lumix::Matrix expected;
+		universe.getRotation(entity).toMatrix(expected);
+		expected.setTranslation(universe.getPosition(entity));
+		expected.multiply3x3(universe.getScale(entity));
+
+		Lumix::Matrix mtx = universe.getMatrix(entity);
+		const float* a = &mtx.m11;
+		const float* b = &expected.m11;
+		for (int i = 0; i < 16; ++i)
+		{
+			LUMIX_EXPECT_CLOSE_EQ(a[i], b[i], 0.00001f);
+		}
+	}
+
+
+	void UT_universe_world_matrices(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Universe universe(allocator);
+
+		static const int ENTITY_COUNT = 10;
+		Lumix::Entity entities[ENTITY_COUNT];
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			entities[i] = universe.createEntity(Lumix::Vec3((float)i, 0, 0), Lumix::Quat(Lumix::Vec3(0, 1, 0), i * 0.1f));
+			expectMatrix(universe, entities[i]);
+		}
+
+		universe.setRotation(entities[1], Lumix::Quat(Lumix::Vec3(1, 0, 0), 0.5f));
+		universe.setScale(entities[2], 3);
+		universe.setPosition(entities[3], 1, 2, 3);
+		for (int i = 0; i < ENTITY_COUNT; ++i) expectMatrix(universe, entities[i]);
+
+		universe.setTransformBatching(true);
+		universe.setRotation(entities[4], Lumix::Quat(Lumix::Vec3(0, 0, 1), 1.5f));
+		universe.setPosition(entities[4], 5, 5, 5);
+		universe.setScale(entities[5], 0.5f);
+		universe.destroyEntity(entities[0]);
+		for (int i = 1; i < ENTITY_COUNT; ++i) expectMatrix(universe, entities[i]);
+
+		universe.flushTransformedEntities();
+		const Lumix::Matrix* matrices = universe.getWorldMatrices();
+		for (int i = 1; i < ENTITY_COUNT; ++i)
+		{
+			expectMatrix(universe, entities[i]);
+			int dense_idx = universe.getDenseIdx(entities[i]);
+			LUMIX_EXPECT(universe.getEntityFromDenseIdx(dense_idx) == entities[i]);
+			LUMIX_EXPECT_CLOSE_EQ(matrices[dense_idx].getTranslation().x, universe.getPosition(entities[i]).x, 0.00001f);
+		}
+
+		Lumix::OutputBlob blob(allocator);
+		universe.serialize(blob);
+		Lumix::Universe loaded(allocator);
+		Lumix::InputBlob input(blob);
+		loaded.deserialize(input);
+		LUMIX_EXPECT(loaded.getEntityCount() == ENTITY_COUNT - 1);
+		for (int i = 1; i < ENTITY_COUNT; ++i)
+		{
+			LUMIX_EXPECT(loaded.hasEntity(entities[i]));
+			LUMIX_EXPECT_CLOSE_EQ(loaded.getScale(entities[i]), universe.getScale(entities[i]), 0.00001f);
+			expectMatrix(loaded, entities[i]);
+		}
+	}
+
+	void UT_hierarchy(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		{
+			Lumix::Universe universe(allocator);
+			Lumix::HierarchyPlugin plugin(*mtjd_manager, allocator);
+			Lumix::Hierarchy* hierarchy = static_cast<Lumix::Hierarchy*>(plugin.createScene(universe));
+
+			// a chain and a wide level, so a pass has more nodes than one job takes
+			static const int CHAIN_LENGTH = 8;
+			static const int LEAVES_COUNT = 200;
+			Lumix::Quat r(0, 0, 0, 1);
+			Lumix::Entity chain[CHAIN_LENGTH];
+			for (int i = 0; i < CHAIN_LENGTH; ++i)
+			{
+				chain[i] = universe.createEntity(Lumix::Vec3((float)i, 0, 0), r);
+				if (i > 0) hierarchy->setParent(chain[i], chain[i - 1]);
+			}
+			Lumix::Entity leaves[LEAVES_COUNT];
+			for (int i = 0; i < LEAVES_COUNT; ++i)
+			{
+				leaves[i] = universe.createEntity(Lumix::Vec3(0, (float)i, 0), r);
+				hierarchy->setParent(leaves[i], chain[CHAIN_LENGTH - 1]);
+			}
+			LUMIX_EXPECT(hierarchy->getParent(chain[3]) == chain[2]);
+			LUMIX_EXPECT(hierarchy->getParent(chain[0]) == Lumix::INVALID_ENTITY);
+
+			// cycles are rejected
+			hierarchy->setParent(chain[0], chain[5]);
+			LUMIX_EXPECT(hierarchy->getParent(chain[0]) == Lumix::INVALID_ENTITY);
+
+			universe.setPosition(chain[0], Lumix::Vec3(10, 0, 0));
+			for (int i = 0; i < CHAIN_LENGTH; ++i)
+			{
+				LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[i]).x, 10.0f + i, 0.0001f);
+			}
+			for (int i = 0; i < LEAVES_COUNT; ++i)
+			{
+				LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(leaves[i]).x, 10.0f, 0.0001f);
+				LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(leaves[i]).y, (float)i, 0.0001f);
+			}
+
+			// moving a child keeps its world transform and changes only its local one
+			universe.setPosition(chain[2], Lumix::Vec3(20, 0, 0));
+			LUMIX_EXPECT_CLOSE_EQ(hierarchy->getLocalPosition(chain[2]).x, 9.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[1]).x, 11.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[3]).x, 21.0f, 0.0001f);
+
+			// rotation of a parent rotates the subtree
+			universe.setRotation(chain[6], Lumix::Quat(Lumix::Vec3(0, 0, 1), Lumix::Math::PI * 0.5f));
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[7]).x, 24.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[7]).y, 1.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(leaves[3]).x, 21.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(leaves[3]).y, -6.0f, 0.0001f);
+
+			// batched moves are resolved when flushed
+			universe.setTransformBatching(true);
+			universe.setPosition(chain[0], Lumix::Vec3(0, 0, 0));
+			universe.setPosition(chain[4], Lumix::Vec3(30, 0, 0));
+			universe.flushTransformedEntities();
+			universe.setTransformBatching(false);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[1]).x, 1.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[3]).x, 11.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[5]).x, 31.0f, 0.0001f);
+
+			// children of a destroyed entity are detached
+			universe.destroyEntity(chain[4]);
+			LUMIX_EXPECT(hierarchy->getParent(chain[5]) == Lumix::INVALID_ENTITY);
+			universe.setPosition(chain[5], Lumix::Vec3(40, 0, 0));
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[6]).x, 41.0f, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(universe.getPosition(chain[3]).x, 11.0f, 0.0001f);
+
+			plugin.destroyScene(hierarchy);
+		}
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
 } // anonymous namespace
 
 REGISTER_TEST("unit_tests/engine/universe", UT_universe, "");
+REGISTER_TEST("unit_tests/engine/universe_transform_batching", UT_universe_transform_batching, "");
+REGISTER_TEST("unit_tests/engine/universe_world_matrices", UT_universe_world_matrices, "");
+REGISTER_TEST("unit_tests/engine/hierarchy", UT_hierarchy, "");
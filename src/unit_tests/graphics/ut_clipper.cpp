@@ -133,7 +133,126 @@ namespace
 
 		Lumix::CullingSystem::destroy(*culling_system);
 	}
+
+	const int GRID_SIZE = 40;
+
+
+	Lumix::Sphere getGridSphere(int index)
+	{
+		return Lumix::Sphere(
+			(index % GRID_SIZE) * 5.0f - 100.0f, (float)(index % 7) - 3.0f, (index / GRID_SIZE) * 5.0f - 100.0f, 1.5f);
+	}
+
+
+	// compares the culling result with testing each sphere against the frustum
+	void checkCulling(Lumix::CullingSystem& culling_system,
+		const Lumix::Frustum& frustum,
+		const Lumix::Array<Lumix::Sphere>& spheres,
+		const Lumix::Array<bool>& is_culled,
+		Lumix::IAllocator& allocator)
+	{
+		Lumix::Array<int> hits(allocator);
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			hits.push(0);
+		}
+		for (auto& subresult : culling_system.getResult())
+		{
+			for (int renderable : subresult)
+			{
+				++hits[renderable];
+			}
+		}
+
+		int visible_count = 0;
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			bool is_visible = is_culled[i] && frustum.isSphereInside(spheres[i].m_position, spheres[i].m_radius);
+			LUMIX_EXPECT(hits[i] == (is_visible ? 1 : 0));
+			if (is_visible) ++visible_count;
+		}
+		// some are visible and some are not
+		LUMIX_EXPECT(visible_count > 0);
+		LUMIX_EXPECT(visible_count < spheres.size());
+	}
+
+
+	void UT_culling_system_static(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::CullingSystem* culling_system = Lumix::CullingSystem::create(*mtjd_manager, allocator);
+
+		Lumix::Array<Lumix::Sphere> spheres(allocator);
+		Lumix::Array<Lumix::ComponentIndex> renderables(allocator);
+		Lumix::Array<bool> is_culled(allocator);
+		for (int i = 0; i < GRID_SIZE * GRID_SIZE; ++i)
+		{
+			spheres.push(getGridSphere(i));
+			renderables.push(i);
+			is_culled.push(true);
+		}
+		// the last row is dynamic
+		int static_count = GRID_SIZE * (GRID_SIZE - 1);
+		Lumix::Array<Lumix::Sphere> static_spheres(allocator);
+		Lumix::Array<Lumix::ComponentIndex> static_renderables(allocator);
+		for (int i = 0; i < static_count; ++i)
+		{
+			static_spheres.push(spheres[i]);
+			static_renderables.push(i);
+		}
+		culling_system->insert(static_spheres, static_renderables);
+		for (int i = static_count; i < spheres.size(); ++i)
+		{
+			culling_system->addDynamic(i, spheres[i]);
+		}
+
+		Lumix::Frustum frustum;
+		Lumix::Vec3 position(0, 10, -120);
+		// the frustum looks against its direction
+		Lumix::Vec3 dir(-0.3f, 0.2f, -1);
+		dir.normalize();
+		frustum.computePerspective(
+			position, dir, Lumix::Vec3(0, 1, 0), Lumix::Math::degreesToRadians(60), 1.5f, 0.1f, 150);
+		culling_system->cullToFrustum(frustum, 1);
+		checkCulling(*culling_system, frustum, spheres, is_culled, allocator);
+
+		// moves so little that the cached classification of static spheres is reused
+		for (int i = 0; i < 5; ++i)
+		{
+			position.x += 0.01f;
+			frustum.computePerspective(
+				position, dir, Lumix::Vec3(0, 1, 0), Lumix::Math::degreesToRadians(60), 1.5f, 0.1f, 150);
+			culling_system->cullToFrustum(frustum, 1);
+			checkCulling(*culling_system, frustum, spheres, is_culled, allocator);
+		}
+
+		// removing, hiding and moving static objects invalidates the cache
+		culling_system->removeStatic(10);
+		is_culled[10] = false;
+		culling_system->setLayerMask(20, 2);
+		is_culled[20] = false;
+		spheres[30] = Lumix::Sphere(0, 0, 0, 1);
+		culling_system->updateBoundingPosition(spheres[30].m_position, 30);
+		// removed objects must not come back when they are moved
+		culling_system->updateBoundingPosition(Lumix::Vec3(0, 0, 0), 10);
+		culling_system->updateBoundingRadius(5, 10);
+		culling_system->cullToFrustum(frustum, 1);
+		checkCulling(*culling_system, frustum, spheres, is_culled, allocator);
+
+		// a different view and the asynchronous path
+		dir.set(0.5f, 0.3f, -1);
+		dir.normalize();
+		frustum.computePerspective(
+			position, dir, Lumix::Vec3(0, 1, 0), Lumix::Math::degreesToRadians(45), 1.5f, 0.1f, 200);
+		culling_system->cullToFrustumAsync(frustum, 1);
+		checkCulling(*culling_system, frustum, spheres, is_culled, allocator);
+
+		Lumix::CullingSystem::destroy(*culling_system);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
 }
 
 REGISTER_TEST("unit_tests/graphics/culling_system", UT_culling_system, "");
 REGISTER_TEST("unit_tests/graphics/culling_system_async", UT_culling_system_async, "");
+REGISTER_TEST("unit_tests/graphics/culling_system_static", UT_culling_system_static, "");
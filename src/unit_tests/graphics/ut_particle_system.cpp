@@ -0,0 +1,145 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/core/math_utils.h"
+#include "engine/core/quat.h"
+#include "engine/universe/universe.h"
+#include "renderer/particle_system.h"
+#include <cmath>
+
+
+namespace
+{
+	// not a multiple of 4, so both the SIMD and the scalar paths run
+	const int PARTICLE_COUNT = 11;
+	const float TIME_DELTA = 0.1f;
+
+
+	bool isEqual(const Lumix::Vec3& a, const Lumix::Vec3& b)
+	{
+		return (a - b).length() < 0.0001f;
+	}
+
+
+	void addParticles(Lumix::ParticleEmitter& emitter)
+	{
+		// no spawning, only the particles added here
+		emitter.m_spawn_count.from = emitter.m_spawn_count.to = 0;
+		for (int i = 0; i < PARTICLE_COUNT; ++i)
+		{
+			emitter.m_position.push(Lumix::Vec3((float)i, (float)(i % 3) - 1, (float)-i));
+			emitter.m_velocity.push(Lumix::Vec3(1, (float)-i, 0.5f * i));
+			emitter.m_life.push(1.0f + i);
+			// every third particle dies in the first update
+			emitter.m_rel_life.push(i % 3 == 0 ? 0.999f : 0.0f);
+			emitter.m_rotation.push((float)i);
+			emitter.m_rotational_speed.push(2.0f * i);
+			emitter.m_alpha.push(1);
+			emitter.m_size.push(1);
+		}
+	}
+
+
+	void UT_particle_emitter_lives(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Universe universe(allocator);
+		Lumix::Entity entity = universe.createEntity(Lumix::Vec3(0, 0, 0), Lumix::Quat(0, 0, 0, 1));
+		Lumix::ParticleEmitter emitter(entity, universe, allocator);
+		addParticles(emitter);
+
+		emitter.update(TIME_DELTA);
+
+		LUMIX_EXPECT(emitter.m_position.size() == PARTICLE_COUNT - 4);
+		LUMIX_EXPECT(emitter.m_velocity.size() == emitter.m_position.size());
+		LUMIX_EXPECT(emitter.m_life.size() == emitter.m_position.size());
+		LUMIX_EXPECT(emitter.m_rel_life.size() == emitter.m_position.size());
+		LUMIX_EXPECT(emitter.m_rotation.size() == emitter.m_position.size());
+		LUMIX_EXPECT(emitter.m_rotational_speed.size() == emitter.m_position.size());
+		LUMIX_EXPECT(emitter.m_alpha.size() == emitter.m_position.size());
+		LUMIX_EXPECT(emitter.m_size.size() == emitter.m_position.size());
+
+		// survivors keep their order
+		int j = 0;
+		for (int i = 0; i < PARTICLE_COUNT; ++i)
+		{
+			if (i % 3 == 0) continue;
+
+			Lumix::Vec3 velocity(1, (float)-i, 0.5f * i);
+			Lumix::Vec3 position = Lumix::Vec3((float)i, (float)(i % 3) - 1, (float)-i) + velocity * TIME_DELTA;
+			LUMIX_EXPECT(isEqual(emitter.m_velocity[j], velocity));
+			LUMIX_EXPECT(isEqual(emitter.m_position[j], position));
+			LUMIX_EXPECT_CLOSE_EQ(emitter.m_life[j], 1.0f + i, 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(emitter.m_rel_life[j], TIME_DELTA / (1.0f + i), 0.0001f);
+			LUMIX_EXPECT_CLOSE_EQ(emitter.m_rotation[j], i + 2.0f * i * TIME_DELTA, 0.0001f);
+			++j;
+		}
+	}
+
+
+	void UT_particle_emitter_modules(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Universe universe(allocator);
+		Lumix::Entity entity = universe.createEntity(Lumix::Vec3(0, 0, 0), Lumix::Quat(0, 0, 0, 1));
+		Lumix::Vec3 attractor_pos(3, 5, -2);
+		Lumix::Entity attractor_entity = universe.createEntity(attractor_pos, Lumix::Quat(0, 0, 0, 1));
+		Lumix::Quat plane_rot(Lumix::Vec3(0, 0, 1), -Lumix::Math::PI * 0.25f);
+		Lumix::Vec3 plane_pos(3, 0, 0);
+		Lumix::Entity plane_entity = universe.createEntity(plane_pos, plane_rot);
+
+		Lumix::ParticleEmitter emitter(entity, universe, allocator);
+		addParticles(emitter);
+		for (float& rel_life : emitter.m_rel_life)
+		{
+			rel_life = 0;
+		}
+
+		auto* force = LUMIX_NEW(allocator, Lumix::ParticleEmitter::ForceModule)(emitter);
+		force->m_acceleration.set(0, -10, 1);
+		emitter.addModule(force);
+		auto* attractor = LUMIX_NEW(allocator, Lumix::ParticleEmitter::AttractorModule)(emitter);
+		attractor->m_force = 20;
+		attractor->m_entities[0] = attractor_entity;
+		attractor->m_count = 1;
+		emitter.addModule(attractor);
+		auto* plane = LUMIX_NEW(allocator, Lumix::ParticleEmitter::PlaneModule)(emitter);
+		plane->m_bounce = 0.5f;
+		plane->m_entities[0] = plane_entity;
+		plane->m_count = 1;
+		emitter.addModule(plane);
+
+		emitter.update(TIME_DELTA);
+
+		LUMIX_EXPECT(emitter.m_position.size() == PARTICLE_COUNT);
+		Lumix::Vec3 normal = plane_rot * Lumix::Vec3(0, 1, 0);
+		float D = -Lumix::dotProduct(normal, plane_pos);
+		int bounced_count = 0;
+		for (int i = 0; i < PARTICLE_COUNT; ++i)
+		{
+			// the same steps as the scalar implementation, in the order of the modules
+			Lumix::Vec3 velocity(1, (float)-i, 0.5f * i);
+			Lumix::Vec3 position = Lumix::Vec3((float)i, (float)(i % 3) - 1, (float)-i) + velocity * TIME_DELTA;
+			LUMIX_EXPECT(isEqual(emitter.m_position[i], position));
+
+			velocity += Lumix::Vec3(0, -10, 1) * TIME_DELTA;
+
+			Lumix::Vec3 to_center = attractor_pos - position;
+			float dist2 = to_center.squaredLength();
+			to_center *= 1 / sqrt(dist2);
+			velocity += to_center * (20 / dist2) * TIME_DELTA;
+
+			if (Lumix::dotProduct(normal, position) + D < 0)
+			{
+				velocity = (velocity - normal * (2 * Lumix::dotProduct(normal, velocity))) * 0.5f;
+				++bounced_count;
+			}
+			LUMIX_EXPECT(isEqual(emitter.m_velocity[i], velocity));
+		}
+		// both branches of the plane are tested
+		LUMIX_EXPECT(bounced_count > 0);
+		LUMIX_EXPECT(bounced_count < PARTICLE_COUNT);
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/particle_emitter_lives", UT_particle_emitter_lives, "")
+REGISTER_TEST("unit_tests/graphics/particle_emitter_modules", UT_particle_emitter_modules, "")
@@ -0,0 +1,77 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/core/array.h"
+#include "engine/core/geometry.h"
+#include "renderer/spatial_index.h"
+
+
+namespace
+{
+	// spheres on a GRID_SIZE x GRID_SIZE grid in the xz plane, 10 units apart
+	const int GRID_SIZE = 16;
+
+
+	Lumix::Vec3 getPosition(int renderable)
+	{
+		return Lumix::Vec3((float)(renderable % GRID_SIZE) * 10, 0, (float)(renderable / GRID_SIZE) * 10);
+	}
+
+
+	bool contains(const Lumix::Array<Lumix::ComponentIndex>& renderables, Lumix::ComponentIndex renderable)
+	{
+		return renderables.indexOf(renderable) >= 0;
+	}
+
+
+	void UT_spatial_index(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::SpatialIndex index(allocator);
+		for (int i = 0; i < GRID_SIZE * GRID_SIZE; ++i)
+		{
+			index.add(i, Lumix::Sphere(getPosition(i), 1));
+		}
+		LUMIX_EXPECT(index.getCount() == GRID_SIZE * GRID_SIZE);
+
+		Lumix::Frustum frustum;
+		frustum.computeOrtho(
+			Lumix::Vec3(25, 50, 25), Lumix::Vec3(0, 1, 0), Lumix::Vec3(0, 0, 1), 20, 20, 0, 100);
+		Lumix::Array<Lumix::ComponentIndex> renderables(allocator);
+		index.getInFrustum(frustum, renderables);
+		for (int i = 0; i < GRID_SIZE * GRID_SIZE; ++i)
+		{
+			Lumix::Vec3 pos = getPosition(i);
+			bool is_inside = pos.x >= 10 && pos.x <= 40 && pos.z >= 10 && pos.z <= 40;
+			LUMIX_EXPECT(contains(renderables, i) == is_inside);
+		}
+
+		// ray along the first row hits its spheres in order
+		Lumix::Array<Lumix::SpatialIndex::RayHit> hits(allocator);
+		index.getOnRay(Lumix::Vec3(-10, 0, 0), Lumix::Vec3(1, 0, 0), hits);
+		LUMIX_EXPECT(hits.size() == GRID_SIZE);
+		for (int i = 0; i < hits.size(); ++i)
+		{
+			LUMIX_EXPECT(hits[i].renderable == i);
+			LUMIX_EXPECT(Lumix::Math::abs(hits[i].t - (9 + i * 10)) < 0.001f);
+		}
+
+		index.update(0, Lumix::Sphere(Lumix::Vec3(1000, 0, 0), 1));
+		index.remove(1);
+		index.remove(1);
+		LUMIX_EXPECT(!index.has(1));
+		LUMIX_EXPECT(index.getCount() == GRID_SIZE * GRID_SIZE - 1);
+		hits.clear();
+		index.getOnRay(Lumix::Vec3(-10, 0, 0), Lumix::Vec3(1, 0, 0), hits);
+		LUMIX_EXPECT(hits.size() == GRID_SIZE - 1);
+		LUMIX_EXPECT(hits[0].renderable == 2);
+		LUMIX_EXPECT(hits.back().renderable == 0);
+
+		index.clear();
+		LUMIX_EXPECT(index.getCount() == 0);
+		renderables.clear();
+		index.getInFrustum(frustum, renderables);
+		LUMIX_EXPECT(renderables.empty());
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/spatial_index", UT_spatial_index, "")
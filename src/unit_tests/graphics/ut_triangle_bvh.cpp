@@ -0,0 +1,93 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/core/array.h"
+#include "renderer/triangle_bvh.h"
+
+#include <cfloat>
+#include <cmath>
+
+
+namespace
+{
+	// heightfield of GRID_SIZE x GRID_SIZE quads, each quad split into 2 triangles tagged by row
+	const int GRID_SIZE = 32;
+
+
+	float getHeight(int x, int z)
+	{
+		return sinf(x * 0.3f) + cosf(z * 0.2f);
+	}
+
+
+	void UT_triangle_bvh(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Vec3> vertices(allocator);
+		Lumix::Array<Lumix::uint32> indices(allocator);
+		Lumix::Array<int> tags(allocator);
+		for (int z = 0; z <= GRID_SIZE; ++z)
+		{
+			for (int x = 0; x <= GRID_SIZE; ++x)
+			{
+				vertices.push(Lumix::Vec3((float)x, getHeight(x, z), (float)z));
+			}
+		}
+		for (int z = 0; z < GRID_SIZE; ++z)
+		{
+			for (int x = 0; x < GRID_SIZE; ++x)
+			{
+				Lumix::uint32 i = z * (GRID_SIZE + 1) + x;
+				indices.push(i);
+				indices.push(i + 1);
+				indices.push(i + GRID_SIZE + 1);
+				indices.push(i + 1);
+				indices.push(i + GRID_SIZE + 2);
+				indices.push(i + GRID_SIZE + 1);
+				tags.push(z);
+				tags.push(z);
+			}
+		}
+
+		Lumix::TriangleBVH bvh(allocator);
+		LUMIX_EXPECT(bvh.isEmpty());
+		bvh.build(&vertices[0], &indices[0], &tags[0], tags.size());
+		LUMIX_EXPECT(!bvh.isEmpty());
+
+		const int RAYS_COUNT = 64;
+		Lumix::Vec3 origins[RAYS_COUNT];
+		Lumix::Vec3 dirs[RAYS_COUNT];
+		for (int i = 0; i < RAYS_COUNT; ++i)
+		{
+			float x = 0.5f + (i % 8) * 3.9f;
+			float z = 0.5f + (i / 8) * 3.9f;
+			origins[i].set(x, 10, z);
+			dirs[i].set(0, -1, 0);
+		}
+		origins[RAYS_COUNT - 1].set(-5, 10, -5);
+
+		Lumix::TriangleBVH::Hit hits[RAYS_COUNT];
+		bvh.castRays(origins, dirs, RAYS_COUNT, FLT_MAX, hits);
+		for (int i = 0; i < RAYS_COUNT - 1; ++i)
+		{
+			Lumix::TriangleBVH::Hit hit = bvh.castRay(origins[i], dirs[i], FLT_MAX);
+			LUMIX_EXPECT(hit.is_hit);
+			LUMIX_EXPECT(hits[i].is_hit);
+			LUMIX_EXPECT(fabsf(hit.t - hits[i].t) < 0.0001f);
+			LUMIX_EXPECT(hit.tag == (int)origins[i].z);
+			float min_height = 10 - Lumix::Math::maximum(getHeight((int)origins[i].x, (int)origins[i].z),
+				Lumix::Math::maximum(getHeight((int)origins[i].x + 1, (int)origins[i].z),
+				Lumix::Math::maximum(getHeight((int)origins[i].x, (int)origins[i].z + 1),
+					getHeight((int)origins[i].x + 1, (int)origins[i].z + 1))));
+			LUMIX_EXPECT(hit.t >= min_height - 0.0001f);
+			LUMIX_EXPECT(hit.t <= 12 + 0.0001f);
+		}
+		LUMIX_EXPECT(!hits[RAYS_COUNT - 1].is_hit);
+		LUMIX_EXPECT(!bvh.castRay(origins[0], Lumix::Vec3(0, 1, 0), FLT_MAX).is_hit);
+		LUMIX_EXPECT(!bvh.castRay(origins[0], dirs[0], 5).is_hit);
+
+		bvh.clear();
+		LUMIX_EXPECT(bvh.isEmpty());
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/triangle_bvh", UT_triangle_bvh, "")